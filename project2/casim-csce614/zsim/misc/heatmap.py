@@ -0,0 +1,98 @@
+#!/usr/bin/python
+
+# Copyright (C) 2013-2015 by Massachusetts Institute of Technology
+#
+# This file is part of zsim.
+#
+# zsim is free software; you can redistribute it and/or modify it under the
+# terms of the GNU General Public License as published by the Free Software
+# Foundation, version 2.
+#
+# If you use this software in your research, we request that you reference
+# the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+# Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+# source of the simulator in any publications that use this software, and that
+# you send us a citation of your work.
+#
+# zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+# WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+# details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program. If not, see <http://www.gnu.org/licenses/>.
+
+# Renders set x time heatmaps from a cache's per-set heatmap counters
+# (array.heatmap = true) in the periodic stats file (zsim.h5, needs
+# sim.statsPhaseInterval > 0 and sim.skipStatsVectors = false).
+# Each row is a bin of contiguous sets, each column a stats interval.
+# Writes a PGM image if the output ends in .pgm, and otherwise uses matplotlib
+# (e.g., for PNG), falling back to a PGM image next to it if matplotlib is missing.
+#
+# Example: ./misc/heatmap.py -c l3 -s conflicts zsim.h5 l3-conflicts.png
+
+import sys
+from optparse import OptionParser
+import h5py
+import numpy as np
+
+parser = OptionParser(usage="%prog [options] zsim.h5 output.{png,pgm}")
+parser.add_option("-c", "--cache", default="l3", dest="cache", help="Cache stats group (e.g., l2, l3)")
+parser.add_option("-s", "--stat", default="misses", dest="stat", help="accesses, misses, evictions, conflicts, or missRate")
+parser.add_option("-b", "--bank", type="int", default=-1, dest="bank", help="Bank to plot (-1 sums all banks)")
+parser.add_option("--log", action="store_true", default=False, dest="log", help="Log color scale")
+(opts, args) = parser.parse_args()
+if len(args) != 2:
+    parser.print_help()
+    sys.exit(1)
+
+dset = h5py.File(args[0], "r")["stats"]["root"]
+if opts.cache not in dset.dtype.names:
+    sys.exit("No stats for cache %s (have %s)" % (opts.cache, ", ".join(dset.dtype.names)))
+hm = dset[opts.cache]["heatmap"]  # records x banks x bins, cumulative
+
+def get(stat):
+    v = hm[stat].astype(np.float64)
+    v = v.sum(axis=1) if opts.bank < 0 else v[:, opts.bank, :]
+    return np.diff(v, axis=0)  # per interval
+
+if opts.stat == "missRate":
+    acc = get("accesses")
+    data = np.where(acc > 0, get("misses") / np.maximum(acc, 1), 0.0)
+elif opts.stat in ("accesses", "misses", "evictions", "conflicts"):
+    data = get(opts.stat)
+else:
+    sys.exit("Invalid stat %s" % opts.stat)
+
+data = data.T  # bins x intervals
+if opts.log: data = np.log10(1.0 + data)
+print("%s.%s: %d set bins x %d intervals, total %g, max %g" % (opts.cache, opts.stat, data.shape[0], data.shape[1], data.sum(), data.max()))
+
+def writePgm(fname):
+    norm = data / data.max() if data.max() > 0 else data
+    with open(fname, "wb") as f:
+        f.write(("P5\n%d %d\n255\n" % (data.shape[1], data.shape[0])).encode())
+        f.write((255 - 255*norm).astype(np.uint8).tobytes())
+    print("Wrote %s" % fname)
+
+out = args[1]
+plt = None
+if not out.endswith(".pgm"):
+    try:
+        import matplotlib
+        matplotlib.use("Agg")
+        import matplotlib.pyplot as plt
+    except ImportError:
+        out = out.rsplit(".", 1)[0] + ".pgm"
+        print("matplotlib not available, writing a PGM image instead")
+
+if plt is None:
+    writePgm(out)
+else:
+    plt.figure(figsize=(10, 6))
+    plt.imshow(data, aspect="auto", origin="lower", interpolation="nearest", cmap="hot")
+    plt.colorbar(label=("log10(1+%s)" if opts.log else "%s") % opts.stat)
+    plt.xlabel("Stats interval")
+    plt.ylabel("Set bin")
+    plt.title("%s %s%s" % (opts.cache, opts.stat, "" if opts.bank < 0 else " (bank %d)" % opts.bank))
+    plt.savefig(out, dpi=100, bbox_inches="tight")
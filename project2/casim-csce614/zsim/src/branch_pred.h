@@ -0,0 +1,665 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BRANCH_PRED_H_
+#define BRANCH_PRED_H_
+
+/* Branch predictors for OOOCore. OOOCoreImpl takes the predictor as a
+ * template parameter, so predict() is inlined in the core's branch path.
+ * All predictors implement the same (static) interface:
+ *  - bool predict(Address branchPc, bool taken): predicts and updates, returns false if mispredicted
+ *  - uint64_t storageBits() const: size of the predictor state
+ *  - void initStats(AggregateStat* bpStat): appends predictor-specific stats
+ *  - void useA3(): select Automaton 3 for counter updates (PAg only)
+ * Predictors only see conditional branches, so global histories only include those.
+ */
+
+#include <math.h>
+#include <algorithm>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+
+/* 2-level branch predictor:
+ *  - L1: Branch history shift registers (bshr): 2^NB entries, HB bits of history/entry, indexed by XOR'd PC
+ *  - L2: Pattern history table (pht): 2^LB entries, 2-bit sat counters, indexed by XOR'd bshr contents
+ *  NOTE: Assumes LB is in [NB, HB] range for XORing (e.g., HB = 18 and NB = 10, LB = 13 is OK)
+ */
+template<uint32_t NB, uint32_t HB, uint32_t LB>
+class BranchPredictorPAg {
+    private:
+        uint32_t bhsr[1 << NB];
+        uint8_t pht[1 << LB];
+        bool useA2; // Ture: use A2, else use A3
+
+    public:
+        BranchPredictorPAg() {
+            useA2 = true;
+            uint32_t numBhsrs = 1 << NB;
+            uint32_t phtSize = 1 << LB;
+
+            for (uint32_t i = 0; i < numBhsrs; i++) {
+                bhsr[i] = 0;
+            }
+            for (uint32_t i = 0; i < phtSize; i++) {
+                pht[i] = 1;  // weak non-taken
+            }
+
+            static_assert(LB <= HB, "Too many PHT entries");
+            static_assert(LB >= NB, "Too few PHT entries (you'll need more XOR'ing)");
+        }
+
+        // Predicts and updates; returns false if mispredicted
+        inline bool predict(Address branchPc, bool taken) {
+            uint32_t bhsrMask = (1 << NB) - 1;
+            uint32_t histMask = (1 << HB) - 1;
+            uint32_t phtMask  = (1 << LB) - 1;
+
+            // Predict
+            // uint32_t bhsrIdx = ((uint32_t)( branchPc ^ (branchPc >> NB) ^ (branchPc >> 2*NB) )) & bhsrMask;
+            uint32_t bhsrIdx = ((uint32_t)( branchPc >> 1)) & bhsrMask;
+            uint32_t phtIdx = bhsr[bhsrIdx];
+
+            // Shift-XOR-mask to fit in PHT
+            phtIdx ^= (phtIdx & ~phtMask) >> (HB - LB); // take the [HB-1, LB] bits of bshr, XOR with [LB-1, ...] bits
+            phtIdx &= phtMask;
+
+            // If uncommented, behaves like a global history predictor
+            // bhsrIdx = 0;
+            // phtIdx = (bhsr[bhsrIdx] ^ ((uint32_t)branchPc)) & phtMask;
+
+            bool pred = pht[phtIdx] > 1;
+
+            // info("BP Pred: 0x%lx bshr[%d]=%x taken=%d pht=%d pred=%d", branchPc, bhsrIdx, phtIdx, taken, pht[phtIdx], pred);
+
+            // Update
+            if (useA2) {
+                pht[phtIdx] = taken? (pred? 3 : (pht[phtIdx]+1)) : (pred? (pht[phtIdx]-1) : 0); //2-bit saturating counter
+            } else {
+                // Automaton 3 (Yeh and Patt, MICRO 1991): strong states fall to weak on a miss, weak states jump to the strong state of the outcome
+                static const uint8_t a3Next[4][2] = {{0, 1}, {0, 3}, {0, 3}, {2, 3}};  // [state][taken]
+                pht[phtIdx] = a3Next[pht[phtIdx]][taken? 1 : 0];
+            }
+            bhsr[bhsrIdx] = ((bhsr[bhsrIdx] << 1) & histMask ) | (taken? 1: 0); //we apply phtMask here, dependence is further away
+
+            // info("BP Update: newPht=%d newBshr=%x", pht[phtIdx], bhsr[bhsrIdx]);
+            return (taken == pred);
+        }
+
+        // Set to use Automaton 3
+        inline void useA3() {useA2 = false;}
+
+        uint64_t storageBits() const {return (1ul << NB)*HB + (1ul << LB)*2;}
+        void initStats(AggregateStat* bpStat) {}
+};
+
+// Common helpers
+
+template <int32_t MIN, int32_t MAX, typename T>
+static inline void satUpdate(T& ctr, bool up) {
+    if (up) {
+        if (ctr < MAX) ctr++;
+    } else {
+        if (ctr > MIN) ctr--;
+    }
+}
+
+// Geometric series of history lengths: i = 0 gets minLen, i = n-1 gets maxLen
+static inline uint32_t geometricHistLen(uint32_t i, uint32_t n, uint32_t minLen, uint32_t maxLen) {
+    if (n == 1) return minLen;
+    return (uint32_t)(minLen*pow((double)maxLen/(double)minLen, (double)i/(double)(n-1)) + 0.5);
+}
+
+// Global outcome history; h[0] is the most recent outcome. SZ must be a power of 2 larger than any history length used
+template <uint32_t SZ>
+class HistoryBuffer {
+    private:
+        uint8_t hist[SZ];
+        uint32_t ptr;
+
+    public:
+        HistoryBuffer() : ptr(0) {
+            static_assert((SZ & (SZ-1)) == 0, "HistoryBuffer size must be a power of 2");
+            memset(hist, 0, sizeof(hist));
+        }
+
+        inline void push(bool taken) {
+            ptr = (ptr - 1) & (SZ - 1);
+            hist[ptr] = taken? 1 : 0;
+        }
+
+        inline uint32_t operator[](uint32_t i) const {return hist[(ptr + i) & (SZ - 1)];}
+};
+
+/* Folds the last origLen history bits into compLen bits incrementally, so
+ * very long histories can be hashed into table indices in O(1) per branch
+ * (the circular shift register of the PPM-like/TAGE papers)
+ */
+class FoldedHistory {
+    private:
+        uint32_t comp;
+        uint32_t compLen;
+        uint32_t origLen;
+        uint32_t outPoint;
+
+    public:
+        FoldedHistory() : comp(0), compLen(1), origLen(0), outPoint(0) {}
+
+        void init(uint32_t _origLen, uint32_t _compLen) {
+            assert(_compLen > 0 && _compLen < 32);
+            comp = 0;
+            origLen = _origLen;
+            compLen = _compLen;
+            outPoint = origLen % compLen;
+        }
+
+        // Call after pushing the new outcome to h
+        template <typename H>
+        inline void update(const H& h) {
+            if (!origLen) return;
+            comp = (comp << 1) ^ h[0];
+            comp ^= h[origLen] << outPoint;
+            comp ^= comp >> compLen;
+            comp &= (1 << compLen) - 1;
+        }
+
+        inline uint32_t get() const {return comp;}
+};
+
+// Predictors without an A3 automaton
+class BranchPredictorBase {
+    public:
+        inline void useA3() {panic("Automaton 3 is only supported by the PAg branch predictor");}
+        void initStats(AggregateStat* bpStat) {}
+};
+
+/* gshare: 2^HB 2-bit sat counters, indexed by PC XOR'd with HB bits of global history */
+template <uint32_t HB>
+class BranchPredictorGShare : public BranchPredictorBase {
+    private:
+        uint8_t pht[1 << HB];
+        uint32_t ghist;
+
+    public:
+        BranchPredictorGShare() : ghist(0) {
+            for (uint32_t i = 0; i < (1 << HB); i++) pht[i] = 1;  // weak non-taken
+        }
+
+        inline bool predict(Address branchPc, bool taken) {
+            uint32_t mask = (1 << HB) - 1;
+            uint32_t idx = ((uint32_t)(branchPc >> 1) ^ ghist) & mask;
+            bool pred = pht[idx] > 1;
+            satUpdate<0, 3>(pht[idx], taken);
+            ghist = ((ghist << 1) | (taken? 1 : 0)) & mask;
+            return (taken == pred);
+        }
+
+        uint64_t storageBits() const {return (1ul << HB)*2 + HB;}
+};
+
+/* Hashed perceptron (Tarjan and Skadron, TACO 2005), with O-GEHL-style
+ * threshold adaptation (Seznec, ISCA 2005):
+ *  - NT tables of 2^LOGE 7-bit weights; table 0 is indexed by PC only (bias),
+ *    table i > 0 by PC XOR'd with a fold of the last hl(i) outcomes, with
+ *    geometric hl(i) in [MIN_HIST, MAX_HIST]
+ *  - Predicts taken if the sum of the selected weights is >= 0, and trains
+ *    on mispredictions or when |sum| <= theta
+ */
+template <uint32_t NT, uint32_t LOGE>
+class BranchPredictorPerceptron : public BranchPredictorBase {
+    private:
+        static const uint32_t MIN_HIST = 3;
+        static const uint32_t MAX_HIST = 128;
+        static const int32_t WMAX = 63;
+        static const int32_t THETA_CTR_MAX = 31;  // 6-bit theta adaptation counter
+
+        int8_t weights[NT][1 << LOGE];
+        HistoryBuffer<256> ghist;
+        FoldedHistory folds[NT];
+        int32_t theta;
+        int32_t thetaCtr;
+
+        uint64_t trainings;
+
+    public:
+        BranchPredictorPerceptron() {
+            static_assert(NT >= 2, "Perceptron needs a bias table and at least one history table");
+            memset(weights, 0, sizeof(weights));
+            for (uint32_t i = 1; i < NT; i++) {
+                folds[i].init(geometricHistLen(i-1, NT-1, MIN_HIST, MAX_HIST), LOGE);
+            }
+            theta = (int32_t)(2.14*(NT + 1) + 20.58);
+            thetaCtr = 0;
+            trainings = 0;
+        }
+
+        inline bool predict(Address branchPc, bool taken) {
+            uint32_t mask = (1 << LOGE) - 1;
+            uint32_t pcHash = (uint32_t)((branchPc >> 1) ^ (branchPc >> (LOGE + 1)));
+            uint32_t idx[NT];
+            int32_t sum = 0;
+            for (uint32_t i = 0; i < NT; i++) {
+                idx[i] = (pcHash ^ folds[i].get()) & mask;
+                sum += weights[i][idx[i]];
+            }
+            bool pred = sum >= 0;
+
+            // Train
+            int32_t absSum = abs(sum);
+            if (pred != taken || absSum <= theta) {
+                trainings++;
+                for (uint32_t i = 0; i < NT; i++) satUpdate<-WMAX-1, WMAX>(weights[i][idx[i]], taken);
+
+                // Keep mispredictions and low-confidence trainings balanced
+                if (pred != taken) {
+                    if (++thetaCtr > THETA_CTR_MAX) {
+                        theta++;
+                        thetaCtr = 0;
+                    }
+                } else {
+                    if (--thetaCtr < -THETA_CTR_MAX-1) {
+                        if (theta > 1) theta--;
+                        thetaCtr = 0;
+                    }
+                }
+            }
+
+            ghist.push(taken);
+            for (uint32_t i = 1; i < NT; i++) folds[i].update(ghist);
+            return (taken == pred);
+        }
+
+        uint64_t storageBits() const {return NT*(1ul << LOGE)*7 + MAX_HIST + 8 /*theta*/ + 6 /*thetaCtr*/;}
+
+        void initStats(AggregateStat* bpStat) {
+            ProxyStat* trainingsStat = new ProxyStat();
+            trainingsStat->init("trainings", "Perceptron weight updates", &trainings);
+            bpStat->append(trainingsStat);
+        }
+};
+
+/* TAGE-SC-L (Seznec, CBP 2014/2016), sized down and simplified:
+ *  - TAGE: a 2^LOGB-entry bimodal base predictor and NT partially-tagged
+ *    tables of 2^LOGT entries, indexed with geometric global history lengths
+ *    in [MIN_HIST, MAX_HIST] (plus path history). The longest hitting table
+ *    provides the prediction, except for newly-allocated weak entries, where
+ *    the alternate prediction is used if it has been doing better (useAltOnNA).
+ *    Mispredictions allocate an entry in a longer table; useful bits are
+ *    aged periodically.
+ *  - SC: statistical corrector, a bias table indexed by PC and TAGE's
+ *    prediction, plus GEHL-like global history tables. It sums its
+ *    counters with a TAGE confidence term, and reverts TAGE's prediction
+ *    when the sum disagrees and is above an adaptive threshold.
+ *  - L: a small loop predictor, which overrides everything else for loops
+ *    with a constant trip count it is confident about.
+ */
+template <uint32_t NT, uint32_t LOGT, uint32_t LOGB>
+class BranchPredictorTAGESCL : public BranchPredictorBase {
+    private:
+        static const uint32_t MIN_HIST = 4;
+        static const uint32_t MAX_HIST = 640;
+        static const uint32_t PATH_BITS = 16;
+        static const uint32_t U_RESET_PERIOD = 1 << 18;
+
+        struct TageEntry {
+            int8_t ctr;  // 3-bit, taken if >= 0
+            uint8_t u;   // 2-bit useful counter
+            uint16_t tag;
+        };
+
+        int8_t bim[1 << LOGB];  // 2-bit, taken if >= 0
+        TageEntry tables[NT][1 << LOGT];
+        uint32_t histLen[NT];
+        uint32_t tagBits[NT];
+        FoldedHistory idxFold[NT];
+        FoldedHistory tagFold0[NT];
+        FoldedHistory tagFold1[NT];
+        HistoryBuffer<1024> ghist;
+        uint32_t pathHist;
+        int32_t useAltOnNA;  // 4-bit
+        uint32_t tick;
+        uint32_t rng;
+
+        // Loop predictor
+        static const uint32_t LOOP_LOG_SETS = 4;
+        static const uint32_t LOOP_WAYS = 4;
+        static const uint32_t LOOP_ITER_MASK = (1 << 10) - 1;
+        static const uint32_t LOOP_TAG_MASK = (1 << 10) - 1;
+        static const uint32_t LOOP_CONF_MAX = 3;
+
+        struct LoopEntry {
+            uint16_t nbIter;   // learned trip count
+            uint16_t curIter;
+            uint16_t tag;
+            uint8_t conf;
+            uint8_t age;  // 0 means free
+            bool dir;     // direction while in the loop
+        };
+
+        LoopEntry loops[(1 << LOOP_LOG_SETS)*LOOP_WAYS];
+        int32_t withLoop;  // 7-bit, use the loop predictor if >= 0
+
+        // Statistical corrector
+        static const uint32_t SC_LOG = 10;
+        static const uint32_t SC_GTABLES = 4;
+        static const int32_t SC_CTR_MAX = 31;  // 6-bit counters
+        static const int32_t SC_THRES_CTR_MAX = 63;
+
+        int8_t scBias[1 << SC_LOG];
+        int8_t scGlobal[SC_GTABLES][1 << SC_LOG];
+        FoldedHistory scFold[SC_GTABLES];
+        int32_t scThreshold;
+        int32_t scThresholdCtr;
+
+        uint64_t tageAllocs, scOverrides, loopOverrides;
+
+        inline uint32_t nextRand() {
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            return rng;
+        }
+
+        inline uint32_t tageIndex(uint32_t pc, uint32_t i) const {
+            uint32_t pathLen = (histLen[i] < PATH_BITS)? histLen[i] : PATH_BITS;
+            uint32_t path = pathHist & ((1 << pathLen) - 1);
+            uint32_t shift = (i % LOGT) + 1;
+            return (pc ^ (pc >> shift) ^ idxFold[i].get() ^ path ^ (path >> (LOGT - shift + 1))) & ((1 << LOGT) - 1);
+        }
+
+        inline uint16_t tageTag(uint32_t pc, uint32_t i) const {
+            return (pc ^ tagFold0[i].get() ^ (tagFold1[i].get() << 1)) & ((1 << tagBits[i]) - 1);
+        }
+
+        inline uint32_t loopSet(uint32_t pc) const {return pc & ((1 << LOOP_LOG_SETS) - 1);}
+        inline uint16_t loopTag(uint32_t pc) const {return (pc >> LOOP_LOG_SETS) & LOOP_TAG_MASK;}
+
+        inline bool loopPredict(const LoopEntry& e) const {return (e.curIter + 1u == e.nbIter)? !e.dir : e.dir;}
+
+        void loopUpdate(LoopEntry* e, uint32_t set, uint16_t tag, bool taken, bool basePred, bool alloc) {
+            if (e) {
+                if (e->conf == LOOP_CONF_MAX) {
+                    bool loopPred = loopPredict(*e);
+                    if (loopPred != taken) {
+                        // Not a regular loop anymore, free the entry
+                        e->age = 0;
+                        e->nbIter = e->curIter = e->conf = 0;
+                        return;
+                    } else if (loopPred != basePred) {
+                        satUpdate<0, 255>(e->age, true);
+                    }
+                }
+
+                e->curIter = (e->curIter + 1) & LOOP_ITER_MASK;
+                if (e->curIter > e->nbIter) {
+                    // Longer than the learned trip count (or still learning)
+                    e->conf = 0;
+                    e->nbIter = 0;
+                }
+
+                if (taken != e->dir) {
+                    // Loop exit
+                    if (e->curIter == e->nbIter) {
+                        satUpdate<0, LOOP_CONF_MAX>(e->conf, true);
+                        if (e->nbIter < 3) {
+                            // Too short to be worth predicting
+                            e->age = 0;
+                            e->nbIter = e->conf = 0;
+                        }
+                    } else if (e->nbIter == 0) {
+                        e->nbIter = e->curIter;  // first complete trip
+                        e->conf = 0;
+                    } else {
+                        e->nbIter = 0;  // irregular trip count
+                        e->conf = 0;
+                    }
+                    e->curIter = 0;
+                }
+            } else if (alloc) {
+                uint32_t w0 = nextRand() % LOOP_WAYS;
+                for (uint32_t k = 0; k < LOOP_WAYS; k++) {
+                    LoopEntry& c = loops[set*LOOP_WAYS + (w0 + k) % LOOP_WAYS];
+                    if (c.age == 0) {
+                        // Mispredictions are usually loop exits, so the loop direction is the opposite
+                        c.tag = tag;
+                        c.dir = !taken;
+                        c.nbIter = c.curIter = c.conf = 0;
+                        c.age = 255;
+                        return;
+                    }
+                }
+                for (uint32_t w = 0; w < LOOP_WAYS; w++) satUpdate<0, 255>(loops[set*LOOP_WAYS + w].age, false);
+            }
+        }
+
+    public:
+        BranchPredictorTAGESCL() {
+            static_assert(NT >= 2 && LOGT >= 8, "TAGE-SC-L too small");
+            for (uint32_t i = 0; i < (1 << LOGB); i++) bim[i] = 0;  // weak taken
+            for (uint32_t i = 0; i < NT; i++) {
+                histLen[i] = geometricHistLen(i, NT, MIN_HIST, MAX_HIST);
+                tagBits[i] = std::min(8 + i/2, 15u);
+                idxFold[i].init(histLen[i], LOGT);
+                tagFold0[i].init(histLen[i], tagBits[i]);
+                tagFold1[i].init(histLen[i], tagBits[i] - 1);
+                for (uint32_t j = 0; j < (1 << LOGT); j++) {
+                    tables[i][j].ctr = 0;
+                    tables[i][j].u = 0;
+                    tables[i][j].tag = 0;
+                }
+            }
+            pathHist = 0;
+            useAltOnNA = 0;
+            tick = 0;
+            rng = 0x2545f491;
+
+            memset(loops, 0, sizeof(loops));
+            withLoop = -1;
+
+            memset(scBias, 0, sizeof(scBias));
+            memset(scGlobal, 0, sizeof(scGlobal));
+            for (uint32_t i = 0; i < SC_GTABLES; i++) scFold[i].init(geometricHistLen(i, SC_GTABLES, 6, 40), SC_LOG);
+            scThreshold = 35;
+            scThresholdCtr = 0;
+
+            tageAllocs = scOverrides = loopOverrides = 0;
+        }
+
+        inline bool predict(Address branchPc, bool taken) {
+            uint32_t pc = (uint32_t)((branchPc >> 1) ^ (branchPc >> 17));
+
+            // TAGE lookup: provider is the longest hitting table, alt the next one
+            uint32_t idx[NT];
+            uint16_t tag[NT];
+            int32_t provider = -1;
+            int32_t alt = -1;
+            for (uint32_t i = 0; i < NT; i++) {
+                idx[i] = tageIndex(pc, i);
+                tag[i] = tageTag(pc, i);
+            }
+            for (int32_t i = NT-1; i >= 0; i--) {
+                if (tables[i][idx[i]].tag == tag[i]) {
+                    if (provider < 0) {
+                        provider = i;
+                    } else {
+                        alt = i;
+                        break;
+                    }
+                }
+            }
+
+            uint32_t bimIdx = pc & ((1 << LOGB) - 1);
+            bool bimPred = bim[bimIdx] >= 0;
+            bool altPred = (alt >= 0)? (tables[alt][idx[alt]].ctr >= 0) : bimPred;
+            bool providerPred = bimPred;
+            bool newAlloc = false;
+            int32_t tageConf;  // |2*ctr + 1|, in [1, 7]
+            if (provider >= 0) {
+                const TageEntry& e = tables[provider][idx[provider]];
+                providerPred = e.ctr >= 0;
+                newAlloc = (e.ctr == 0 || e.ctr == -1) && e.u == 0;
+                tageConf = abs(2*e.ctr + 1);
+            } else {
+                tageConf = 2*abs(2*bim[bimIdx] + 1) - 1;
+            }
+            bool tagePred = (newAlloc && useAltOnNA >= 0)? altPred : providerPred;
+
+            // SC lookup
+            uint32_t scMask = (1 << SC_LOG) - 1;
+            uint32_t scBiasIdx = ((pc << 1) | (tagePred? 1 : 0)) & scMask;
+            uint32_t scIdx[SC_GTABLES];
+            int32_t lsum = 2*scBias[scBiasIdx] + 1;
+            for (uint32_t i = 0; i < SC_GTABLES; i++) {
+                scIdx[i] = (pc ^ (pc >> SC_LOG) ^ scFold[i].get()) & scMask;
+                lsum += 2*scGlobal[i][scIdx[i]] + 1;
+            }
+            lsum += (tagePred? 1 : -1)*8*tageConf;
+            bool scPred = lsum >= 0;
+            bool basePred = (scPred != tagePred && abs(lsum) >= scThreshold)? scPred : tagePred;
+
+            // Loop lookup
+            uint32_t lset = loopSet(pc);
+            uint16_t ltag = loopTag(pc);
+            LoopEntry* loopEntry = nullptr;
+            for (uint32_t w = 0; w < LOOP_WAYS; w++) {
+                LoopEntry& c = loops[lset*LOOP_WAYS + w];
+                if (c.age && c.tag == ltag) {
+                    loopEntry = &c;
+                    break;
+                }
+            }
+            bool loopValid = loopEntry && loopEntry->conf == LOOP_CONF_MAX;
+            bool loopPred = loopValid && loopPredict(*loopEntry);
+            bool pred = (loopValid && withLoop >= 0)? loopPred : basePred;
+
+            if (basePred != tagePred) scOverrides++;
+            if (pred != basePred) loopOverrides++;
+
+            // Loop update
+            if (loopValid && loopPred != basePred) satUpdate<-64, 63>(withLoop, loopPred == taken);
+            loopUpdate(loopEntry, lset, ltag, taken, basePred, basePred != taken);
+
+            // SC update
+            if (scPred != tagePred) {
+                satUpdate<-SC_THRES_CTR_MAX-1, SC_THRES_CTR_MAX>(scThresholdCtr, scPred != taken);
+                if (scThresholdCtr == SC_THRES_CTR_MAX) {
+                    scThreshold += 2;
+                    scThresholdCtr = 0;
+                } else if (scThresholdCtr == -SC_THRES_CTR_MAX-1) {
+                    if (scThreshold > 6) scThreshold -= 2;
+                    scThresholdCtr = 0;
+                }
+            }
+            if (scPred != taken || abs(lsum) < scThreshold) {
+                satUpdate<-SC_CTR_MAX-1, SC_CTR_MAX>(scBias[scBiasIdx], taken);
+                for (uint32_t i = 0; i < SC_GTABLES; i++) satUpdate<-SC_CTR_MAX-1, SC_CTR_MAX>(scGlobal[i][scIdx[i]], taken);
+            }
+
+            // TAGE update
+            if (provider >= 0) {
+                TageEntry& e = tables[provider][idx[provider]];
+                if (newAlloc && providerPred != altPred) satUpdate<-8, 7>(useAltOnNA, altPred == taken);
+                if (e.u == 0) {
+                    // Also train the alternate, it may be providing the prediction
+                    if (alt >= 0) satUpdate<-4, 3>(tables[alt][idx[alt]].ctr, taken);
+                    else satUpdate<-2, 1>(bim[bimIdx], taken);
+                }
+                satUpdate<-4, 3>(e.ctr, taken);
+                if (providerPred != altPred) satUpdate<0, 3>(e.u, providerPred == taken);
+            } else {
+                satUpdate<-2, 1>(bim[bimIdx], taken);
+            }
+
+            if (tagePred != taken && provider < (int32_t)NT - 1) {
+                // Allocate in a longer table; skip one at random to spread allocations
+                uint32_t start = provider + 1;
+                if (start < NT - 1 && (nextRand() & 1)) start++;
+                bool allocated = false;
+                for (uint32_t i = start; i < NT; i++) {
+                    TageEntry& e = tables[i][idx[i]];
+                    if (e.u == 0) {
+                        e.tag = tag[i];
+                        e.ctr = taken? 0 : -1;
+                        tageAllocs++;
+                        allocated = true;
+                        break;
+                    }
+                }
+                if (!allocated) {
+                    for (uint32_t i = start; i < NT; i++) satUpdate<0, 3>(tables[i][idx[i]].u, false);
+                }
+            }
+
+            if (++tick == U_RESET_PERIOD) {
+                tick = 0;
+                for (uint32_t i = 0; i < NT; i++) {
+                    for (uint32_t j = 0; j < (1 << LOGT); j++) tables[i][j].u >>= 1;
+                }
+            }
+
+            // History update
+            ghist.push(taken);
+            pathHist = ((pathHist << 1) ^ (pc & 1)) & ((1 << PATH_BITS) - 1);
+            for (uint32_t i = 0; i < NT; i++) {
+                idxFold[i].update(ghist);
+                tagFold0[i].update(ghist);
+                tagFold1[i].update(ghist);
+            }
+            for (uint32_t i = 0; i < SC_GTABLES; i++) scFold[i].update(ghist);
+
+            return (taken == pred);
+        }
+
+        uint64_t storageBits() const {
+            uint64_t bits = (1ul << LOGB)*2;
+            for (uint32_t i = 0; i < NT; i++) bits += (1ul << LOGT)*(3 + 2 + tagBits[i]);
+            bits += MAX_HIST + PATH_BITS + 4 /*useAltOnNA*/ + 18 /*tick*/;
+            bits += (1ul << LOOP_LOG_SETS)*LOOP_WAYS*(10 + 10 + 10 + 2 + 8 + 1) + 7 /*withLoop*/;
+            bits += (1ul << SC_LOG)*(1 + SC_GTABLES)*6 + 16 /*threshold*/ + 7 /*thresholdCtr*/;
+            return bits;
+        }
+
+        void initStats(AggregateStat* bpStat) {
+            ProxyStat* tageAllocsStat = new ProxyStat();
+            tageAllocsStat->init("tageAllocs", "TAGE tagged entry allocations", &tageAllocs);
+            bpStat->append(tageAllocsStat);
+            ProxyStat* scOverridesStat = new ProxyStat();
+            scOverridesStat->init("scOverrides", "Predictions reverted by the statistical corrector", &scOverrides);
+            bpStat->append(scOverridesStat);
+            ProxyStat* loopOverridesStat = new ProxyStat();
+            loopOverridesStat->init("loopOverrides", "Predictions overridden by the loop predictor", &loopOverrides);
+            bpStat->append(loopOverridesStat);
+        }
+};
+
+// Default geometries, used by the OOO core configs (sys.cores.<group>.branchPredictor)
+typedef BranchPredictorGShare<16> GShareBP;               // 16KB
+typedef BranchPredictorPerceptron<8, 11> PerceptronBP;    // ~14KB
+typedef BranchPredictorTAGESCL<12, 10, 13> TAGESCLBP;     // ~30KB
+
+#endif  // BRANCH_PRED_H_
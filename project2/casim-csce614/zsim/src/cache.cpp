@@ -27,11 +27,16 @@
 #include "hash.h"
 
 #include "event_recorder.h"
+#include "miss_prof.h"
+#include "req_trace.h"
 #include "timing_event.h"
 #include "zsim.h"
 
 Cache::Cache(uint32_t _numLines, CC* _cc, CacheArray* _array, ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, const g_string& _name)
-    : cc(_cc), array(_array), rp(_rp), numLines(_numLines), accLat(_accLat), invLat(_invLat), name(_name) {}
+    : cc(_cc), array(_array), rp(_rp), numLines(_numLines), accLat(_accLat), invLat(_invLat), name(_name), latencyHists(false), profComp(HP_CACHE), missProfLevel(-1)
+{
+    traceComp = zinfo->reqTracer? zinfo->reqTracer->registerComponent(name.c_str()) : 0;
+}
 
 const char* Cache::getName() {
     return name.c_str();
@@ -56,27 +61,43 @@ void Cache::initCacheStats(AggregateStat* cacheStat) {
     cc->initStats(cacheStat);
     array->initStats(cacheStat);
     rp->initStats(cacheStat);
+    if (latencyHists) {
+        profHitLatHist.init("hitLatHist", "Latency histogram of GETs that hit");
+        profMissLatHist.init("missLatHist", "Latency histogram of GETs that miss");
+        cacheStat->append(&profHitLatHist);
+        cacheStat->append(&profMissLatHist);
+    }
+}
+
+void Cache::profileMiss(const MemReq& req) {
+    if ((req.type == GETS || req.type == GETX) && !req.is(MemReq::PREFETCH)) zinfo->missProf->recordMiss(missProfLevel, req.srcId);
 }
 
 uint64_t Cache::access(MemReq& req) {
+    HostProfScope hps(profComp);
     uint64_t respCycle = req.cycle;
     bool skipAccess = cc->startAccess(req); //may need to skip access due to races (NOTE: may change req.type!)
     if (likely(!skipAccess)) {
         bool updateReplacement = (req.type == GETS) || (req.type == GETX);
         int32_t lineId = array->lookup(req.lineAddr, &req, updateReplacement);
+        bool hit = (lineId != -1);
+        if (!hit && unlikely(missProfLevel >= 0)) profileMiss(req);
         respCycle += accLat;
+        if (lineId != -1 && (req.type == GETS || req.type == GETX)) respCycle += array->getDecompressionLatency(lineId);
 
         if (lineId == -1 && cc->shouldAllocate(req)) {
             //Make space for new line
             Address wbLineAddr;
             lineId = array->preinsert(req.lineAddr, &req, &wbLineAddr); //find the lineId to replace
             trace(Cache, "[%s] Evicting 0x%lx", name.c_str(), wbLineAddr);
+            if (unlikely(req.victimLineAddr != nullptr) && cc->isValid(lineId)) *req.victimLineAddr = wbLineAddr;
 
             //Evictions are not in the critical path in any sane implementation -- we do not include their delays
             //NOTE: We might be "evicting" an invalid line for all we know. Coherence controllers will know what to do
             cc->processEviction(req, wbLineAddr, lineId, respCycle); //1. if needed, send invalidates/downgrades to lower level
 
             array->postinsert(req.lineAddr, &req, lineId); //do the actual insertion. NOTE: Now we must split insert into a 2-phase thing because cc unlocks us.
+            evictToFit(req, lineId, respCycle);
         }
         // Enforce single-record invariant: Writeback access may have a timing
         // record. If so, read it.
@@ -116,6 +137,8 @@ uint64_t Cache::access(MemReq& req) {
                 evRec->pushRecord(acc);
             }
         }
+        recordLatency(req, hit, respCycle);
+        if (unlikely(req.is(MemReq::TRACED))) traceAccess(req, hit, respCycle);
     }
 
     cc->endAccess(req);
@@ -125,6 +148,56 @@ uint64_t Cache::access(MemReq& req) {
     return respCycle;
 }
 
+void Cache::traceAccess(const MemReq& req, bool hit, uint64_t respCycle) {
+    zinfo->reqTracer->record(zinfo->reqTracer->curId(req.srcId), traceComp, req.type, req.cycle, respCycle, hit? TR_HIT : TR_MISS);
+}
+
+uint64_t Cache::evictToFit(MemReq& req, uint32_t lineId, uint64_t cycle) {
+    EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
+    uint64_t evDoneCycle = 0;
+    uint32_t evLineId;
+    Address evLineAddr;
+    while (array->preevict(lineId, &req, &evLineId, &evLineAddr)) {
+        TimingRecord prevWb;
+        prevWb.clear();
+        if (evRec && evRec->hasRecord()) prevWb = evRec->popRecord();
+
+        trace(Cache, "[%s] Evicting 0x%lx to make room for 0x%lx", name.c_str(), evLineAddr, req.lineAddr);
+        evDoneCycle = MAX(evDoneCycle, cc->processEviction(req, evLineAddr, evLineId, cycle));
+        array->postevict(evLineId);
+
+        if (!prevWb.isValid()) continue;
+        if (!evRec->hasRecord()) {
+            evRec->pushRecord(prevWb);
+            continue;
+        }
+
+        // Both writebacks have records: run them in parallel, and end when both are done
+        TimingRecord wb = evRec->popRecord();
+        uint64_t startCycle = MIN(prevWb.reqCycle, wb.reqCycle);
+        uint64_t endCycle = MAX(prevWb.respCycle, wb.respCycle);
+        DelayEvent* startEv = new (evRec) DelayEvent(0);
+        startEv->setMinStartCycle(startCycle);
+        DelayEvent* endEv = new (evRec) DelayEvent(0);
+        endEv->setMinStartCycle(endCycle);
+        bool anyEnd = false;
+        for (TimingRecord* r : {&prevWb, &wb}) {
+            DelayEvent* dStart = new (evRec) DelayEvent(r->reqCycle - startCycle);
+            dStart->setMinStartCycle(startCycle);
+            startEv->addChild(dStart, evRec)->addChild(r->startEvent, evRec);
+            if (r->endEvent) {  // writebacks from a Cache may leave it unset
+                DelayEvent* dEnd = new (evRec) DelayEvent(endCycle - r->respCycle);
+                dEnd->setMinStartCycle(r->respCycle);
+                r->endEvent->addChild(dEnd, evRec)->addChild(endEv, evRec);
+                anyEnd = true;
+            }
+        }
+        TimingRecord merged = {wb.addr, startCycle, endCycle, wb.type, startEv, anyEnd? endEv : nullptr};
+        evRec->pushRecord(merged);
+    }
+    return evDoneCycle;
+}
+
 void Cache::startInvalidate() {
     cc->startInv(); //note we don't grab tcc; tcc serializes multiple up accesses, down accesses don't see it
 }
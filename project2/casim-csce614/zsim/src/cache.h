@@ -30,6 +30,7 @@
 #include "coherence_ctrls.h"
 #include "g_std/g_string.h"
 #include "g_std/g_vector.h"
+#include "host_prof.h"
 #include "memory_hierarchy.h"
 #include "repl_policies.h"
 #include "stats.h"
@@ -55,6 +56,14 @@ class Cache : public BaseCache {
 
         g_string name;
 
+        // Latency distributions of GETs whose line was (hit) or was not (miss) present
+        bool latencyHists;
+        LatencyHistogram profHitLatHist, profMissLatHist;
+
+        uint16_t traceComp; // our component id in zinfo->reqTracer
+        HostProfComp profComp; // what host profiling charges our accesses to
+        int32_t missProfLevel; // level we report misses as to zinfo->missProf, -1 if not profiling
+
     public:
         Cache(uint32_t _numLines, CC* _cc, CacheArray* _array, ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, const g_string& _name);
 
@@ -62,6 +71,8 @@ class Cache : public BaseCache {
         void setParents(uint32_t _childId, const g_vector<MemObject*>& parents, Network* network);
         void setChildren(const g_vector<BaseCache*>& children, Network* network);
         void initStats(AggregateStat* parentStat);
+        void setLatencyHists(bool enable) { latencyHists = enable; }
+        void setMissProfLevel(int32_t level) { missProfLevel = level; }
 
         virtual uint64_t access(MemReq& req);
 
@@ -74,6 +85,29 @@ class Cache : public BaseCache {
     protected:
         void initCacheStats(AggregateStat* cacheStat);
 
+        inline bool profilesLatency(const MemReq& req) const {
+            return latencyHists && (req.type == GETS || req.type == GETX);
+        }
+
+        // Called under the cc lock, or from the cache's weave domain (TimingCache), so no atomics needed
+        inline void recordLatency(bool hit, uint64_t lat) {
+            if (hit) profHitLatHist.record(lat);
+            else profMissLatHist.record(lat);
+        }
+
+        inline void recordLatency(const MemReq& req, bool hit, uint64_t respCycle) {
+            if (profilesLatency(req)) recordLatency(hit, respCycle - req.cycle);
+        }
+
+        void traceAccess(const MemReq& req, bool hit, uint64_t respCycle);
+
+        // Attributes demand misses with zinfo->missProf; only called if missProfLevel >= 0
+        void profileMiss(const MemReq& req);
+
+        // Compressed arrays: evicts more lines until the one in lineId fits, merging their writeback records into one.
+        // Returns when the last eviction finishes, 0 if there were none.
+        uint64_t evictToFit(MemReq& req, uint32_t lineId, uint64_t cycle);
+
         void startInvalidate(); // grabs cc's downLock
         uint64_t finishInvalidate(const InvReq& req); // performs inv and releases downLock
 };
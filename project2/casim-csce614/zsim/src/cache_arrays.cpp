@@ -24,27 +24,44 @@
  */
 
 #include "cache_arrays.h"
+#include "compression.h"
+#include "event_queue.h"
 #include "hash.h"
 #include "repl_policies.h"
+#include "set_heatmap.h"
+#include "zsim.h"
 
 /* Set-associative array implementation */
 
-SetAssocArray::SetAssocArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf) : rp(_rp), hf(_hf), numLines(_numLines), assoc(_assoc)  {
+SetAssocArray::SetAssocArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf) : rp(_rp), hf(_hf), numLines(_numLines), assoc(_assoc), heatmap(nullptr)  {
     array = gm_calloc<Address>(numLines);
     numSets = numLines/assoc;
     setMask = numSets - 1;
     assert_msg(isPow2(numSets), "must have a power of 2 # sets, but you specified %d", numSets);
 }
 
+bool SetAssocArray::enableHeatmap(uint32_t bins, uint32_t shadowWays) {
+    heatmap = new SetHeatmap(numSets, bins, shadowWays);
+    return true;
+}
+
+void SetAssocArray::initStats(AggregateStat* parentStat) {
+    if (heatmap) heatmap->initStats(parentStat);
+}
+
 int32_t SetAssocArray::lookup(const Address lineAddr, const MemReq* req, bool updateReplacement) {
     uint32_t set = hf->hash(0, lineAddr) & setMask;
     uint32_t first = set*assoc;
     for (uint32_t id = first; id < first + assoc; id++) {
         if (array[id] ==  lineAddr) {
-            if (updateReplacement) rp->update(id, req);
+            if (updateReplacement) {
+                rp->update(id, req);
+                if (unlikely(heatmap != nullptr)) heatmap->access(set, lineAddr, true);
+            }
             return id;
         }
     }
+    if (updateReplacement && unlikely(heatmap != nullptr)) heatmap->access(set, lineAddr, false);
     return -1;
 }
 
@@ -55,6 +72,7 @@ uint32_t SetAssocArray::preinsert(const Address lineAddr, const MemReq* req, Add
     uint32_t candidate = rp->rankCands(req, SetAssocCands(first, first+assoc));
 
     *wbLineAddr = array[candidate];
+    if (unlikely(heatmap != nullptr)) heatmap->evict(set, *wbLineAddr);
     return candidate;
 }
 
@@ -65,10 +83,124 @@ void SetAssocArray::postinsert(const Address lineAddr, const MemReq* req, uint32
 }
 
 
+/* Compressed set-associative array implementation */
+
+class CompressedArrayPhaseEvent : public Event {
+    private:
+        CompressedArray* array;
+    public:
+        explicit CompressedArrayPhaseEvent(CompressedArray* _array) : Event(1), array(_array) {}
+        void callback() { array->samplePhase(); }
+};
+
+CompressedArray::CompressedArray(uint32_t _numTags, uint32_t _tagWays, uint32_t dataWays, CompressionModel* _model, ReplPolicy* _rp, HashFamily* _hf)
+    : SetAssocArray(_numTags, _tagWays, _rp, _hf), model(_model), segsPerLine(_model->getSegsPerLine()), usedLines(0), usedSegs(0)
+{
+    assert_msg(segsPerLine > 0 && segsPerLine < 256, "invalid number of segments per line %d", segsPerLine);
+    assert_msg(dataWays > 0 && dataWays <= assoc, "compressed sets need 1..%d lines of data, %d given", assoc, dataWays);
+    setSegBudget = dataWays*segsPerLine;
+    lineSegs = gm_calloc<uint8_t>(numLines);
+    lineDecompLat = gm_calloc<uint8_t>(numLines);
+    setSegs = gm_calloc<uint32_t>(numSets);
+    zinfo->eventQueue->insert(new CompressedArrayPhaseEvent(this));
+}
+
+void CompressedArray::initStats(AggregateStat* parentStat) {
+    SetAssocArray::initStats(parentStat);
+    AggregateStat* objStats = new AggregateStat();
+    objStats->init("array", "Compressed array stats");
+    profFills.init("fills", "Lines filled"); objStats->append(&profFills);
+    profFillSegs.init("fillSegs", "Data segments taken by filled lines"); objStats->append(&profFillSegs);
+    profFillSizes.init("fillSizes", "Filled lines by compressed size (1..N segments)", segsPerLine); objStats->append(&profFillSizes);
+    profDecompHits.init("decompHits", "Reads that hit on compressed lines"); objStats->append(&profDecompHits);
+    profExtraEvictions.init("extraEvs", "Evictions beyond the replaced tag to make room for data"); objStats->append(&profExtraEvictions);
+    profUsedLines.init("lines", "Resident lines (effective capacity)", &usedLines); objStats->append(&profUsedLines);
+    profUsedSegs.init("segs", "Data segments in use", &usedSegs); objStats->append(&profUsedSegs);
+    profPhases.init("phases", "Phases sampled"); objStats->append(&profPhases);
+    profPhaseLines.init("phaseLines", "Resident lines, summed over phases"); objStats->append(&profPhaseLines);
+    profPhaseSegs.init("phaseSegs", "Data segments in use, summed over phases"); objStats->append(&profPhaseSegs);
+    parentStat->append(objStats);
+}
+
+void CompressedArray::samplePhase() {
+    profPhases.inc();
+    profPhaseLines.inc(usedLines);
+    profPhaseSegs.inc(usedSegs);
+}
+
+void CompressedArray::setLineSize(uint32_t lineId, uint32_t segs, uint32_t decompLat) {
+    uint32_t set = lineId/assoc;
+    if (lineSegs[lineId]) {
+        setSegs[set] -= lineSegs[lineId];
+        usedSegs -= lineSegs[lineId];
+        usedLines--;
+    }
+    lineSegs[lineId] = segs;
+    lineDecompLat[lineId] = MIN(decompLat, 255u);
+    if (segs) {
+        setSegs[set] += segs;
+        usedSegs += segs;
+        usedLines++;
+    }
+}
+
+int32_t CompressedArray::lookup(const Address lineAddr, const MemReq* req, bool updateReplacement) {
+    int32_t lineId = SetAssocArray::lookup(lineAddr, req, updateReplacement);
+    if (lineId != -1 && req) {
+        if (req->type == PUTX) {
+            // The written-back data may compress differently
+            uint32_t decompLat;
+            uint32_t segs = model->compress(lineAddr, &decompLat);
+            setLineSize(lineId, segs, decompLat);
+        } else if ((req->type == GETS || req->type == GETX) && lineDecompLat[lineId]) {
+            profDecompHits.inc();
+        }
+    }
+    return lineId;
+}
+
+uint32_t CompressedArray::preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr) {
+    newSegs = model->compress(lineAddr, &newDecompLat);
+    return SetAssocArray::preinsert(lineAddr, req, wbLineAddr);
+}
+
+void CompressedArray::postinsert(const Address lineAddr, const MemReq* req, uint32_t candidate) {
+    SetAssocArray::postinsert(lineAddr, req, candidate);
+    setLineSize(candidate, newSegs, newDecompLat);
+    profFills.inc();
+    profFillSegs.inc(newSegs);
+    profFillSizes.inc(newSegs - 1);
+}
+
+bool CompressedArray::preevict(uint32_t lineId, const MemReq* req, uint32_t* evLineId, Address* evLineAddr) {
+    uint32_t set = lineId/assoc;
+    if (setSegs[set] <= setSegBudget) return false;
+
+    // Rank the other lines that hold data
+    ZWalkInfo cands[assoc];
+    uint32_t numCands = 0;
+    uint32_t first = set*assoc;
+    for (uint32_t id = first; id < first + assoc; id++) {
+        if (id != lineId && lineSegs[id]) cands[numCands++].set(0, id, -1);
+    }
+    assert(numCands);  // a single line always fits
+    *evLineId = rp->rankCands(req, ZCands(&cands[0], &cands[numCands]));
+    *evLineAddr = array[*evLineId];
+    return true;
+}
+
+void CompressedArray::postevict(uint32_t evLineId) {
+    if (unlikely(heatmap != nullptr)) heatmap->evict(evLineId/assoc, array[evLineId]);
+    setLineSize(evLineId, 0, 0);
+    array[evLineId] = 0;
+    rp->replaced(evLineId);
+    profExtraEvictions.inc();
+}
+
 /* ZCache implementation */
 
 ZArray::ZArray(uint32_t _numLines, uint32_t _ways, uint32_t _candidates, ReplPolicy* _rp, HashFamily* _hf) //(int _size, int _lineSize, int _assoc, int _zassoc, ReplacementPolicy<T>* _rp, int _hashType)
-    : rp(_rp), hf(_hf), numLines(_numLines), ways(_ways), cands(_candidates)
+    : rp(_rp), hf(_hf), numLines(_numLines), ways(_ways), cands(_candidates), heatmap(nullptr)
 {
     assert_msg(ways > 1, "zcaches need >=2 ways to work");
     assert_msg(cands >= ways, "candidates < ways does not make sense in a zcache");
@@ -87,7 +219,13 @@ ZArray::ZArray(uint32_t _numLines, uint32_t _ways, uint32_t _candidates, ReplPol
     swapArray = gm_calloc<uint32_t>(cands/ways + 2);  // conservative upper bound (tight within 2 ways)
 }
 
+bool ZArray::enableHeatmap(uint32_t bins, uint32_t shadowWays) {
+    heatmap = new SetHeatmap(numSets, bins, shadowWays);
+    return true;
+}
+
 void ZArray::initStats(AggregateStat* parentStat) {
+    if (heatmap) heatmap->initStats(parentStat);
     AggregateStat* objStats = new AggregateStat();
     objStats->init("array", "ZArray stats");
     statSwaps.init("swaps", "Block swaps in replacement process");
@@ -108,10 +246,12 @@ int32_t ZArray::lookup(const Address lineAddr, const MemReq* req, bool updateRep
         if (array[lineId] == lineAddr) {
             if (updateReplacement) {
                 rp->update(lineId, req);
+                if (unlikely(heatmap != nullptr)) heatmap->access(hf->hash(0, lineAddr) & setMask, lineAddr, true);
             }
             return lineId;
         }
     }
+    if (updateReplacement && unlikely(heatmap != nullptr)) heatmap->access(hf->hash(0, lineAddr) & setMask, lineAddr, false);
     return -1;
 }
 
@@ -195,6 +335,7 @@ uint32_t ZArray::preinsert(const Address lineAddr, const MemReq* req, Address* w
 
     //Write address of line we're replacing
     *wbLineAddr = array[bestCandidate];
+    if (unlikely(heatmap != nullptr)) heatmap->evict(hf->hash(0, *wbLineAddr) & setMask, *wbLineAddr);
 
     return bestCandidate;
 }
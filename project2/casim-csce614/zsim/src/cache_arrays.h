@@ -48,11 +48,25 @@ class CacheArray : public GlobAlloc {
          */
         virtual void postinsert(const Address lineAddr, const MemReq* req, uint32_t lineId) = 0;
 
+        /* Compressed arrays may need to evict more lines for the one in lineId to fit.
+         * If so, returns true and the tag ID and address of the next line to evict.
+         * Like preinsert(), it is followed by postevict(), which frees the line.
+         */
+        virtual bool preevict(uint32_t lineId, const MemReq* req, uint32_t* evLineId, Address* evLineAddr) {return false;}
+        virtual void postevict(uint32_t evLineId) {}
+
+        /* Cycles to decompress the line in lineId when it is read out on a hit */
+        virtual uint32_t getDecompressionLatency(uint32_t lineId) const {return 0;}
+
+        /* Enables per-set heatmap counters (see set_heatmap.h). Returns false if the array has no sets */
+        virtual bool enableHeatmap(uint32_t bins, uint32_t shadowWays) {return false;}
+
         virtual void initStats(AggregateStat* parent) {}
 };
 
 class ReplPolicy;
 class HashFamily;
+class SetHeatmap;
 
 /* Set-associative cache array */
 class SetAssocArray : public CacheArray {
@@ -64,6 +78,7 @@ class SetAssocArray : public CacheArray {
         uint32_t numSets;
         uint32_t assoc;
         uint32_t setMask;
+        SetHeatmap* heatmap; // nullptr unless enabled
 
     public:
         SetAssocArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf);
@@ -71,6 +86,58 @@ class SetAssocArray : public CacheArray {
         int32_t lookup(const Address lineAddr, const MemReq* req, bool updateReplacement);
         uint32_t preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr);
         void postinsert(const Address lineAddr, const MemReq* req, uint32_t candidate);
+
+        bool enableHeatmap(uint32_t bins, uint32_t shadowWays);
+        void initStats(AggregateStat* parentStat);
+};
+
+class CompressionModel;
+
+/* Set-associative array with compressed data storage. Each set has
+ * tagRatio x more tags than lines of data, and its data is stored in
+ * fixed-size segments (e.g., 8 of 8 bytes per 64-byte line), so a line takes
+ * as many segments as its compressed size. The replacement policy picks the
+ * tag to reuse, and then more lines, until the set's data fits.
+ *
+ * Writebacks can make resident lines grow; a set that overflows this way is
+ * brought back within budget on its next fill.
+ */
+class CompressedArray : public SetAssocArray {
+    private:
+        CompressionModel* model;
+        uint32_t segsPerLine;
+        uint32_t setSegBudget;
+        uint8_t* lineSegs;  // 0 if the tag holds no data
+        uint8_t* lineDecompLat;
+        uint32_t* setSegs;
+
+        // preinsert() compresses the incoming line, postinsert() stores it
+        uint32_t newSegs, newDecompLat;
+
+        uint64_t usedLines, usedSegs;
+
+        Counter profFills, profFillSegs, profDecompHits, profExtraEvictions;
+        VectorCounter profFillSizes;
+        Counter profPhases, profPhaseLines, profPhaseSegs;
+        ProxyStat profUsedLines, profUsedSegs;
+
+    public:
+        CompressedArray(uint32_t _numTags, uint32_t _tagWays, uint32_t dataWays, CompressionModel* _model, ReplPolicy* _rp, HashFamily* _hf);
+
+        int32_t lookup(const Address lineAddr, const MemReq* req, bool updateReplacement);
+        uint32_t preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr);
+        void postinsert(const Address lineAddr, const MemReq* req, uint32_t candidate);
+        bool preevict(uint32_t lineId, const MemReq* req, uint32_t* evLineId, Address* evLineAddr);
+        void postevict(uint32_t evLineId);
+        uint32_t getDecompressionLatency(uint32_t lineId) const {return lineDecompLat[lineId];}
+
+        void initStats(AggregateStat* parentStat);
+
+        // Called every phase to track effective capacity over time
+        void samplePhase();
+
+    private:
+        void setLineSize(uint32_t lineId, uint32_t segs, uint32_t decompLat);
 };
 
 /* The cache array that started this simulator :) */
@@ -92,6 +159,8 @@ class ZArray : public CacheArray {
 
         uint32_t lastCandIdx;
 
+        SetHeatmap* heatmap; // nullptr unless enabled; sets are positions in the first way
+
         Counter statSwaps;
 
     public:
@@ -105,6 +174,7 @@ class ZArray : public CacheArray {
         //Should be called after preinsert(). Allows intervening lookups
         uint32_t getLastCandIdx() const {return lastCandIdx;}
 
+        bool enableHeatmap(uint32_t bins, uint32_t shadowWays);
         void initStats(AggregateStat* parentStat);
 };
 
@@ -25,7 +25,10 @@
 
 #include "coherence_ctrls.h"
 #include "cache.h"
+#include "mesh_network.h"
 #include "network.h"
+#include "req_trace.h"
+#include "zsim.h"
 
 /* Do a simple XOR block hash on address to determine its bank. Hacky for now,
  * should probably have a class that deals with this with a real hash function
@@ -46,10 +49,13 @@ uint32_t MESIBottomCC::getParentId(Address lineAddr) {
 void MESIBottomCC::init(const g_vector<MemObject*>& _parents, Network* network, const char* name) {
     parents.resize(_parents.size());
     parentRTTs.resize(_parents.size());
+    parentRoutes.resize(_parents.size());
     for (uint32_t p = 0; p < parents.size(); p++) {
         parents[p] = _parents[p];
         parentRTTs[p] = (network)? network->getRTT(name, parents[p]->getName()) : 0;
+        parentRoutes[p] = (network)? network->getRoute(name, parents[p]->getName()) : nullptr;
     }
+    traceComp = zinfo->reqTracer? zinfo->reqTracer->registerComponent(name) : 0;
 }
 
 
@@ -73,8 +79,10 @@ uint64_t MESIBottomCC::processEviction(Address wbLineAddr, uint32_t lineId, bool
             break;
         case M:
             {
+                uint32_t parentId = getParentId(wbLineAddr);
                 MemReq req = {wbLineAddr, PUTX, selfId, state, cycle, &ccLock, *state, srcId, 0 /*no flags*/};
-                respCycle = parents[getParentId(wbLineAddr)]->access(req);
+                respCycle = parents[parentId]->access(req);
+                if (unlikely(parentRoutes[parentId] != nullptr)) parentRoutes[parentId]->recordWriteback(srcId);
             }
             break;
 
@@ -107,6 +115,10 @@ uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessTy
                 MemReq req = {lineAddr, GETS, selfId, state, cycle, &ccLock, *state, srcId, flags};
                 uint32_t nextLevelLat = parents[parentId]->access(req) - cycle;
                 uint32_t netLat = parentRTTs[parentId];
+                if (unlikely(parentRoutes[parentId] != nullptr)) parentRoutes[parentId]->recordAccess(lineAddr, GETS, srcId, cycle, cycle + nextLevelLat);
+                if (unlikely(flags & MemReq::TRACED)) {
+                    zinfo->reqTracer->record(zinfo->reqTracer->curId(srcId), traceComp, GETS, cycle + nextLevelLat, cycle + nextLevelLat + netLat, TR_NET);
+                }
                 profGETNextLevelLat.inc(nextLevelLat);
                 profGETNetLat.inc(netLat);
                 respCycle += nextLevelLat + netLat;
@@ -125,6 +137,10 @@ uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessTy
                 MemReq req = {lineAddr, GETX, selfId, state, cycle, &ccLock, *state, srcId, flags};
                 uint32_t nextLevelLat = parents[parentId]->access(req) - cycle;
                 uint32_t netLat = parentRTTs[parentId];
+                if (unlikely(parentRoutes[parentId] != nullptr)) parentRoutes[parentId]->recordAccess(lineAddr, GETX, srcId, cycle, cycle + nextLevelLat);
+                if (unlikely(flags & MemReq::TRACED)) {
+                    zinfo->reqTracer->record(zinfo->reqTracer->curId(srcId), traceComp, GETX, cycle + nextLevelLat, cycle + nextLevelLat + netLat, TR_NET);
+                }
                 profGETNextLevelLat.inc(nextLevelLat);
                 profGETNetLat.inc(netLat);
                 respCycle += nextLevelLat + netLat;
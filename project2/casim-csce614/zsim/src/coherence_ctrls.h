@@ -30,6 +30,7 @@
 #include "constants.h"
 #include "g_std/g_string.h"
 #include "g_std/g_vector.h"
+#include "host_prof.h"
 #include "locks.h"
 #include "memory_hierarchy.h"
 #include "pad.h"
@@ -75,6 +76,7 @@ class CC : public GlobAlloc {
 
 class Cache;
 class Network;
+class NetRoute;
 
 /* NOTE: To avoid virtual function overheads, there is no BottomCC interface, since we only have a MESI controller for now */
 
@@ -83,6 +85,7 @@ class MESIBottomCC : public GlobAlloc {
         MESIState* array;
         g_vector<MemObject*> parents;
         g_vector<uint32_t> parentRTTs;
+        g_vector<NetRoute*> parentRoutes; //non-null if the network models contention to that parent
         uint32_t numLines;
         uint32_t selfId;
 
@@ -95,6 +98,7 @@ class MESIBottomCC : public GlobAlloc {
         Counter profGETNextLevelLat, profGETNetLat;
 
         bool nonInclusiveHack;
+        uint16_t traceComp; // component id in zinfo->reqTracer, for network spans
 
         PAD();
         lock_t ccLock;
@@ -304,6 +308,7 @@ class MESICC : public CC {
 
         //Access methods
         bool startAccess(MemReq& req) {
+            HostProfScope hps(HP_COHERENCE);
             assert((req.type == GETS) || (req.type == GETX) || (req.type == PUTS) || (req.type == PUTX));
 
             /* Child should be locked when called. We do hand-over-hand locking when going
@@ -338,6 +343,7 @@ class MESICC : public CC {
         }
 
         uint64_t processEviction(const MemReq& triggerReq, Address wbLineAddr, int32_t lineId, uint64_t startCycle) {
+            HostProfScope hps(HP_COHERENCE);
             bool lowerLevelWriteback = false;
             uint64_t evCycle = tcc->processEviction(wbLineAddr, lineId, &lowerLevelWriteback, startCycle, triggerReq.srcId); //1. if needed, send invalidates/downgrades to lower level
             evCycle = bcc->processEviction(wbLineAddr, lineId, lowerLevelWriteback, evCycle, triggerReq.srcId); //2. if needed, write back line to upper level
@@ -345,6 +351,7 @@ class MESICC : public CC {
         }
 
         uint64_t processAccess(const MemReq& req, int32_t lineId, uint64_t startCycle, uint64_t* getDoneCycle = nullptr) {
+            HostProfScope hps(HP_COHERENCE);
             uint64_t respCycle = startCycle;
             //Handle non-inclusive writebacks by bypassing
             //NOTE: Most of the time, these are due to evictions, so the line is not there. But the second condition can trigger in NUCA-initiated
@@ -380,6 +387,7 @@ class MESICC : public CC {
         }
 
         void endAccess(const MemReq& req) {
+            HostProfScope hps(HP_COHERENCE);
             //Relock child before we unlock ourselves (hand-over-hand)
             if (req.childLock) {
                 futex_lock(req.childLock);
@@ -391,10 +399,12 @@ class MESICC : public CC {
 
         //Inv methods
         void startInv() {
+            HostProfScope hps(HP_COHERENCE);
             bcc->lock(); //note we don't grab tcc; tcc serializes multiple up accesses, down accesses don't see it
         }
 
         uint64_t processInv(const InvReq& req, int32_t lineId, uint64_t startCycle) {
+            HostProfScope hps(HP_COHERENCE);
             uint64_t respCycle = tcc->processInval(req.lineAddr, lineId, req.type, req.writeback, startCycle, req.srcId); //send invalidates or downgrades to children
             bcc->processInval(req.lineAddr, lineId, req.type, req.writeback); //adjust our own state
 
@@ -433,6 +443,7 @@ class MESITerminalCC : public CC {
 
         //Access methods
         bool startAccess(MemReq& req) {
+            HostProfScope hps(HP_COHERENCE);
             assert((req.type == GETS) || (req.type == GETX)); //no puts!
 
             /* Child should be locked when called. We do hand-over-hand locking when going
@@ -457,12 +468,14 @@ class MESITerminalCC : public CC {
         }
 
         uint64_t processEviction(const MemReq& triggerReq, Address wbLineAddr, int32_t lineId, uint64_t startCycle) {
+            HostProfScope hps(HP_COHERENCE);
             bool lowerLevelWriteback = false;
             uint64_t endCycle = bcc->processEviction(wbLineAddr, lineId, lowerLevelWriteback, startCycle, triggerReq.srcId); //2. if needed, write back line to upper level
             return endCycle;  // critical path unaffected, but TimingCache needs it
         }
 
         uint64_t processAccess(const MemReq& req, int32_t lineId, uint64_t startCycle,  uint64_t* getDoneCycle = nullptr) {
+            HostProfScope hps(HP_COHERENCE);
             assert(lineId != -1);
             assert(!getDoneCycle);
             //if needed, fetch line or upgrade miss from upper level
@@ -472,6 +485,7 @@ class MESITerminalCC : public CC {
         }
 
         void endAccess(const MemReq& req) {
+            HostProfScope hps(HP_COHERENCE);
             //Relock child before we unlock ourselves (hand-over-hand)
             if (req.childLock) {
                 futex_lock(req.childLock);
@@ -481,10 +495,12 @@ class MESITerminalCC : public CC {
 
         //Inv methods
         void startInv() {
+            HostProfScope hps(HP_COHERENCE);
             bcc->lock();
         }
 
         uint64_t processInv(const InvReq& req, int32_t lineId, uint64_t startCycle) {
+            HostProfScope hps(HP_COHERENCE);
             bcc->processInval(req.lineAddr, lineId, req.type, req.writeback); //adjust our own state
             bcc->unlock();
             return startCycle; //no extra delay in terminal caches
@@ -0,0 +1,182 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "compression.h"
+#include <string.h>
+#include "bithacks.h"
+#include "log.h"
+#include "pin.H"
+#include "zsim.h"
+
+/* Synthetic model */
+
+SyntheticCompression::SyntheticCompression(uint32_t _segsPerLine, const g_vector<uint32_t>& weights, uint32_t _decompLat)
+    : CompressionModel(_segsPerLine), decompLat(_decompLat)
+{
+    if (weights.size() != segsPerLine) panic("Synthetic compression needs %d size weights (1..%d segments), %ld given", segsPerLine, segsPerLine, weights.size());
+    uint64_t sum = 0;
+    for (uint32_t w : weights) {
+        sum += w;
+        cumWeights.push_back(sum);
+    }
+    if (!sum) panic("Synthetic compression size weights are all zero");
+}
+
+uint32_t SyntheticCompression::compress(Address lineAddr, uint32_t* lat) {
+    // splitmix64 finalizer: sizes are uncorrelated with address patterns, but fixed per line
+    uint64_t h = lineAddr + 0x9E3779B97F4A7C15ul;
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ul;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBul;
+    h = (h ^ (h >> 31)) % cumWeights.back();
+
+    uint32_t segs = 1;
+    while (cumWeights[segs-1] <= h) segs++;
+    *lat = (segs < segsPerLine)? decompLat : 0;
+    return segs;
+}
+
+/* BDI and FPC */
+
+static inline uint64_t readLE(const uint8_t* p, uint32_t bytes) {
+    uint64_t v = 0;
+    memcpy(&v, p, bytes);  // x86 is little-endian
+    return v;
+}
+
+static inline int64_t signExtend(uint64_t v, uint32_t bytes) {
+    uint32_t shift = 64 - 8*bytes;
+    return ((int64_t)(v << shift)) >> shift;
+}
+
+static inline bool fitsSigned(int64_t v, uint32_t bytes) {
+    int64_t lim = 1l << (8*bytes - 1);
+    return v >= -lim && v < lim;
+}
+
+uint32_t BDICompressedSize(const uint8_t* line, uint32_t len) {
+    bool zeros = true, repeated = true;
+    uint64_t first = readLE(line, 8);
+    for (uint32_t i = 0; i < len; i += 8) {
+        uint64_t v = readLE(line + i, 8);
+        zeros &= !v;
+        repeated &= (v == first);
+    }
+    if (zeros) return 1;
+    if (repeated) return 8;
+
+    // Base size, delta size. Values are deltas from an implicit zero base or
+    // from an explicit base (the first value that is not a small immediate).
+    static const uint32_t encodings[][2] = {{8, 1}, {8, 2}, {8, 4}, {4, 1}, {4, 2}, {2, 1}};
+    uint32_t best = len;
+    for (auto& enc : encodings) {
+        uint32_t b = enc[0], d = enc[1];
+        uint32_t n = len/b;
+        bool haveBase = false;
+        uint64_t base = 0;
+        bool fits = true;
+        for (uint32_t i = 0; i < n && fits; i++) {
+            uint64_t v = readLE(line + i*b, b);
+            if (fitsSigned(signExtend(v, b), d)) continue;
+            if (!haveBase) {
+                base = v;
+                haveBase = true;
+            } else {
+                fits = fitsSigned(signExtend(v - base, b), d);
+            }
+        }
+        if (fits) best = MIN(best, b + n*d + (n + 7)/8);  // base, deltas, and a bit per value to pick its base
+    }
+    return best;
+}
+
+uint32_t FPCCompressedSize(const uint8_t* line, uint32_t len) {
+    uint32_t bits = 0;
+    uint32_t zeroRun = 0;
+    for (uint32_t i = 0; i < len; i += 4) {
+        uint32_t w = readLE(line + i, 4);
+        if (!w) {
+            if (!zeroRun) bits += 3 + 3;  // runs of up to 8 zero words
+            zeroRun = (zeroRun + 1) % 8;
+            continue;
+        }
+        zeroRun = 0;
+
+        int32_t s = (int32_t)w;
+        int16_t lo = w & 0xffff;
+        int16_t hi = w >> 16;
+        uint8_t b0 = w & 0xff;
+        uint32_t data;
+        if (s >= -8 && s < 8) data = 4;
+        else if (s >= -128 && s < 128) data = 8;
+        else if (s >= -32768 && s < 32768) data = 16;
+        else if (!lo) data = 16;  // halfword padded with a zero halfword
+        else if (lo >= -128 && lo < 128 && hi >= -128 && hi < 128) data = 16;  // two sign-extended bytes
+        else if (w == b0 * 0x01010101u) data = 8;  // repeated bytes
+        else data = 32;
+        bits += 3 + data;
+    }
+    return (bits + 7)/8;
+}
+
+/* Sampled model */
+
+#define MAX_SAMPLED_LINE_SIZE 512
+
+SampledCompression::SampledCompression(Algorithm _algorithm, uint32_t _lineSize, uint32_t _segmentBytes, uint32_t _bdiLat, uint32_t _fpcLat, CompressionModel* _fallback)
+    : CompressionModel(_lineSize/_segmentBytes), algorithm(_algorithm), lineSize(_lineSize), segmentBytes(_segmentBytes),
+      bdiLat(_bdiLat), fpcLat(_fpcLat), fallback(_fallback)
+{
+    if (lineSize > MAX_SAMPLED_LINE_SIZE || lineSize % 8) panic("Sampled compression needs lines of at most %d bytes, in multiples of 8", MAX_SAMPLED_LINE_SIZE);
+    if (fallback->getSegsPerLine() != segsPerLine) panic("Fallback compression model must use the same segments per line");
+}
+
+uint32_t SampledCompression::compress(Address lineAddr, uint32_t* lat) {
+    // lineAddr is a virtual line address with the process index in its top bits; we can only read our own process's memory.
+    // With a physical page allocator, lineAddr is physical, and we do not keep the reverse mapping.
+    if (zinfo->physMem || (lineAddr >> (64 - lineBits)) != (procMask >> (64 - lineBits))) return fallback->compress(lineAddr, lat);
+    uint8_t buf[MAX_SAMPLED_LINE_SIZE];
+    if (PIN_SafeCopy(buf, (void*)(lineAddr << lineBits), lineSize) != lineSize) return fallback->compress(lineAddr, lat);
+
+    uint32_t bytes = lineSize;
+    *lat = 0;
+    if (algorithm == BDI || algorithm == BDI_FPC) {
+        bytes = BDICompressedSize(buf, lineSize);
+        *lat = bdiLat;
+    }
+    if (algorithm == FPC || algorithm == BDI_FPC) {
+        uint32_t fpcBytes = FPCCompressedSize(buf, lineSize);
+        if (fpcBytes < bytes) {
+            bytes = fpcBytes;
+            *lat = fpcLat;
+        }
+    }
+
+    uint32_t segs = (bytes + segmentBytes - 1)/segmentBytes;
+    if (segs >= segsPerLine) {
+        *lat = 0;
+        return segsPerLine;
+    }
+    return segs;
+}
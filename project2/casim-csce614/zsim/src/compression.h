@@ -0,0 +1,88 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPRESSION_H_
+#define COMPRESSION_H_
+
+/* Compressibility models for compressed caches. A model returns the size of a
+ * line, in data segments, and the latency to decompress it on a hit.
+ */
+
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "memory_hierarchy.h"
+
+class CompressionModel : public GlobAlloc {
+    protected:
+        const uint32_t segsPerLine;
+
+    public:
+        explicit CompressionModel(uint32_t _segsPerLine) : segsPerLine(_segsPerLine) {}
+        uint32_t getSegsPerLine() const {return segsPerLine;}
+
+        // Returns the compressed size in segments (1..segsPerLine); uncompressed lines have no decompression latency
+        virtual uint32_t compress(Address lineAddr, uint32_t* decompLat) = 0;
+};
+
+/* Synthetic compressibility: each line gets a fixed size drawn from a
+ * distribution (weights for 1..segsPerLine segments), using a hash of its
+ * address, so the same line always has the same size.
+ */
+class SyntheticCompression : public CompressionModel {
+    private:
+        g_vector<uint64_t> cumWeights;
+        uint32_t decompLat;
+
+    public:
+        SyntheticCompression(uint32_t _segsPerLine, const g_vector<uint32_t>& weights, uint32_t _decompLat);
+        uint32_t compress(Address lineAddr, uint32_t* decompLat);
+};
+
+/* Compresses the line's current contents in the application's memory with
+ * BDI (base-delta-immediate, Pekhimenko et al., PACT 2012), FPC (frequent
+ * pattern compression, Alameldeen and Wood, ISCA 2004), or the best of both.
+ * Lines we cannot read (other processes' or unmapped) fall back to the
+ * synthetic model.
+ */
+class SampledCompression : public CompressionModel {
+    public:
+        enum Algorithm {BDI, FPC, BDI_FPC};
+
+    private:
+        const Algorithm algorithm;
+        const uint32_t lineSize, segmentBytes;
+        const uint32_t bdiLat, fpcLat;
+        CompressionModel* fallback;
+
+    public:
+        SampledCompression(Algorithm _algorithm, uint32_t _lineSize, uint32_t _segmentBytes, uint32_t _bdiLat, uint32_t _fpcLat, CompressionModel* _fallback);
+        uint32_t compress(Address lineAddr, uint32_t* decompLat);
+};
+
+// Compressed sizes, in bytes, of a line of len bytes (a multiple of 8)
+uint32_t BDICompressedSize(const uint8_t* line, uint32_t len);
+uint32_t FPCCompressedSize(const uint8_t* line, uint32_t len);
+
+#endif  // COMPRESSION_H_
@@ -31,10 +31,12 @@
 #include <typeinfo>
 #include <unordered_map>
 #include <vector>
+#include "host_prof.h"
 #include "log.h"
 #include "ooo_core.h"
 #include "timing_core.h"
 #include "timing_event.h"
+#include "weave_timeline.h"
 #include "zsim.h"
 
 //Set to 1 to produce a post-mortem analysis log
@@ -61,6 +63,7 @@ void ContentionSim::SimThreadTrampoline(void* arg) {
 ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
     numDomains = _numDomains;
     numSimThreads = _numSimThreads;
+    timeline = nullptr;
     threadsDone = 0;
     limit = 0;
     lastLimit = 0;
@@ -196,6 +199,11 @@ void ContentionSim::enqueue(TimingEvent* ev, uint64_t cycle) {
     assert(ev->domain < (int32_t)numDomains);
 
     domains[ev->domain].pq.enqueue(ev, cycle);
+    if (unlikely(timeline != nullptr)) timeline->recordEnqueue(ev->domain, ev, cycle);
+}
+
+void ContentionSim::flushTimeline() {
+    if (timeline) timeline->flush();
 }
 
 void ContentionSim::enqueueSynced(TimingEvent* ev, uint64_t cycle) {
@@ -276,12 +284,16 @@ void ContentionSim::simThreadLoop(uint32_t thid) {
         }
 
         //info("%d --- phase start", domain);
-        simulatePhaseThread(thid);
+        {
+            HostProfScope hps(HP_WEAVE);
+            simulatePhaseThread(thid);
+        }
         //info("%d --- phase end", domain);
 
         uint32_t val = __sync_add_and_fetch(&threadsDone, 1);
         if (val == numSimThreads) {
             threadsDone = 0;
+            if (unlikely(timeline != nullptr) && timeline->windowDone(limit)) timeline->flush(); //all threads are idle now
             futex_unlock(&waitLock); //unblock caller
         }
     }
@@ -305,7 +317,9 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
                 domCycle = cycle;
                 domain.curCycle = cycle;
             }
+            if (unlikely(timeline != nullptr)) timeline->beginRun(simThreads[thid].firstDomain, te, cycle);
             te->run(cycle);
+            if (unlikely(timeline != nullptr)) timeline->endRun(simThreads[thid].firstDomain);
             uint64_t newCycle = pq.size()? pq.firstCycle() : limit;
             assert(newCycle >= domCycle);
             if (newCycle != domCycle) domain.curCycle = newCycle;
@@ -373,7 +387,9 @@ void ContentionSim::simulatePhaseThread(uint32_t thid) {
                     TimingEvent* te = pq.dequeue(cycle);
                     //uint64_t nextCycle = pq.size()? pq.firstCycle() : cycle;
                     if (cycle != domain->curCycle) domain->curCycle = cycle;
+                    if (unlikely(timeline != nullptr)) timeline->beginRun(domain - domains, te, cycle);
                     te->run(cycle);
+                    if (unlikely(timeline != nullptr)) timeline->endRun(domain - domains);
                     domain->curCycle = pq.size()? pq.firstCycle() : limit;
                     domain->queuePrio = domain->curCycle;
                     if (domain->prio == 0) domPq.push(domain);
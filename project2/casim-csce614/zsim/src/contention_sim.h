@@ -46,6 +46,7 @@
 class TimingEvent;
 class DelayEvent;
 class CrossingEvent;
+class WeaveTimeline;
 
 #define PQ_BLOCKS 1024
 
@@ -125,6 +126,8 @@ class ContentionSim : public GlobAlloc {
         //lock_t testLock;
         lock_t postMortemLock;
 
+        WeaveTimeline* timeline; // nullptr unless recording the weave timeline
+
     public:
         ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads);
 
@@ -132,6 +135,9 @@ class ContentionSim : public GlobAlloc {
 
         void postInit(); //must be called after the simulator is initialized
 
+        void setTimeline(WeaveTimeline* _timeline) { timeline = _timeline; }
+        void flushTimeline(); // writes the weave timeline if it was not written yet; call when threads are idle
+
         void enqueue(TimingEvent* ev, uint64_t cycle);
         void enqueueSynced(TimingEvent* ev, uint64_t cycle);
         void enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t srcId, uint32_t srcDomain, uint32_t dstDomain, EventRecorder* evRec);
@@ -151,6 +157,9 @@ class ContentionSim : public GlobAlloc {
 
         void setPrio(uint32_t domain, uint32_t prio) {domains[domain].prio = prio;}
 
+        //Only tracked when each sim thread owns a single domain (0 otherwise)
+        uint64_t getDomainWeaveNs(uint32_t domain) const {return domains[domain].profTime.get();}
+
 #if PROFILE_CROSSINGS
         void profileCrossing(uint32_t srcDomain, uint32_t dstDomain, uint32_t count) {
             domains[dstDomain].profIncomingCrossings.inc(srcDomain);
@@ -30,7 +30,11 @@
 #include "bithacks.h"
 #include "config.h"  // for Tokenize
 #include "contention_sim.h"
+#include "domain_profiler.h"
 #include "event_recorder.h"
+#include "host_prof.h"
+#include "miss_prof.h"
+#include "req_trace.h"
 #include "timing_event.h"
 #include "zsim.h"
 
@@ -45,6 +49,9 @@ class DDRMemoryAccEvent : public TimingEvent {
         bool write;
 
     public:
+        TraceTag trace;
+        MissProfCtx profCtx;  // requester of a demand read, with sim.missProfile
+
         DDRMemoryAccEvent(DDRMemory* _mem, bool _isWrite, Address _addr, int32_t domain, uint32_t preDelay, uint32_t postDelay)
             : TimingEvent(preDelay, postDelay, domain), mem(_mem), addr(_addr), write(_isWrite) {}
 
@@ -151,15 +158,18 @@ class SchedEvent : public TimingEvent, public GlobAlloc {
 /* Init & bound phase functionality */
 
 DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerChannel, uint32_t _banksPerRank,
-        uint32_t _sysFreqMHz, const char* tech, const char* addrMapping, uint32_t _controllerSysLatency,
+        uint32_t _sysFreqMHz, const char* tech, const char* refresh, const char* addrMapping, uint32_t _controllerSysLatency,
         uint32_t _queueDepth, uint32_t _rowHitLimit, bool _deferredWrites, bool _closedPage,
         uint32_t _domain, g_string& _name)
     : lineSize(_lineSize), ranksPerChannel(_ranksPerChannel), banksPerRank(_banksPerRank),
       controllerSysLatency(_controllerSysLatency), queueDepth(_queueDepth), rowHitLimit(_rowHitLimit),
       deferredWrites(_deferredWrites), closedPage(_closedPage), domain(_domain), name(_name)
 {
+    weaveNode = zinfo->domainProfiler? zinfo->domainProfiler->registerNode(name, DomainProfiler::NODE_MEM, domain) : 0;
+    traceComp = zinfo->reqTracer? zinfo->reqTracer->registerComponent(name.c_str()) : 0;
     sysFreqKHz = 1000 * _sysFreqMHz;
-    initTech(tech);  // sets all tXX and memFreqKHz
+    initTech(tech, refresh);  // sets all tXX, bankGroups, refreshMode, memFreqKHz, and banksPerRank if 0
+    if (banksPerRank % bankGroups != 0) panic("%s: %d banks/rank not divisible in %d bank groups", name.c_str(), banksPerRank, bankGroups);
     if (memFreqKHz >= sysFreqKHz/2) {
         panic("You may need to tweak the scheduling code, which works with system cycles." \
             "With these frequencies, events (which run on system cycles) can't hit us every memory cycle.");
@@ -173,9 +183,13 @@ DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerCh
 
     rdQueue.init(queueDepth);
     wrQueue.init(queueDepth);
+    nextReqSeq = 0;
+    rowIndex.init(2*queueDepth);
+    rdPendingBanks.resize((ranksPerChannel*banksPerRank + 63)/64, 0);
+    wrPendingBanks.resize((ranksPerChannel*banksPerRank + 63)/64, 0);
 
-    info("%s: domain %d, %d ranks/ch %d banks/rank, tech %s, boundLat %d rd / %d wr",
-            name.c_str(), domain, ranksPerChannel, banksPerRank, tech, minRdLatency, minWrLatency);
+    info("%s: domain %d, %d ranks/ch %d banks/rank (%d groups), tech %s (gear %d), boundLat %d rd / %d wr",
+            name.c_str(), domain, ranksPerChannel, banksPerRank, bankGroups, tech, gear, minRdLatency, minWrLatency);
 
     minRespCycle = tCL + tBL + 1; // We subtract tCL + tBL from this on some checks; this avoids overflows
 
@@ -183,7 +197,9 @@ DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerCh
     for (uint32_t i = 0; i < ranksPerChannel; i++) banks[i].resize(banksPerRank);
 
     rankActWindows.resize(ranksPerChannel);
-    for (uint32_t i = 0; i < ranksPerChannel; i++) rankActWindows[i].init(4);  // we only model FAW; for TAW (other technologies) change this to 2
+    for (uint32_t i = 0; i < ranksPerChannel; i++) rankActWindows[i].init(4, bankGroups);  // we only model FAW; for TAW (other technologies) change this to 2
+    groupLastCmdCycle.resize(ranksPerChannel*bankGroups, 0);
+    lastCmdGroup = 0;
 
     // We get line addresses, and for a 64-byte line, there are _colSize/(JEDEC_BUS_WIDTH/8) lines/page
     uint32_t colBits = ilog2(_colSize/(JEDEC_BUS_WIDTH/8)*64/lineSize);
@@ -218,7 +234,12 @@ DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerCh
             ilog2(rankMask << rankShift), rankShift, ilog2(bankMask << bankShift), bankShift);
 
     // Weave phase events
-    new RefreshEvent(this, memToSysCycle(tREFI), domain);
+    // Per-bank and same-bank refreshes split each tREFI among the banks they cycle through
+    uint32_t refreshInterval = tREFI;
+    if (refreshMode == REF_PER_BANK) refreshInterval = tREFI/banksPerRank;
+    else if (refreshMode == REF_SAME_BANK) refreshInterval = tREFI/(banksPerRank/bankGroups);
+    nextRefreshBank = 0;
+    new RefreshEvent(this, memToSysCycle(refreshInterval), domain);
 
     nextSchedCycle = -1ul;
     nextSchedEvent = nullptr;
@@ -235,12 +256,14 @@ void DDRMemory::initStats(AggregateStat* parentStat) {
     profReadHits.init("rdhits", "Read row hits"); memStats->append(&profReadHits);
     profWriteHits.init("wrhits", "Write row hits"); memStats->append(&profWriteHits);
     latencyHist.init("mlh", "latency histogram for memory requests", NUMBINS); memStats->append(&latencyHist);
+    profRdLatHist.init("rdLatHist", "Read latency histogram"); memStats->append(&profRdLatHist);
     parentStat->append(memStats);
 }
 
 /* Bound phase interface */
 
 uint64_t DDRMemory::access(MemReq& req) {
+    HostProfScope hps(HP_MEM);
     switch (req.type) {
         case PUTS:
         case PUTX:
@@ -262,12 +285,20 @@ uint64_t DDRMemory::access(MemReq& req) {
         bool isWrite = (req.type == PUTX);
         uint64_t respCycle = req.cycle + (isWrite? minWrLatency : minRdLatency);
         if (zinfo->eventRecorders[req.srcId]) {
+            if (unlikely(zinfo->domainProfiler != nullptr)) {
+                zinfo->domainProfiler->recordEdge(zinfo->eventRecorders[req.srcId]->getWeaveNode(), weaveNode);
+            }
             DDRMemoryAccEvent* memEv = new (zinfo->eventRecorders[req.srcId]) DDRMemoryAccEvent(this,
                     isWrite, req.lineAddr, domain, preDelay, isWrite? postDelayWr : postDelayRd);
             memEv->setMinStartCycle(req.cycle);
+            if (unlikely(req.is(MemReq::TRACED))) memEv->trace.set(zinfo->reqTracer->curId(req.srcId), req.type);
+            if (unlikely(zinfo->missProf != nullptr) && !isWrite && !req.is(MemReq::PREFETCH)) memEv->profCtx = zinfo->missProf->getCtx(req.srcId);
             TimingRecord tr = {req.lineAddr, req.cycle, respCycle, req.type, memEv, memEv};
             zinfo->eventRecorders[req.srcId]->pushRecord(tr);
         }
+        if (unlikely(req.is(MemReq::TRACED))) {
+            zinfo->reqTracer->record(zinfo->reqTracer->curId(req.srcId), traceComp, req.type, req.cycle, respCycle, TR_MEM);
+        }
         //info("Access to %lx at %ld, %ld latency", req.lineAddr, req.cycle, minLatency);
         return respCycle;
     }
@@ -300,8 +331,7 @@ void DDRMemory::enqueue(DDRMemoryAccEvent* ev, uint64_t sysCycle) {
     // Create request
     Request ovfReq;
     bool overflow = rdQueue.full() || wrQueue.full();
-    bool useWrQueue = deferredWrites && ev->isWrite();
-    Request* req = overflow? &ovfReq : useWrQueue? wrQueue.alloc() : rdQueue.alloc();
+    Request* req = overflow? &ovfReq : allocRequest(ev->isWrite());
 
     req->addr = ev->getAddr();
     req->loc = mapLineAddr(ev->getAddr());
@@ -342,6 +372,12 @@ void DDRMemory::enqueue(DDRMemoryAccEvent* ev, uint64_t sysCycle) {
     }
 }
 
+DDRMemory::Request* DDRMemory::allocRequest(bool write) {
+    Request* req = (deferredWrites && write)? wrQueue.alloc() : rdQueue.alloc();
+    req->seq = nextReqSeq++;
+    return req;
+}
+
 void DDRMemory::queue(Request* req, uint64_t memCycle) {
     // If it's a write, respond to it immediately
     if (req->write) {
@@ -366,7 +402,9 @@ void DDRMemory::queue(Request* req, uint64_t memCycle) {
 
     // Alloc in per-bank queue, in FR order
     Bank& bank = banks[req->loc.rank][req->loc.bank];
-    InList<Request>& q = (deferredWrites && req->write)? bank.wrReqs : bank.rdReqs;
+    bool isWriteQueue = deferredWrites && req->write;
+    InList<Request>& q = isWriteQueue? bank.wrReqs : bank.rdReqs;
+    uint32_t qIdx = bankQueueIdx(req->loc, isWriteQueue);
 
     // Print bak queue? Use to verify FR-FCFS
 #if 0
@@ -381,21 +419,17 @@ void DDRMemory::queue(Request* req, uint64_t memCycle) {
     printQ("PRE");
 #endif
 
-    Request* m = q.back();
-    while (m) {
-        if (m->loc.row == req->loc.row) {
-            if (m->rowHitSeq < rowHitLimit) {
-                // queue after last same-row access
-                req->rowHitSeq = m->rowHitSeq + 1;
-                q.insertAfter(m, req);
-            } else {
-                // queue last to get some fairness
-                req->rowHitSeq = 0;
-                q.push_back(req);
-            }
-            break;
+    Request* m = rowIndex.find(qIdx, req->loc.row);  // last same-row access
+    if (m) {
+        if (m->rowHitSeq < rowHitLimit) {
+            // queue after last same-row access
+            req->rowHitSeq = m->rowHitSeq + 1;
+            q.insertAfter(m, req);
+        } else {
+            // queue last to get some fairness
+            req->rowHitSeq = 0;
+            q.push_back(req);
         }
-        m = m->prev;
     }
 
     // No matches...
@@ -417,6 +451,11 @@ void DDRMemory::queue(Request* req, uint64_t memCycle) {
             q.push_back(req);
         }
     }
+
+    // In all cases, req is now the last access to its row in the bank queue
+    rowIndex.set(qIdx, req->loc.row, req);
+    uint32_t b = qIdx/2;
+    (isWriteQueue? wrPendingBanks : rdPendingBanks)[b/64] |= 1ul << (b % 64);
 #if 0
     printQ("POST");
 #endif
@@ -431,9 +470,10 @@ uint64_t DDRMemory::tick(uint64_t sysCycle) {
     assert(minSchedCycle >= memCycle);
     if (!rdQueue.full() && !wrQueue.full() && !overflowQueue.empty()) {
         Request& ovfReq = overflowQueue.front();
-        bool useWrQueue = deferredWrites && ovfReq.write;
-        Request* req = useWrQueue? wrQueue.alloc() : rdQueue.alloc();
+        Request* req = allocRequest(ovfReq.write);
+        uint64_t seq = req->seq;
         *req = ovfReq;
+        req->seq = seq;
         overflowQueue.pop_front();
 
         queue(req, memCycle);
@@ -483,8 +523,10 @@ uint64_t DDRMemory::findMinCmdCycle(const Request& r) const {
         }
         uint64_t actCycle = std::max(r.arrivalCycle, std::max(preCycle + tRP, bank.lastActCycle + tRRD));
         actCycle = std::max(actCycle, rankActWindows[r.loc.rank].minActCycle() + tFAW);
+        if (bankGroups > 1) actCycle = std::max(actCycle, rankActWindows[r.loc.rank].minGroupActCycle(bankGroup(r.loc), tRRD_S, tRRD_L));
         minCmdCycle = actCycle + tRCD;
     }
+    if (bankGroups > 1) minCmdCycle = std::max(minCmdCycle, groupLastCmdCycle[rankGroupIdx(r.loc)] + tCCD_L);
     return minCmdCycle;
 }
 
@@ -513,24 +555,20 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
     RequestQueue<Request>& queue = isWriteQueue? wrQueue : rdQueue;
     assert(!queue.empty());
 
+    // Only the head of each bank queue can issue; among ready heads, pick the
+    // oldest arrival. Walk the banks with pending requests instead of the queue.
+    g_vector<uint64_t>& pendingBanks = isWriteQueue? wrPendingBanks : rdPendingBanks;
     Request* r = nullptr;
-    RequestQueue<Request>::iterator ir = queue.begin();
     uint64_t minSchedCycle = -1ul;
-    while (ir != queue.end()) {
-        //Bank& bank = banks[(*ir)->loc.rank][(*ir)->loc.bank];
-        //if ((isWriteQueue? bank.wrReqs : bank.rdReqs).front() == *ir) {
-        if (!(*ir)->prev) {  // FASTAH!
-            uint64_t minCmdCycle = findMinCmdCycle(**ir);
+    for (uint32_t w = 0; w < pendingBanks.size(); w++) {
+        for (uint64_t pending = pendingBanks[w]; pending; pending &= pending - 1) {
+            uint32_t b = w*64 + __builtin_ctzl(pending);
+            const Bank& bank = banks[b / banksPerRank][b % banksPerRank];
+            Request* head = (isWriteQueue? bank.wrReqs : bank.rdReqs).front();
+            uint64_t minCmdCycle = findMinCmdCycle(*head);
             minSchedCycle = std::min(minSchedCycle, minCmdCycle);
-            if (minCmdCycle <= curCycle) {
-                r = *ir;
-                break;
-            }
-            //DEBUG("Skipping 0x%lx, not ready %ld", (*ir)->ev->getAddr(), minCmdCycle);
-        } else {
-            //DEBUG("Skipping 0x%lx, not first", (*ir)->ev->getAddr());
+            if (minCmdCycle <= curCycle && (!r || head->seq < r->seq)) r = head;
         }
-        ir.inc();
     }
 
     if (!r) {
@@ -549,7 +587,12 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
     // Compute the minimum cycle at which the read or write command can be issued,
     // without column access or data bus constraints
     uint64_t minCmdCycle = std::max(curCycle, minRespCycle - tCL);
-    if (lastCmdWasWrite && !r->write) minCmdCycle = std::max(minCmdCycle, minRespCycle + tWTR);
+    uint32_t rgIdx = rankGroupIdx(r->loc);
+    if (lastCmdWasWrite && !r->write) {
+        bool sameGroup = bankGroups == 1 || lastCmdGroup == rgIdx;
+        minCmdCycle = std::max(minCmdCycle, minRespCycle + (sameGroup? tWTR : tWTR_S));
+    }
+    if (bankGroups > 1) minCmdCycle = std::max(minCmdCycle, groupLastCmdCycle[rgIdx] + tCCD_L);
     bool rowHit = false;
     if (r->loc.row == bank.openRow && bank.open) {
         // Row buffer hit
@@ -567,12 +610,13 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
 
         uint64_t actCycle = std::max(r->arrivalCycle, std::max(preCycle + tRP, bank.lastActCycle + tRRD));
         actCycle = std::max(actCycle, rankActWindows[r->loc.rank].minActCycle() + tFAW);
+        if (bankGroups > 1) actCycle = std::max(actCycle, rankActWindows[r->loc.rank].minGroupActCycle(bankGroup(r->loc), tRRD_S, tRRD_L));
 
         // Record ACT
         bank.open = true;
         bank.openRow = r->loc.row;
         if (preIssued) bank.minPreCycle = preCycle + tRAS;
-        rankActWindows[r->loc.rank].addActivation(actCycle);
+        rankActWindows[r->loc.rank].addActivation(actCycle, bankGroup(r->loc));
         bank.lastActCycle = actCycle;
 
         minCmdCycle = std::max(minCmdCycle, actCycle + tRCD);
@@ -580,8 +624,11 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
 
     // Figure out data bus constraints, find actual time at which command is issued
     uint64_t cmdCycle = std::max(minCmdCycle, minRespCycle - tCL);
+    if (tCCD_S > tBL) cmdCycle = std::max(cmdCycle, minRespCycle - tCL - tBL + tCCD_S);  // back-to-back bursts are usually tCCD_S apart
     minRespCycle = cmdCycle + tCL + tBL;
     lastCmdWasWrite = r->write;
+    lastCmdGroup = rgIdx;
+    groupLastCmdCycle[rgIdx] = cmdCycle;
 
     // Record PRE
     // if closed-page, close (auto-precharge) if no more row buffer hits
@@ -613,8 +660,14 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
         profReads.inc();
         profTotalRdLat.inc(scDelay);
         if (rowHit) profReadHits.inc();
+        else if (unlikely(ev->profCtx.valid)) zinfo->missProf->record(ev->profCtx, MP_DRAM_ROW);
         uint32_t bucket = std::min(NUMBINS-1, scDelay/BINSIZE);
         latencyHist.inc(bucket, 1);
+        profRdLatHist.record(scDelay);
+        if (unlikely(ev->trace.id)) {
+            zinfo->reqTracer->record(ev->trace.id, traceComp, ev->trace.type, r->startSysCycle, sysCycle, TR_DRAM_QUEUE);
+            zinfo->reqTracer->record(ev->trace.id, traceComp, ev->trace.type, sysCycle, doneSysCycle, rowHit? TR_ROW_HIT : TR_ROW_MISS);
+        }
     } else {
         uint32_t scDelay = memToSysCycle(minRespCycle) + controllerSysLatency - r->startSysCycle;
         profWrites.inc();
@@ -625,26 +678,47 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
     DEBUG("Served 0x%lx lat %ld clocks", r->addr, minRespCycle-curCycle);
 
     // Dequeue this req
-    queue.remove(ir);
-    (isWriteQueue? bank.wrReqs : bank.rdReqs).pop_front();
+    InList<Request>& q = isWriteQueue? bank.wrReqs : bank.rdReqs;
+    uint32_t qIdx = bankQueueIdx(r->loc, isWriteQueue);
+    if (rowIndex.find(qIdx, r->loc.row) == r) rowIndex.erase(qIdx, r->loc.row);
+    q.pop_front();
+    uint32_t b = qIdx/2;
+    if (q.empty()) pendingBanks[b/64] &= ~(1ul << (b % 64));
+    queue.remove(r);
 
     return (rdQueue.empty() && wrQueue.empty())? -1ul : minRespCycle - tCL;
 }
 
 void DDRMemory::refresh(uint64_t sysCycle) {
     uint64_t memCycle = sysToMemCycle(sysCycle);
+
+    // All-bank refreshes cover every bank; per-bank refreshes cover one bank
+    // per rank, and same-bank refreshes the same bank of every group
+    auto refreshed = [this](uint32_t b) {
+        switch (refreshMode) {
+            case REF_PER_BANK: return b == nextRefreshBank;
+            case REF_SAME_BANK: return b / bankGroups == nextRefreshBank;
+            default: return true;
+        }
+    };
+
     uint64_t minRefreshCycle = memCycle;
     for (auto& rankBanks : banks) {
-        for (auto& bank : rankBanks) {
+        for (uint32_t b = 0; b < banksPerRank; b++) {
+            if (!refreshed(b)) continue;
+            Bank& bank = rankBanks[b];
             minRefreshCycle = std::max(minRefreshCycle, std::max(bank.minPreCycle, bank.lastCmdCycle));
         }
     }
     assert(minRefreshCycle >= memCycle);
 
-    uint64_t refreshDoneCycle = minRefreshCycle + tRFC;
-    assert(tRFC >= tRP);
+    uint32_t refreshLat = (refreshMode == REF_ALL_BANK)? tRFC : tRFCpb;
+    uint64_t refreshDoneCycle = minRefreshCycle + refreshLat;
+    assert(refreshLat >= tRP);
     for (auto& rankBanks : banks) {
-        for (auto& bank : rankBanks) {
+        for (uint32_t b = 0; b < banksPerRank; b++) {
+            if (!refreshed(b)) continue;
+            Bank& bank = rankBanks[b];
             // Close and force the ACT to happen at least at tRFC
             // PRE <-tRP-> ACT, so discount tRP
             bank.minPreCycle = refreshDoneCycle - tRP;
@@ -652,20 +726,150 @@ void DDRMemory::refresh(uint64_t sysCycle) {
         }
     }
 
+    if (refreshMode == REF_PER_BANK) nextRefreshBank = (nextRefreshBank + 1) % banksPerRank;
+    else if (refreshMode == REF_SAME_BANK) nextRefreshBank = (nextRefreshBank + 1) % (banksPerRank/bankGroups);
+
     DEBUG("Refresh %ld start %ld done %ld", memCycle, minRefreshCycle, refreshDoneCycle);
 }
 
 
 /* Tech/Device timing parameters */
 
-void DDRMemory::initTech(const char* techName) {
+void DDRMemory::initTech(const char* techName, const char* refreshName) {
     std::string tech(techName);
     double tCK;
 
-    // tBL's below are for 64-byte lines; we adjust as needed
+    // Defaults for technologies without bank groups or fine-grained refresh
+    uint32_t techBanksPerRank = 8;
+    bankGroups = 1;
+    tCCD_S = tCCD_L = tRRD_S = tRRD_L = tWTR_S = 0;
+    tRFCpb = 0;
+    RefreshMode fineRefresh = REF_ALL_BANK;  // fine-grained refresh mode supported, if any
+    RefreshMode defRefresh = REF_ALL_BANK;
 
-    // Please keep this orderly; go from faster to slower technologies
-    if (tech == "DDR3-1333-CL10") {
+    // tBL's below are for 64-byte lines; we adjust as needed
+    // With bank groups, tRRD and tWTR are the same-group (_L) values
+
+    // Please keep this orderly; go from faster to slower technologies (by data rate, then CAS latency in ns)
+    if (tech == "DDR5-6400-CL52") {
+        // One 32-bit subchannel (BL16), 16Gb x8 devices
+        tCK = 0.3125;
+        tBL = 8;
+        tCL = 52;
+        tRCD = 52;
+        tRTP = 24;
+        tRP = 52;
+        tRRD = 16;
+        tRAS = 103;
+        tFAW = 34;
+        tWTR = 32;
+        tWR = 96;
+        tRFC = 944;
+        tREFI = 12480;
+        tCCD_S = 8;
+        tCCD_L = 16;
+        tRRD_S = 8;
+        tRRD_L = 16;
+        tWTR_S = 8;
+        tRFCpb = 416;  // REFsb
+        bankGroups = 8;
+        techBanksPerRank = 32;
+        fineRefresh = REF_SAME_BANK;
+    } else if (tech == "LPDDR5-6400") {
+        // One 16-bit channel in bank group mode (BL32 per 64-byte line), CK = WCK/4 = 800 MHz
+        tCK = 1.25;
+        tBL = 4;
+        tCL = 17;
+        tRCD = 15;
+        tRTP = 6;
+        tRP = 15;
+        tRRD = 4;
+        tRAS = 34;
+        tFAW = 16;
+        tWTR = 10;
+        tWR = 28;
+        tRFC = 224;
+        tREFI = 3120;
+        tCCD_S = 4;
+        tCCD_L = 8;
+        tRRD_S = 4;
+        tRRD_L = 4;
+        tWTR_S = 5;
+        tRFCpb = 112;
+        bankGroups = 4;
+        techBanksPerRank = 16;
+        fineRefresh = defRefresh = REF_PER_BANK;
+    } else if (tech == "DDR5-4800-CL40") {
+        // One 32-bit subchannel (BL16), 16Gb x8 devices
+        tCK = 0.4167;
+        tBL = 8;
+        tCL = 40;
+        tRCD = 39;
+        tRTP = 18;
+        tRP = 39;
+        tRRD = 12;
+        tRAS = 77;
+        tFAW = 32;
+        tWTR = 24;
+        tWR = 72;
+        tRFC = 708;
+        tREFI = 9360;
+        tCCD_S = 8;
+        tCCD_L = 12;
+        tRRD_S = 8;
+        tRRD_L = 12;
+        tWTR_S = 6;
+        tRFCpb = 312;  // REFsb
+        bankGroups = 8;
+        techBanksPerRank = 32;
+        fineRefresh = REF_SAME_BANK;
+    } else if (tech == "DDR4-3200-CL22") {
+        // 8Gb x8 devices
+        tCK = 0.625;
+        tBL = 4;
+        tCL = 22;
+        tRCD = 22;
+        tRTP = 12;
+        tRP = 22;
+        tRRD = 8;
+        tRAS = 52;
+        tFAW = 34;
+        tWTR = 12;
+        tWR = 24;
+        tRFC = 560;
+        tREFI = 12480;
+        tCCD_S = 4;
+        tCCD_L = 8;
+        tRRD_S = 4;
+        tRRD_L = 8;
+        tWTR_S = 4;
+        bankGroups = 4;
+        techBanksPerRank = 16;
+    } else if (tech == "HBM2e-3200") {
+        // One pseudo-channel (64 bits, BL4), 8Gb dies; from JESD235C-class datasheets
+        tCK = 0.625;
+        tBL = 4;  // two BL4 bursts per 64-byte line
+        tCL = 23;
+        tRCD = 23;
+        tRTP = 8;
+        tRP = 23;
+        tRRD = 6;
+        tRAS = 53;
+        tFAW = 26;
+        tWTR = 12;
+        tWR = 26;
+        tRFC = 560;
+        tREFI = 6240;
+        tCCD_S = 2;
+        tCCD_L = 6;
+        tRRD_S = 4;
+        tRRD_L = 6;
+        tWTR_S = 4;
+        tRFCpb = 256;
+        bankGroups = 4;
+        techBanksPerRank = 16;
+        fineRefresh = defRefresh = REF_PER_BANK;
+    } else if (tech == "DDR3-1333-CL10") {
         // from DRAMSim2/ini/DDR3_micron_16M_8B_x4_sg15.ini (Micron)
         tCK = 1.5;  // ns; all other in mem cycles
         tBL = 4;
@@ -718,6 +922,18 @@ void DDRMemory::initTech(const char* techName) {
     // Check all params were set
     assert(tCK > 0.0);
     assert(tBL && tCL && tRCD && tRTP && tRP && tRRD && tRAS && tFAW && tWTR && tWR && tRFC && tREFI);
+    assert(bankGroups == 1 || (tCCD_S && tCCD_L && tRRD_S && tRRD_L && tWTR_S));
+    assert(fineRefresh == REF_ALL_BANK || tRFCpb);
+
+    if (!banksPerRank) banksPerRank = techBanksPerRank;
+
+    std::string refresh(refreshName);
+    if (refresh == "") refreshMode = defRefresh;
+    else if (refresh == "allBank") refreshMode = REF_ALL_BANK;
+    else if (refresh == "perBank") refreshMode = REF_PER_BANK;
+    else if (refresh == "sameBank") refreshMode = REF_SAME_BANK;
+    else panic("Invalid refresh mode %s (allBank, perBank or sameBank)", refreshName);
+    if (refreshMode != REF_ALL_BANK && refreshMode != fineRefresh) panic("Technology %s does not support %s refresh", techName, refreshName);
 
     if (isPow2(lineSize) && lineSize >= 64) {
         tBL = lineSize*tBL/64;
@@ -730,5 +946,19 @@ void DDRMemory::initTech(const char* techName) {
     }
 
     memFreqKHz = (uint64_t)(1e9/tCK/1e3);
+
+    // Scheduling works on system cycles, so it needs memory clocks slower than
+    // half the system clock. For faster technologies, run the controller in
+    // gear-down mode, as DDR4/DDR5 controllers do: each controller clock is
+    // gear memory clocks, and timings are rounded up to controller clocks.
+    gear = 1;
+    while (memFreqKHz/gear >= sysFreqKHz/2) gear *= 2;
+    if (gear > 1) {
+        for (uint32_t* t : {&tBL, &tCL, &tRCD, &tRTP, &tRP, &tRRD, &tRAS, &tFAW, &tWTR, &tWR, &tRFC, &tREFI,
+                &tCCD_S, &tCCD_L, &tRRD_S, &tRRD_L, &tWTR_S, &tRFCpb}) {
+            *t = (*t + gear - 1)/gear;
+        }
+        memFreqKHz /= gear;
+    }
 }
 
@@ -26,9 +26,11 @@
 #ifndef DDR_MEM_H_
 #define DDR_MEM_H_
 
+#include <algorithm>
 #include <deque>
 
 #include "g_std/g_string.h"
+#include "g_std/g_vector.h"
 #include "intrusive_list.h"
 #include "memory_hierarchy.h"
 #include "pad.h"
@@ -38,25 +40,38 @@
 /* Helper data structures */
 
 /* Efficiently track the activation window: A circular buffer that stores the
- * next allowed cycle we're allowed to issue an activation
+ * next allowed cycle we're allowed to issue an activation. Also tracks the
+ * last activation to the rank and to each bank group, for tRRD_S/tRRD_L.
  */
 class ActWindow {
     private:
         g_vector<uint64_t> buf;
         uint32_t idx;
+        uint64_t lastAct;
+        g_vector<uint64_t> lastGroupAct;
 
     public:
-        void init(uint32_t size) {
+        void init(uint32_t size, uint32_t bankGroups) {
             buf.resize(size);
             for (uint32_t i = 0; i < size; i++) buf[i] = 0;
             idx = 0;
+            lastAct = 0;
+            lastGroupAct.resize(bankGroups, 0);
         }
 
         inline uint64_t minActCycle() const {
             return buf[idx];
         }
 
-        inline void addActivation(uint64_t actCycle) {
+        // ACTs to different bank groups are spaced by tRRD_S, and to the same group by tRRD_L
+        inline uint64_t minGroupActCycle(uint32_t group, uint32_t tRRD_S, uint32_t tRRD_L) const {
+            return std::max(lastAct + tRRD_S, lastGroupAct[group] + tRRD_L);
+        }
+
+        inline void addActivation(uint64_t actCycle, uint32_t group) {
+            lastAct = std::max(lastAct, actCycle);
+            lastGroupAct[group] = std::max(lastGroupAct[group], actCycle);
+
             assert(buf[idx] <= actCycle); // o/w we have violated tTAW/tFAW and more...
 
             // We need to reorder rank ACT commands, which may happen somewhat out of order
@@ -78,54 +93,106 @@ class ActWindow {
         inline uint32_t dec(uint32_t i) const { return i? i-1 : buf.size()-1; }
 };
 
-// Read or write queues, ordered/inserted by arrival time, out-of-order finish
+// Read or write queue storage. Requests finish out of order; FR-FCFS order is
+// kept by the per-bank lists, and arrival order by each request's sequence number
 template <typename T>
 class RequestQueue {
     private:
-        struct Node : InListNode<Node> {
-            T elem;
-        };
-        InList<Node> reqList;  // FIFO
-        InList<Node> freeList; // LIFO (higher locality)
+        g_vector<T*> freeList; // LIFO (higher locality)
+        size_t capacity;
 
     public:
+        RequestQueue() : capacity(0) {}
+
         void init(size_t size) {
-            assert(reqList.empty() && freeList.empty());
-            Node* buf = gm_calloc<Node>(size);
+            assert(!capacity);
+            T* buf = gm_calloc<T>(size);
             for (uint32_t i = 0; i < size; i++) {
-                new (&buf[i]) Node();
+                new (&buf[i]) T();
                 freeList.push_back(&buf[i]);
             }
+            capacity = size;
         }
 
-        inline bool empty() const { return reqList.empty(); }
+        inline bool empty() const { return freeList.size() == capacity; }
         inline bool full() const { return freeList.empty(); }
-        inline size_t size() const { return reqList.size(); }
+        inline size_t size() const { return capacity - freeList.size(); }
 
         inline T* alloc() {
             assert(!full());
-            Node* n = freeList.back();
+            T* e = freeList.back();
             freeList.pop_back();
-            reqList.push_back(n);
-            return &n->elem;
+            return e;
+        }
+
+        inline void remove(T* e) {
+            assert(!empty());
+            freeList.push_back(e);
         }
+};
 
-        struct iterator {
-            Node* n;
-            explicit inline iterator(Node* _n) : n(_n) {}
-            inline void inc() {n = n->next;}  // overloading prefix/postfix too messy
-            inline T* operator*() const { return &(n->elem); }
-            inline bool operator==(const iterator& it) const { return it.n == n; }
-            inline bool operator!=(const iterator& it) const { return it.n != n; }
+/* Finds the last request to a given row in a bank queue, so that FR-FCFS
+ * insertion does not scan the queue. Open addressing with linear probing and
+ * backward-shift deletion; holds at most one entry per queued request, so it
+ * is sized to never fill up and never allocates after init.
+ */
+template <typename T>
+class RowIndex {
+    private:
+        struct Entry {
+            uint64_t row;
+            uint32_t queue;
+            T* last;  // nullptr if free
         };
+        g_vector<Entry> table;
+        uint32_t mask;
 
-        inline iterator begin() const {return iterator(reqList.front());}
-        inline iterator end() const {return iterator(nullptr);}
+        inline uint32_t hash(uint32_t queue, uint64_t row) const {
+            return (((row * 0x9E3779B97F4A7C15ul) ^ (queue * 0xC2B2AE3D27D4EB4Ful)) >> 32) & mask;
+        }
+
+        inline uint32_t findSlot(uint32_t queue, uint64_t row) const {
+            uint32_t i = hash(queue, row);
+            while (table[i].last && (table[i].row != row || table[i].queue != queue)) i = (i + 1) & mask;
+            return i;
+        }
 
-        inline void remove(iterator i) {
-            assert(i.n);
-            reqList.remove(i.n);
-            freeList.push_back(i.n);
+    public:
+        void init(uint32_t maxEntries) {
+            uint32_t size = 1;
+            while (size < 2*maxEntries) size <<= 1;
+            Entry empty = {0, 0, nullptr};
+            table.resize(size, empty);
+            mask = size - 1;
+        }
+
+        inline T* find(uint32_t queue, uint64_t row) const {
+            return table[findSlot(queue, row)].last;
+        }
+
+        inline void set(uint32_t queue, uint64_t row, T* last) {
+            Entry& e = table[findSlot(queue, row)];
+            e.row = row;
+            e.queue = queue;
+            e.last = last;
+        }
+
+        void erase(uint32_t queue, uint64_t row) {
+            uint32_t i = findSlot(queue, row);
+            assert(table[i].last);
+            uint32_t j = i;
+            while (true) {
+                j = (j + 1) & mask;
+                if (!table[j].last) break;
+                // Move j back into the hole unless its home slot lies cyclically in (i, j]
+                uint32_t k = hash(table[j].queue, table[j].row);
+                bool stays = (i <= j)? (i < k && k <= j) : (i < k || k <= j);
+                if (!stays) {
+                    table[i] = table[j];
+                    i = j;
+                }
+            }
+            table[i].last = nullptr;
         }
 };
 
@@ -149,6 +216,7 @@ class DDRMemory : public MemObject {
             bool write;
 
             uint64_t rowHitSeq; // sequence number used to throttle max # row hits
+            uint64_t seq;  // arrival order in the read or write queue, breaks FR-FCFS ties across banks
 
             // Cycle accounting
             uint64_t arrivalCycle;  // in memCycles
@@ -186,13 +254,17 @@ class DDRMemory : public MemObject {
         bool lastCmdWasWrite;
 
         static const uint32_t JEDEC_BUS_WIDTH = 64;
-        const uint32_t lineSize, ranksPerChannel, banksPerRank;
+        const uint32_t lineSize, ranksPerChannel;
+        uint32_t banksPerRank;  // 0 in the constructor selects the technology's default
+        uint32_t bankGroups;    // 1 for technologies without bank groups
         const uint32_t controllerSysLatency;  // in sysCycles
         const uint32_t queueDepth;
         const uint32_t rowHitLimit; // row hits not prioritized in FR-FCFS beyond this point
         const bool deferredWrites;
         const bool closedPage;
         const uint32_t domain;
+        uint32_t weaveNode; //only valid if zinfo->domainProfiler
+        uint16_t traceComp; //only valid if zinfo->reqTracer
 
         // DRAM timing parameters -- initialized in initTech()
         // All parameters are in memory clocks (multiples of tCK)
@@ -209,6 +281,22 @@ class DDRMemory : public MemObject {
         uint32_t tRFC;   // Refresh to ACT (refresh leaves rows closed)
         uint32_t tREFI;  // Refresh interval
 
+        // Bank group parameters, only used if bankGroups > 1 (tRRD and tWTR above are the same-group values)
+        uint32_t tCCD_S; // RD/WR to RD/WR, different bank group
+        uint32_t tCCD_L; // RD/WR to RD/WR, same bank group
+        uint32_t tRRD_S; // ACT to ACT, different bank group
+        uint32_t tRRD_L; // ACT to ACT, same bank group
+        uint32_t tWTR_S; // end of WR burst to RD command, different bank group
+
+        // Per-bank (REFpb) or same-bank (DDR5 REFsb) refresh to ACT; 0 if unsupported
+        uint32_t tRFCpb;
+
+        enum RefreshMode {REF_ALL_BANK, REF_PER_BANK, REF_SAME_BANK};
+        RefreshMode refreshMode;
+        uint32_t nextRefreshBank;  // REF_PER_BANK: bank; REF_SAME_BANK: bank index within each group
+
+        uint32_t gear;  // memory clocks per controller clock, see initTech()
+
         // Address mapping information
         uint32_t colShift, colMask;
         uint32_t rankShift, rankMask;
@@ -221,9 +309,17 @@ class DDRMemory : public MemObject {
 
         RequestQueue<Request> rdQueue, wrQueue;
         std::deque<Request> overflowQueue;
+        uint64_t nextReqSeq;
+
+        // Per-bank queue indexes: last request per row, and bitmaps of banks
+        // (rank*banksPerRank + bank) with non-empty read or write queues
+        RowIndex<Request> rowIndex;
+        g_vector<uint64_t> rdPendingBanks, wrPendingBanks;
 
         g_vector< g_vector<Bank> > banks; // indexed by rank, bank
         g_vector<ActWindow> rankActWindows;
+        g_vector<uint64_t> groupLastCmdCycle;  // RD/WR commands, indexed by rank*bankGroups + group
+        uint32_t lastCmdGroup;
 
         // Event scheduling
         SchedEvent* nextSchedEvent;
@@ -239,6 +335,7 @@ class DDRMemory : public MemObject {
         Counter profReadHits, profWriteHits;  // row buffer hits
         VectorCounter latencyHist;
         static const uint32_t BINSIZE = 10, NUMBINS = 100;
+        LatencyHistogram profRdLatHist;
         PAD();
 
         //In KHz, though it does not matter so long as they are consistent and fine-grain enough (not Hz because we multiply
@@ -259,7 +356,7 @@ class DDRMemory : public MemObject {
 
     public:
         DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerChannel, uint32_t _banksPerRank,
-            uint32_t _sysFreqMHz, const char* tech, const char* addrMapping, uint32_t _controllerSysLatency,
+            uint32_t _sysFreqMHz, const char* tech, const char* refresh, const char* addrMapping, uint32_t _controllerSysLatency,
             uint32_t _queueDepth, uint32_t _rowHitLimit, bool _deferredWrites, bool _closedPage,
             uint32_t _domain, g_string& _name);
 
@@ -281,11 +378,20 @@ class DDRMemory : public MemObject {
         AddrLoc mapLineAddr(Address lineAddr);
 
         void queue(Request* req, uint64_t memCycle);
+        Request* allocRequest(bool write);
+
+        // Bank queues are numbered 2*(rank*banksPerRank + bank) + (is write queue)
+        inline uint32_t bankQueueIdx(const AddrLoc& loc, bool wrQueue) const {
+            return 2*(loc.rank*banksPerRank + loc.bank) + (wrQueue? 1 : 0);
+        }
 
         inline uint64_t trySchedule(uint64_t curCycle, uint64_t sysCycle);
         uint64_t findMinCmdCycle(const Request& r) const;
 
-        void initTech(const char* tech);
+        inline uint32_t bankGroup(const AddrLoc& loc) const { return loc.bank % bankGroups; }  // low bank bits interleave groups
+        inline uint32_t rankGroupIdx(const AddrLoc& loc) const { return loc.rank*bankGroups + bankGroup(loc); }
+
+        void initTech(const char* tech, const char* refresh);
 };
 
 
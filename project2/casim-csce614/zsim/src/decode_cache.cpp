@@ -0,0 +1,190 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "decode_cache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log.h"
+
+#define DECODE_CACHE_MAGIC (0x7a73696d64656331L)  // "zsimdec1"
+#define DECODE_CACHE_VERSION (1)
+
+struct DecodeCache::Header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t uopBytes;
+    uint64_t fileBytes;
+    uint64_t numSlots;  // power of 2
+    uint64_t heapStart;
+    volatile uint64_t heapTop;
+    volatile uint64_t entries;
+};
+
+DecodeCache::DecodeCache(const char* file, uint64_t fileBytes) : header(nullptr), slots(nullptr), base(nullptr), fd(-1) {
+    fd = open(file, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        warn("Decode cache: could not open %s, disabled", file);
+        return;
+    }
+
+    lockFile(F_WRLCK);
+    struct stat st;
+    if (fstat(fd, &st) != 0) panic("Decode cache: fstat(%s) failed", file);
+    bool create = (st.st_size == 0);
+    if (create) {
+        if (ftruncate(fd, fileBytes) != 0) panic("Decode cache: could not size %s to %ld bytes", file, fileBytes);
+    } else {
+        fileBytes = st.st_size;
+    }
+
+    void* m = mmap(nullptr, fileBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED) panic("Decode cache: mmap of %s failed", file);
+    base = static_cast<uint8_t*>(m);
+    Header* h = reinterpret_cast<Header*>(base);
+
+    if (create) {
+        // Average entries are a few hundred bytes; keep the table at most half full
+        uint64_t numSlots = 1;
+        while (numSlots < fileBytes/256) numSlots <<= 1;
+        h->magic = DECODE_CACHE_MAGIC;
+        h->version = DECODE_CACHE_VERSION;
+        h->uopBytes = sizeof(DynUop);
+        h->fileBytes = fileBytes;
+        h->numSlots = numSlots;
+        h->heapStart = sizeof(Header) + numSlots*sizeof(uint64_t);
+        h->heapTop = h->heapStart;
+        h->entries = 0;
+        if (h->heapStart >= fileBytes) panic("Decode cache: %ld bytes is too small", fileBytes);
+    }
+
+    bool valid = h->magic == DECODE_CACHE_MAGIC && h->version == DECODE_CACHE_VERSION &&
+        h->uopBytes == sizeof(DynUop) && h->fileBytes == fileBytes;
+    lockFile(F_UNLCK);
+
+    if (!valid) {
+        // Other runs may be using it, so never reinitialize an existing file
+        warn("Decode cache: %s was written by an incompatible zsim version, disabled (remove it to rebuild)", file);
+        munmap(base, fileBytes);
+        base = nullptr;
+        close(fd);
+        fd = -1;
+        return;
+    }
+
+    header = h;
+    slots = reinterpret_cast<volatile uint64_t*>(base + sizeof(Header));
+    info("Decode cache: %s, %ld entries, %ld/%ld MB used", file, header->entries,
+            header->heapTop >> 20, header->fileBytes >> 20);
+}
+
+void DecodeCache::lockFile(short type) {
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;  // l_start = l_len = 0 covers the whole file
+    while (fcntl(fd, F_SETLKW, &fl) != 0) {
+        if (errno != EINTR) panic("Decode cache: fcntl lock failed (%d)", errno);
+    }
+}
+
+uint64_t DecodeCache::hashKey(const uint8_t* code, uint32_t codeBytes, uint32_t instrs, uint32_t blockOffset) {
+    uint64_t h = 0xcbf29ce484222325L;  // FNV-1a
+    for (uint32_t i = 0; i < codeBytes; i++) {
+        h ^= code[i];
+        h *= 0x100000001b3L;
+    }
+    h ^= (((uint64_t)instrs) << 8) | blockOffset;
+    h *= 0x100000001b3L;
+    return h ^ (h >> 29);
+}
+
+bool DecodeCache::matches(const Entry* e, uint64_t key, const uint8_t* code, uint32_t codeBytes, uint32_t instrs, uint32_t blockOffset) const {
+    return e->key == key && e->codeBytes == codeBytes && e->instrs == instrs &&
+        e->blockOffset == blockOffset && memcmp(e->code(), code, codeBytes) == 0;
+}
+
+const DecodeCache::Entry* DecodeCache::lookup(const uint8_t* code, uint32_t codeBytes, uint32_t instrs, uint32_t blockOffset) const {
+    if (!header) return nullptr;
+    uint64_t key = hashKey(code, codeBytes, instrs, blockOffset);
+    uint64_t mask = header->numSlots - 1;
+    for (uint64_t i = 0; i < header->numSlots; i++) {
+        uint64_t off = slots[(key + i) & mask];
+        if (!off) return nullptr;
+        const Entry* e = reinterpret_cast<const Entry*>(base + off);
+        if (matches(e, key, code, codeBytes, instrs, blockOffset)) return e;
+    }
+    return nullptr;
+}
+
+void DecodeCache::insert(const uint8_t* code, uint32_t codeBytes, uint32_t instrs, uint32_t blockOffset,
+        const DynUop* uops, uint32_t numUops, uint32_t approxInstrs)
+{
+    if (!header) return;
+    uint64_t key = hashKey(code, codeBytes, instrs, blockOffset);
+    uint64_t mask = header->numSlots - 1;
+    uint64_t entryBytes = sizeof(Entry) + ((codeBytes + 7) & ~7) + numUops*sizeof(DynUop);
+    entryBytes = (entryBytes + 7) & ~7;
+
+    lockFile(F_WRLCK);
+    if (header->heapTop + entryBytes > header->fileBytes || 2*(header->entries + 1) > header->numSlots) {
+        static bool warned = false;
+        if (!warned) warn("Decode cache is full, not caching new BBLs (increase sim.decodeCacheMB)");
+        warned = true;
+        lockFile(F_UNLCK);
+        return;
+    }
+
+    // Re-probe under the lock; another process may have inserted this BBL
+    uint64_t idx = key & mask;
+    while (slots[idx]) {
+        const Entry* e = reinterpret_cast<const Entry*>(base + slots[idx]);
+        if (matches(e, key, code, codeBytes, instrs, blockOffset)) {
+            lockFile(F_UNLCK);
+            return;
+        }
+        idx = (idx + 1) & mask;
+    }
+
+    uint64_t off = header->heapTop;
+    Entry* e = reinterpret_cast<Entry*>(base + off);
+    e->key = key;
+    e->codeBytes = codeBytes;
+    e->instrs = instrs;
+    e->blockOffset = blockOffset;
+    e->approxInstrs = approxInstrs;
+    e->uops = numUops;
+    e->pad = 0;
+    memcpy(const_cast<uint8_t*>(e->code()), code, codeBytes);
+    memcpy(const_cast<DynUop*>(e->uop()), uops, numUops*sizeof(DynUop));
+    header->heapTop = off + entryBytes;
+    header->entries++;
+    __sync_synchronize();  // entry must be visible before we publish it to lock-free readers
+    slots[idx] = off;
+    lockFile(F_UNLCK);
+}
@@ -0,0 +1,83 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DECODE_CACHE_H_
+#define DECODE_CACHE_H_
+
+#include <stdint.h>
+#include "decoder.h"
+
+/* Persistent, content-addressed cache of decoded BBLs (sim.decodeCache).
+ *
+ * Every process of a run decodes each BBL into uops whenever Pin JITs a trace,
+ * and every run of a sweep does it again. This cache keeps decoded BBLs in a
+ * file that all processes mmap. Entries are keyed by the BBL's code bytes, its
+ * offset within a 16-byte fetch block (the predecoder model depends on it) and
+ * its instruction count, so they stay valid across ASLR, processes and runs as
+ * long as the decoder does not change (bump DECODE_CACHE_VERSION if it does).
+ *
+ * Lookups are lock-free. Inserts are serialized across processes with an
+ * fcntl() lock, which the kernel drops if the holder dies; within a process,
+ * Pin already serializes instrumentation callbacks. Once the file is full, we
+ * simply stop inserting.
+ */
+class DecodeCache {
+    public:
+        struct Entry {
+            uint64_t key;
+            uint32_t codeBytes;
+            uint32_t instrs;
+            uint32_t blockOffset;
+            uint32_t approxInstrs;
+            uint32_t uops;
+            uint32_t pad;
+            // Followed by codeBytes of code, padded to 8 bytes, then uops DynUops
+
+            const uint8_t* code() const { return reinterpret_cast<const uint8_t*>(this + 1); }
+            const DynUop* uop() const { return reinterpret_cast<const DynUop*>(code() + ((codeBytes + 7) & ~7)); }
+        };
+
+    private:
+        struct Header;
+
+        Header* header;
+        volatile uint64_t* slots;
+        uint8_t* base;
+        int fd;
+
+    public:
+        DecodeCache(const char* file, uint64_t fileBytes);
+
+        const Entry* lookup(const uint8_t* code, uint32_t codeBytes, uint32_t instrs, uint32_t blockOffset) const;
+        void insert(const uint8_t* code, uint32_t codeBytes, uint32_t instrs, uint32_t blockOffset,
+                const DynUop* uops, uint32_t numUops, uint32_t approxInstrs);
+
+    private:
+        static uint64_t hashKey(const uint8_t* code, uint32_t codeBytes, uint32_t instrs, uint32_t blockOffset);
+        bool matches(const Entry* e, uint64_t key, const uint8_t* code, uint32_t codeBytes, uint32_t instrs, uint32_t blockOffset) const;
+        void lockFile(short type);
+};
+
+#endif  // DECODE_CACHE_H_
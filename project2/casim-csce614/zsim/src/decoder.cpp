@@ -32,6 +32,7 @@
 #include <string>
 #include <vector>
 #include "core.h"
+#include "decode_cache.h"
 #include "locks.h"
 #include "log.h"
 
@@ -1297,12 +1298,52 @@ static std::vector<uint32_t>* bblApproxOpcodes[MAX_BBLS];
 
 #endif
 
+static DecodeCache* decodeCache = nullptr;  // process-local, but the file it maps is shared
+
+void Decoder::initDecodeCache(const char* file, uint32_t sizeMB) {
+    assert(!decodeCache);
+    decodeCache = new DecodeCache(file, ((uint64_t)sizeMB) << 20);
+}
+
+static BblInfo* allocOOOBbl(ADDRINT bblAddr, const DynUop* uops, uint32_t numUops, uint32_t approxInstrs) {
+    uint32_t objBytes = offsetof(BblInfo, oooBbl) + DynBbl::bytes(numUops);
+    BblInfo* bblInfo = static_cast<BblInfo*>(gm_malloc(objBytes));  // can't use type-safe interface
+
+    DynBbl& dynBbl = bblInfo->oooBbl[0];
+    dynBbl.addr = bblAddr;
+    dynBbl.uops = numUops;
+    dynBbl.approxInstrs = approxInstrs;
+    for (uint32_t i = 0; i < numUops; i++) dynBbl.uop[i] = uops[i];
+    return bblInfo;
+}
+
 BblInfo* Decoder::decodeBbl(BBL bbl, bool oooDecoding) {
     uint32_t instrs = BBL_NumIns(bbl);
     uint32_t bytes = BBL_Size(bbl);
     BblInfo* bblInfo;
 
     if (oooDecoding) {
+#ifndef BBL_PROFILING
+        //Decode cache lookup, keyed by code contents (BBL_PROFILING needs the full decode)
+        std::vector<uint8_t> code;
+        ADDRINT bblAddr = BBL_Address(bbl);
+        uint32_t blockOffset = bblAddr & 0xf;
+        if (decodeCache) {
+            code.resize(bytes);
+            if (PIN_SafeCopy(&code[0], (const VOID*)bblAddr, bytes) != bytes) {
+                code.clear();  // unreadable code, just decode it
+            } else {
+                const DecodeCache::Entry* e = decodeCache->lookup(&code[0], bytes, instrs, blockOffset);
+                if (e) {
+                    bblInfo = allocOOOBbl(bblAddr, e->uop(), e->uops, e->approxInstrs);
+                    bblInfo->instrs = instrs;
+                    bblInfo->bytes = bytes;
+                    return bblInfo;
+                }
+            }
+        }
+#endif
+
         //Decode BBL
         uint32_t approxInstrs = 0;
         uint32_t curIns = 0;
@@ -1456,18 +1497,13 @@ BblInfo* Decoder::decodeBbl(BBL bbl, bool oooDecoding) {
 
         assert(uopIdx == uopVec.size());
 
-        //Allocate
-        uint32_t objBytes = offsetof(BblInfo, oooBbl) + DynBbl::bytes(uopVec.size());
-        bblInfo = static_cast<BblInfo*>(gm_malloc(objBytes));  // can't use type-safe interface
+        //Allocate and initialize ooo part
+        bblInfo = allocOOOBbl(BBL_Address(bbl), uopVec.data(), uopVec.size(), approxInstrs);
 
-        //Initialize ooo part
+#ifndef BBL_PROFILING
+        if (!code.empty()) decodeCache->insert(&code[0], bytes, instrs, blockOffset, uopVec.data(), uopVec.size(), approxInstrs);
+#else
         DynBbl& dynBbl = bblInfo->oooBbl[0];
-        dynBbl.addr = BBL_Address(bbl);
-        dynBbl.uops = uopVec.size();
-        dynBbl.approxInstrs = approxInstrs;
-        for (uint32_t i = 0; i < dynBbl.uops; i++) dynBbl.uop[i] = uopVec[i];
-
-#ifdef BBL_PROFILING
         futex_lock(&bblIdxLock);
         dynBbl.bblIdx = bblIdx++;
         assert(dynBbl.bblIdx < MAX_BBLS);
@@ -128,6 +128,9 @@ class Decoder {
         //If oooDecoding is true, produces a DynBbl with DynUops that can be used in OOO cores
         static BblInfo* decodeBbl(BBL bbl, bool oooDecoding);
 
+        //Enables the persistent decode cache (see decode_cache.h); call once per process
+        static void initDecodeCache(const char* file, uint32_t sizeMB);
+
 #ifdef BBL_PROFILING
         static void profileBbl(uint64_t bblIdx);
         static void dumpBblProfile();
@@ -24,6 +24,7 @@
  */
 
 #include "detailed_mem.h"
+#include "host_prof.h"
 #include "zsim.h"
 #include "tick_event.h"
 #include <algorithm>
@@ -1100,6 +1101,7 @@ void MemControllerBase::TickScheduler(uint64_t sysCycle) {
 }
 
 uint64_t MemControllerBase::access(MemReq& req) {
+    HostProfScope hps(HP_MEM);
     switch (req.type) {
         case PUTS:
         case PUTX:
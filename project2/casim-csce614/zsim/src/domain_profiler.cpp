@@ -0,0 +1,185 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "domain_profiler.h"
+#include <algorithm>
+#include <fstream>
+#include <vector>
+#include "contention_sim.h"
+#include "profile_stats.h"
+#include "zsim.h"
+
+DomainProfiler::DomainProfiler(uint32_t _numDomains, double _imbalance)
+    : edges(nullptr), numNodes(0), numDomains(_numDomains), imbalance(_imbalance)
+{
+    assert(numDomains > 0);
+    assert(imbalance >= 1.0);
+}
+
+uint32_t DomainProfiler::registerNode(const g_string& name, NodeType type, uint32_t domain) {
+    assert_msg(!edges, "%s: cannot register weave nodes after initialization", name.c_str());
+    assert(domain < numDomains);
+    Node n = {name, type, domain};
+    nodes.push_back(n);
+    return nodes.size() - 1;
+}
+
+void DomainProfiler::postInit() {
+    numNodes = nodes.size();
+    edges = gm_calloc<uint64_t>(MAX(numNodes*numNodes, 1u));
+    info("Domain profiler: %d weave components, %d domains", numNodes, numDomains);
+}
+
+uint64_t DomainProfiler::evaluate(const g_vector<uint32_t>& map, const g_vector<uint64_t>& load,
+        g_vector<uint64_t>& domLoad) const
+{
+    domLoad.assign(numDomains, 0);
+    uint64_t cut = 0;
+    for (uint32_t i = 0; i < numNodes; i++) {
+        domLoad[map[i]] += load[i];
+        for (uint32_t j = 0; j < numNodes; j++) {
+            if (map[i] != map[j]) cut += edges[i*numNodes + j];
+        }
+    }
+    return cut;
+}
+
+void DomainProfiler::computeAndWrite(const char* mapFile) {
+    assert(edges);
+
+    // Node load: requests sent and received. Both ends produce weave events
+    // for every request, so this tracks the weave work each node generates.
+    g_vector<uint64_t> load(numNodes, 1);  // +1 so idle nodes still get spread
+    uint64_t totalLoad = 0;
+    uint64_t totalTraffic = 0;
+    for (uint32_t i = 0; i < numNodes; i++) {
+        for (uint32_t j = 0; j < numNodes; j++) {
+            load[i] += affinity(i, j);
+            totalTraffic += edges[i*numNodes + j];
+        }
+        totalLoad += load[i];
+    }
+
+    uint64_t maxNodeLoad = *std::max_element(load.begin(), load.end());
+    uint64_t cap = MAX((uint64_t)(imbalance*totalLoad/numDomains), maxNodeLoad);
+
+    // Greedy placement, heaviest nodes first: pick the domain we have the most
+    // traffic with among those with spare capacity, else the least loaded one
+    std::vector<uint32_t> order(numNodes);
+    for (uint32_t i = 0; i < numNodes; i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&load](uint32_t a, uint32_t b) { return load[a] > load[b]; });
+
+    const uint32_t UNASSIGNED = (uint32_t)-1;
+    g_vector<uint32_t> map(numNodes, UNASSIGNED);
+    g_vector<uint64_t> domLoad(numDomains, 0);
+    g_vector<uint64_t> domAff(numDomains, 0);
+    for (uint32_t n : order) {
+        domAff.assign(numDomains, 0);
+        for (uint32_t j = 0; j < numNodes; j++) {
+            if (map[j] != UNASSIGNED) domAff[map[j]] += affinity(n, j);
+        }
+        uint32_t best = 0;
+        bool bestFits = false;
+        for (uint32_t d = 0; d < numDomains; d++) {
+            bool fits = domLoad[d] + load[n] <= cap;
+            bool better;
+            if (fits != bestFits) better = fits;
+            else if (domAff[d] != domAff[best]) better = domAff[d] > domAff[best];
+            else better = domLoad[d] < domLoad[best];
+            if (d == 0 || better) {
+                best = d;
+                bestFits = fits;
+            }
+        }
+        map[n] = best;
+        domLoad[best] += load[n];
+    }
+
+    // Refinement: move single nodes while that reduces the cut and keeps balance
+    const uint32_t MAX_PASSES = 16;
+    for (uint32_t pass = 0; pass < MAX_PASSES; pass++) {
+        uint32_t moves = 0;
+        for (uint32_t n = 0; n < numNodes; n++) {
+            domAff.assign(numDomains, 0);
+            for (uint32_t j = 0; j < numNodes; j++) {
+                if (j != n) domAff[map[j]] += affinity(n, j);
+            }
+            uint32_t cur = map[n];
+            uint32_t best = cur;
+            for (uint32_t d = 0; d < numDomains; d++) {
+                if (d == cur || domLoad[d] + load[n] > cap) continue;
+                if (domAff[d] > domAff[best]) best = d;
+            }
+            if (best != cur) {
+                domLoad[cur] -= load[n];
+                domLoad[best] += load[n];
+                map[n] = best;
+                moves++;
+            }
+        }
+        if (!moves) break;
+    }
+
+    // Predicted parallelism: total weave load over the load of the critical domain
+    g_vector<uint32_t> curMap(numNodes);
+    for (uint32_t i = 0; i < numNodes; i++) curMap[i] = nodes[i].domain;
+    g_vector<uint64_t> curDomLoad, newDomLoad;
+    uint64_t curCut = evaluate(curMap, load, curDomLoad);
+    uint64_t newCut = evaluate(map, load, newDomLoad);
+    double curPred = ((double)totalLoad)/(*std::max_element(curDomLoad.begin(), curDomLoad.end()));
+    double newPred = ((double)totalLoad)/(*std::max_element(newDomLoad.begin(), newDomLoad.end()));
+    double tt = MAX(totalTraffic, (uint64_t)1);
+
+    // Achieved parallelism: per-domain weave time over weave wall-clock time.
+    // Domain times are only tracked when each sim thread owns one domain.
+    uint64_t domNs = 0;
+    for (uint32_t d = 0; d < numDomains; d++) domNs += zinfo->contentionSim->getDomainWeaveNs(d);
+    uint64_t weaveNs = zinfo->profSimTime->count(PROF_WEAVE);
+
+    info("Domain profiler: %ld requests between %d weave components", totalTraffic, numNodes);
+    info("Domain profiler: current mapping: %.1f%% of requests cross domains, predicted weave parallelism %.2f",
+            100.0*curCut/tt, curPred);
+    if (domNs && weaveNs) {
+        info("Domain profiler: current mapping: achieved weave parallelism %.2f", ((double)domNs)/weaveNs);
+    } else {
+        info("Domain profiler: current mapping: achieved weave parallelism not available (needs sim.contentionThreads == sim.domains)");
+    }
+    info("Domain profiler: new mapping: %.1f%% of requests cross domains, predicted weave parallelism %.2f",
+            100.0*newCut/tt, newPred);
+
+    std::ofstream out(mapFile, std::ios_base::out);
+    out << "// Weave domain mapping produced by sim.profileDomains" << std::endl;
+    out << "// Profiled " << totalTraffic << " requests over " << zinfo->numPhases << " phases" << std::endl;
+    out << "// Current mapping: " << 100.0*curCut/tt << "% crossing requests, predicted parallelism " << curPred << std::endl;
+    out << "// New mapping: " << 100.0*newCut/tt << "% crossing requests, predicted parallelism " << newPred << std::endl;
+    out << "// Use: @include this file inside the sim group of the next run" << std::endl;
+    out << "domains = " << numDomains << ";" << std::endl;
+    out << "domainMap = {" << std::endl;
+    for (uint32_t i = 0; i < numNodes; i++) {
+        out << "    " << nodes[i].name << " = " << map[i] << ";" << std::endl;
+    }
+    out << "};" << std::endl;
+    info("Domain profiler: wrote mapping to %s", mapFile);
+}
@@ -0,0 +1,97 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DOMAIN_PROFILER_H_
+#define DOMAIN_PROFILER_H_
+
+#include <stdint.h>
+#include "g_std/g_string.h"
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "log.h"
+
+/* Profiles weave-phase communication between the components that produce
+ * timing events (cores, timing cache banks and weave memory controllers),
+ * and uses it to derive a domain assignment that balances weave load while
+ * minimizing domain crossings.
+ *
+ * Unlike PROFILE_CROSSINGS, which counts crossings between *domains*, this
+ * counts requests between *components* in the bound phase, so the resulting
+ * graph does not depend on the mapping currently in use. Each request from
+ * component A to component B becomes a request/response crossing pair iff A
+ * and B live in different domains.
+ *
+ * Enable with sim.profileDomains. The mapping is written as a config fragment
+ * (domains.cfg in the output dir) that can be @include'd inside the sim group
+ * of a later run; init.cpp honors sim.domainMap.<component name> overrides.
+ */
+class DomainProfiler : public GlobAlloc {
+    public:
+        enum NodeType {NODE_CORE, NODE_CACHE, NODE_MEM};
+
+    private:
+        struct Node {
+            g_string name;
+            NodeType type;
+            uint32_t domain;
+        };
+
+        g_vector<Node> nodes;
+        uint64_t* edges; //[dst*numNodes + src], allocated on postInit
+        uint32_t numNodes;
+        const uint32_t numDomains;
+        const double imbalance; //max allowed domain load over the average
+
+    public:
+        DomainProfiler(uint32_t _numDomains, double _imbalance);
+
+        // Init-time interface
+        uint32_t registerNode(const g_string& name, NodeType type, uint32_t domain);
+        void postInit(); //call after all components are registered
+
+        // Bound-phase interface. Called from the destination component, so
+        // most updates are already serialized by its locks; memory
+        // controllers are not, so we always use atomics (profiling only).
+        inline void recordEdge(uint32_t src, uint32_t dst) {
+            if (src == dst) return;
+            assert(edges && src < numNodes && dst < numNodes);
+            __sync_fetch_and_add(&edges[dst*numNodes + src], 1);
+        }
+
+        // Computes a new mapping from the traffic profiled so far, writes the
+        // config fragment to mapFile, and logs predicted vs achieved parallelism
+        void computeAndWrite(const char* mapFile);
+
+    private:
+        uint64_t affinity(uint32_t a, uint32_t b) const {
+            return edges[a*numNodes + b] + edges[b*numNodes + a];
+        }
+
+        // Sum of node loads per domain and total cut traffic for a mapping
+        uint64_t evaluate(const g_vector<uint32_t>& map, const g_vector<uint64_t>& load,
+                g_vector<uint64_t>& domLoad) const;
+};
+
+#endif  // DOMAIN_PROFILER_H_
@@ -0,0 +1,259 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dram_cache.h"
+#include "event_recorder.h"
+#include "host_prof.h"
+#include "timing_event.h"
+#include "zsim.h"
+
+DRAMCache::DRAMCache(MemObject* _mem, MemObject* _cacheMem, uint64_t capacityLines, uint32_t _ways, bool _alloy,
+        uint32_t tagCacheEntries, uint32_t _tagCacheLatency, const g_string& _name)
+    : mem(_mem), cacheMem(_cacheMem), name(_name), alloy(_alloy), ways(_alloy? 1 : _ways),
+      numSets(capacityLines/(_alloy? 1 : _ways)), tagCacheLatency(_tagCacheLatency), accessCount(0)
+{
+    if (!ways) panic("%s: need at least one way", name.c_str());
+    if (!numSets) panic("%s: capacity is smaller than a set", name.c_str());
+    if (!alloy) {
+        if (!tagCacheEntries) panic("%s: set-associative DRAM caches need a tag cache", name.c_str());
+        tagCache.resize(tagCacheEntries, 0);
+    }
+    futex_init(&lock);
+    info("%s: %s DRAM cache, %ld sets x %d ways, backed by %s", name.c_str(), alloy? "Alloy" : "set-associative",
+            numSets, ways, mem->getName());
+}
+
+void DRAMCache::initStats(AggregateStat* parentStat) {
+    AggregateStat* cacheStat = new AggregateStat();
+    cacheStat->init(name.c_str(), "DRAM cache stats");
+    profGETHit.init("hGET", "GET hits"); cacheStat->append(&profGETHit);
+    profGETMiss.init("mGET", "GET misses"); cacheStat->append(&profGETMiss);
+    profPUTXHit.init("hPUTX", "Dirty writebacks that hit (written to the cache)"); cacheStat->append(&profPUTXHit);
+    profPUTXMiss.init("mPUTX", "Dirty writebacks that miss (forwarded to memory)"); cacheStat->append(&profPUTXMiss);
+    profFills.init("fills", "Lines filled on GET misses"); cacheStat->append(&profFills);
+    profDirtyEvictions.init("dirtyEvs", "Dirty victims written back to memory"); cacheStat->append(&profDirtyEvictions);
+    profTagCacheHits.init("tcHits", "Tag cache hits"); cacheStat->append(&profTagCacheHits);
+    profTagCacheMisses.init("tcMisses", "Tag cache misses (tag reads from DRAM)"); cacheStat->append(&profTagCacheMisses);
+    profCacheReads.init("cacheRd", "Line reads from the cache's DRAM (tags, data, victims)"); cacheStat->append(&profCacheReads);
+    profCacheWrites.init("cacheWr", "Line writes to the cache's DRAM (fills, writeback hits)"); cacheStat->append(&profCacheWrites);
+    profMemReads.init("memRd", "Line reads from memory"); cacheStat->append(&profMemReads);
+    profMemWrites.init("memWr", "Line writes to memory"); cacheStat->append(&profMemWrites);
+    profSets.init("sets", "Sets allocated in the sparse tag store"); cacheStat->append(&profSets);
+    cacheMem->initStats(cacheStat);
+    parentStat->append(cacheStat);
+    mem->initStats(parentStat);
+}
+
+// Returns the matching line, or nullptr and the LRU victim on a miss. Allocates untouched sets.
+DRAMCache::Line* DRAMCache::lookup(uint64_t set, Address lineAddr, Line** victim) {
+    auto it = setMap.find(set);
+    uint32_t first;
+    if (it == setMap.end()) {
+        first = lines.size();
+        Line invalid = {0, 0, false, false};
+        lines.resize(lines.size() + ways, invalid);
+        setMap[set] = first;
+        profSets.inc();
+    } else {
+        first = it->second;
+    }
+
+    Line* lru = &lines[first];
+    for (uint32_t w = 0; w < ways; w++) {
+        Line* l = &lines[first + w];
+        if (l->valid && l->lineAddr == lineAddr) return l;
+        if (!l->valid || (lru->valid && l->lastUse < lru->lastUse)) lru = l;
+    }
+    *victim = lru;
+    return nullptr;
+}
+
+uint64_t DRAMCache::subAccess(MemObject* target, Address lineAddr, AccessType type, uint64_t cycle, const MemReq& req, TimingRecord* rec) {
+    MESIState state = I;
+    MemReq subReq = {lineAddr, type, req.childId, &state, cycle, nullptr, state, req.srcId, 0, nullptr};
+    uint64_t respCycle = target->access(subReq);
+    EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
+    rec->clear();
+    if (evRec && evRec->hasRecord()) *rec = evRec->popRecord();
+    return respCycle;
+}
+
+uint64_t DRAMCache::access(MemReq& req) {
+    HostProfScope hps(HP_MEM);
+    switch (req.type) {
+        case PUTS:
+        case PUTX:
+            *req.state = I;
+            break;
+        case GETS:
+            *req.state = req.is(MemReq::NOEXCL)? S : E;
+            break;
+        case GETX:
+            *req.state = M;
+            break;
+        default: panic("!?");
+    }
+    if (req.type == PUTS) return req.cycle;  // clean writebacks never reach memory
+
+    bool isWrite = (req.type == PUTX);
+    uint64_t set = req.lineAddr % numSets;
+
+    // Update the tag store and tag cache
+    futex_lock(&lock);
+    bool tagCacheHit = true;
+    if (!alloy) {
+        uint64_t& tcEntry = tagCache[set % tagCache.size()];
+        tagCacheHit = (tcEntry == set + 1);
+        tcEntry = set + 1;
+        if (tagCacheHit) profTagCacheHits.inc();
+        else profTagCacheMisses.inc();
+    }
+
+    Line* victim = nullptr;
+    Line* line = lookup(set, req.lineAddr, &victim);
+    bool hit = (line != nullptr);
+    bool victimDirty = false;
+    Address victimAddr = 0;
+    uint32_t way = 0;
+    if (hit) {
+        line->lastUse = ++accessCount;
+        if (isWrite) line->dirty = true;
+        if (isWrite) profPUTXHit.inc();
+        else profGETHit.inc();
+        way = (line - &lines[0]) % ways;
+    } else if (!isWrite) {
+        victimDirty = victim->valid && victim->dirty;
+        victimAddr = victim->lineAddr;
+        victim->lineAddr = req.lineAddr;
+        victim->lastUse = ++accessCount;
+        victim->valid = true;
+        victim->dirty = false;
+        profGETMiss.inc();
+        profFills.inc();
+        if (victimDirty) profDirtyEvictions.inc();
+        way = (victim - &lines[0]) % ways;
+    } else {
+        profPUTXMiss.inc();
+    }
+    futex_unlock(&lock);
+
+    /* Timing: sub-accesses to the cache's DRAM and to memory, each waiting for
+     * the one in dep (-1: the request itself). The request responds when the
+     * last sub-access on the critical path does; fills and victim writebacks
+     * are off the critical path.
+     */
+    enum {TAG, PROBE, DATA, MEM, FILL, VICTIM_RD, VICTIM_WR, MAX_SUBS};
+    TimingRecord recs[MAX_SUBS];
+    uint64_t resps[MAX_SUBS];
+    int32_t deps[MAX_SUBS];
+    for (uint32_t i = 0; i < MAX_SUBS; i++) {
+        recs[i].clear();
+        deps[i] = -2;  // not issued
+    }
+    uint64_t startCycle = req.cycle + (alloy? 0 : tagCacheLatency);  // set-associative: after the tag cache lookup
+    auto issue = [&](uint32_t i, int32_t dep, MemObject* target, Address lineAddr, AccessType type) {
+        uint64_t cycle = (dep == -1)? startCycle : resps[dep];
+        resps[i] = subAccess(target, lineAddr, type, cycle, req, &recs[i]);
+        deps[i] = dep;
+        if (target == cacheMem) {
+            if (type == PUTX) profCacheWrites.inc();
+            else profCacheReads.inc();
+        } else {
+            if (type == PUTX) profMemWrites.inc();
+            else profMemReads.inc();
+        }
+        return i;
+    };
+
+    Address dataAddr = set*ways + way;  // tags live in the same row as their set's data
+    int32_t last;  // last sub-access on the critical path
+    if (alloy) {
+        // The TAD read checks the tag and returns the data, or the victim on a miss
+        last = issue(PROBE, -1, cacheMem, dataAddr, GETS);
+        if (hit && isWrite) last = issue(DATA, PROBE, cacheMem, dataAddr, PUTX);
+        if (!hit && victimDirty) issue(VICTIM_WR, PROBE, mem, victimAddr, PUTX);
+    } else {
+        last = tagCacheHit? -1 : issue(TAG, -1, cacheMem, set*ways, GETS);
+        if (hit) {
+            last = issue(DATA, last, cacheMem, dataAddr, isWrite? PUTX : GETS);
+        } else if (victimDirty) {
+            issue(VICTIM_RD, last, cacheMem, dataAddr, GETS);
+            issue(VICTIM_WR, VICTIM_RD, mem, victimAddr, PUTX);
+        }
+    }
+    if (!hit) {
+        last = issue(MEM, last, mem, req.lineAddr, isWrite? PUTX : GETS);
+        if (!isWrite) issue(FILL, MEM, cacheMem, dataAddr, PUTX);
+    }
+
+    uint64_t respCycle = (last == -1)? startCycle : resps[last];
+
+    // Stitch the sub-accesses' timing records into a single record
+    EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
+    bool anyRecord = false;
+    for (uint32_t i = 0; i < MAX_SUBS; i++) anyRecord |= recs[i].isValid();
+    if (evRec && anyRecord) {
+        DelayEvent* root = new (evRec) DelayEvent(0);
+        root->setMinStartCycle(req.cycle);
+        TimingEvent* anchorEvs[MAX_SUBS];
+        uint64_t anchorCycles[MAX_SUBS];
+        // Sub-accesses without records (e.g., on a bound-only memory) leave their parent as the anchor
+        auto anchor = [&](int32_t i, TimingEvent** ev, uint64_t* cycle) {
+            if (i == -1) {
+                *ev = root;
+                *cycle = req.cycle;
+            } else {
+                *ev = anchorEvs[i];
+                *cycle = anchorCycles[i];
+            }
+        };
+        for (uint32_t i = 0; i < MAX_SUBS; i++) {
+            if (deps[i] == -2) continue;
+            TimingEvent* parentEv;
+            uint64_t parentCycle;
+            anchor(deps[i], &parentEv, &parentCycle);
+            if (recs[i].isValid()) {
+                assert(recs[i].reqCycle >= parentCycle);
+                DelayEvent* d = new (evRec) DelayEvent(recs[i].reqCycle - parentCycle);
+                d->setMinStartCycle(parentCycle);
+                parentEv->addChild(d, evRec)->addChild(recs[i].startEvent, evRec);
+                anchorEvs[i] = recs[i].endEvent;
+                anchorCycles[i] = recs[i].respCycle;
+            } else {
+                anchorEvs[i] = parentEv;
+                anchorCycles[i] = parentCycle;
+            }
+        }
+
+        TimingEvent* endEv;
+        uint64_t endCycle;
+        anchor(last, &endEv, &endCycle);
+        TimingRecord tr = {req.lineAddr, req.cycle, endCycle, req.type, root, endEv};
+        evRec->pushRecord(tr);
+    }
+
+    assert(respCycle >= req.cycle);
+    return respCycle;
+}
@@ -0,0 +1,102 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DRAM_CACHE_H_
+#define DRAM_CACHE_H_
+
+/* Memory-side DRAM cache (e.g., an HBM tier in front of DDR memory). Sits
+ * between the LLC and a memory controller (or address splitter), and uses a
+ * separate DDR-like controller as its data (and tag) store.
+ *
+ * Two organizations:
+ *  - Alloy: direct-mapped, tags stored with data (TAD), so a single DRAM read
+ *    both checks the tag and returns the data.
+ *  - SetAssoc: tags of each set stored in DRAM, cached by a small SRAM tag
+ *    cache; a tag cache miss costs an extra DRAM read before the data access.
+ *
+ * GETs that miss read memory and fill the cache (off the critical path),
+ * writing back dirty victims. PUTXs that hit update the cache; PUTXs that miss
+ * go to memory (no write-allocate). The tag store is sparse: sets are
+ * allocated on first touch, so multi-GB caches cost memory proportional to
+ * their footprint.
+ */
+
+#include "g_std/g_string.h"
+#include "g_std/g_unordered_map.h"
+#include "g_std/g_vector.h"
+#include "locks.h"
+#include "memory_hierarchy.h"
+#include "pad.h"
+#include "stats.h"
+
+struct TimingRecord;
+
+class DRAMCache : public MemObject {
+    private:
+        struct Line {
+            Address lineAddr;
+            uint64_t lastUse;  // LRU
+            bool valid;
+            bool dirty;
+        };
+
+        MemObject* const mem;       // next level (main memory)
+        MemObject* const cacheMem;  // cache's own DRAM
+        const g_string name;
+        const bool alloy;
+        const uint32_t ways;
+        const uint64_t numSets;
+        const uint32_t tagCacheLatency;  // in sysCycles
+
+        g_unordered_map<uint64_t, uint32_t> setMap;  // set -> first way in lines, allocated on first touch
+        g_vector<Line> lines;
+        g_vector<uint64_t> tagCache;  // direct-mapped, holds set+1 (0 -> invalid)
+        uint64_t accessCount;
+
+        PAD();
+        lock_t lock;
+        PAD();
+
+        Counter profGETHit, profGETMiss, profPUTXHit, profPUTXMiss;
+        Counter profFills, profDirtyEvictions;
+        Counter profTagCacheHits, profTagCacheMisses;
+        Counter profCacheReads, profCacheWrites, profMemReads, profMemWrites;  // traffic, in lines
+        Counter profSets;
+
+    public:
+        // tagCacheEntries is only used by set-associative caches
+        DRAMCache(MemObject* _mem, MemObject* _cacheMem, uint64_t capacityLines, uint32_t _ways, bool _alloy,
+                uint32_t tagCacheEntries, uint32_t _tagCacheLatency, const g_string& _name);
+
+        uint64_t access(MemReq& req);
+        const char* getName() {return name.c_str();}
+        void initStats(AggregateStat* parentStat);
+
+    private:
+        Line* lookup(uint64_t set, Address lineAddr, Line** victim);
+        uint64_t subAccess(MemObject* target, Address lineAddr, AccessType type, uint64_t cycle, const MemReq& req, TimingRecord* rec);
+};
+
+#endif  // DRAM_CACHE_H_
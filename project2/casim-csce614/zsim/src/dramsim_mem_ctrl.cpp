@@ -27,6 +27,7 @@
 #include <map>
 #include <string>
 #include "event_recorder.h"
+#include "host_prof.h"
 #include "tick_event.h"
 #include "timing_event.h"
 #include "zsim.h"
@@ -93,6 +94,7 @@ void DRAMSimMemory::initStats(AggregateStat* parentStat) {
 }
 
 uint64_t DRAMSimMemory::access(MemReq& req) {
+    HostProfScope hps(HP_MEM);
     switch (req.type) {
         case PUTS:
         case PUTX:
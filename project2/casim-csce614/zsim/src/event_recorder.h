@@ -27,6 +27,7 @@
 #define EVENT_RECORDER_H_
 
 #include "g_std/g_vector.h"
+#include "host_prof.h"
 #include "memory_hierarchy.h"
 #include "pad.h"
 #include "slab_alloc.h"
@@ -56,6 +57,7 @@ class EventRecorder : public GlobAlloc {
         TimingRecord tr;
         CrossingStack crossingStack;
         uint32_t srcId;
+        uint32_t weaveNode; //DomainProfiler node currently handling this core's request
 
         volatile uint64_t lastGapCycles;
         PAD();
@@ -63,7 +65,7 @@ class EventRecorder : public GlobAlloc {
         PAD();
 
     public:
-        EventRecorder() {
+        EventRecorder() : weaveNode(0) {
             tr.clear();
         }
 
@@ -71,10 +73,12 @@ class EventRecorder : public GlobAlloc {
 
         template <typename T>
         T* alloc() {
+            HostProfScope hps(HP_EVENTS);
             return slabAlloc.alloc<T>();
         }
 
         void* alloc(size_t sz) {
+            HostProfScope hps(HP_EVENTS);
             return slabAlloc.alloc(sz);
         }
 
@@ -121,6 +125,9 @@ class EventRecorder : public GlobAlloc {
         uint32_t getSourceId() const {return srcId;}
         void setSourceId(uint32_t i) {srcId = i;}
 
+        inline uint32_t getWeaveNode() const {return weaveNode;}
+        inline void setWeaveNode(uint32_t n) {weaveNode = n;}
+
         inline CrossingStack& getCrossingStack() {
             return crossingStack;
         }
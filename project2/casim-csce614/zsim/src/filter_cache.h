@@ -29,6 +29,11 @@
 #include "bithacks.h"
 #include "cache.h"
 #include "galloc.h"
+#include "miss_prof.h"
+#include "page_alloc.h"
+#include "req_trace.h"
+#include "sharing_detector.h"
+#include "tlb.h"
 #include "zsim.h"
 
 /* Extends Cache with an L0 direct-mapped cache, optimized to hell for hits
@@ -47,8 +52,9 @@ class FilterCache : public Cache {
             volatile Address rdAddr;
             volatile Address wrAddr;
             volatile uint64_t availCycle;
+            volatile Address pAddr;  // physical line address of rdAddr, matched by invalidations
 
-            void clear() {wrAddr = 0; rdAddr = 0; availCycle = 0;}
+            void clear() {wrAddr = 0; rdAddr = 0; availCycle = 0; pAddr = 0;}
         };
 
         //Replicates the most accessed line of each set in the cache
@@ -61,29 +67,59 @@ class FilterCache : public Cache {
         lock_t filterLock;
         uint64_t fGETSHit, fGETXHit;
 
+        MMU* mmu;  // nullptr if translation is not modeled
+
+        Address profPc; // basic block the core is simulating, for zinfo->missProf and shDet
+        SharingDetector* shDet; // nullptr unless this is an L1D and sim.sharingDetector is set
+
     public:
         FilterCache(uint32_t _numSets, uint32_t _numLines, CC* _cc, CacheArray* _array,
                 ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, g_string& _name)
             : Cache(_numLines, _cc, _array, _rp, _accLat, _invLat, _name)
         {
+            profComp = HP_FILTER;
             numSets = _numSets;
             setMask = numSets - 1;
+            // Invalidations index the filter array with physical addresses, which only match virtual ones within a page
+            if (zinfo->physMem && numSets > zinfo->physMem->getPageLines()) {
+                panic("%s: with sys.physMem, filter caches can have at most %d sets", _name.c_str(), zinfo->physMem->getPageLines());
+            }
             filterArray = gm_memalign<FilterEntry>(CACHE_LINE_BYTES, numSets);
             for (uint32_t i = 0; i < numSets; i++) filterArray[i].clear();
             futex_init(&filterLock);
             fGETSHit = fGETXHit = 0;
             srcId = -1;
             reqFlags = 0;
+            mmu = nullptr;
+            profPc = 0;
+            shDet = nullptr;
         }
 
         void setSourceId(uint32_t id) {
             srcId = id;
         }
 
+        uint32_t getSourceId() const {
+            return srcId;
+        }
+
+        void setMMU(MMU* _mmu) {
+            mmu = _mmu;
+        }
+
         void setFlags(uint32_t flags) {
             reqFlags = flags;
         }
 
+        void setSharingDetector(SharingDetector* _shDet) {
+            shDet = _shDet;
+        }
+
+        // Cores call this before simulating each basic block's accesses
+        inline void setProfPc(Address pc) {
+            profPc = pc;
+        }
+
         void initStats(AggregateStat* parentStat) {
             AggregateStat* cacheStat = new AggregateStat();
             cacheStat->init(name.c_str(), "Filter cache stats");
@@ -105,9 +141,10 @@ class FilterCache : public Cache {
             uint64_t availCycle = filterArray[idx].availCycle; //read before, careful with ordering to avoid timing races
             if (vLineAddr == filterArray[idx].rdAddr) {
                 fGETSHit++;
+                if (unlikely(shDet != nullptr)) shDet->record(srcId, filterArray[idx].pAddr, vAddr, false, profPc);
                 return MAX(curCycle, availCycle);
             } else {
-                return replace(vLineAddr, idx, true, curCycle);
+                return replace(vAddr, idx, true, curCycle);
             }
         }
 
@@ -117,20 +154,33 @@ class FilterCache : public Cache {
             uint64_t availCycle = filterArray[idx].availCycle; //read before, careful with ordering to avoid timing races
             if (vLineAddr == filterArray[idx].wrAddr) {
                 fGETXHit++;
+                if (unlikely(shDet != nullptr)) shDet->record(srcId, filterArray[idx].pAddr, vAddr, true, profPc);
                 //NOTE: Stores don't modify availCycle; we'll catch matches in the core
                 //filterArray[idx].availCycle = curCycle; //do optimistic store-load forwarding
                 return MAX(curCycle, availCycle);
             } else {
-                return replace(vLineAddr, idx, false, curCycle);
+                return replace(vAddr, idx, false, curCycle);
             }
         }
 
-        uint64_t replace(Address vLineAddr, uint32_t idx, bool isLoad, uint64_t curCycle) {
-            Address pLineAddr = procMask | vLineAddr;
+        uint64_t replace(Address vAddr, uint32_t idx, bool isLoad, uint64_t curCycle) {
+            HostProfScope hps(HP_FILTER);
+            Address vLineAddr = vAddr >> lineBits;
+            if (unlikely(zinfo->missProf != nullptr)) zinfo->missProf->startMiss(srcId, profPc, vLineAddr);
+            // Translate first: page walks go through the L1D, so we must not hold filterLock
+            TimingRecord walkRec;
+            walkRec.clear();
+            if (mmu) curCycle = mmu->translate(vLineAddr, reqFlags & MemReq::IFETCH, curCycle, &walkRec);
+
+            Address pLineAddr = zinfo->physMem? zinfo->physMem->translate(procIdx, vLineAddr) : (procMask | vLineAddr);
             MESIState dummyState = MESIState::I;
             futex_lock(&filterLock);
+            if (unlikely(shDet != nullptr)) shDet->startMiss(srcId, pLineAddr, vAddr, !isLoad, profPc);
             MemReq req = {pLineAddr, isLoad? GETS : GETX, 0, &dummyState, curCycle, &filterLock, dummyState, srcId, reqFlags};
+            if (unlikely(zinfo->reqTracer != nullptr) && zinfo->reqTracer->sample(srcId)) req.set(MemReq::TRACED);
             uint64_t respCycle  = access(req);
+            if (unlikely(walkRec.isValid())) mmu->finishWalk(&walkRec, srcId);
+            if (unlikely(shDet != nullptr)) shDet->endMiss(srcId);
 
             //Due to the way we do the locking, at this point the old address might be invalidated, but we have the new address guaranteed until we release the lock
 
@@ -138,6 +188,7 @@ class FilterCache : public Cache {
             Address oldAddr = filterArray[idx].rdAddr;
             filterArray[idx].wrAddr = isLoad? -1L : vLineAddr;
             filterArray[idx].rdAddr = vLineAddr;
+            filterArray[idx].pAddr = pLineAddr;
 
             //For LSU simulation purposes, loads bypass stores even to the same line if there is no conflict,
             //(e.g., st to x, ld from x+8) and we implement store-load forwarding at the core.
@@ -148,13 +199,25 @@ class FilterCache : public Cache {
             return respCycle;
         }
 
+        // Page-table reads: go through the cache like loads, but bypass the filter array
+        uint64_t walkLoad(Address pLineAddr, uint64_t curCycle) {
+            MESIState dummyState = MESIState::I;
+            futex_lock(&filterLock);
+            MemReq req = {pLineAddr, GETS, 0, &dummyState, curCycle, &filterLock, dummyState, srcId, 0};
+            uint64_t respCycle = access(req);
+            futex_unlock(&filterLock);
+            return respCycle;
+        }
+
         uint64_t invalidate(const InvReq& req) {
             Cache::startInvalidate();  // grabs cache's downLock
             futex_lock(&filterLock);
-            uint32_t idx = req.lineAddr & setMask; //works because of how virtual<->physical is done...
-            if ((filterArray[idx].rdAddr | procMask) == req.lineAddr) { //FIXME: If another process calls invalidate(), procMask will not match even though we may be doing a capacity-induced invalidation!
+            if (unlikely(shDet != nullptr)) shDet->invalidated(srcId, req);
+            uint32_t idx = req.lineAddr & setMask; //works because virtual and physical lines share their page offset
+            if (filterArray[idx].pAddr == req.lineAddr) {
                 filterArray[idx].wrAddr = -1L;
                 filterArray[idx].rdAddr = -1L;
+                filterArray[idx].pAddr = 0;
             }
             uint64_t respCycle = Cache::finishInvalidate(req); // releases cache's downLock
             futex_unlock(&filterLock);
@@ -27,71 +27,40 @@
 #include <hdf5.h>
 #include <hdf5_hl.h>
 #include <iostream>
+#include <unistd.h>
 #include <vector>
 #include "galloc.h"
 #include "log.h"
 #include "stats.h"
+#include "stats_writer.h"
 #include "zsim.h"
 
 /** Implements the HDF5 backend. Creates one big table in the file, and writes one row per dump.
- * NOTE: Because dump may be called from multiple processes, we close and open the HDF5 file every dump.
- * This is inefficient, but dumps are not that common anyhow, and we get the ability to read hdf5 files mid-simulation.
- * (alternatively, we could have an extra thread exclusively dedicated to writing stats).
+ * Dumps only snapshot the stats into a ring of records, using a precompiled list of getters (see
+ * stats_writer.h). If there is a stats writer thread, it owns the file: it keeps it open, appends full
+ * chunks, and flushes after each append, so the file can still be read mid-simulation. Without a writer
+ * thread, dump may be called from multiple processes, so we open and close the file on every write.
  */
-class HDF5BackendImpl : public GlobAlloc {
+class HDF5BackendImpl : public GlobAlloc, public AsyncStatsSink {
     private:
         const char* filename;
         AggregateStat* rootStat;
         bool skipVectors;
         bool sumRegularAggregates;
 
-        uint64_t* dataBuf; //buffered record data
-        uint64_t* curPtr; //points to next element to write in dump
+        CompiledStats* compiled;
+        StatsRing* ring;
+        StatsWriter* writer;
+        hid_t fileID; // only valid in the process that does the writes, -1 if closed
+
         uint64_t recordSize; // in bytes
         uint32_t recordsPerWrite; //how many records to buffer; determines chunk size as well
 
-        uint32_t bufferedRecords; //number of records buffered (dumped w/o being written), <= recordsPerWrite
-
         // Always have a single function to determine when to skip a stat to avoid inconsistencies in the code
         bool skipStat(Stat* s) {
             return skipVectors && dynamic_cast<VectorStat*>(s);
         }
 
-        // Dump the stats, inorder walk
-        void dumpWalk(Stat* s) {
-            if (skipStat(s)) return;
-            if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
-                if (as->isRegular() && sumRegularAggregates) {
-                    //Dump first record
-                    uint64_t* startPtr = curPtr;
-                    dumpWalk(as->get(0));
-                    uint64_t* tmpPtr = curPtr;
-                    uint32_t sz = tmpPtr - startPtr;
-                    //Dump others below, and add them up
-                    for (uint32_t i = 1; i < as->size(); i++) {
-                        dumpWalk(as->get(i));
-                        //Add record with previous ones
-                        assert(curPtr == tmpPtr + sz);
-                        for (uint32_t j = 0; j < sz; j++) startPtr[j] += tmpPtr[j];
-                        //Rewind
-                        curPtr = tmpPtr;
-                    }
-                } else {
-                    for (uint32_t i = 0; i < as->size(); i++) {
-                        dumpWalk(as->get(i));
-                    }
-                }
-            } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
-                *(curPtr++) = ss->get();
-            } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
-                for (uint32_t i = 0; i < vs->size(); i++) {
-                    *(curPtr++) = vs->count(i);
-                }
-            } else {
-                panic("Unrecognized stat type");
-            }
-        }
-
         //Note this is a local vector, b/c it's only used at initialization.
         std::vector<hid_t> uniqueTypes;
 
@@ -188,12 +157,12 @@ class HDF5BackendImpl : public GlobAlloc {
         }
 
     public:
-        HDF5BackendImpl(const char* _filename, AggregateStat* _rootStat, size_t _bytesPerWrite, bool _skipVectors, bool _sumRegularAggregates) :
+        HDF5BackendImpl(const char* _filename, AggregateStat* _rootStat, size_t _bytesPerWrite, bool _skipVectors, bool _sumRegularAggregates, StatsWriter* _writer) :
             filename(_filename), rootStat(_rootStat), skipVectors(_skipVectors), sumRegularAggregates(_sumRegularAggregates)
         {
             // Create stats file
             info("HDF5 backend: Opening %s", filename);
-            hid_t fileID = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+            fileID = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
 
             hid_t rootType = getH5Type(rootStat);
 
@@ -212,45 +181,70 @@ class HDF5BackendImpl : public GlobAlloc {
                     nullptr, 9 /*compression*/, nullptr);
             assert(hErrVal == 0);
 
-            size_t bufSize = recordsPerWrite*recordSize;
-            if (sumRegularAggregates) bufSize += recordSize; //conservatively add space for a record. See dumpWalk(), we bleed into the buffer a bit when dumping a regular aggregate.
-            dataBuf = static_cast<uint64_t*>(gm_malloc(bufSize));
-            curPtr = dataBuf;
+            H5Fclose(fileID);
+            fileID = -1;
 
-            bufferedRecords = 0;
+            compiled = new CompiledStats(rootStat, skipVectors, sumRegularAggregates);
+            assert_msg(compiled->recordWords()*sizeof(uint64_t) == recordSize, "HDF5 (%s): compiled record has %d words, type has %ld bytes",
+                    filename, compiled->recordWords(), recordSize);
 
-            info("HDF5 backend: Created table, %ld bytes/record, %d records/write", recordSize, recordsPerWrite);
-            H5Fclose(fileID);
+            // Two chunks of slack let the writer append one while dumps fill the next
+            ring = new StatsRing(compiled->recordWords(), 2*recordsPerWrite);
+            writer = _writer;
+            if (writer) writer->registerSink(this);
+
+            info("HDF5 backend: Created table, %ld bytes/record, %d records/write%s", recordSize, recordsPerWrite, writer? ", async" : "");
         }
 
         ~HDF5BackendImpl() {}
 
         void dump(bool buffered) {
-            // Copy stats to data buffer
-            dumpWalk(rootStat);
-            bufferedRecords++;
-
-            assert_msg(dataBuf + bufferedRecords*recordSize/sizeof(uint64_t) == curPtr, "HDF5 (%s): %p + %d * %ld / %ld != %p", filename, dataBuf, bufferedRecords, recordSize, sizeof(uint64_t), curPtr);
+            // Copy stats to the ring
+            uint64_t* record = ring->reserve();
+            while (!record) {
+                // Ring full: wait for the writer to catch up, or make room ourselves
+                if (writer && writer->isRunning()) usleep(10);
+                else drain(false);
+                record = ring->reserve();
+            }
+            compiled->snapshot(record);
+            ring->commit();
+
+            if (writer && writer->isRunning()) {
+                if (!buffered) writer->flush();
+            } else if (ring->occupancy() >= recordsPerWrite || !buffered) {
+                drain(!buffered);
+                close();
+            }
+        }
 
-            // Write to table if needed
-            if (bufferedRecords == recordsPerWrite || !buffered) {
-                hid_t fileID = H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT);
+        void drain(bool all) {
+            size_t fieldOffsets[] = {0};
+            size_t fieldSizes[] = {recordSize};
+            bool wrote = false;
+            while (ring->occupancy() >= recordsPerWrite || (all && ring->occupancy())) {
+                const uint64_t* records;
+                uint32_t n = ring->peek(&records);
+                if (n > recordsPerWrite) n = recordsPerWrite;
+                if (fileID < 0) fileID = H5Fopen(filename, H5F_ACC_RDWR, H5P_DEFAULT);
+                H5TBappend_records(fileID, "stats", n, recordSize, fieldOffsets, fieldSizes, records);
+                ring->release(n);
+                wrote = true;
+            }
+            if (wrote) H5Fflush(fileID, H5F_SCOPE_LOCAL);
+        }
 
-                size_t fieldOffsets[] = {0};
-                size_t fieldSizes[] = {recordSize};
-                H5TBappend_records(fileID, "stats", bufferedRecords, recordSize, fieldOffsets, fieldSizes, dataBuf);
+        void close() {
+            if (fileID >= 0) {
                 H5Fclose(fileID);
-
-                //Rewind
-                bufferedRecords = 0;
-                curPtr = dataBuf;
+                fileID = -1;
             }
         }
 };
 
 
 HDF5Backend::HDF5Backend(const char* filename, AggregateStat* rootStat, size_t bytesPerWrite, bool skipVectors, bool sumRegularAggregates) {
-    backend = new HDF5BackendImpl(filename, rootStat, bytesPerWrite, skipVectors, sumRegularAggregates);
+    backend = new HDF5BackendImpl(filename, rootStat, bytesPerWrite, skipVectors, sumRegularAggregates, zinfo->statsWriter);
 }
 
 void HDF5Backend::dump(bool buffered) {
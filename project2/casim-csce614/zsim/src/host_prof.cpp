@@ -0,0 +1,307 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "host_prof.h"
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "core.h"
+#include "pin.H"
+#include "rdtsc.h"
+#include "stats.h"
+
+#define HOST_PROF_MAX_DEPTH 64
+#define HOST_PROF_FOLD_CYCLES (10*1000*1000)
+
+static const char* compNames[] = {"core", "filterCache", "cache", "coherence", "mem", "events", "weave", "stats", "sync"};
+static const char* compDescs[] = {"Core models", "Filter cache miss path", "Cache banks", "Coherence controllers",
+    "Memory controllers", "Timing event allocation", "Weave-phase event simulation", "Stats dumps", "Barriers and joins"};
+static const char* counterNames[] = {"cycles", "instrs", "llcMisses", "brMisses"};
+static const char* counterDescs[] = {"Host cycles", "Host instructions", "Host LLC misses", "Host branch mispredictions"};
+static const char* pkiNames[] = {"cyclesPKI", "instrsPKI", "llcMissesPKI", "brMissesPKI"};
+static const char* pkiDescs[] = {"Host cycles per 1000 simulated instructions", "Host instructions per 1000 simulated instructions",
+    "Host LLC misses per 1000 simulated instructions", "Host branch mispredictions per 1000 simulated instructions"};
+
+// Process-local; the counters of a thread are only readable from that thread
+struct HostProfThread {
+    bool perf;
+    bool finiPending;
+    uint32_t tid;
+    uint32_t depth;
+    int fds[HPC_NUM_COUNTERS];
+    volatile perf_event_mmap_page* pages[HPC_NUM_COUNTERS];
+    uint64_t last[HPC_NUM_COUNTERS];
+    uint64_t local[HP_NUM_COMPS][HPC_NUM_COUNTERS];
+    uint64_t localCalls[HP_NUM_COMPS];
+    uint64_t unfolded; // cycles since the last fold
+    uint8_t stack[HOST_PROF_MAX_DEPTH];
+};
+
+static HostProfThread* profThreads[MAX_THREADS];
+
+static inline uint64_t rdpmc(uint32_t counter) {
+    uint32_t hi, lo;
+    __asm__ __volatile__("rdpmc" : "=a"(lo), "=d"(hi) : "c"(counter));
+    return ((uint64_t)lo) | (((uint64_t)hi) << 32);
+}
+
+// User-level read of a self-monitoring counter, see perf_event_mmap_page in linux/perf_event.h
+static inline uint64_t readCounter(volatile perf_event_mmap_page* pc) {
+    uint64_t count;
+    uint32_t seq;
+    do {
+        seq = pc->lock;
+        __asm__ __volatile__("" ::: "memory");
+        uint32_t idx = pc->index;
+        count = pc->offset;
+        if (pc->cap_user_rdpmc && idx) {
+            uint32_t shift = 64 - pc->pmc_width;
+            int64_t pmc = ((int64_t)(rdpmc(idx - 1) << shift)) >> shift; //sign-extend
+            count += pmc;
+        }
+        __asm__ __volatile__("" ::: "memory");
+    } while (pc->lock != seq);
+    return count;
+}
+
+static void closeCounters(HostProfThread* th) {
+    for (uint32_t c = 0; c < HPC_NUM_COUNTERS; c++) {
+        if (th->pages[c]) munmap((void*)th->pages[c], sysconf(_SC_PAGESIZE));
+        if (th->fds[c] >= 0) close(th->fds[c]);
+        th->pages[c] = nullptr;
+        th->fds[c] = -1;
+    }
+}
+
+// Opens a group of counters for the calling thread; returns false if we can't read them from user level
+static bool openCounters(HostProfThread* th) {
+    static const uint64_t configs[] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    for (uint32_t c = 0; c < HPC_NUM_COUNTERS; c++) {
+        th->fds[c] = -1;
+        th->pages[c] = nullptr;
+    }
+    for (uint32_t c = 0; c < HPC_NUM_COUNTERS; c++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[c];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        int groupFd = c? th->fds[0] : -1;
+        th->fds[c] = syscall(__NR_perf_event_open, &attr, 0 /*calling thread*/, -1 /*any cpu*/, groupFd, 0);
+        if (th->fds[c] < 0) break;
+        void* page = mmap(nullptr, pageSize, PROT_READ, MAP_SHARED, th->fds[c], 0);
+        if (page == MAP_FAILED) break;
+        th->pages[c] = (volatile perf_event_mmap_page*)page;
+        if (!th->pages[c]->cap_user_rdpmc) break;
+    }
+    bool ok = th->pages[HPC_NUM_COUNTERS-1] && th->pages[HPC_NUM_COUNTERS-1]->cap_user_rdpmc;
+    if (!ok) closeCounters(th);
+    return ok;
+}
+
+static inline void readCounters(HostProfThread* th, uint64_t* now) {
+    if (th->perf) {
+        for (uint32_t c = 0; c < HPC_NUM_COUNTERS; c++) now[c] = readCounter(th->pages[c]);
+    } else {
+        now[HPC_CYCLES] = rdtsc();
+        for (uint32_t c = 1; c < HPC_NUM_COUNTERS; c++) now[c] = 0;
+    }
+}
+
+// Charges everything since the last transition to the innermost scope
+static inline void charge(HostProfThread* th, const uint64_t* now) {
+    if (th->depth) {
+        uint64_t* dst = th->local[th->stack[th->depth-1]];
+        for (uint32_t c = 0; c < HPC_NUM_COUNTERS; c++) dst[c] += now[c] - th->last[c];
+        th->unfolded += now[HPC_CYCLES] - th->last[HPC_CYCLES];
+    }
+    for (uint32_t c = 0; c < HPC_NUM_COUNTERS; c++) th->last[c] = now[c];
+}
+
+HostProfiler::HostProfiler(bool tryPerf) : fallbackWarned(false) {
+    for (uint32_t i = 0; i < HP_NUM_COMPS; i++) {
+        for (uint32_t c = 0; c < HPC_NUM_COUNTERS; c++) totals[i][c] = 0;
+        calls[i] = 0;
+    }
+
+    usePerf = false;
+    if (tryPerf) {
+        HostProfThread probe;
+        usePerf = openCounters(&probe);
+        if (usePerf) closeCounters(&probe);
+        else warn("Host profiling: perf counters not readable from user level (check perf_event_paranoid and rdpmc), falling back to rdtsc");
+    }
+    info("Host profiling enabled, using %s", usePerf? "perf_event counters" : "rdtsc (cycles only)");
+}
+
+HostProfThread* HostProfiler::initThread(uint32_t tid) {
+    HostProfThread* th = new HostProfThread();
+    memset(th, 0, sizeof(HostProfThread));
+    th->tid = tid;
+    th->perf = usePerf && openCounters(th);
+    if (usePerf && !th->perf) {
+        for (uint32_t c = 0; c < HPC_NUM_COUNTERS; c++) th->fds[c] = -1;
+        if (!fallbackWarned) {
+            fallbackWarned = true;
+            warn("Host profiling: could not open perf counters for thread %d, it will only report rdtsc cycles", tid);
+        }
+    }
+    readCounters(th, th->last);
+    profThreads[tid] = th;
+    return th;
+}
+
+HostProfThread* HostProfiler::enter(HostProfComp comp) {
+    uint32_t tid = PIN_ThreadId();
+    assert(tid < MAX_THREADS);
+    HostProfThread* th = profThreads[tid];
+    if (unlikely(th == nullptr)) th = initThread(tid);
+
+    uint64_t now[HPC_NUM_COUNTERS];
+    readCounters(th, now);
+    charge(th, now);
+    assert_msg(th->depth < HOST_PROF_MAX_DEPTH, "Host profiling: scopes nested too deep");
+    th->stack[th->depth++] = comp;
+    th->localCalls[comp]++;
+    return th;
+}
+
+void HostProfiler::leave(HostProfThread* th) {
+    uint64_t now[HPC_NUM_COUNTERS];
+    readCounters(th, now);
+    charge(th, now);
+    assert(th->depth);
+    th->depth--;
+
+    if (!th->depth) {
+        if (th->finiPending) {
+            fold(th);
+            closeCounters(th);
+            profThreads[th->tid] = nullptr;
+            delete th;
+        } else if (th->unfolded > HOST_PROF_FOLD_CYCLES) {
+            fold(th);
+        }
+    }
+}
+
+void HostProfiler::fold(HostProfThread* th) {
+    for (uint32_t i = 0; i < HP_NUM_COMPS; i++) {
+        for (uint32_t c = 0; c < HPC_NUM_COUNTERS; c++) {
+            if (th->local[i][c]) __sync_fetch_and_add(&totals[i][c], th->local[i][c]);
+            th->local[i][c] = 0;
+        }
+        if (th->localCalls[i]) __sync_fetch_and_add(&calls[i], th->localCalls[i]);
+        th->localCalls[i] = 0;
+    }
+    th->unfolded = 0;
+}
+
+void HostProfiler::flush() {
+    HostProfThread* th = profThreads[PIN_ThreadId()];
+    if (th) fold(th);
+}
+
+void HostProfiler::threadFini(uint32_t tid) {
+    HostProfThread* th = profThreads[tid];
+    if (!th) return;
+    if (th->depth) {
+        th->finiPending = true;
+    } else {
+        fold(th);
+        closeCounters(th);
+        profThreads[tid] = nullptr;
+        delete th;
+    }
+}
+
+void HostProfiler::processFork() {
+    // The parent's counters count the parent's threads; drop them and their unfolded counts.
+    // Only the forking thread is outside any scope: the parent's other threads may be, e.g.,
+    // blocked in a barrier (HP_SYNC), but they do not exist in the child, so their scopes never close.
+    for (uint32_t tid = 0; tid < MAX_THREADS; tid++) {
+        HostProfThread* th = profThreads[tid];
+        if (!th) continue;
+        closeCounters(th);
+        profThreads[tid] = nullptr;
+        delete th;
+    }
+}
+
+uint64_t HostProfiler::simInstrs() const {
+    uint64_t instrs = 0;
+    for (uint32_t i = 0; i < zinfo->numCores; i++) instrs += zinfo->cores[i]->getInstrs();
+    return instrs;
+}
+
+void HostProfiler::initStats(AggregateStat* parentStat) {
+    AggregateStat* profStat = new AggregateStat();
+    profStat->init("hostProf", "Host-side simulator profile");
+
+    auto perfLambda = [this]() { return (uint64_t)usePerf; };
+    auto perfStat = makeLambdaStat(perfLambda);
+    perfStat->init("perf", "1 if counts come from perf_event counters, 0 if rdtsc cycles only");
+    profStat->append(perfStat);
+
+    auto instrsLambda = [this]() { return simInstrs(); };
+    auto instrsStat = makeLambdaStat(instrsLambda);
+    instrsStat->init("simInstrs", "Simulated instructions");
+    profStat->append(instrsStat);
+
+    for (uint32_t i = 0; i < HP_NUM_COMPS; i++) {
+        AggregateStat* compStat = new AggregateStat();
+        compStat->init(compNames[i], compDescs[i]);
+
+        auto callsLambda = [this, i]() { return calls[i]; };
+        auto callsStat = makeLambdaStat(callsLambda);
+        callsStat->init("calls", "Profiled scopes entered");
+        compStat->append(callsStat);
+
+        for (uint32_t c = 0; c < HPC_NUM_COUNTERS; c++) {
+            auto countLambda = [this, i, c]() { return totals[i][c]; };
+            auto countStat = makeLambdaStat(countLambda);
+            countStat->init(counterNames[c], counterDescs[c]);
+            compStat->append(countStat);
+        }
+
+        for (uint32_t c = 0; c < HPC_NUM_COUNTERS; c++) {
+            auto pkiLambda = [this, i, c]() {
+                uint64_t instrs = simInstrs();
+                return instrs? 1000*totals[i][c]/instrs : 0;
+            };
+            auto pkiStat = makeLambdaStat(pkiLambda);
+            pkiStat->init(pkiNames[c], pkiDescs[c]);
+            compStat->append(pkiStat);
+        }
+        profStat->append(compStat);
+    }
+    parentStat->append(profStat);
+}
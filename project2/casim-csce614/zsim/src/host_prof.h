@@ -0,0 +1,123 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOST_PROF_H_
+#define HOST_PROF_H_
+
+/* Host-side self-profiling (sim.hostProfile). Attributes the simulator's own
+ * cycles, instructions, LLC misses and branch mispredictions to the component
+ * doing the work, so we know which hotspots are worth attacking.
+ *
+ * Code regions open a HostProfScope for their component. Scopes nest, and
+ * counts are exclusive: time spent in a nested scope (e.g., the L2 access a
+ * filter cache miss triggers) is charged to the inner component only.
+ *
+ * Each bound-phase, weave and stats thread lazily opens a group of per-thread
+ * perf_event counters (user-level only) and reads them with rdpmc through the
+ * mmap'd control pages, so a scope transition costs a few rdpmcs instead of a
+ * read() syscall. If perf_event_open or user-level rdpmc is not available,
+ * we fall back to rdtsc, which only gives cycles (reference cycles, and
+ * including any time the thread spends blocked inside a scope).
+ *
+ * Per-thread counts are folded into global totals every ~10M host cycles and
+ * when threads finish. Results appear in the hostProf stats group, both raw
+ * and normalized per 1000 simulated instructions.
+ */
+
+#include <stdint.h>
+#include "galloc.h"
+#include "log.h"
+#include "zsim.h"
+
+enum HostProfComp {
+    HP_CORE,        // core models (analysis calls, incl. inlined L1 hits)
+    HP_FILTER,      // filter cache miss path
+    HP_CACHE,       // shared and private cache banks (bound phase)
+    HP_COHERENCE,   // coherence controllers
+    HP_MEM,         // memory controllers (bound phase)
+    HP_EVENTS,      // timing event allocation
+    HP_WEAVE,       // weave-phase event simulation
+    HP_STATS,       // stats dumps and writes
+    HP_SYNC,        // scheduler barriers and joins
+    HP_NUM_COMPS
+};
+
+enum HostProfCounter {
+    HPC_CYCLES,
+    HPC_INSTRS,
+    HPC_LLC_MISSES,
+    HPC_BR_MISSES,
+    HPC_NUM_COUNTERS
+};
+
+class AggregateStat;
+struct HostProfThread;
+
+class HostProfiler : public GlobAlloc {
+    private:
+        volatile uint64_t totals[HP_NUM_COMPS][HPC_NUM_COUNTERS];
+        volatile uint64_t calls[HP_NUM_COMPS];
+        bool usePerf;
+        volatile bool fallbackWarned;
+
+    public:
+        explicit HostProfiler(bool tryPerf);
+        void initStats(AggregateStat* parentStat);
+
+        // Scope interface; see HostProfScope
+        HostProfThread* enter(HostProfComp comp);
+        void leave(HostProfThread* th);
+
+        // Folds the calling thread's counts into the totals
+        void flush();
+
+        // Releases the counters of a finished Pin thread. Must be called from
+        // that thread; if it is inside a scope, this happens when it leaves it.
+        void threadFini(uint32_t tid);
+
+        // A forked child inherits its parent's per-thread state; drop it
+        void processFork();
+
+    private:
+        HostProfThread* initThread(uint32_t tid);
+        void fold(HostProfThread* th);
+        uint64_t simInstrs() const;
+};
+
+class HostProfScope {
+    private:
+        HostProfThread* th;
+
+    public:
+        explicit HostProfScope(HostProfComp comp) : th(nullptr) {
+            if (unlikely(zinfo->hostProf != nullptr)) th = zinfo->hostProf->enter(comp);
+        }
+
+        ~HostProfScope() {
+            if (unlikely(th != nullptr)) zinfo->hostProf->leave(th);
+        }
+};
+
+#endif  // HOST_PROF_H_
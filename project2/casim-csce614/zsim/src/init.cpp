@@ -25,14 +25,19 @@
  */
 
 #include "init.h"
+#include <functional>
+#include <limits.h>
 #include <list>
+#include <set>
 #include <sstream>
 #include <stdlib.h>
 #include <string>
 #include <sys/time.h>
+#include <unistd.h>
 #include <vector>
 #include "cache.h"
 #include "cache_arrays.h"
+#include "compression.h"
 #include "config.h"
 #include "constants.h"
 #include "contention_sim.h"
@@ -40,40 +45,54 @@
 #include "detailed_mem.h"
 #include "detailed_mem_params.h"
 #include "ddr_mem.h"
+#include "dram_cache.h"
 #include "debug_zsim.h"
+#include "domain_profiler.h"
 #include "dramsim_mem_ctrl.h"
 #include "event_queue.h"
 #include "filter_cache.h"
 #include "galloc.h"
 #include "hash.h"
+#include "host_prof.h"
 #include "ideal_arrays.h"
 #include "locks.h"
 #include "log.h"
 #include "mem_ctrls.h"
+#include "miss_prof.h"
+#include "mesh_network.h"
 #include "network.h"
 #include "null_core.h"
 #include "ooo_core.h"
+#include "page_alloc.h"
 #include "part_repl_policies.h"
 #include "rrip_repl.h"
 #include "pin_cmd.h"
+#include "prefetch_engines.h"
 #include "prefetcher.h"
 #include "proc_stats.h"
 #include "process_stats.h"
 #include "process_tree.h"
+#include "req_trace.h"
 #include "profile_stats.h"
 #include "repl_policies.h"
 #include "scheduler.h"
+#include "sharing_detector.h"
 #include "simple_core.h"
 #include "stats.h"
 #include "stats_filter.h"
+#include "stats_writer.h"
 #include "str.h"
+#include "telemetry.h"
+#include "tiered_mem.h"
 #include "timing_cache.h"
 #include "timing_core.h"
 #include "timing_event.h"
+#include "tlb.h"
 #include "trace_driver.h"
 #include "tracing_cache.h"
 #include "virt/port_virtualizer.h"
 #include "weave_md1_mem.h" //validation, could be taken out...
+#include "weave_timeline.h"
 #include "zsim.h"
 
 extern void EndOfPhaseActions(); //in zsim.cpp
@@ -102,6 +121,18 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
     uint32_t numHashes = 1;
     uint32_t ways = config.get<uint32_t>(prefix + "array.ways", 4);
     string arrayType = config.get<const char*>(prefix + "array.type", "SetAssoc");
+
+    // Compressed arrays have tagRatio x more tags than lines of data. Everything indexed by tag (repl policy, coherence state) grows with them.
+    bool compressed = config.exists(prefix + "array.compression");
+    uint32_t dataWays = ways;
+    if (compressed) {
+        if (arrayType != "SetAssoc") panic("%s: only SetAssoc arrays can be compressed", name.c_str());
+        if (isTerminal) panic("%s: terminal caches cannot be compressed", name.c_str());
+        uint32_t tagRatio = config.get<uint32_t>(prefix + "array.compression.tagRatio", 2);
+        if (!tagRatio) panic("%s: array.compression.tagRatio must be >= 1", name.c_str());
+        numLines *= tagRatio;
+        ways *= tagRatio;
+    }
     uint32_t candidates = (arrayType == "Z")? config.get<uint32_t>(prefix + "array.candidates", 16) : ways;
 
     //Need to know number of hash functions before instantiating array
@@ -240,7 +271,41 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
 
     //Alright, build the array
     CacheArray* array = nullptr;
-    if (arrayType == "SetAssoc") {
+    if (compressed) {
+        if (replType == "WayPart" || replType == "Vantage" || replType == "IdealLRUPart") panic("%s: compressed arrays do not support partitioning", name.c_str());
+        string cPrefix = prefix + "array.compression.";
+        uint32_t segmentBytes = config.get<uint32_t>(cPrefix + "segmentBytes", 8);
+        if (!segmentBytes || lineSize % segmentBytes) panic("%s: array.compression.segmentBytes must divide the line size", name.c_str());
+        uint32_t segsPerLine = lineSize/segmentBytes;
+
+        // Synthetic sizes: weights for lines of 1..segsPerLine segments. The default is mostly incompressible.
+        g_vector<uint32_t> weights;
+        stringstream ss(config.get<const char*>(cPrefix + "sizeWeights", ""));
+        uint32_t w;
+        while (ss >> w) weights.push_back(w);
+        if (weights.empty()) {
+            weights.resize(segsPerLine, 1);
+            weights[segsPerLine-1] = segsPerLine;
+        }
+
+        uint32_t bdiLat = config.get<uint32_t>(cPrefix + "bdiLatency", 1);
+        uint32_t fpcLat = config.get<uint32_t>(cPrefix + "fpcLatency", 5);
+        string source = config.get<const char*>(cPrefix + "source", "Synthetic");
+        string algorithm = config.get<const char*>(cPrefix + "algorithm", "BDI");
+        CompressionModel* model = new SyntheticCompression(segsPerLine, weights, (algorithm == "FPC")? fpcLat : bdiLat);
+        if (source == "Sampled") {
+            if (zinfo->traceDriven) panic("%s: sampled compression needs the application's memory, use Synthetic with traces", name.c_str());
+            SampledCompression::Algorithm alg;
+            if (algorithm == "BDI") alg = SampledCompression::BDI;
+            else if (algorithm == "FPC") alg = SampledCompression::FPC;
+            else if (algorithm == "BDI+FPC") alg = SampledCompression::BDI_FPC;
+            else panic("%s: invalid compression algorithm %s (BDI, FPC, or BDI+FPC)", name.c_str(), algorithm.c_str());
+            model = new SampledCompression(alg, lineSize, segmentBytes, bdiLat, fpcLat, model);
+        } else if (source != "Synthetic") {
+            panic("%s: invalid compression source %s (Synthetic or Sampled)", name.c_str(), source.c_str());
+        }
+        array = new CompressedArray(numLines, ways, dataWays, model, rp, hf);
+    } else if (arrayType == "SetAssoc") {
         array = new SetAssocArray(numLines, ways, rp, hf);
     } else if (arrayType == "Z") {
         array = new ZArray(numLines, ways, candidates, rp, hf);
@@ -259,6 +324,15 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
         panic("This should not happen, we already checked for it!"); //unless someone changed arrayStr...
     }
 
+    //Per-set heatmap counters
+    if (config.get<bool>(prefix + "array.heatmap", false)) {
+        uint32_t bins = config.get<uint32_t>(prefix + "array.heatmapBins", 64);
+        uint32_t shadowWays = config.get<uint32_t>(prefix + "array.heatmapShadowWays", 4);
+        if (!isPow2(bins)) panic("%s: array.heatmapBins must be a power of 2, %d given", name.c_str(), bins);
+        if (!shadowWays || shadowWays > 255) panic("%s: array.heatmapShadowWays must be in 1..255, %d given", name.c_str(), shadowWays);
+        if (!array->enableHeatmap(bins, shadowWays)) panic("%s: array.heatmap needs a SetAssoc or Z array", name.c_str());
+    }
+
     //Latency
     uint32_t latency = config.get<uint32_t>(prefix + "latency", 10);
     uint32_t accLat = (isTerminal)? 0 : latency; //terminal caches has no access latency b/c it is assumed accLat is hidden by the pipeline
@@ -299,6 +373,9 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
         cache = new FilterCache(numSets, numLines, cc, array, rp, accLat, invLat, name);
     }
 
+    // Hit/miss latency histograms; off by default in L1s, whose hits the filter caches do not see
+    cache->setLatencyHists(config.get<bool>(prefix + "latencyHists", !isTerminal));
+
 #if 0
     info("Built L%d bank, %d bytes, %d lines, %d ways (%d candidates if array is Z), %s array, %s hash, %s replacement, accLat %d, invLat %d name %s",
             level, bankSize, numLines, ways, candidates, arrayType.c_str(), hashType.c_str(), replType.c_str(), accLat, invLat, name.c_str());
@@ -310,9 +387,10 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
 // NOTE: frequency is SYSTEM frequency; mem freq specified in tech
 DDRMemory* BuildDDRMemory(Config& config, uint32_t lineSize, uint32_t frequency, uint32_t domain, g_string name, const string& prefix) {
     uint32_t ranksPerChannel = config.get<uint32_t>(prefix + "ranksPerChannel", 4);
-    uint32_t banksPerRank = config.get<uint32_t>(prefix + "banksPerRank", 8);  // DDR3 std is 8
+    uint32_t banksPerRank = config.get<uint32_t>(prefix + "banksPerRank", 0);  // 0 -> tech default (8 for DDR3, 16 for DDR4, 32 for DDR5)
     uint32_t pageSize = config.get<uint32_t>(prefix + "pageSize", 8*1024);  // 1Kb cols, x4 devices
     const char* tech = config.get<const char*>(prefix + "tech", "DDR3-1333-CL10");  // see cpp file for other techs
+    const char* refresh = config.get<const char*>(prefix + "refresh", "");  // allBank, perBank or sameBank; empty -> tech default
     const char* addrMapping = config.get<const char*>(prefix + "addrMapping", "rank:col:bank");  // address splitter interleaves channels; row always on top
 
     // If set, writes are deferred and bursted out to reduce WTR overheads
@@ -327,17 +405,18 @@ DDRMemory* BuildDDRMemory(Config& config, uint32_t lineSize, uint32_t frequency,
     uint32_t queueDepth = config.get<uint32_t>(prefix + "queueDepth", 16);
     uint32_t controllerLatency = config.get<uint32_t>(prefix + "controllerLatency", 10);  // in system cycles
 
-    auto mem = new DDRMemory(zinfo->lineSize, pageSize, ranksPerChannel, banksPerRank, frequency, tech,
+    auto mem = new DDRMemory(zinfo->lineSize, pageSize, ranksPerChannel, banksPerRank, frequency, tech, refresh,
             addrMapping, controllerLatency, queueDepth, maxRowHits, deferWrites, closedPage, domain, name);
     return mem;
 }
 
-MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t frequency, uint32_t domain, g_string& name) {
+// prefix selects the config group, e.g., sys.mem. (or a memory tier within it)
+MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t frequency, uint32_t domain, g_string& name, const string& prefix) {
     //Type
-    string type = config.get<const char*>("sys.mem.type", "Simple");
+    string type = config.get<const char*>(prefix + "type", "Simple");
 
     //Latency
-    uint32_t latency = (type == "DDR")? -1 : config.get<uint32_t>("sys.mem.latency", 100);
+    uint32_t latency = (type == "DDR")? -1 : config.get<uint32_t>(prefix + "latency", 100);
 
     MemObject* mem = nullptr;
     if (type == "Simple") {
@@ -348,29 +427,29 @@ MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t fre
         // a single CCT across the system, and we are dealing with latencies in *core* clock cycles
 
         // Peak bandwidth (in MB/s)
-        uint32_t bandwidth = config.get<uint32_t>("sys.mem.bandwidth", 6400);
+        uint32_t bandwidth = config.get<uint32_t>(prefix + "bandwidth", 6400);
 
         mem = new MD1Memory(lineSize, frequency, bandwidth, latency, name);
     } else if (type == "WeaveMD1") {
-        uint32_t bandwidth = config.get<uint32_t>("sys.mem.bandwidth", 6400);
-        uint32_t boundLatency = config.get<uint32_t>("sys.mem.boundLatency", latency);
+        uint32_t bandwidth = config.get<uint32_t>(prefix + "bandwidth", 6400);
+        uint32_t boundLatency = config.get<uint32_t>(prefix + "boundLatency", latency);
         mem = new WeaveMD1Memory(lineSize, frequency, bandwidth, latency, boundLatency, domain, name);
     } else if (type == "WeaveSimple") {
-        uint32_t boundLatency = config.get<uint32_t>("sys.mem.boundLatency", 100);
+        uint32_t boundLatency = config.get<uint32_t>(prefix + "boundLatency", 100);
         mem = new WeaveSimpleMemory(latency, boundLatency, domain, name);
     } else if (type == "DDR") {
-        mem = BuildDDRMemory(config, lineSize, frequency, domain, name, "sys.mem.");
+        mem = BuildDDRMemory(config, lineSize, frequency, domain, name, prefix);
     } else if (type == "DRAMSim") {
         uint64_t cpuFreqHz = 1000000 * frequency;
-        uint32_t capacity = config.get<uint32_t>("sys.mem.capacityMB", 16384);
-        string dramTechIni = config.get<const char*>("sys.mem.techIni");
-        string dramSystemIni = config.get<const char*>("sys.mem.systemIni");
-        string outputDir = config.get<const char*>("sys.mem.outputDir");
-        string traceName = config.get<const char*>("sys.mem.traceName");
+        uint32_t capacity = config.get<uint32_t>(prefix + "capacityMB", 16384);
+        string dramTechIni = config.get<const char*>(prefix + "techIni");
+        string dramSystemIni = config.get<const char*>(prefix + "systemIni");
+        string outputDir = config.get<const char*>(prefix + "outputDir");
+        string traceName = config.get<const char*>(prefix + "traceName");
         mem = new DRAMSimMemory(dramTechIni, dramSystemIni, outputDir, traceName, capacity, cpuFreqHz, latency, domain, name);
     } else if (type == "Detailed") {
         // FIXME(dsm): Don't use a separate config file... see DDRMemory
-        g_string mcfg = config.get<const char*>("sys.mem.paramFile", "");
+        g_string mcfg = config.get<const char*>(prefix + "paramFile", "");
         mem = new MemControllerBase(mcfg, lineSize, frequency, domain, name);
     } else {
         panic("Invalid memory controller type %s", type.c_str());
@@ -380,6 +459,65 @@ MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t fre
 
 typedef vector<vector<BaseCache*>> CacheGroup;
 
+// Default domain assignments can be overridden per component, e.g., with a
+// mapping produced by DomainProfiler (sim.domainMap.<name> = <domain>)
+static uint32_t MapDomain(Config& config, const g_string& name, uint32_t defDomain) {
+    string key = string("sim.domainMap.") + name.c_str();
+    if (!config.exists(key.c_str())) return defDomain;
+    uint32_t domain = config.get<uint32_t>(key.c_str());
+    if (domain >= zinfo->numDomains) panic("%s: domain %d out of range (%d domains)", key.c_str(), domain, zinfo->numDomains);
+    return domain;
+}
+
+PrefetchEngine* BuildPrefetchEngine(Config& config, const string& type, const string& prefix, const g_string& name) {
+    if (type == "stride") {
+        uint32_t entries = config.get<uint32_t>(prefix + "entries", 64);
+        uint32_t regionBits = config.get<uint32_t>(prefix + "regionBits", 6); //4KB regions w/ 64B lines
+        return new StridePrefetchEngine(name, entries, regionBits);
+    } else if (type == "stream") {
+        uint32_t entries = config.get<uint32_t>(prefix + "entries", 16);
+        uint32_t window = config.get<uint32_t>(prefix + "window", 16);
+        uint32_t distance = config.get<uint32_t>(prefix + "distance", 16);
+        return new StreamPrefetchEngine(name, entries, window, distance);
+    } else if (type == "bestOffset") {
+        uint32_t rrEntries = config.get<uint32_t>(prefix + "rrEntries", 256);
+        uint32_t pageBits = config.get<uint32_t>(prefix + "pageBits", 6);
+        return new BestOffsetPrefetchEngine(name, rrEntries, pageBits);
+    } else if (type == "spp") {
+        uint32_t sigEntries = config.get<uint32_t>(prefix + "sigEntries", 256);
+        uint32_t patternEntries = config.get<uint32_t>(prefix + "patternEntries", 512);
+        uint32_t pageBits = config.get<uint32_t>(prefix + "pageBits", 6);
+        uint32_t threshold = config.get<uint32_t>(prefix + "threshold", 25);
+        return new SignaturePathPrefetchEngine(name, sigEntries, patternEntries, pageBits, threshold);
+    } else {
+        panic("%s: Invalid prefetch engine %s (supported: stride stream bestOffset spp)", name.c_str(), type.c_str());
+    }
+}
+
+BaseCache* BuildPrefetchController(Config& config, const string& prefix, const g_string& name) {
+    uint32_t trackerEntries = config.get<uint32_t>(prefix + "trackerEntries", 4096);
+    uint32_t evictionEntries = config.get<uint32_t>(prefix + "evictionEntries", 4096);
+    bool throttle = config.get<bool>(prefix + "throttle", false);
+    uint32_t throttleInterval = config.get<uint32_t>(prefix + "throttleInterval", 8192);
+    PrefetchController* pc = new PrefetchController(name, trackerEntries, evictionEntries, throttle, throttleInterval);
+
+    //Engines are chained in order; each has its own subgroup of parameters (e.g., sys.caches.l2pf.stream.distance)
+    vector<string> types;
+    Tokenize(config.get<const char*>(prefix + "engines"), types, " ,");
+    if (types.empty()) panic("%s: engines is empty", name.c_str());
+    std::set<string> seen;
+    for (const string& type : types) {
+        if (seen.count(type)) panic("%s: engine %s used twice", name.c_str(), type.c_str());
+        seen.insert(type);
+        string ePrefix = prefix + type + ".";
+        uint32_t degree = config.get<uint32_t>(ePrefix + "degree", (type == "bestOffset")? 1 : 2);
+        uint32_t maxDegree = config.get<uint32_t>(ePrefix + "maxDegree", throttle? 4*degree : degree);
+        if (degree == 0 || maxDegree < degree) panic("%s: %s needs 0 < degree <= maxDegree", name.c_str(), type.c_str());
+        pc->addEngine(BuildPrefetchEngine(config, type, ePrefix, g_string(type.c_str())), degree, maxDegree);
+    }
+    return pc;
+}
+
 CacheGroup* BuildCacheGroup(Config& config, const string& name, bool isTerminal) {
     CacheGroup* cgp = new CacheGroup;
     CacheGroup& cg = *cgp;
@@ -389,13 +527,15 @@ CacheGroup* BuildCacheGroup(Config& config, const string& name, bool isTerminal)
     bool isPrefetcher = config.get<bool>(prefix + "isPrefetcher", false);
     if (isPrefetcher) { //build a prefetcher group
         uint32_t prefetchers = config.get<uint32_t>(prefix + "prefetchers", 1);
+        //Without an engine list, use the original StreamPrefetcher
+        bool useEngines = config.exists(prefix + "engines");
         cg.resize(prefetchers);
         for (vector<BaseCache*>& bg : cg) bg.resize(1);
         for (uint32_t i = 0; i < prefetchers; i++) {
             stringstream ss;
             ss << name << "-" << i;
             g_string pfName(ss.str().c_str());
-            cg[i][0] = new StreamPrefetcher(pfName);
+            cg[i][0] = useEngines? BuildPrefetchController(config, prefix, pfName) : new StreamPrefetcher(pfName);
         }
         return cgp;
     }
@@ -421,6 +561,7 @@ CacheGroup* BuildCacheGroup(Config& config, const string& name, bool isTerminal)
             }
             g_string bankName(ss.str().c_str());
             uint32_t domain = (i*banks + j)*zinfo->numDomains/(caches*banks); //(banks > 1)? nextDomain() : (i*banks + j)*zinfo->numDomains/(caches*banks);
+            domain = MapDomain(config, bankName, domain);
             cg[i][j] = BuildCacheBank(config, prefix, bankName, bankSize, isTerminal, domain);
         }
     }
@@ -442,9 +583,16 @@ static void InitSystem(Config& config) {
         return cVec;
     };
 
-    // If a network file is specified, build a Network
+    // If a network topology is specified, build a contention-aware MeshNetwork;
+    // otherwise, if a network file is specified, build a fixed-delay Network
     string networkFile = config.get<const char*>("sys.networkFile", "");
-    Network* network = (networkFile != "")? new Network(networkFile.c_str()) : nullptr;
+    Network* network = nullptr;
+    if (config.exists("sys.network.type")) {
+        if (networkFile != "") panic("sys.network and sys.networkFile are mutually exclusive");
+        network = new MeshNetwork(config, zinfo->lineSize, "net");
+    } else if (networkFile != "") {
+        network = new Network(networkFile.c_str());
+    }
 
     // Build the caches
     vector<const char*> cacheGroupNames;
@@ -495,6 +643,29 @@ static void InitSystem(Config& config) {
         for (auto& childVec : childMap[group]) fringe.insert(fringe.end(), childVec.begin(), childVec.end());
     }
 
+    //Miss profiling levels: 0 for caches next to the cores, and up from there (prefetcher groups do not count)
+    if (zinfo->missProf) {
+        auto isCache = [&](const string& group) { return dynamic_cast<Cache*>((*cMap[group])[0][0]) != nullptr; };
+        std::function<uint32_t(const string&)> levelOf = [&](const string& group) -> uint32_t {
+            uint32_t level = 0;
+            for (auto& childVec : childMap[group]) for (auto& child : childVec) {
+                level = MAX(level, levelOf(child) + (isCache(child)? 1 : 0));
+            }
+            return level;
+        };
+        for (auto& it : cMap) {
+            uint32_t level = levelOf(it.first);
+            if (level >= MP_CACHE_LEVELS) {
+                warn("Miss profiler: %s is at level %d, its misses will count as L%d misses", it.first.c_str(), level + 1, MP_CACHE_LEVELS);
+                level = MP_CACHE_LEVELS - 1;
+            }
+            for (auto& bankVec : *it.second) for (BaseCache* bank : bankVec) {
+                Cache* c = dynamic_cast<Cache*>(bank);
+                if (c) c->setMissProfLevel(level);
+            }
+        }
+    }
+
     //Check single LLC
     if (cMap[llc]->size() != 1) panic("Last-level cache %s must have caches = 1, but %ld were specified", llc.c_str(), cMap[llc]->size());
 
@@ -514,8 +685,29 @@ static void InitSystem(Config& config) {
         ss << "mem-" << i;
         g_string name(ss.str().c_str());
         //uint32_t domain = nextDomain(); //i*zinfo->numDomains/memControllers;
-        uint32_t domain = i*zinfo->numDomains/memControllers;
-        mems[i] = BuildMemoryController(config, zinfo->lineSize, zinfo->freqMHz, domain, name);
+        uint32_t domain = MapDomain(config, name, i*zinfo->numDomains/memControllers);
+        if (config.exists("sys.mem.tiers")) {
+            // Near tier configured like sys.mem, far tier (e.g., CXL-attached) under sys.mem.tiers.far
+            string tPrefix = "sys.mem.tiers.";
+            uint64_t nearSizeMB = config.get<uint32_t>(tPrefix + "nearSizeMB", 1024);
+            uint32_t pageSize = config.get<uint32_t>(tPrefix + "pageSize", 4096);
+            uint32_t epochPhases = config.get<uint32_t>(tPrefix + "epochPhases", 1000);
+            uint32_t sampleRate = config.get<uint32_t>(tPrefix + "sampleRate", 1);
+            uint32_t maxMigrations = config.get<uint32_t>(tPrefix + "maxMigrations", 256);
+            uint32_t promoteThreshold = config.get<uint32_t>(tPrefix + "promoteThreshold", 4);
+            uint32_t linesPerAccess = config.get<uint32_t>(tPrefix + "migrationLinesPerAccess", 4);
+            if (pageSize % zinfo->lineSize || !isPow2(pageSize/zinfo->lineSize)) panic("sys.mem.tiers.pageSize must be a power-of-2 multiple of the line size");
+            uint64_t nearFrames = (nearSizeMB << 20)/pageSize/memControllers;
+
+            g_string nearName = name + "-near";
+            g_string farName = name + "-far";
+            MemObject* nearMem = BuildMemoryController(config, zinfo->lineSize, zinfo->freqMHz, domain, nearName, "sys.mem.");
+            MemObject* farMem = BuildMemoryController(config, zinfo->lineSize, zinfo->freqMHz, domain, farName, tPrefix + "far.");
+            mems[i] = new TieredMemory(nearMem, farMem, nearFrames, pageSize/zinfo->lineSize, sampleRate, maxMigrations,
+                    promoteThreshold, linesPerAccess, epochPhases, name);
+        } else {
+            mems[i] = BuildMemoryController(config, zinfo->lineSize, zinfo->freqMHz, domain, name, "sys.mem.");
+        }
     }
 
     if (memControllers > 1) {
@@ -527,6 +719,28 @@ static void InitSystem(Config& config) {
         }
     }
 
+    // Optional memory-side DRAM cache: one slice in front of each memory object,
+    // each with its own DDR-like controller (configured like sys.mem, e.g., tech)
+    if (config.exists("sys.mem.dramCache")) {
+        string dcPrefix = "sys.mem.dramCache.";
+        uint64_t sizeMB = config.get<uint32_t>(dcPrefix + "sizeMB", 1024);
+        string organization = config.get<const char*>(dcPrefix + "organization", "Alloy");
+        if (organization != "Alloy" && organization != "SetAssoc") panic("Invalid DRAM cache organization %s (Alloy or SetAssoc)", organization.c_str());
+        uint32_t ways = config.get<uint32_t>(dcPrefix + "ways", 8);  // SetAssoc only
+        uint32_t tagCacheEntries = config.get<uint32_t>(dcPrefix + "tagCacheEntries", 16384);  // SetAssoc only, in sets
+        uint32_t tagCacheLatency = config.get<uint32_t>(dcPrefix + "tagCacheLatency", 4);  // SetAssoc only, in system cycles
+        uint64_t sliceLines = (sizeMB << 20)/zinfo->lineSize/mems.size();
+
+        for (uint32_t i = 0; i < mems.size(); i++) {
+            stringstream ss;
+            ss << "dcache-" << i;
+            g_string name(ss.str().c_str());
+            uint32_t domain = MapDomain(config, name, i*zinfo->numDomains/mems.size());
+            DDRMemory* cacheMem = BuildDDRMemory(config, zinfo->lineSize, zinfo->freqMHz, domain, name + "-dram", dcPrefix);
+            mems[i] = new DRAMCache(mems[i], cacheMem, sliceLines, ways, organization == "Alloy", tagCacheEntries, tagCacheLatency, name);
+        }
+    }
+
     //Connect everything
     bool printHierarchy = config.get<bool>("sim.printHierarchy", false);
 
@@ -625,6 +839,15 @@ static void InitSystem(Config& config) {
         unordered_map <string, vector<Core*>> coreMap;
         config.subgroups("sys.cores", coreGroupNames);
 
+        // Optional address translation: per-core L1 TLBs and page-walk caches, and a shared L2 TLB
+        SharedTLB* l2tlb = nullptr;
+        AggregateStat* mmuStats = nullptr;
+        if (config.exists("sys.tlbs")) {
+            l2tlb = new SharedTLB(config.get<uint32_t>("sys.tlbs.l2.entries", 1536), config.get<uint32_t>("sys.tlbs.l2.ways", 12));
+            mmuStats = new AggregateStat(true);
+            mmuStats->init("mmu", "Address translation stats");
+        }
+
         uint32_t coreIdx = 0;
         for (const char* group : coreGroupNames) {
             if (parentMap.count(group)) panic("Core group name %s is invalid, a cache group already has that name", group);
@@ -640,15 +863,36 @@ static void InitSystem(Config& config) {
             union {
                 SimpleCore* simpleCores;
                 TimingCore* timingCores;
-                OOOCore* oooCores;
                 NullCore* nullCores;
             };
+            OOOCoreShape oooShape;
+            string branchPredictor;
             if (type == "Simple") {
                 simpleCores = gm_memalign<SimpleCore>(CACHE_LINE_BYTES, cores);
             } else if (type == "Timing") {
                 timingCores = gm_memalign<TimingCore>(CACHE_LINE_BYTES, cores);
             } else if (type == "OOO") {
-                oooCores = gm_memalign<OOOCore>(CACHE_LINE_BYTES, cores);
+                // Shape: start from a preset, then apply any per-parameter overrides
+                string shapeName = config.get<const char*>(prefix + "ooo.shape", "Nehalem");
+                const OOOCoreShape* preset = OOOCore::getShape(shapeName.c_str());
+                if (!preset) panic("%s: Invalid OOO core shape %s, supported shapes:%s", group, shapeName.c_str(), OOOCore::supportedShapes().c_str());
+                oooShape = *preset;
+                oooShape.iwSize = config.get<uint32_t>(prefix + "ooo.iwSize", oooShape.iwSize);
+                oooShape.robSize = config.get<uint32_t>(prefix + "ooo.robSize", oooShape.robSize);
+                oooShape.retireWidth = config.get<uint32_t>(prefix + "ooo.retireWidth", oooShape.retireWidth);
+                oooShape.lqSize = config.get<uint32_t>(prefix + "ooo.lqSize", oooShape.lqSize);
+                oooShape.sqSize = config.get<uint32_t>(prefix + "ooo.sqSize", oooShape.sqSize);
+                oooShape.uopQueueSize = config.get<uint32_t>(prefix + "ooo.uopQueueSize", oooShape.uopQueueSize);
+                oooShape.issueWidth = config.get<uint32_t>(prefix + "ooo.issueWidth", oooShape.issueWidth);
+                oooShape.rfReadsPerCycle = config.get<uint32_t>(prefix + "ooo.rfReadsPerCycle", oooShape.rfReadsPerCycle);
+                oooShape.bpNB = config.get<uint32_t>(prefix + "ooo.bpNB", oooShape.bpNB);
+                oooShape.bpHB = config.get<uint32_t>(prefix + "ooo.bpHB", oooShape.bpHB);
+                oooShape.bpLB = config.get<uint32_t>(prefix + "ooo.bpLB", oooShape.bpLB);
+                branchPredictor = config.get<const char*>(prefix + "branchPredictor", "PAg");
+                if (!OOOCore::isBranchPredictor(branchPredictor.c_str())) {
+                    panic("%s: Invalid branch predictor %s, supported predictors:%s", group, branchPredictor.c_str(), OOOCore::supportedBranchPredictors().c_str());
+                }
+                if (automaton == "A3" && branchPredictor != "PAg") panic("%s: automaton A3 is only supported by the PAg branch predictor", group);
                 zinfo->oooDecode = true; //enable uop decoding, this is false by default, must be true if even one OOO cpu is in the system
             } else if (type == "Null") {
                 nullCores = gm_memalign<NullCore>(CACHE_LINE_BYTES, cores);
@@ -688,22 +932,41 @@ static void InitSystem(Config& config) {
                     FilterCache* dc = dynamic_cast<FilterCache*>(dgroup[assignedCaches[dcache]][0]);
                     assert(dc);
                     dc->setSourceId(coreIdx);
+                    dc->setSharingDetector(zinfo->sharingDetector);
                     assignedCaches[dcache]++;
 
+                    if (l2tlb) {
+                        MMU* mmu = new MMU(config.get<uint32_t>("sys.tlbs.l1i.entries", 64), config.get<uint32_t>("sys.tlbs.l1i.ways", 4),
+                                config.get<uint32_t>("sys.tlbs.l1d.entries", 64), config.get<uint32_t>("sys.tlbs.l1d.ways", 4),
+                                l2tlb, config.get<uint32_t>("sys.tlbs.l2.latency", 7),
+                                config.get<uint32_t>("sys.tlbs.pwc.entries", 32), config.get<uint32_t>("sys.tlbs.pwc.latency", 1), name);
+                        mmu->setWalkCache(dc);
+                        ic->setMMU(mmu);
+                        dc->setMMU(mmu);
+                        mmu->initStats(mmuStats);
+                    }
+
                     //Build the core
                     if (type == "Simple") {
                         core = new (&simpleCores[j]) SimpleCore(ic, dc, name);
                     } else if (type == "Timing") {
-                        uint32_t domain = j*zinfo->numDomains/cores;
+                        uint32_t domain = MapDomain(config, name, j*zinfo->numDomains/cores);
                         TimingCore* tcore = new (&timingCores[j]) TimingCore(ic, dc, domain, name);
                         zinfo->eventRecorders[coreIdx] = tcore->getEventRecorder();
                         zinfo->eventRecorders[coreIdx]->setSourceId(coreIdx);
+                        if (zinfo->domainProfiler) {
+                            zinfo->eventRecorders[coreIdx]->setWeaveNode(zinfo->domainProfiler->registerNode(name, DomainProfiler::NODE_CORE, domain));
+                        }
                         core = tcore;
                     } else {
                         assert(type == "OOO");
-                        OOOCore* ocore = new (&oooCores[j]) OOOCore(ic, dc, name);
+                        uint32_t domain = MapDomain(config, name, 0); //OOO cores have always used domain 0
+                        OOOCore* ocore = OOOCore::create(oooShape, branchPredictor.c_str(), ic, dc, name, domain);
                         zinfo->eventRecorders[coreIdx] = ocore->getEventRecorder();
                         zinfo->eventRecorders[coreIdx]->setSourceId(coreIdx);
+                        if (zinfo->domainProfiler) {
+                            zinfo->eventRecorders[coreIdx]->setWeaveNode(zinfo->domainProfiler->registerNode(name, DomainProfiler::NODE_CORE, domain));
+                        }
                         core = ocore;
                         if (automaton == "A3") ocore->useA3forBranchPred();
                     }
@@ -743,6 +1006,7 @@ static void InitSystem(Config& config) {
             for (Core* core : coreMap[group]) core->initStats(groupStat);
             zinfo->rootStat->append(groupStat);
         }
+        if (mmuStats) zinfo->rootStat->append(mmuStats);
     } else {  // trace-driven: create trace driver and proxy caches
         vector<TraceDriverProxyCache*> proxies;
         for (const char* grp : cacheGroupNames) {
@@ -782,6 +1046,8 @@ static void InitSystem(Config& config) {
     for (auto mem : mems) mem->initStats(memStat);
     zinfo->rootStat->append(memStat);
 
+    if (network) network->initStats(zinfo->rootStat);
+
     //Odds and ends: BuildCacheGroup new'd the cache groups, we need to delete them
     for (pair<string, CacheGroup*> kv : cMap) delete kv.second;
     cMap.clear();
@@ -807,6 +1073,10 @@ static void PostInitStats(bool perProcessDir, Config& config) {
     const char* cmpStatsFile = gm_strdup((pathStr + "zsim-cmp.h5").c_str());
     const char* statsFile = gm_strdup((pathStr + "zsim.out").c_str());
 
+    // Asynchronous stats: dumps just snapshot into per-backend rings, a thread in this process writes files
+    bool asyncStats = config.get<bool>("sim.asyncStats", true);
+    zinfo->statsWriter = asyncStats? new StatsWriter() : nullptr;
+
     if (zinfo->statsPhaseInterval) {
         const char* periodicStatsFilter = config.get<const char*>("sim.periodicStatsFilter", "");
         AggregateStat* prStat = (!strlen(periodicStatsFilter))? zinfo->rootStat : FilterStats(zinfo->rootStat, periodicStatsFilter);
@@ -818,6 +1088,7 @@ static void PostInitStats(bool perProcessDir, Config& config) {
             public:
                 explicit PeriodicStatsDumpEvent(uint32_t period) : Event(period) {}
                 void callback() {
+                    HostProfScope hps(HP_STATS);
                     zinfo->trigger = 10000;
                     zinfo->periodicStatsBackend->dump(true /*buffered*/);
                 }
@@ -838,6 +1109,7 @@ static void PostInitStats(bool perProcessDir, Config& config) {
         for (uint32_t i = 0; i < zinfo->numCores; i++) {
             auto getInstrs = [i]() { return zinfo->cores[i]->getInstrs(); };
             auto dumpStats = [i]() {
+                HostProfScope hps(HP_STATS);
                 info("Dumping eventual stats for core %d", i);
                 zinfo->trigger = i;
                 zinfo->eventualStatsBackend->dump(true /*buffered*/);
@@ -851,6 +1123,8 @@ static void PostInitStats(bool perProcessDir, Config& config) {
     StatsBackend* textStats = new TextBackend(statsFile, zinfo->rootStat);
     zinfo->statsBackends->push_back(compactStats);
     zinfo->statsBackends->push_back(textStats);
+
+    if (zinfo->statsWriter) zinfo->statsWriter->start();
 }
 
 static void InitGlobalStats() {
@@ -915,6 +1189,20 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     uint32_t numSimThreads = config.get<uint32_t>("sim.contentionThreads", MAX((uint32_t)1, zinfo->numDomains/2)); //gives a bit of parallelism, TODO tune
     zinfo->contentionSim = new ContentionSim(zinfo->numDomains, numSimThreads);
     zinfo->contentionSim->initStats(zinfo->rootStat);
+    if (config.exists("sim.weaveTimeline")) {
+        uint64_t startCycle = config.get<uint64_t>("sim.weaveTimeline.startCycle", 0);
+        uint64_t endCycle = config.get<uint64_t>("sim.weaveTimeline.endCycle", startCycle + 2*1000*1000);
+        uint32_t maxRecords = config.get<uint32_t>("sim.weaveTimeline.maxRecordsPerDomain", 4*1024*1024);
+        const char* timelineFile = gm_strdup((string(zinfo->outputDir) + "/weave-timeline.json").c_str());
+        zinfo->contentionSim->setTimeline(new WeaveTimeline(timelineFile, zinfo->numDomains, startCycle, endCycle, maxRecords));
+    }
+    if (config.get<bool>("sim.profileDomains", false)) {
+        double imbalance = config.get<double>("sim.profileDomainsImbalance", 1.1);
+        if (imbalance < 1.0) panic("sim.profileDomainsImbalance must be >= 1.0");
+        zinfo->domainProfiler = new DomainProfiler(zinfo->numDomains, imbalance);
+    } else {
+        zinfo->domainProfiler = nullptr;
+    }
     zinfo->eventRecorders = gm_calloc<EventRecorder*>(zinfo->numCores);
 
     zinfo->traceWriters = new g_vector<AccessTraceWriter*>();
@@ -945,6 +1233,23 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     zinfo->ffReinstrument = config.get<bool>("sim.ffReinstrument", false);
     if (zinfo->ffReinstrument) warn("sim.ffReinstrument = true, switching fast-forwarding on a multi-threaded process may be unstable");
 
+    const char* decodeCacheFile = config.get<const char*>("sim.decodeCache", "");
+    zinfo->decodeCacheMB = config.get<uint32_t>("sim.decodeCacheMB", 256);
+    if (strlen(decodeCacheFile) == 0) {
+        zinfo->decodeCacheFile = nullptr;
+    } else if (decodeCacheFile[0] == '/') {
+        zinfo->decodeCacheFile = gm_strdup(decodeCacheFile);
+    } else {
+        //Resolve now, processes may chdir
+        char cwd[PATH_MAX];
+        if (!getcwd(cwd, PATH_MAX)) panic("getcwd() failed");
+        zinfo->decodeCacheFile = gm_strdup((string(cwd) + "/" + decodeCacheFile).c_str());
+    }
+
+    zinfo->batchedInstrs = config.get<bool>("sim.batchedInstrs", false);
+    zinfo->batchedInstrsBuffer = config.get<uint32_t>("sim.batchedInstrsBuffer", 1024);
+    if (zinfo->batchedInstrs && zinfo->batchedInstrsBuffer == 0) panic("sim.batchedInstrsBuffer must be > 0");
+
     zinfo->registerThreads = config.get<bool>("sim.registerThreads", false);
     zinfo->globalPauseFlag = config.get<bool>("sim.startInGlobalPause", false);
 
@@ -989,14 +1294,58 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
 
     zinfo->pinCmd = new PinCmd(&config, nullptr /*don't pass config file to children --- can go either way, it's optional*/, outputDir, shmid);
 
+    //Physical page allocator (optional; filter caches and page walkers translate through it)
+    if (config.exists("sys.physMem")) {
+        string policy = config.get<const char*>("sys.physMem.policy", "Random");
+        PageAllocator::Policy p;
+        if (policy == "Random") p = PageAllocator::RANDOM;
+        else if (policy == "Buddy") p = PageAllocator::BUDDY;
+        else if (policy == "Color") p = PageAllocator::COLOR;
+        else panic("Invalid sys.physMem.policy %s (Random, Buddy, or Color)", policy.c_str());
+        zinfo->physMem = new PageAllocator(p, config.get<uint64_t>("sys.physMem.sizeMB", 16384), zinfo->lineSize, zinfo->numProcs /*max procs; every process has a slot in the process tree*/,
+                zinfo->numProcs, config.get<uint32_t>("sys.physMem.colors", 64), config.get<uint32_t>("sys.physMem.colorShift", 0),
+                config.get<bool>("sys.physMem.partitionColors", false), config.get<uint64_t>("sys.physMem.seed", 0xF4A3E5));
+        zinfo->physMem->initStats(zinfo->rootStat);
+    }
+
+    //Sampled request tracing (before the system, components register with it)
+    uint32_t reqTraceSampleRate = config.get<uint32_t>("sim.reqTraceSampleRate", 0);
+    if (reqTraceSampleRate) {
+        const char* reqTraceFile = gm_strdup((string(zinfo->outputDir) + "/reqtrace.bin").c_str());
+        zinfo->reqTracer = new ReqTracer(reqTraceFile, reqTraceSampleRate, zinfo->numCores);
+    }
+
+    //Miss attribution profiler (before the system, caches are assigned levels as they are built)
+    if (config.get<bool>("sim.missProfile", false)) {
+        if (zinfo->traceDriven) panic("sim.missProfile needs simulated cores and processes, it does not support sim.traceDriven");
+        uint32_t entries = config.get<uint32_t>("sim.missProfileEntries", 256);
+        if (!entries) panic("sim.missProfileEntries must be > 0");
+        zinfo->missProf = new MissProfiler(zinfo->numProcs, zinfo->numCores, entries, config.get<uint64_t>("sim.missProfileMinAllocBytes", 0));
+    }
+
+    //False-sharing detector (before the system, L1Ds are attached to it as cores are built)
+    if (config.get<bool>("sim.sharingDetector", false)) {
+        zinfo->sharingDetector = new SharingDetector(zinfo->numCores, zinfo->numProcs, config.get<uint32_t>("sim.sharingTableLines", 1024),
+                config.get<uint32_t>("sim.sharingWordBytes", 4), config.get<uint32_t>("sim.sharingEntries", 256));
+        zinfo->sharingDetector->initStats(zinfo->rootStat);
+    }
+
     //Caches, cores, memory controllers
     InitSystem(config);
+    if (zinfo->batchedInstrs && zinfo->oooDecode) panic("sim.batchedInstrs only supports Simple and Timing cores (OOO cores need per-instruction branch calls)");
+    if (zinfo->domainProfiler) zinfo->domainProfiler->postInit();
 
     //Sched stats (deferred because of circular deps)
     if (zinfo->sched) zinfo->sched->initStats(zinfo->rootStat);
 
     zinfo->processStats = new ProcessStats(zinfo->rootStat);
 
+    //Host-side self-profiling
+    if (config.get<bool>("sim.hostProfile", false)) {
+        zinfo->hostProf = new HostProfiler(config.get<bool>("sim.hostProfilePerf", true));
+        zinfo->hostProf->initStats(zinfo->rootStat);
+    }
+
     const char* procStatsFilter = config.get<const char*>("sim.procStatsFilter", "");
     if (strlen(procStatsFilter)) {
         zinfo->procStats = new ProcStats(zinfo->rootStat, FilterStats(zinfo->rootStat, procStatsFilter));
@@ -1012,6 +1361,16 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     bool perProcessDir = config.get<bool>("sim.perProcessDir", false);
     PostInitStats(perProcessDir, config);
 
+    //Live telemetry (published by the harness)
+    if (config.get<bool>("sim.telemetry", false)) {
+        const char* telemetryFilter = config.get<const char*>("sim.telemetryFilter", ".*-[0-9]+\\.(cycles|instrs|mGETS|mGETXIM|mGETXSM|rd|wr)");
+        AggregateStat* tlStat = FilterStats(zinfo->rootStat, telemetryFilter);
+        if (!tlStat) warn("No stats match sim.telemetryFilter regex (%s), telemetry will only carry global counters", telemetryFilter);
+        uint32_t telemetryPhases = config.get<uint32_t>("sim.telemetryPhases", 1);
+        if (!telemetryPhases) panic("sim.telemetryPhases must be > 0");
+        zinfo->telemetry = new Telemetry(tlStat, telemetryPhases);
+    }
+
     zinfo->perProcessCpuEnum = config.get<bool>("sim.perProcessCpuEnum", false);
 
     //Odds and ends
@@ -1025,6 +1384,12 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     config.get<uint32_t>("sim.gmMBytes", (1 << 10));
     if (!zinfo->attachDebugger) config.get<bool>("sim.deadlockDetection", true);
     config.get<bool>("sim.aslr", false);
+    if (zinfo->telemetry) {
+        std::stringstream ss;
+        ss << "/dev/shm/zsim-telemetry." << zinfo->harnessPid;  // the harness's default
+        config.get<const char*>("sim.telemetryFile", ss.str().c_str());
+        config.get<uint32_t>("sim.telemetryPollMs", 100);
+    }
 
     //Write config out
     bool strictConfig = config.get<bool>("sim.strictConfig", true); //if true, panic on unused variables
@@ -26,9 +26,11 @@
 //#include "timing_event.h"
 //#include "event_recorder.h"
 #include "mem_ctrls.h"
+#include "host_prof.h"
 #include "zsim.h"
 
 uint64_t SimpleMemory::access(MemReq& req) {
+    HostProfScope hps(HP_MEM);
     switch (req.type) {
         case PUTS:
         case PUTX:
@@ -107,6 +109,7 @@ void MD1Memory::updateLatency() {
 }
 
 uint64_t MD1Memory::access(MemReq& req) {
+    HostProfScope hps(HP_MEM);
     if (zinfo->numPhases > lastPhase) {
         futex_lock(&updateLock);
         //Recheck, someone may have updated already
@@ -97,9 +97,14 @@ struct MemReq {
         NONINCLWB     = (1<<3), //This is a non-inclusive writeback. Do not assume that the line was in the lower level. Used on NUCA (BankDir).
         PUTX_KEEPEXCL = (1<<4), //Non-relinquishing PUTX. On a PUTX, maintain the requestor's E state instead of removing the sharer (i.e., this is a pure writeback)
         PREFETCH      = (1<<5), //Prefetch GETS access. Only set at level where prefetch is issued; handled early in MESICC
+        TRACED        = (1<<6), //Sampled for end-to-end tracing; components append spans to zinfo->reqTracer (see req_trace.h)
     };
     uint32_t flags;
 
+    //If set, the cache that handles the access writes here the valid line it evicted to make room for it, if any
+    //(used by prefetchers to track prefetched lines and pollution). Not propagated across levels.
+    Address* victimLineAddr;
+
     inline void set(Flag f) {flags |= f;}
     inline bool is (Flag f) const {return flags & f;}
 };
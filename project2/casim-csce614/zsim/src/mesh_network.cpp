@@ -0,0 +1,259 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mesh_network.h"
+#include <stdlib.h>
+#include <string>
+#include "config.h"
+#include "event_recorder.h"
+#include "log.h"
+#include "str.h"
+#include "timing_event.h"
+#include "zsim.h"
+
+using std::string;
+
+enum MeshPorts {PORT_E, PORT_W, PORT_N, PORT_S};
+enum RingPorts {PORT_CW, PORT_CCW};
+
+// Weave-phase event for a packet crossing one link
+class NetLinkEvent : public TimingEvent {
+    private:
+        MeshNetwork* const net;
+        const uint32_t link;
+        const uint32_t flits;
+        const uint32_t lat;
+
+    public:
+        NetLinkEvent(MeshNetwork* _net, uint32_t _link, uint32_t _flits, uint32_t _lat, int32_t domain)
+            : TimingEvent(0, 0, domain), net(_net), link(_link), flits(_flits), lat(_lat) {}
+
+        void simulate(uint64_t startCycle) {
+            done(net->traverse(link, flits, lat, startCycle));
+        }
+};
+
+// Chains one link event per hop; the last hop also pays for ejection and serialization
+static void BuildPath(MeshNetwork* net, const g_vector<uint32_t>& links, uint32_t flits, uint64_t startCycle, EventRecorder* evRec,
+        TimingEvent** firstEv, TimingEvent** lastEv) {
+    assert(links.size());
+    uint32_t hopDelay = net->getHopDelay();
+    TimingEvent* prev = nullptr;
+    for (uint32_t i = 0; i < links.size(); i++) {
+        bool last = (i == links.size() - 1);
+        uint32_t lat = last? net->pathLatency(i + 1, flits) - i*hopDelay : hopDelay;
+        NetLinkEvent* ev = new (evRec) NetLinkEvent(net, links[i], flits, lat, net->getLinkDomain(links[i]));
+        ev->setMinStartCycle(startCycle + i*hopDelay);
+        if (prev) prev->addChild(ev, evRec);
+        else *firstEv = ev;
+        prev = ev;
+    }
+    *lastEv = prev;
+}
+
+void NetRoute::recordAccess(Address lineAddr, AccessType type, uint32_t srcId, uint64_t cycle, uint64_t nextLevelRespCycle) {
+    EventRecorder* evRec = zinfo->eventRecorders[srcId];
+    if (!evRec) return;
+
+    TimingRecord r;
+    r.clear();
+    if (evRec->hasRecord()) r = evRec->popRecord();
+
+    uint32_t reqLat = net->pathLatency(reqLinks.size(), 1);
+    uint32_t respLat = net->pathLatency(respLinks.size(), net->getDataFlits());
+
+    TimingEvent* reqStart;
+    TimingEvent* reqEnd;
+    TimingEvent* respStart;
+    TimingEvent* respEnd;
+    BuildPath(net, reqLinks, 1, cycle, evRec, &reqStart, &reqEnd);
+    BuildPath(net, respLinks, net->getDataFlits(), cycle + reqLat, evRec, &respStart, &respEnd);
+
+    if (r.isValid()) {
+        // Keep any bound-phase slack the next level had before and after its own events
+        assert(r.reqCycle >= cycle && r.respCycle <= nextLevelRespCycle);
+        DelayEvent* dUp = new (evRec) DelayEvent(r.reqCycle - cycle);
+        DelayEvent* dDown = new (evRec) DelayEvent(nextLevelRespCycle - r.respCycle);
+        dUp->setMinStartCycle(cycle + reqLat);
+        dDown->setMinStartCycle(cycle + reqLat);
+        reqEnd->addChild(dUp, evRec)->addChild(r.startEvent, evRec);
+        r.endEvent->addChild(dDown, evRec)->addChild(respStart, evRec);
+    } else {
+        // Next level does not record events (e.g., a bound-only cache); charge its latency as a fixed delay
+        DelayEvent* dNext = new (evRec) DelayEvent(nextLevelRespCycle - cycle);
+        dNext->setMinStartCycle(cycle + reqLat);
+        reqEnd->addChild(dNext, evRec)->addChild(respStart, evRec);
+        r.addr = lineAddr << lineBits;
+        r.type = type;
+    }
+
+    r.reqCycle = cycle;
+    r.respCycle = nextLevelRespCycle + reqLat + respLat;
+    r.startEvent = reqStart;
+    r.endEvent = respEnd;
+    evRec->pushRecord(r);
+}
+
+void NetRoute::recordWriteback(uint32_t srcId) {
+    EventRecorder* evRec = zinfo->eventRecorders[srcId];
+    if (!evRec || !evRec->hasRecord()) return;
+
+    TimingRecord r = evRec->popRecord();
+    TimingEvent* wbStart;
+    TimingEvent* wbEnd;
+    BuildPath(net, reqLinks, net->getDataFlits(), r.reqCycle, evRec, &wbStart, &wbEnd);
+
+    DelayEvent* startEv = new (evRec) DelayEvent(0);
+    startEv->setMinStartCycle(r.reqCycle);
+    startEv->addChild(wbStart, evRec);
+    startEv->addChild(r.startEvent, evRec);
+    r.startEvent = startEv;
+    evRec->pushRecord(r);
+}
+
+MeshNetwork::MeshNetwork(Config& _config, uint32_t lineSize, const g_string& _name) : name(_name), config(&_config) {
+    string type = config->get<const char*>("sys.network.type");
+    if (type == "Mesh") {
+        topology = MESH;
+        dimX = config->get<uint32_t>("sys.network.meshX", 4);
+        dimY = config->get<uint32_t>("sys.network.meshY", 4);
+        numPorts = 4;
+    } else if (type == "Ring") {
+        topology = RING;
+        dimX = config->get<uint32_t>("sys.network.nodes", 16);
+        dimY = 1;
+        numPorts = 2;
+    } else {
+        panic("Invalid network type %s (Mesh or Ring)", type.c_str());
+    }
+    numTiles = dimX*dimY;
+    if (!numTiles) panic("Network %s has no tiles", name.c_str());
+
+    routerDelay = config->get<uint32_t>("sys.network.routerDelay", 2);
+    linkDelay = config->get<uint32_t>("sys.network.linkDelay", 1);
+    uint32_t flitBytes = config->get<uint32_t>("sys.network.flitBytes", 16);
+    if (!flitBytes) panic("Network %s: flitBytes must be non-zero", name.c_str());
+    dataFlits = (lineSize + flitBytes - 1)/flitBytes;
+    memControllers = config->get<uint32_t>("sys.mem.controllers", 1);
+
+    linkFreeCycle.resize(numTiles*numPorts, 0);
+    linkNames.resize(numTiles*numPorts);
+    const char* meshPortNames[] = {"E", "W", "N", "S"};
+    const char* ringPortNames[] = {"cw", "ccw"};
+    for (uint32_t t = 0; t < numTiles; t++) {
+        for (uint32_t p = 0; p < numPorts; p++) {
+            string s = "t" + Str(t) + ((topology == MESH)? meshPortNames[p] : ringPortNames[p]);
+            linkNames[t*numPorts + p] = gm_strdup(s.c_str());
+        }
+    }
+
+    info("%s: %s network, %dx%d tiles, %d cycles/hop, %d-flit lines", name.c_str(), type.c_str(), dimX, dimY, getHopDelay(), dataFlits);
+}
+
+uint32_t MeshNetwork::getLinkDomain(uint32_t link) const {
+    return (link/numPorts)*zinfo->numDomains/numTiles;
+}
+
+uint32_t MeshNetwork::getTile(const char* entity) {
+    string key = string("sys.network.tiles.") + entity;
+    uint32_t tile;
+    if (config->exists(key)) {
+        tile = config->get<uint32_t>(key);
+    } else {
+        // Default placement: memory controllers spread evenly across tiles,
+        // everything else on the tile matching its index (bank index if banked)
+        string e(entity);
+        size_t dash = e.rfind('-');
+        uint32_t idx = 0;
+        if (dash != string::npos) {
+            string suffix = e.substr(dash + 1);
+            size_t bank = suffix.find('b');
+            idx = atoi(suffix.c_str() + ((bank != string::npos)? bank + 1 : 0));
+        }
+        tile = (e.compare(0, 4, "mem-") == 0)? idx*numTiles/memControllers : idx % numTiles;
+    }
+    if (tile >= numTiles) panic("%s: %s placed on tile %d, but there are only %d tiles", name.c_str(), entity, tile, numTiles);
+    return tile;
+}
+
+void MeshNetwork::route(uint32_t srcTile, uint32_t dstTile, g_vector<uint32_t>& links) const {
+    links.clear();
+    if (topology == MESH) {
+        // XY dimension-order routing
+        uint32_t x = srcTile % dimX, y = srcTile / dimX;
+        uint32_t dx = dstTile % dimX, dy = dstTile / dimX;
+        while (x != dx) {
+            uint32_t port = (dx > x)? PORT_E : PORT_W;
+            links.push_back((y*dimX + x)*numPorts + port);
+            x = (dx > x)? x + 1 : x - 1;
+        }
+        while (y != dy) {
+            uint32_t port = (dy > y)? PORT_N : PORT_S;
+            links.push_back((y*dimX + x)*numPorts + port);
+            y = (dy > y)? y + 1 : y - 1;
+        }
+    } else {
+        uint32_t cwHops = (dstTile + numTiles - srcTile) % numTiles;
+        bool cw = cwHops <= numTiles/2;
+        uint32_t hops = cw? cwHops : numTiles - cwHops;
+        uint32_t t = srcTile;
+        for (uint32_t h = 0; h < hops; h++) {
+            links.push_back(t*numPorts + (cw? PORT_CW : PORT_CCW));
+            t = cw? (t + 1) % numTiles : (t + numTiles - 1) % numTiles;
+        }
+    }
+}
+
+uint32_t MeshNetwork::getRTT(const char* src, const char* dst) {
+    uint32_t srcTile = getTile(src);
+    uint32_t dstTile = getTile(dst);
+    g_vector<uint32_t> links;
+    route(srcTile, dstTile, links);
+    // Request is a single control flit, response carries the line
+    return pathLatency(links.size(), 1) + pathLatency(links.size(), dataFlits);
+}
+
+NetRoute* MeshNetwork::getRoute(const char* src, const char* dst) {
+    uint32_t srcTile = getTile(src);
+    uint32_t dstTile = getTile(dst);
+    if (srcTile == dstTile) return nullptr;  // same tile, never enters the network
+    NetRoute* r = new NetRoute(this);
+    route(srcTile, dstTile, r->reqLinks);
+    route(dstTile, srcTile, r->respLinks);
+    return r;
+}
+
+void MeshNetwork::initStats(AggregateStat* parentStat) {
+    AggregateStat* netStat = new AggregateStat();
+    netStat->init(name.c_str(), "Network stats");
+    uint32_t numLinks = numTiles*numPorts;
+    profPkts.init("pkts", "Packets sent on each link", numLinks, &linkNames[0]);
+    profFlits.init("flits", "Flits sent on each link (busy cycles; divide by cycles for utilization)", numLinks, &linkNames[0]);
+    profQueueCycles.init("qCycles", "Cycles packets waited for each link to free up", numLinks, &linkNames[0]);
+    netStat->append(&profPkts);
+    netStat->append(&profFlits);
+    netStat->append(&profQueueCycles);
+    parentStat->append(netStat);
+}
@@ -0,0 +1,126 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MESH_NETWORK_H_
+#define MESH_NETWORK_H_
+
+/* Contention-aware on-chip network for tiled systems. Caches, cache banks and
+ * memory controllers are placed on the tiles of a 2D mesh (XY dimension-order
+ * routing) or a bidirectional ring (shortest direction).
+ *
+ * Bound phase: getRTT() returns the zero-load round-trip latency, which
+ * charges a router and a link delay per hop, the ejection router, and the
+ * serialization of a single-flit request and a line-sized response.
+ *
+ * Weave phase: misses that cross the network are wrapped in a chain of link
+ * events, with the request path before the next level's events and the
+ * response path after them. Each link carries one flit per cycle, so packets
+ * that share a link queue behind each other. Link events run in the domain of
+ * the tile that drives the link, so link state has a single writer.
+ *
+ * Invalidations keep using the fixed zero-load RTT.
+ */
+
+#include "bithacks.h"
+#include "g_std/g_string.h"
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "memory_hierarchy.h"
+#include "network.h"
+#include "stats.h"
+
+class Config;
+class MeshNetwork;
+
+// Path between two entities: requests travel through reqLinks, responses through respLinks
+class NetRoute : public GlobAlloc {
+    public:
+        MeshNetwork* const net;
+        g_vector<uint32_t> reqLinks;
+        g_vector<uint32_t> respLinks;
+
+        explicit NetRoute(MeshNetwork* _net) : net(_net) {}
+
+        // Called by the requester after the next level responds to a GETS/GETX at cycle
+        void recordAccess(Address lineAddr, AccessType type, uint32_t srcId, uint64_t cycle, uint64_t nextLevelRespCycle);
+        // Called by the requester after a dirty writeback; the data transfer contends for links but is off the critical path
+        void recordWriteback(uint32_t srcId);
+};
+
+class MeshNetwork : public Network, public GlobAlloc {
+    private:
+        enum Topology {MESH, RING};
+
+        const g_string name;
+        Topology topology;
+        uint32_t dimX, dimY; //ring: dimX tiles, dimY = 1
+        uint32_t numTiles;
+        uint32_t numPorts; //output links per tile
+        uint32_t routerDelay, linkDelay;
+        uint32_t dataFlits; //flits in a line-sized response or writeback
+        uint32_t memControllers;
+
+        Config* config; //only used to place entities, i.e., during initialization
+
+        g_vector<uint64_t> linkFreeCycle;
+        g_vector<const char*> linkNames;
+
+        VectorCounter profPkts, profFlits, profQueueCycles;
+
+    public:
+        MeshNetwork(Config& _config, uint32_t lineSize, const g_string& _name);
+
+        uint32_t getRTT(const char* src, const char* dst);
+        NetRoute* getRoute(const char* src, const char* dst);
+
+        void initStats(AggregateStat* parentStat);
+
+        inline uint32_t getHopDelay() const {return routerDelay + linkDelay;}
+        inline uint32_t getDataFlits() const {return dataFlits;}
+
+        // Zero-load latency of a packet over a path of hops links
+        inline uint32_t pathLatency(uint32_t hops, uint32_t flits) const {
+            return hops? hops*(routerDelay + linkDelay) + routerDelay + flits - 1 : 0;
+        }
+
+        // Weave phase: link is busy for flits cycles after the head flit is sent, returns the cycle the head leaves the link plus lat
+        inline uint64_t traverse(uint32_t link, uint32_t flits, uint32_t lat, uint64_t startCycle) {
+            uint64_t sendCycle = MAX(startCycle, linkFreeCycle[link]);
+            linkFreeCycle[link] = sendCycle + flits;
+            profPkts.inc(link);
+            profFlits.inc(link, flits);
+            profQueueCycles.inc(link, sendCycle - startCycle);
+            return sendCycle + lat;
+        }
+
+        // Domain that simulates a link's events, i.e., that of the tile driving it
+        uint32_t getLinkDomain(uint32_t link) const;
+
+    private:
+        uint32_t getTile(const char* entity);
+        void route(uint32_t srcTile, uint32_t dstTile, g_vector<uint32_t>& links) const;
+};
+
+#endif  // MESH_NETWORK_H_
@@ -0,0 +1,338 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "miss_prof.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "log.h"
+#include "zsim.h"
+
+/* Bounded tables */
+
+MissProfTable::MissProfTable(uint32_t _maxEntries) : numEntries(0), maxEntries(_maxEntries), replacements(0) {
+    uint32_t buckets = 1;
+    while (buckets < 2*maxEntries) buckets <<= 1;
+    hashMask = buckets - 1;
+    entries = gm_calloc<MissProfEntry>(maxEntries);
+    heads = gm_calloc<int32_t>(buckets);
+    for (uint32_t i = 0; i < buckets; i++) heads[i] = -1;
+}
+
+uint32_t MissProfTable::bucket(Address key) const {
+    return ((key * 0x9E3779B97F4A7C15UL) >> 32) & hashMask;
+}
+
+void MissProfTable::unlink(uint32_t idx) {
+    int32_t* p = &heads[bucket(entries[idx].key)];
+    while (*p != (int32_t)idx) {
+        assert(*p >= 0);
+        p = &entries[*p].next;
+    }
+    *p = entries[idx].next;
+}
+
+void MissProfTable::inc(Address key, MissProfCounter c) {
+    uint32_t b = bucket(key);
+    int32_t idx = heads[b];
+    while (idx >= 0 && entries[idx].key != key) idx = entries[idx].next;
+
+    if (idx < 0) {
+        uint64_t error = 0;
+        if (numEntries < maxEntries) {
+            idx = numEntries++;
+        } else {
+            // Replace the lightest entry; the new key may have had up to as many misses
+            idx = 0;
+            for (uint32_t i = 1; i < numEntries; i++) {
+                if (entries[i].weight < entries[idx].weight) idx = i;
+            }
+            unlink(idx);
+            error = entries[idx].weight;
+            replacements++;
+        }
+        MissProfEntry& e = entries[idx];
+        e.key = key;
+        for (uint32_t i = 0; i < MP_NUM_COUNTERS; i++) e.counts[i] = 0;
+        e.weight = error;
+        e.error = error;
+        e.next = heads[b];
+        heads[b] = idx;
+    }
+
+    entries[idx].counts[c]++;
+    entries[idx].weight++;
+}
+
+/* Live objects (process-local) */
+
+struct AllocObj {
+    Address end;
+    Address site;
+};
+
+struct AllocCall {
+    uint32_t depth;  // allocators may call each other (e.g., calloc -> malloc); only the outermost call counts
+    uint64_t size;
+    Address site;
+    Address oldPtr;  // realloc
+    Address sp;      // stack pointer on entry to the outermost call
+};
+
+static std::map<Address, AllocObj> liveObjs;
+static lock_t objLock;
+static AllocCall allocCalls[MAX_THREADS];
+static volatile uint64_t unbalancedCalls;  // allocator entries and exits that did not pair up (tail calls, longjmps, ...)
+
+// Pin does not guarantee IPOINT_AFTER fires on every exit. If the outermost call's frame is gone
+// (a call at the same or a shallower stack depth), its exit was missed, so forget it.
+static inline bool OuterCallLive(AllocCall& ac, ADDRINT sp) {
+    if (!ac.depth) return false;
+    if (sp < ac.sp) return true;  // nested: the stack grows down
+    ac.depth = 0;
+    __sync_fetch_and_add(&unbalancedCalls, 1);
+    return false;
+}
+
+static Address FindAllocSite(Address addr) {
+    Address site = 0;
+    futex_lock(&objLock);
+    auto it = liveObjs.upper_bound(addr);
+    if (it != liveObjs.begin()) {
+        --it;
+        if (addr < it->second.end) site = it->second.site;
+    }
+    futex_unlock(&objLock);
+    return site;
+}
+
+static VOID AllocEnter(THREADID tid, ADDRINT size, ADDRINT site, ADDRINT oldPtr, ADDRINT sp) {
+    AllocCall& ac = allocCalls[tid];
+    if (OuterCallLive(ac, sp)) {
+        ac.depth++;
+        return;
+    }
+    ac.depth = 1;
+    ac.size = size;
+    ac.site = site;
+    ac.oldPtr = oldPtr;
+    ac.sp = sp;
+}
+
+static VOID CallocEnter(THREADID tid, ADDRINT num, ADDRINT size, ADDRINT site, ADDRINT sp) {
+    AllocEnter(tid, num*size, site, 0, sp);
+}
+
+static VOID AllocExit(THREADID tid, ADDRINT ptr) {
+    AllocCall& ac = allocCalls[tid];
+    if (ac.depth == 0) {  // its entry was forgotten as missed, or not instrumented
+        __sync_fetch_and_add(&unbalancedCalls, 1);
+        return;
+    }
+    if (--ac.depth) return;  // nested
+    futex_lock(&objLock);
+    if (ac.oldPtr && (ptr || !ac.size)) liveObjs.erase(ac.oldPtr);  // a failed realloc keeps the old object
+    if (ptr && ac.size && ac.size >= zinfo->missProf->getMinAllocBytes()) {
+        AllocObj obj = {ptr + ac.size, ac.site};
+        liveObjs[ptr] = obj;
+    }
+    futex_unlock(&objLock);
+}
+
+static VOID FreeEnter(THREADID tid, ADDRINT ptr, ADDRINT sp) {
+    if (!ptr || OuterCallLive(allocCalls[tid], sp)) return;
+    futex_lock(&objLock);
+    liveObjs.erase(ptr);
+    futex_unlock(&objLock);
+}
+
+void MissProfInstrumentImage(IMG img) {
+    if (!zinfo->missProf) return;
+    // The dynamic loader has its own private allocator
+    if (IMG_Name(img).find("/ld-") != std::string::npos) return;
+
+    bool found = false;
+    RTN rtn = RTN_FindByName(img, "malloc");
+    if (RTN_Valid(rtn)) {
+        RTN_Open(rtn);
+        RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR) AllocEnter, IARG_THREAD_ID, IARG_FUNCARG_ENTRYPOINT_VALUE, 0,
+                IARG_RETURN_IP, IARG_ADDRINT, (ADDRINT)0, IARG_REG_VALUE, REG_STACK_PTR, IARG_END);
+        RTN_InsertCall(rtn, IPOINT_AFTER, (AFUNPTR) AllocExit, IARG_THREAD_ID, IARG_FUNCRET_EXITPOINT_VALUE, IARG_END);
+        RTN_Close(rtn);
+        found = true;
+    }
+
+    rtn = RTN_FindByName(img, "calloc");
+    if (RTN_Valid(rtn)) {
+        RTN_Open(rtn);
+        RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR) CallocEnter, IARG_THREAD_ID, IARG_FUNCARG_ENTRYPOINT_VALUE, 0,
+                IARG_FUNCARG_ENTRYPOINT_VALUE, 1, IARG_RETURN_IP, IARG_REG_VALUE, REG_STACK_PTR, IARG_END);
+        RTN_InsertCall(rtn, IPOINT_AFTER, (AFUNPTR) AllocExit, IARG_THREAD_ID, IARG_FUNCRET_EXITPOINT_VALUE, IARG_END);
+        RTN_Close(rtn);
+        found = true;
+    }
+
+    rtn = RTN_FindByName(img, "realloc");
+    if (RTN_Valid(rtn)) {
+        RTN_Open(rtn);
+        RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR) AllocEnter, IARG_THREAD_ID, IARG_FUNCARG_ENTRYPOINT_VALUE, 1,
+                IARG_RETURN_IP, IARG_FUNCARG_ENTRYPOINT_VALUE, 0, IARG_REG_VALUE, REG_STACK_PTR, IARG_END);
+        RTN_InsertCall(rtn, IPOINT_AFTER, (AFUNPTR) AllocExit, IARG_THREAD_ID, IARG_FUNCRET_EXITPOINT_VALUE, IARG_END);
+        RTN_Close(rtn);
+        found = true;
+    }
+
+    rtn = RTN_FindByName(img, "free");
+    if (RTN_Valid(rtn)) {
+        RTN_Open(rtn);
+        RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR) FreeEnter, IARG_THREAD_ID, IARG_FUNCARG_ENTRYPOINT_VALUE, 0,
+                IARG_REG_VALUE, REG_STACK_PTR, IARG_END);
+        RTN_Close(rtn);
+        found = true;
+    }
+
+    if (found) info("Miss profiler: tracking allocations in %s", IMG_Name(img).c_str());
+}
+
+void MissProfProcessFork() {
+    futex_init(&objLock);
+    for (uint32_t i = 0; i < MAX_THREADS; i++) allocCalls[i].depth = 0;
+    unbalancedCalls = 0;
+}
+
+/* Profiler */
+
+MissProfiler::MissProfiler(uint32_t _numProcs, uint32_t _numSrcs, uint32_t maxEntries, uint64_t _minAllocBytes)
+    : numProcs(_numProcs), numSrcs(_numSrcs), minAllocBytes(_minAllocBytes)
+{
+    procs = gm_calloc<ProcTables>(numProcs);
+    for (uint32_t p = 0; p < numProcs; p++) {
+        futex_init(&procs[p].lock);
+        procs[p].pcs = new MissProfTable(maxEntries);
+        procs[p].sites = new MissProfTable(maxEntries);
+    }
+    ctxs = gm_calloc<MissProfCtx>(numSrcs);
+}
+
+void MissProfiler::startMiss(uint32_t srcId, Address pc, Address vLineAddr) {
+    assert(srcId < numSrcs);
+    MissProfCtx& ctx = ctxs[srcId];
+    ctx.pc = pc;
+    ctx.site = FindAllocSite(vLineAddr << lineBits);
+    ctx.proc = procIdx;
+    ctx.valid = 1;
+}
+
+void MissProfiler::record(const MissProfCtx& ctx, MissProfCounter c) {
+    assert(ctx.proc < numProcs);
+    ProcTables& pt = procs[ctx.proc];
+    futex_lock(&pt.lock);
+    pt.pcs->inc(ctx.pc, c);
+    pt.sites->inc(ctx.site, c);
+    pt.totals[c]++;
+    futex_unlock(&pt.lock);
+}
+
+std::string SymbolizeAddr(Address addr) {
+    std::stringstream ss;
+    ss << "0x" << std::hex << addr << std::dec;
+    PIN_LockClient();
+    RTN rtn = RTN_FindByAddress(addr);
+    if (RTN_Valid(rtn)) ss << " " << RTN_Name(rtn) << "+0x" << std::hex << (addr - RTN_Address(rtn)) << std::dec;
+    IMG img = IMG_FindByAddress(addr);
+    if (IMG_Valid(img)) {
+        const std::string& imgName = IMG_Name(img);
+        ss << " (" << imgName.substr(imgName.rfind('/') + 1) << ")";
+    }
+    INT32 col = 0, line = 0;
+    std::string file;
+    PIN_GetSourceLocation(addr, &col, &line, &file);
+    if (line && !file.empty()) ss << " " << file << ":" << line;
+    PIN_UnlockClient();
+    return ss.str();
+}
+
+static const char* counterNames[] = {"L1", "L2", "L3", "rowMiss"};
+
+static void WriteTable(std::ofstream& out, const char* title, const std::vector<MissProfEntry>& entries, const uint64_t* totals,
+        uint64_t replacements, bool sites)
+{
+    out << title << " (" << entries.size() << " entries, " << replacements << " replaced)" << std::endl;
+    out << "  rank";
+    for (uint32_t c = 0; c < MP_NUM_COUNTERS; c++) out << "\t" << counterNames[c];
+    out << "\t%L3\terr\t" << (sites? "allocation site" : "code") << std::endl;
+    uint32_t rank = 0;
+    for (const MissProfEntry& e : entries) {
+        out << "  " << ++rank;
+        for (uint32_t c = 0; c < MP_NUM_COUNTERS; c++) out << "\t" << e.counts[c];
+        char pct[16];
+        snprintf(pct, sizeof(pct), "%.1f", totals[MP_L3]? 100.0*e.counts[MP_L3]/totals[MP_L3] : 0.0);
+        out << "\t" << pct << "\t" << e.error << "\t";
+        if (!e.key) out << (sites? "<untracked: stack, static, or small objects>" : "<unknown>");
+        else out << (sites? SymbolizeAddr(e.key - 1) : SymbolizeAddr(e.key));  // sites are return addresses; point at the call
+        out << std::endl;
+    }
+    out << std::endl;
+}
+
+void MissProfiler::writeReport(const char* fileName) {
+    // Copy our tables so we do not hold the lock while symbolizing
+    ProcTables& pt = procs[procIdx];
+    std::vector<MissProfEntry> pcs, sites;
+    uint64_t totals[MP_NUM_COUNTERS];
+    futex_lock(&pt.lock);
+    for (uint32_t i = 0; i < pt.pcs->size(); i++) pcs.push_back(pt.pcs->get(i));
+    for (uint32_t i = 0; i < pt.sites->size(); i++) sites.push_back(pt.sites->get(i));
+    for (uint32_t c = 0; c < MP_NUM_COUNTERS; c++) totals[c] = pt.totals[c];
+    uint64_t pcRepl = pt.pcs->getReplacements();
+    uint64_t siteRepl = pt.sites->getReplacements();
+    futex_unlock(&pt.lock);
+
+    // Deepest misses first
+    auto cmp = [](const MissProfEntry& a, const MissProfEntry& b) {
+        for (int32_t c = MP_CACHE_LEVELS - 1; c >= 0; c--) {
+            if (a.counts[c] != b.counts[c]) return a.counts[c] > b.counts[c];
+        }
+        return a.counts[MP_DRAM_ROW] > b.counts[MP_DRAM_ROW];
+    };
+    std::sort(pcs.begin(), pcs.end(), cmp);
+    std::sort(sites.begin(), sites.end(), cmp);
+
+    std::ofstream out(fileName);
+    out << "# Hot misses, process " << procIdx << std::endl;
+    out << "# Demand misses per cache level (L1 is the level closest to cores) and DRAM row misses of reads;" << std::endl;
+    out << "# code is the basic block that issued the access, err bounds the misses a table entry may have lost" << std::endl;
+    out << "Totals:";
+    for (uint32_t c = 0; c < MP_NUM_COUNTERS; c++) out << " " << counterNames[c] << " " << totals[c];
+    out << std::endl;
+    out << "Unbalanced allocator calls: " << unbalancedCalls << std::endl << std::endl;
+    if (unbalancedCalls) warn("Miss profiler: %ld allocator calls did not pair up with their exits; some allocation sites may be missing", unbalancedCalls);
+    WriteTable(out, "Code", pcs, totals, pcRepl, false);
+    WriteTable(out, "Data", sites, totals, siteRepl, true);
+    info("Wrote miss profile to %s", fileName);
+}
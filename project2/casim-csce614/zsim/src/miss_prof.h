@@ -0,0 +1,156 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MISS_PROF_H_
+#define MISS_PROF_H_
+
+/* Miss attribution profiler (sim.missProfile). Attributes demand misses at
+ * each cache level, and DRAM row misses, to the code that issued them and to
+ * the allocation site of the data they touched, and writes a ranked "hot
+ * misses" report per process (missprof-p<procIdx>.txt) when it ends.
+ *
+ * Code is identified by the address of the basic block that issued the access
+ * (cores do not track per-uop PCs), which cores pass to their L1s with
+ * FilterCache::setProfPc(). Data is identified by the return address of the
+ * malloc/calloc/realloc call that allocated the object; we intercept those
+ * and free() in the simulated process and keep a per-process map of live
+ * objects. Accesses outside any tracked object (stack, static data, or
+ * objects smaller than sim.missProfileMinAllocBytes) fall in one bucket.
+ *
+ * When an L1 misses, it saves the context (code, data, process) of its
+ * requester, and every level below attributes its misses to that context,
+ * through req.srcId. DRAM read events carry the context to the weave phase,
+ * where row hits and misses are known.
+ *
+ * Per-process tables are bounded to sim.missProfileEntries code and data
+ * entries. When a table is full, a new key replaces the entry with the fewest
+ * misses, and inherits its count as the error bound (space-saving), so heavy
+ * hitters are never lost.
+ */
+
+#include <stdint.h>
+#include <string>
+#include "galloc.h"
+#include "locks.h"
+#include "memory_hierarchy.h"
+#include "pin.H"
+
+enum MissProfCounter {
+    MP_L1,
+    MP_L2,
+    MP_L3,
+    MP_DRAM_ROW,    // DRAM row misses (reads only)
+    MP_NUM_COUNTERS
+};
+
+#define MP_CACHE_LEVELS MP_DRAM_ROW
+
+// Requester context at the time of a miss; DRAM events keep a copy
+struct MissProfCtx {
+    Address pc;     // basic block address, 0 if unknown
+    Address site;   // allocation site, 0 if untracked
+    uint32_t proc;
+    uint32_t valid;  // 0 if unset
+
+    MissProfCtx() : pc(0), site(0), proc(0), valid(0) {}
+};
+
+struct MissProfEntry {
+    Address key;
+    uint64_t counts[MP_NUM_COUNTERS];
+    uint64_t weight;  // sum of counts, including the inherited error
+    uint64_t error;   // upper bound of misses not counted (space-saving)
+    int32_t next;     // hash chain
+};
+
+class MissProfTable : public GlobAlloc {
+    private:
+        MissProfEntry* entries;
+        int32_t* heads;
+        uint32_t numEntries, maxEntries, hashMask;
+        uint64_t replacements;
+
+    public:
+        explicit MissProfTable(uint32_t _maxEntries);
+        void inc(Address key, MissProfCounter c);
+
+        uint32_t size() const { return numEntries; }
+        const MissProfEntry& get(uint32_t i) const { return entries[i]; }
+        uint64_t getReplacements() const { return replacements; }
+
+    private:
+        uint32_t bucket(Address key) const;
+        void unlink(uint32_t idx);
+};
+
+class MissProfiler : public GlobAlloc {
+    private:
+        struct ProcTables {
+            lock_t lock;
+            MissProfTable* pcs;
+            MissProfTable* sites;
+            uint64_t totals[MP_NUM_COUNTERS];
+        };
+
+        ProcTables* procs;
+        MissProfCtx* ctxs;  // per srcId
+        uint32_t numProcs;
+        uint32_t numSrcs;
+        const uint64_t minAllocBytes;
+
+    public:
+        MissProfiler(uint32_t _numProcs, uint32_t _numSrcs, uint32_t maxEntries, uint64_t _minAllocBytes);
+
+        // Bound phase, from the L1 miss path of srcId. Looks up the object that holds vLineAddr.
+        void startMiss(uint32_t srcId, Address pc, Address vLineAddr);
+
+        // Bound phase, for a demand miss at a cache level (0 is the L1)
+        void recordMiss(uint32_t level, uint32_t srcId) {
+            const MissProfCtx& ctx = ctxs[srcId];
+            if (ctx.valid) record(ctx, (MissProfCounter)level);
+        }
+
+        // For events that outlive the request (e.g., DRAM reads in the weave phase)
+        const MissProfCtx& getCtx(uint32_t srcId) const { return ctxs[srcId]; }
+        void record(const MissProfCtx& ctx, MissProfCounter c);
+
+        uint64_t getMinAllocBytes() const { return minAllocBytes; }
+
+        // Symbolizes the calling process's tables and writes its report. Call from the process, before it ends.
+        void writeReport(const char* fileName);
+};
+
+/* Process-local hooks (in miss_prof.cpp) */
+
+// Called on image load; instruments the image's allocation functions
+void MissProfInstrumentImage(IMG img);
+
+// A forked child inherits its parent's live objects, but not its lock holders
+void MissProfProcessFork();
+
+// Formats a code address with its routine, image, and source line, if the calling process knows them
+std::string SymbolizeAddr(Address addr);
+
+#endif  // MISS_PROF_H_
@@ -35,13 +35,28 @@
 #include <string>
 #include <unordered_map>
 
+class AggregateStat;
+class NetRoute;
+
 class Network {
     private:
         std::unordered_map<std::string, uint32_t> delayMap;
 
+    protected:
+        Network() {} //for derived topologies that do not use a description file
+
     public:
         explicit Network(const char* filename);
-        uint32_t getRTT(const char* src, const char* dst);
+        virtual ~Network() {}
+
+        virtual uint32_t getRTT(const char* src, const char* dst);
+
+        // Networks that model contention return the path between two entities, which
+        // coherence controllers use to record weave-phase events (see mesh_network.h).
+        // Fixed-delay networks have no paths.
+        virtual NetRoute* getRoute(const char* src, const char* dst) {return nullptr;}
+
+        virtual void initStats(AggregateStat* parentStat) {}
 };
 
 #endif  // NETWORK_H_
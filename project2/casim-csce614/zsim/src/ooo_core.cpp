@@ -41,8 +41,7 @@
 #define DEBUG_MSG(args...)
 //#define DEBUG_MSG(args...) info(args)
 
-// Core parameters
-// TODO(dsm): Make OOOCore templated, subsuming these
+// Core parameters (structure sizes and widths are in the core shape, see below)
 
 // Stages --- more or less matched to Westmere, but have not seen detailed pipe diagrams anywhare
 #define FETCH_STAGE 1
@@ -52,10 +51,9 @@
 
 #define L1D_LAT 4  // fixed, and FilterCache does not include L1 delay
 #define FETCH_BYTES_PER_CYCLE 16
-#define ISSUES_PER_CYCLE 4
-#define RF_READS_PER_CYCLE 3
 
-OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name) : Core(_name), l1i(_l1i), l1d(_l1d), cRec(0, _name) {
+template <typename S, typename P>
+OOOCoreImpl<S, P>::OOOCoreImpl(FilterCache* _l1i, FilterCache* _l1d, g_string& _name, uint32_t _domain) : OOOCore(_name), l1i(_l1i), l1d(_l1d), cRec(_domain, _name) {
     decodeCycle = DECODE_STAGE;  // allow subtracting from it
     curCycle = 0;
     phaseEndCycle = zinfo->phaseLength;
@@ -64,6 +62,7 @@ OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name) : Core(_
         regScoreboard[i] = 0;
     }
     prevBbl = nullptr;
+    prevBblAddr = 0;
 
     lastStoreCommitCycle = 0;
     lastStoreAddrCommitCycle = 0;
@@ -76,7 +75,8 @@ OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name) : Core(_
     for (uint32_t i = 0; i < FWD_ENTRIES; i++) fwdArray[i].set((Address)(-1L), 0);
 }
 
-void OOOCore::initStats(AggregateStat* parentStat) {
+template <typename S, typename P>
+void OOOCoreImpl<S, P>::initStats(AggregateStat* parentStat) {
     AggregateStat* coreStat = new AggregateStat();
     coreStat->init(name.c_str(), "Core stats");
 
@@ -110,6 +110,22 @@ void OOOCore::initStats(AggregateStat* parentStat) {
     coreStat->append(mispredBranchesStat);
     coreStat->append(condBranchesStat);
 
+    AggregateStat* bpStat = new AggregateStat();
+    bpStat->init("bp", "Branch predictor stats");
+    auto m = [this]() { return instrs? mispredBranches*1000*1000/instrs : 0; };
+    LambdaStat<decltype(m)>* mpkiStat = new LambdaStat<decltype(m)>(m);
+    mpkiStat->init("mpkiX1000", "Branch mispredictions per 1K instrs, x1000 (fixed point)");
+    bpStat->append(mpkiStat);
+    auto b = [this]() { return branchPred.storageBits(); };
+    LambdaStat<decltype(b)>* storageStat = new LambdaStat<decltype(b)>(b);
+    storageStat->init("storageBits", "Branch predictor state budget (bits)");
+    bpStat->append(storageStat);
+    branchPred.initStats(bpStat);
+    coreStat->append(bpStat);
+
+    profLoadLatHist.init("loadLatHist", "Load-to-use latency histogram");
+    coreStat->append(&profLoadLatHist);
+
 #ifdef OOO_STALL_STATS
     profFetchStalls.init("fetchStalls",  "Fetch stalls");  coreStat->append(&profFetchStalls);
     profDecodeStalls.init("decodeStalls", "Decode stalls"); coreStat->append(&profDecodeStalls);
@@ -119,10 +135,13 @@ void OOOCore::initStats(AggregateStat* parentStat) {
     parentStat->append(coreStat);
 }
 
-uint64_t OOOCore::getInstrs() const {return instrs;}
-uint64_t OOOCore::getPhaseCycles() const {return curCycle % zinfo->phaseLength;}
+template <typename S, typename P>
+uint64_t OOOCoreImpl<S, P>::getInstrs() const {return instrs;}
+template <typename S, typename P>
+uint64_t OOOCoreImpl<S, P>::getPhaseCycles() const {return curCycle % zinfo->phaseLength;}
 
-void OOOCore::contextSwitch(int32_t gid) {
+template <typename S, typename P>
+void OOOCoreImpl<S, P>::contextSwitch(int32_t gid) {
     if (gid == -1) {
         // Do not execute previous BBL, as we were context-switched
         prevBbl = nullptr;
@@ -134,37 +153,45 @@ void OOOCore::contextSwitch(int32_t gid) {
 }
 
 
-InstrFuncPtrs OOOCore::GetFuncPtrs() {return {LoadFunc, StoreFunc, BblFunc, BranchFunc, PredLoadFunc, PredStoreFunc, FPTR_ANALYSIS, {0}};}
+template <typename S, typename P>
+InstrFuncPtrs OOOCoreImpl<S, P>::GetFuncPtrs() {return {LoadFunc, StoreFunc, BblFunc, BranchFunc, PredLoadFunc, PredStoreFunc, FPTR_ANALYSIS, {0}};}
 
-inline void OOOCore::load(Address addr) {
+template <typename S, typename P>
+inline void OOOCoreImpl<S, P>::load(Address addr) {
     loadAddrs[loads++] = addr;
 }
 
-void OOOCore::store(Address addr) {
+template <typename S, typename P>
+void OOOCoreImpl<S, P>::store(Address addr) {
     storeAddrs[stores++] = addr;
 }
 
 // Predicated loads and stores call this function, gets recorded as a 0-cycle op.
 // Predication is rare enough that we don't need to model it perfectly to be accurate (i.e. the uops still execute, retire, etc), but this is needed for correctness.
-void OOOCore::predFalseLoad() {
+template <typename S, typename P>
+void OOOCoreImpl<S, P>::predFalseLoad() {
     loadAddrs[loads++] = -1L;
 }
 
-void OOOCore::predFalseStore() {
+template <typename S, typename P>
+void OOOCoreImpl<S, P>::predFalseStore() {
     storeAddrs[stores++] = -1L;
 }
 
-void OOOCore::branch(Address pc, bool taken, Address takenNpc, Address notTakenNpc) {
+template <typename S, typename P>
+void OOOCoreImpl<S, P>::branch(Address pc, bool taken, Address takenNpc, Address notTakenNpc) {
     branchPc = pc;
     branchTaken = taken;
     branchTakenNpc = takenNpc;
     branchNotTakenNpc = notTakenNpc;
 }
 
-inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
+template <typename S, typename P>
+inline void OOOCoreImpl<S, P>::bbl(Address bblAddr, BblInfo* bblInfo) {
     if (!prevBbl) {
         // This is the 1st BBL since scheduled, nothing to simulate
         prevBbl = bblInfo;
+        prevBblAddr = bblAddr;
         // Kill lingering ops from previous BBL
         loads = stores = 0;
         return;
@@ -175,6 +202,9 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
     uint32_t bblInstrs = prevBbl->instrs;
     DynBbl* bbl = &(prevBbl->oooBbl[0]);
     prevBbl = bblInfo;
+    l1i->setProfPc(prevBblAddr);  // wrong-path fetches are charged to the mispredicted block
+    l1d->setProfPc(prevBblAddr);
+    prevBblAddr = bblAddr;
 
     uint32_t loadIdx = 0;
     uint32_t storeIdx = 0;
@@ -202,8 +232,8 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
         prevDecCycle = uop->decCycle;
         uopQueue.markLeave(curCycle);
 
-        // Implement issue width limit --- we can only issue 4 uops/cycle
-        if (curCycleIssuedUops >= ISSUES_PER_CYCLE) {
+        // Implement issue width limit --- we can only issue S::ISSUE uops/cycle
+        if (curCycleIssuedUops >= S::ISSUE) {
 #ifdef OOO_STALL_STATS
             profIssueStalls.inc();
 #endif
@@ -224,8 +254,8 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
         // RF read stalls
         // if srcs are not available at issue time, we have to go thru the RF
         curCycleRFReads += ((c0 < curCycle)? 1 : 0) + ((c1 < curCycle)? 1 : 0);
-        if (curCycleRFReads > RF_READS_PER_CYCLE) {
-            curCycleRFReads -= RF_READS_PER_CYCLE;
+        if (curCycleRFReads > S::RF_READS) {
+            curCycleRFReads -= S::RF_READS;
             curCycleIssuedUops = 0;  // or 1? that's probably a 2nd-order detail
             insWindow.advancePos(curCycle);
         }
@@ -291,6 +321,8 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
                         reqSatisfiedCycle = MAX(reqSatisfiedCycle, fwdArray[fwdIdx].storeCycle);
                     }
 
+                    if (addr != ((Address)-1L)) profLoadLatHist.record(reqSatisfiedCycle - dispatchCycle);
+
                     commitCycle = reqSatisfiedCycle;
                     loadQueue.markRetire(commitCycle);
                 }
@@ -426,6 +458,7 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
     branchPc = 0;  // clear for next BBL
 
     // Simulate current bbl ifetch
+    l1i->setProfPc(bblAddr);
     Address endAddr = bblAddr + bblInfo->bytes;
     for (Address fetchAddr = bblAddr; fetchAddr < endAddr; fetchAddr += lineSize) {
         // The Nehalem frontend fetches instructions in 16-byte-wide accesses.
@@ -450,7 +483,8 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
 }
 
 // Timing simulation code
-void OOOCore::join() {
+template <typename S, typename P>
+void OOOCoreImpl<S, P>::join() {
     DEBUG_MSG("[%s] Joining, curCycle %ld phaseEnd %ld", name.c_str(), curCycle, phaseEndCycle);
     uint64_t targetCycle = cRec.notifyJoin(curCycle);
     if (targetCycle > curCycle) advance(targetCycle);
@@ -459,24 +493,28 @@ void OOOCore::join() {
     DEBUG_MSG("[%s] Joined, curCycle %ld phaseEnd %ld", name.c_str(), curCycle, phaseEndCycle);
 }
 
-void OOOCore::leave() {
+template <typename S, typename P>
+void OOOCoreImpl<S, P>::leave() {
     DEBUG_MSG("[%s] Leaving, curCycle %ld phaseEnd %ld", name.c_str(), curCycle, phaseEndCycle);
     cRec.notifyLeave(curCycle);
 }
 
-void OOOCore::cSimStart() {
+template <typename S, typename P>
+void OOOCoreImpl<S, P>::cSimStart() {
     uint64_t targetCycle = cRec.cSimStart(curCycle);
     assert(targetCycle >= curCycle);
     if (targetCycle > curCycle) advance(targetCycle);
 }
 
-void OOOCore::cSimEnd() {
+template <typename S, typename P>
+void OOOCoreImpl<S, P>::cSimEnd() {
     uint64_t targetCycle = cRec.cSimEnd(curCycle);
     assert(targetCycle >= curCycle);
     if (targetCycle > curCycle) advance(targetCycle);
 }
 
-void OOOCore::advance(uint64_t targetCycle) {
+template <typename S, typename P>
+void OOOCoreImpl<S, P>::advance(uint64_t targetCycle) {
     assert(targetCycle > curCycle);
     decodeCycle += targetCycle - curCycle;
     insWindow.longAdvance(curCycle, targetCycle);
@@ -491,23 +529,28 @@ void OOOCore::advance(uint64_t targetCycle) {
 
 // Pin interface code
 
-void OOOCore::LoadFunc(THREADID tid, ADDRINT addr) {static_cast<OOOCore*>(cores[tid])->load(addr);}
-void OOOCore::StoreFunc(THREADID tid, ADDRINT addr) {static_cast<OOOCore*>(cores[tid])->store(addr);}
+template <typename S, typename P>
+void OOOCoreImpl<S, P>::LoadFunc(THREADID tid, ADDRINT addr) {static_cast<OOOCoreImpl<S, P>*>(cores[tid])->load(addr);}
+template <typename S, typename P>
+void OOOCoreImpl<S, P>::StoreFunc(THREADID tid, ADDRINT addr) {static_cast<OOOCoreImpl<S, P>*>(cores[tid])->store(addr);}
 
-void OOOCore::PredLoadFunc(THREADID tid, ADDRINT addr, BOOL pred) {
-    OOOCore* core = static_cast<OOOCore*>(cores[tid]);
+template <typename S, typename P>
+void OOOCoreImpl<S, P>::PredLoadFunc(THREADID tid, ADDRINT addr, BOOL pred) {
+    OOOCoreImpl<S, P>* core = static_cast<OOOCoreImpl<S, P>*>(cores[tid]);
     if (pred) core->load(addr);
     else core->predFalseLoad();
 }
 
-void OOOCore::PredStoreFunc(THREADID tid, ADDRINT addr, BOOL pred) {
-    OOOCore* core = static_cast<OOOCore*>(cores[tid]);
+template <typename S, typename P>
+void OOOCoreImpl<S, P>::PredStoreFunc(THREADID tid, ADDRINT addr, BOOL pred) {
+    OOOCoreImpl<S, P>* core = static_cast<OOOCoreImpl<S, P>*>(cores[tid]);
     if (pred) core->store(addr);
     else core->predFalseStore();
 }
 
-void OOOCore::BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
-    OOOCore* core = static_cast<OOOCore*>(cores[tid]);
+template <typename S, typename P>
+void OOOCoreImpl<S, P>::BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
+    OOOCoreImpl<S, P>* core = static_cast<OOOCoreImpl<S, P>*>(cores[tid]);
     core->bbl(bblAddr, bblInfo);
 
     while (core->curCycle > core->phaseEndCycle) {
@@ -526,7 +569,128 @@ void OOOCore::BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
     }
 }
 
-void OOOCore::BranchFunc(THREADID tid, ADDRINT pc, BOOL taken, ADDRINT takenNpc, ADDRINT notTakenNpc) {
-    static_cast<OOOCore*>(cores[tid])->branch(pc, taken, takenNpc, notTakenNpc);
+template <typename S, typename P>
+void OOOCoreImpl<S, P>::BranchFunc(THREADID tid, ADDRINT pc, BOOL taken, ADDRINT takenNpc, ADDRINT notTakenNpc) {
+    static_cast<OOOCoreImpl<S, P>*>(cores[tid])->branch(pc, taken, takenNpc, notTakenNpc);
+}
+
+
+// Core shapes
+
+// Westmere/Nehalem, the original (and default) model
+struct NehalemShape {
+    static const uint32_t IW = 36, ROB = 128, RETIRE = 4, LQ = 32, SQ = 32, UOPQ = 28;
+    static const uint32_t ISSUE = 4, RF_READS = 3;
+    static const uint32_t BP_NB = 11, BP_HB = 18, BP_LB = 14;
+};
+
+// Silvermont-like: narrow and shallow (the real core has per-cluster RSs, we approximate with a unified IW)
+struct SilvermontShape {
+    static const uint32_t IW = 32, ROB = 32, RETIRE = 2, LQ = 10, SQ = 16, UOPQ = 32;
+    static const uint32_t ISSUE = 2, RF_READS = 3;
+    static const uint32_t BP_NB = 11, BP_HB = 18, BP_LB = 14;
+};
+
+// Skylake-like: the PRF removes the ROB-read bottleneck, so RF reads are effectively unlimited
+struct SkylakeShape {
+    static const uint32_t IW = 97, ROB = 224, RETIRE = 4, LQ = 72, SQ = 56, UOPQ = 64;
+    static const uint32_t ISSUE = 4, RF_READS = 64;
+    static const uint32_t BP_NB = 12, BP_HB = 20, BP_LB = 16;
+};
+
+// Golden Cove-like
+struct GoldenCoveShape {
+    static const uint32_t IW = 160, ROB = 512, RETIRE = 8, LQ = 192, SQ = 114, UOPQ = 144;
+    static const uint32_t ISSUE = 6, RF_READS = 64;
+    static const uint32_t BP_NB = 13, BP_HB = 22, BP_LB = 17;
+};
+
+typedef OOOCore* (*OOOCoreFactory)(FilterCache*, FilterCache*, g_string&, uint32_t);
+
+template <typename S, typename P>
+static OOOCore* makeOOOCore(FilterCache* l1i, FilterCache* l1d, g_string& name, uint32_t domain) {
+    OOOCoreImpl<S, P>* core = gm_memalign<OOOCoreImpl<S, P>>(CACHE_LINE_BYTES, 1);
+    return new (core) OOOCoreImpl<S, P>(l1i, l1d, name, domain);
+}
+
+// Every shape is instantiated with each of these predictors; PAg takes its geometry from the shape
+static const char* branchPredictorNames[] = {"PAg", "gshare", "perceptron", "TAGE-SC-L"};
+static const uint32_t numBranchPredictors = sizeof(branchPredictorNames)/sizeof(branchPredictorNames[0]);
+
+struct OOOCoreShapeEntry {
+    OOOCoreShape shape;
+    OOOCoreFactory factories[numBranchPredictors];
+};
+
+template <typename S>
+static OOOCoreShapeEntry describe(const char* name) {
+    OOOCoreShape s = {name, S::IW, S::ROB, S::RETIRE, S::LQ, S::SQ, S::UOPQ, S::ISSUE, S::RF_READS, S::BP_NB, S::BP_HB, S::BP_LB};
+    OOOCoreShapeEntry e = {s, {
+        makeOOOCore<S, BranchPredictorPAg<S::BP_NB, S::BP_HB, S::BP_LB>>,
+        makeOOOCore<S, GShareBP>,
+        makeOOOCore<S, PerceptronBP>,
+        makeOOOCore<S, TAGESCLBP>,
+    }};
+    return e;
 }
 
+// To support a new shape, add its traits above and an entry here
+static const OOOCoreShapeEntry shapeTable[] = {
+    describe<NehalemShape>("Nehalem"),
+    describe<SilvermontShape>("Silvermont"),
+    describe<SkylakeShape>("Skylake"),
+    describe<GoldenCoveShape>("GoldenCove"),
+};
+
+static const uint32_t numShapes = sizeof(shapeTable)/sizeof(shapeTable[0]);
+
+const OOOCoreShape* OOOCore::getShape(const char* name) {
+    for (uint32_t i = 0; i < numShapes; i++) {
+        if (strcmp(shapeTable[i].shape.name, name) == 0) return &shapeTable[i].shape;
+    }
+    return nullptr;
+}
+
+std::string OOOCore::supportedShapes() {
+    std::string res;
+    for (uint32_t i = 0; i < numShapes; i++) {
+        const OOOCoreShape& s = shapeTable[i].shape;
+        char buf[256];
+        snprintf(buf, sizeof(buf), "\n  %s: iwSize %d robSize %d retireWidth %d lqSize %d sqSize %d uopQueueSize %d issueWidth %d rfReadsPerCycle %d bp %d/%d/%d",
+                s.name, s.iwSize, s.robSize, s.retireWidth, s.lqSize, s.sqSize, s.uopQueueSize, s.issueWidth, s.rfReadsPerCycle, s.bpNB, s.bpHB, s.bpLB);
+        res += buf;
+    }
+    return res;
+}
+
+static int32_t branchPredictorIdx(const char* name) {
+    for (uint32_t i = 0; i < numBranchPredictors; i++) {
+        if (strcmp(branchPredictorNames[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+bool OOOCore::isBranchPredictor(const char* name) {
+    return branchPredictorIdx(name) >= 0;
+}
+
+std::string OOOCore::supportedBranchPredictors() {
+    std::string res;
+    for (uint32_t i = 0; i < numBranchPredictors; i++) {
+        res += " ";
+        res += branchPredictorNames[i];
+    }
+    return res;
+}
+
+OOOCore* OOOCore::create(const OOOCoreShape& shape, const char* branchPredictor, FilterCache* l1i, FilterCache* l1d, g_string& name, uint32_t domain) {
+    int32_t bp = branchPredictorIdx(branchPredictor);
+    if (bp < 0) panic("%s: Invalid branch predictor %s, supported predictors:%s", name.c_str(), branchPredictor, supportedBranchPredictors().c_str());
+    for (uint32_t i = 0; i < numShapes; i++) {
+        if (shapeTable[i].shape.sameParams(shape)) return shapeTable[i].factories[bp](l1i, l1d, name, domain);
+    }
+    panic("%s: OOO core shape (iwSize %d robSize %d retireWidth %d lqSize %d sqSize %d uopQueueSize %d issueWidth %d rfReadsPerCycle %d bp %d/%d/%d) "
+            "is not instantiated; add it to shapeTable in ooo_core.cpp. Supported shapes:%s", name.c_str(),
+            shape.iwSize, shape.robSize, shape.retireWidth, shape.lqSize, shape.sqSize, shape.uopQueueSize, shape.issueWidth,
+            shape.rfReadsPerCycle, shape.bpNB, shape.bpHB, shape.bpLB, supportedShapes().c_str());
+}
@@ -29,8 +29,10 @@
 #include <algorithm>
 #include <queue>
 #include <string>
+#include "branch_pred.h"
 #include "core.h"
 #include "g_std/g_multimap.h"
+#include "g_std/g_vector.h"
 #include "memory_hierarchy.h"
 #include "ooo_core_recorder.h"
 #include "pad.h"
@@ -40,90 +42,35 @@
 
 class FilterCache;
 
-/* 2-level branch predictor:
- *  - L1: Branch history shift registers (bshr): 2^NB entries, HB bits of history/entry, indexed by XOR'd PC
- *  - L2: Pattern history table (pht): 2^LB entries, 2-bit sat counters, indexed by XOR'd bshr contents
- *  NOTE: Assumes LB is in [NB, HB] range for XORing (e.g., HB = 18 and NB = 10, LB = 13 is OK)
+/* Instruction window. Keeps, for every future cycle, which ports are taken
+ * and how many uops are scheduled. Cycles are kept in two H-cycle windows
+ * (current and next) that are rebased every H cycles; farther cycles go into
+ * a sorted overflow vector. Port occupancy is also kept as per-port bitmaps,
+ * 64 cycles per word, so finding the first cycle with a free port among
+ * portMask takes a few ANDs and a ctz per 64 cycles instead of a probe per
+ * cycle (long-latency uops and LSU backpressure used to probe linearly).
  */
-template<uint32_t NB, uint32_t HB, uint32_t LB>
-class BranchPredictorPAg {
-    private:
-        uint32_t bhsr[1 << NB];
-        uint8_t pht[1 << LB];
-        bool useA2; // Ture: use A2, else use A3
-
-    public:
-        BranchPredictorPAg() {
-            useA2 = true;
-            uint32_t numBhsrs = 1 << NB;
-            uint32_t phtSize = 1 << LB;
-
-            for (uint32_t i = 0; i < numBhsrs; i++) {
-                bhsr[i] = 0;
-            }
-            for (uint32_t i = 0; i < phtSize; i++) {
-                pht[i] = 1;  // weak non-taken
-            }
-
-            static_assert(LB <= HB, "Too many PHT entries");
-            static_assert(LB >= NB, "Too few PHT entries (you'll need more XOR'ing)");
-        }
-
-        // Predicts and updates; returns false if mispredicted
-        inline bool predict(Address branchPc, bool taken) {
-            uint32_t bhsrMask = (1 << NB) - 1;
-            uint32_t histMask = (1 << HB) - 1;
-            uint32_t phtMask  = (1 << LB) - 1;
-
-            // Predict
-            // uint32_t bhsrIdx = ((uint32_t)( branchPc ^ (branchPc >> NB) ^ (branchPc >> 2*NB) )) & bhsrMask;
-            uint32_t bhsrIdx = ((uint32_t)( branchPc >> 1)) & bhsrMask;
-            uint32_t phtIdx = bhsr[bhsrIdx];
-
-            // Shift-XOR-mask to fit in PHT
-            phtIdx ^= (phtIdx & ~phtMask) >> (HB - LB); // take the [HB-1, LB] bits of bshr, XOR with [LB-1, ...] bits
-            phtIdx &= phtMask;
-
-            // If uncommented, behaves like a global history predictor
-            // bhsrIdx = 0;
-            // phtIdx = (bhsr[bhsrIdx] ^ ((uint32_t)branchPc)) & phtMask;
-
-            bool pred = pht[phtIdx] > 1;
-
-            // info("BP Pred: 0x%lx bshr[%d]=%x taken=%d pht=%d pred=%d", branchPc, bhsrIdx, phtIdx, taken, pht[phtIdx], pred);
-
-            // Update
-            if (useA2) {
-                pht[phtIdx] = taken? (pred? 3 : (pht[phtIdx]+1)) : (pred? (pht[phtIdx]-1) : 0); //2-bit saturating counter
-            } else {
-                // Please implement Automaton 3 for update
-
-            }
-            bhsr[bhsrIdx] = ((bhsr[bhsrIdx] << 1) & histMask ) | (taken? 1: 0); //we apply phtMask here, dependence is further away
-
-            // info("BP Update: newPht=%d newBshr=%x", pht[phtIdx], bhsr[bhsrIdx]);
-            return (taken == pred);
-        }
-
-        // Set to use Automaton 3
-        inline void useA3() {useA2 = false;}
-};
-
-
 template<uint32_t H, uint32_t WSZ>
 class WindowStructure {
     private:
-        // NOTE: Nehalem has POPCNT, but we want this to run reasonably fast on Core2's, so let's keep track of both count and mask.
-        struct WinCycle {
+        static_assert(H % 64 == 0, "WindowStructure: H must be a multiple of 64");
+        static_assert((H & (H - 1)) == 0, "WindowStructure: H must be a power of 2 (physSlot() wraps with a mask)");
+        static const uint32_t NPORTS = 8;  // port masks are uint8_t
+        static const uint32_t WORDS = 2*H/64;
+
+        // Both windows live in one 2H-cycle array; window w (0=cur, 1=next) starts at (curHalf ^ w)*H
+        uint8_t* occUnits;
+        uint8_t* count;
+        uint64_t portBusy[NPORTS][WORDS];  // bit i of word j: port busy at physical slot j*64+i
+        uint32_t curHalf;
+
+        struct UBCycle {
+            uint64_t cycle;
             uint8_t occUnits;
             uint8_t count;
-            inline void set(uint8_t o, uint8_t c) {occUnits = o; count = c;}
+            bool operator<(uint64_t c) const {return cycle < c;}
         };
-
-        WinCycle* curWin;
-        WinCycle* nextWin;
-        typedef g_map<uint64_t, WinCycle> UBWin;
-        typedef typename UBWin::iterator UBWinIterator;
+        typedef g_vector<UBCycle> UBWin;  // sorted by cycle
         UBWin ubWin;
         uint32_t occupancy;  // elements scheduled in the future
 
@@ -133,8 +80,12 @@ class WindowStructure {
 
     public:
         WindowStructure() {
-            curWin = gm_calloc<WinCycle>(H);
-            nextWin = gm_calloc<WinCycle>(H);
+            occUnits = gm_calloc<uint8_t>(2*H);
+            count = gm_calloc<uint8_t>(2*H);
+            for (uint32_t p = 0; p < NPORTS; p++) {
+                for (uint32_t w = 0; w < WORDS; w++) portBusy[p][w] = 0;
+            }
+            curHalf = 0;
             curPos = 0;
             occupancy = 0;
         }
@@ -159,24 +110,25 @@ class WindowStructure {
         }
 
         inline void advancePos(uint64_t& curCycle) {
-            occupancy -= curWin[curPos].count;
-            curWin[curPos].set(0, 0);
+            uint32_t slot = physSlot(curPos);
+            occupancy -= count[slot];
+            clearSlot(slot);
             curPos++;
             curCycle++;
 
             if (curPos == H) {  // rebase
                 // info("[%ld] Rebasing, curCycle=%ld", curCycle/H, curCycle);
-                std::swap(curWin, nextWin);
+                curHalf ^= 1;
                 curPos = 0;
                 uint64_t nextWinHorizon = curCycle + 2*H;  // first cycle out of range
 
                 if (!ubWin.empty()) {
-                    UBWinIterator it = ubWin.begin();
-                    while (it != ubWin.end() && it->first < nextWinHorizon) {
-                        uint32_t nextWinPos = it->first - H - curCycle;
-                        assert_msg(nextWinPos < H, "WindowStructure: ubWin elem exceeds limit cycle=%ld curCycle=%ld nextWinPos=%d", it->first, curCycle, nextWinPos);
-                        nextWin[nextWinPos] = it->second;
-                        // info("Moved %d events from unbounded window, cycle %ld (%d cycles away)", it->second, it->first, it->first - curCycle);
+                    typename UBWin::iterator it = ubWin.begin();
+                    while (it != ubWin.end() && it->cycle < nextWinHorizon) {
+                        uint32_t nextWinPos = it->cycle - H - curCycle;
+                        assert_msg(nextWinPos < H, "WindowStructure: ubWin elem exceeds limit cycle=%ld curCycle=%ld nextWinPos=%d", it->cycle, curCycle, nextWinPos);
+                        setSlot(physSlot(H + nextWinPos), it->occUnits, it->count);
+                        // info("Moved %d events from unbounded window, cycle %ld (%d cycles away)", it->count, it->cycle, it->cycle - curCycle);
                         it++;
                     }
                     ubWin.erase(ubWin.begin(), it);
@@ -214,6 +166,46 @@ class WindowStructure {
         }
 
     private:
+        // Window position (0..2H-1, relative to the current window) to array slot
+        inline uint32_t physSlot(uint32_t winPos) const {
+            return (winPos + curHalf*H) & (2*H - 1);
+        }
+
+        inline void clearSlot(uint32_t slot) {
+            uint64_t bit = 1ul << (slot & 63);
+            for (uint32_t o = occUnits[slot]; o; o &= o - 1) {
+                portBusy[__builtin_ctz(o)][slot >> 6] &= ~bit;
+            }
+            occUnits[slot] = 0;
+            count[slot] = 0;
+        }
+
+        inline void setSlot(uint32_t slot, uint8_t occ, uint8_t cnt) {
+            clearSlot(slot);
+            uint64_t bit = 1ul << (slot & 63);
+            for (uint32_t o = occ; o; o &= o - 1) {
+                portBusy[__builtin_ctz(o)][slot >> 6] |= bit;
+            }
+            occUnits[slot] = occ;
+            count[slot] = cnt;
+        }
+
+        // Returns the first window position in [winPos, 2H) with a free port in portMask, or 2H if none
+        inline uint32_t findFree(uint32_t winPos, uint8_t portMask) const {
+            while (winPos < 2*H) {
+                uint32_t slot = physSlot(winPos);
+                uint32_t word = slot >> 6;
+                uint32_t bit = slot & 63;
+                uint64_t busy = ~0ul;
+                for (uint32_t m = portMask; m; m &= m - 1) busy &= portBusy[__builtin_ctz(m)][word];
+                uint64_t avail = (~busy) >> bit;
+                // Both windows are word-aligned, so the rest of this word is still in range
+                if (avail) return winPos + __builtin_ctzl(avail);
+                winPos += 64 - bit;
+            }
+            return 2*H;
+        }
+
         template <bool touchOccupancy, bool recordPort>
         void scheduleInternal(uint64_t& curCycle, uint64_t& schedCycle, uint8_t portMask) {
             // If the window is full, advance curPos until it's not
@@ -223,76 +215,59 @@ class WindowStructure {
 
             uint32_t delay = (schedCycle > curCycle)? (schedCycle - curCycle) : 0;
 
-            // Schedule, progressively increasing delay if we cannot find a slot
-            uint32_t curWinPos = curPos + delay;
-            while (curWinPos < H) {
-                if (trySchedule<touchOccupancy, recordPort>(curWin[curWinPos], portMask)) {
-                    schedCycle = curCycle + (curWinPos - curPos);
+            // Schedule at the first cycle at or after the requested one with a free port
+            uint32_t startPos = curPos + delay;
+            uint32_t winPos = (startPos < 2*H)? findFree(startPos, portMask) : startPos;
+            if (winPos < 2*H) {
+                uint32_t slot = physSlot(winPos);
+                uint8_t occ = occUnits[slot];
+                uint8_t cnt = count[slot];
+                bool success = trySchedule<touchOccupancy, recordPort>(occ, cnt, portMask);
+                assert(success);
+                setSlot(slot, occ, cnt);
+                schedCycle = curCycle + (winPos - curPos);
+            } else {
+                schedCycle = curCycle + (winPos - curPos);
+                typename UBWin::iterator it = std::lower_bound(ubWin.begin(), ubWin.end(), schedCycle);
+                while (true) {
+                    if (it == ubWin.end() || it->cycle != schedCycle) {
+                        UBCycle uc = {schedCycle, 0, 0};
+                        bool success = trySchedule<touchOccupancy, recordPort>(uc.occUnits, uc.count, portMask);
+                        assert(success);
+                        ubWin.insert(it, uc);
+                    } else if (!trySchedule<touchOccupancy, recordPort>(it->occUnits, it->count, portMask)) {
+                        // Try next cycle
+                        it++;
+                        schedCycle++;
+                        continue;
+                    }  // else scheduled correctly
                     break;
-                } else {
-                    curWinPos++;
-                }
-            }
-            if (curWinPos >= H) {
-                uint32_t nextWinPos = curWinPos - H;
-                while (nextWinPos < H) {
-                    if (trySchedule<touchOccupancy, recordPort>(nextWin[nextWinPos], portMask)) {
-                        schedCycle = curCycle + (nextWinPos + H - curPos);
-                        break;
-                    } else {
-                        nextWinPos++;
-                    }
-                }
-                if (nextWinPos >= H) {
-                    schedCycle = curCycle + (nextWinPos + H - curPos);
-                    UBWinIterator it = ubWin.lower_bound(schedCycle);
-                    while (true) {
-                        if (it == ubWin.end()) {
-                            WinCycle wc = {0, 0};
-                            bool success = trySchedule<touchOccupancy, recordPort>(wc, portMask);
-                            assert(success);
-                            ubWin.insert(std::pair<uint64_t, WinCycle>(schedCycle, wc));
-                        } else if (it->first != schedCycle) {
-                            WinCycle wc = {0, 0};
-                            bool success = trySchedule<touchOccupancy, recordPort>(wc, portMask);
-                            assert(success);
-                            ubWin.insert(it /*hint, makes insert faster*/, std::pair<uint64_t, WinCycle>(schedCycle, wc));
-                        } else {
-                            if (!trySchedule<touchOccupancy, recordPort>(it->second, portMask)) {
-                                // Try next cycle
-                                it++;
-                                schedCycle++;
-                                continue;
-                            }  // else scheduled correctly
-                        }
-                        break;
-                    }
-                    // info("Scheduled event in unbounded window, cycle %ld", schedCycle);
                 }
+                // info("Scheduled event in unbounded window, cycle %ld", schedCycle);
             }
             if (touchOccupancy) occupancy++;
         }
 
         template <bool touchOccupancy, bool recordPort>
-        inline uint8_t trySchedule(WinCycle& wc, uint8_t portMask) {
+        inline uint8_t trySchedule(uint8_t& occ, uint8_t& cnt, uint8_t portMask) {
             static_assert(!(recordPort && !touchOccupancy), "Can't have recordPort and !touchOccupancy");
             if (touchOccupancy) {
-                uint8_t availMask = (~wc.occUnits) & portMask;
+                uint8_t availMask = (~occ) & portMask;
                 if (availMask) {
-                    // info("PRE: occUnits=%x portMask=%x availMask=%x", wc.occUnits, portMask, availMask);
+                    // info("PRE: occUnits=%x portMask=%x availMask=%x", occ, portMask, availMask);
                     uint8_t firstAvail = __builtin_ffs(availMask) - 1;
                     // NOTE: This is not fair across ports. I tried round-robin scheduling, and there is no measurable difference
                     // (in our case, fairness comes from following program order)
                     if (recordPort) lastPort = firstAvail;
-                    wc.occUnits |= 1 << firstAvail;
-                    wc.count++;
-                    // info("POST: occUnits=%x count=%x firstAvail=%d", wc.occUnits, wc.count, firstAvail);
+                    occ |= 1 << firstAvail;
+                    cnt++;
+                    // info("POST: occUnits=%x count=%x firstAvail=%d", occ, cnt, firstAvail);
                 }
                 return availMask;
             } else {
                 // This is a shadow req, port has only 1 bit set
-                uint8_t availMask = (~wc.occUnits) & portMask;
-                wc.occUnits |= portMask;  // or anyway, no conditionals
+                uint8_t availMask = (~occ) & portMask;
+                occ |= portMask;  // or anyway, no conditionals
                 return availMask;
             }
         }
@@ -368,7 +343,64 @@ class CycleQueue {
 
 struct BblInfo;
 
+/* OOO core shapes. Structure sizes and widths are template parameters, so
+ * the hot loops have constant bounds; each shape in ooo_core.cpp is
+ * instantiated ahead of time, and the config (sys.cores.<group>.ooo) picks
+ * one of them. Shapes are matched by value, so a config can name a preset
+ * and/or spell out its parameters, but only instantiated combinations work.
+ */
+struct OOOCoreShape {
+    const char* name;
+    uint32_t iwSize;        // instruction window (RS) entries
+    uint32_t robSize;
+    uint32_t retireWidth;   // ROB and LSQ retires/cycle
+    uint32_t lqSize;
+    uint32_t sqSize;
+    uint32_t uopQueueSize;  // decoded uop queue between decode and issue
+    uint32_t issueWidth;
+    uint32_t rfReadsPerCycle;
+    uint32_t bpNB, bpHB, bpLB;  // BranchPredictorPAg geometry (other predictors have fixed sizes)
+
+    bool sameParams(const OOOCoreShape& s) const {
+        return iwSize == s.iwSize && robSize == s.robSize && retireWidth == s.retireWidth &&
+            lqSize == s.lqSize && sqSize == s.sqSize && uopQueueSize == s.uopQueueSize &&
+            issueWidth == s.issueWidth && rfReadsPerCycle == s.rfReadsPerCycle &&
+            bpNB == s.bpNB && bpHB == s.bpHB && bpLB == s.bpLB;
+    }
+};
+
+// Interface used by the rest of the simulator; OOOCoreImpl<Shape> has the model
 class OOOCore : public Core {
+    public:
+        explicit OOOCore(g_string& _name) : Core(_name) {}
+
+        // Contention simulation interface
+        virtual EventRecorder* getEventRecorder() = 0;
+        virtual void cSimStart() = 0;
+        virtual void cSimEnd() = 0;
+
+        // Set Automaton 3 for branch predictor update
+        virtual void useA3forBranchPred() = 0;
+
+        // Shapes with a pre-instantiated model; getShape returns nullptr if name is unknown
+        static const OOOCoreShape* getShape(const char* name);
+        static std::string supportedShapes();
+
+        // Branch predictors each shape is instantiated with (sys.cores.<group>.branchPredictor)
+        static bool isBranchPredictor(const char* name);
+        static std::string supportedBranchPredictors();
+
+        // Panics if shape does not match a pre-instantiated one or the branch predictor is unknown
+        static OOOCore* create(const OOOCoreShape& shape, const char* branchPredictor, FilterCache* l1i, FilterCache* l1d, g_string& name, uint32_t domain);
+};
+
+/* S is a shape traits struct with static const uint32_t members IW, ROB,
+ * RETIRE, LQ, SQ, UOPQ, ISSUE, RF_READS, BP_NB, BP_HB and BP_LB, matching
+ * the fields of OOOCoreShape (see the shapes in ooo_core.cpp). P is the
+ * branch predictor (see branch_pred.h).
+ */
+template <typename S, typename P>
+class OOOCoreImpl : public OOOCore {
     private:
         FilterCache* l1i;
         FilterCache* l1d;
@@ -379,6 +411,7 @@ class OOOCore : public Core {
         uint64_t regScoreboard[MAX_REGISTERS]; //contains timestamp of next issue cycles where each reg can be sourced
 
         BblInfo* prevBbl;
+        Address prevBblAddr;
 
         //Record load and store addresses
         Address loadAddrs[256];
@@ -394,8 +427,8 @@ class OOOCore : public Core {
         //buffers, but we split the associative component from the limited-size modeling.
         //NOTE: We do not model the 10-entry fill buffer here; the weave model should take care
         //to not overlap more than 10 misses.
-        ReorderBuffer<32, 4> loadQueue;
-        ReorderBuffer<32, 4> storeQueue;
+        ReorderBuffer<S::LQ, S::RETIRE> loadQueue;
+        ReorderBuffer<S::SQ, S::RETIRE> storeQueue;
 
         uint32_t curCycleRFReads; //for RF read stalls
         uint32_t curCycleIssuedUops; //for uop issue limits
@@ -403,17 +436,16 @@ class OOOCore : public Core {
         //This would be something like the Atom... (but careful, the iw probably does not allow 2-wide when configured with 1 slot)
         //WindowStructure<1024, 1 /*size*/, 2 /*width*/> insWindow; //this would be something like an Atom, except all the instruction pairing business...
 
-        //Nehalem
-        WindowStructure<1024, 36 /*size*/> insWindow; //NOTE: IW width is implicitly determined by the decoder, which sets the port masks according to uop type
-        ReorderBuffer<128, 4> rob;
+        WindowStructure<1024, S::IW> insWindow; //NOTE: IW width is implicitly determined by the decoder, which sets the port masks according to uop type
+        ReorderBuffer<S::ROB, S::RETIRE> rob;
 
-        // Agner's guide says it's a 2-level pred and BHSR is 18 bits, so this is the config that makes sense;
+        // Agner's guide says Nehalem has a 2-level pred and BHSR is 18 bits, so this is the config that makes sense;
         // in practice, this is probably closer to the Pentium M's branch predictor, (see Uzelac and Milenkovic,
         // ISPASS 2009), which get the 18 bits of history through a hybrid predictor (2-level + bimodal + loop)
         // where a few of the 2-level history bits are in the tag.
         // Since this is close enough, we'll leave it as is for now. Feel free to reverse-engineer the real thing...
         // UPDATE: Now pht index is XOR-folded BSHR. This has 6656 bytes total -- not negligible, but not ridiculous.
-        BranchPredictorPAg<11, 18, 14> branchPred;
+        P branchPred;
 
         Address branchPc;  //0 if last bbl was not a conditional branch
         bool branchTaken;
@@ -421,9 +453,10 @@ class OOOCore : public Core {
         Address branchNotTakenNpc;
 
         uint64_t decodeCycle;
-        CycleQueue<28> uopQueue;  // models issue queue
+        CycleQueue<S::UOPQ> uopQueue;  // models issue queue
 
         uint64_t instrs, uops, bbls, approxInstrs, mispredBranches, condBranches;
+        LatencyHistogram profLoadLatHist; // load-to-use, from dispatch to data available
 
 #ifdef OOO_STALL_STATS
         Counter profFetchStalls, profDecodeStalls, profIssueStalls;
@@ -444,7 +477,7 @@ class OOOCore : public Core {
         OOOCoreRecorder cRec;
 
     public:
-        OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name);
+        OOOCoreImpl(FilterCache* _l1i, FilterCache* _l1d, g_string& _name, uint32_t _domain);
 
         void initStats(AggregateStat* parentStat);
 
@@ -460,12 +493,11 @@ class OOOCore : public Core {
         InstrFuncPtrs GetFuncPtrs();
 
         // Contention simulation interface
-        inline EventRecorder* getEventRecorder() {return cRec.getEventRecorder();}
+        EventRecorder* getEventRecorder() {return cRec.getEventRecorder();}
         void cSimStart();
         void cSimEnd();
 
-        // Set Automaton 3 for branch predictor update
-        inline void useA3forBranchPred() {branchPred.useA3();}
+        void useA3forBranchPred() {branchPred.useA3();}
 
     private:
         inline void load(Address addr);
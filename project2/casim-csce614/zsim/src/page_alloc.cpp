@@ -0,0 +1,122 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "page_alloc.h"
+#include "bithacks.h"
+#include "log.h"
+
+PageAllocator::PageAllocator(Policy _policy, uint64_t sizeMB, uint32_t lineSize, uint32_t maxProcs, uint32_t procs,
+        uint32_t _colors, uint32_t _colorShift, bool _partitionColors, uint64_t seed)
+    : policy(_policy), pageLinesBits(12 - ilog2(lineSize)), numFrames((sizeMB << 20) >> 12), rng(seed), nextChunk(0),
+      colors(_colors), colorShift(_colorShift), colorsPerProc(MAX(1u, _colors/MAX(1u, procs))), partitionColors(_partitionColors), allocFrames(0)
+{
+    if (lineSize > 4096) panic("Page allocator needs lines of at most 4KB");
+    if (!numFrames || numFrames >= (1ul << 32)) panic("Page allocator: invalid physical memory size %ld MB", sizeMB);
+    if (policy == COLOR && (!colors || colors > numFrames)) panic("Page allocator: invalid number of colors %d", colors);
+    roots.resize(maxProcs, nullptr);
+    if (policy == RANDOM) usedFrames.resize((numFrames + 63)/64, 0);
+    if (policy == COLOR) colorAllocs.resize(colors, 0);
+    futex_init(&lock);
+}
+
+void PageAllocator::initStats(AggregateStat* parentStat) {
+    AggregateStat* allocStat = new AggregateStat();
+    allocStat->init("physMem", "Physical page allocator stats");
+    profPages.init("pages", "Pages mapped"); allocStat->append(&profPages);
+    profNodes.init("nodes", "Radix table nodes allocated"); allocStat->append(&profNodes);
+    profColorMisses.init("colorMisses", "Pages that did not get their color (it was exhausted)"); allocStat->append(&profColorMisses);
+    parentStat->append(allocStat);
+}
+
+uint32_t PageAllocator::mapPage(uint32_t procIdx, uint64_t vpn) {
+    assert(procIdx < roots.size());
+    futex_lock(&lock);
+
+    // Walk down, creating nodes as needed
+    void* volatile* slot = &roots[procIdx];
+    for (uint32_t level = LEVELS; level > 0; level--) {
+        if (!*slot) {
+            void* node;
+            if (level > 1) node = gm_calloc<Node>(1);
+            else node = gm_calloc<Leaf>(1);
+            __sync_synchronize();  // lock-free readers must see it zeroed
+            *slot = node;
+            profNodes.inc();
+        }
+        if (level > 1) slot = &static_cast<Node*>(*slot)->children[(vpn >> (LEVEL_BITS*(level-1))) % FANOUT];
+    }
+    Leaf* leaf = static_cast<Leaf*>(*slot);
+
+    uint32_t frame = leaf->frames[vpn % FANOUT];
+    if (!frame) {  // may have raced with another thread of this process
+        frame = allocFrame(procIdx, vpn, leaf) + 1;
+        __sync_synchronize();
+        leaf->frames[vpn % FANOUT] = frame;
+        profPages.inc();
+    }
+    futex_unlock(&lock);
+    return frame;
+}
+
+uint64_t PageAllocator::allocFrame(uint32_t procIdx, uint64_t vpn, Leaf* leaf) {
+    if (allocFrames == numFrames) panic("Page allocator: out of physical memory (%ld frames), increase sys.physMem.sizeMB", numFrames);
+
+    switch (policy) {
+        case RANDOM: {
+            uint64_t f = (rng.randInt() | (rng.randInt() << 32)) % numFrames;
+            while (usedFrames[f/64] & (1ul << (f % 64))) f = (f + 1) % numFrames;
+            usedFrames[f/64] |= 1ul << (f % 64);
+            allocFrames++;
+            return f;
+        }
+        case BUDDY: {
+            if (!leaf->chunk) {
+                if ((nextChunk + 1)*FANOUT > numFrames) panic("Page allocator: out of 2MB chunks, increase sys.physMem.sizeMB");
+                leaf->chunk = nextChunk*FANOUT + 1;
+                nextChunk++;
+            }
+            allocFrames++;
+            return leaf->chunk - 1 + vpn % FANOUT;
+        }
+        case COLOR: {
+            uint32_t color = partitionColors? ((procIdx*colorsPerProc + vpn % colorsPerProc) % colors) : ((vpn + procIdx*colorsPerProc) % colors);
+            // Frames of color c, in order: runs of 2^colorShift frames, every colors runs
+            uint64_t run = 1ul << colorShift;
+            for (uint32_t i = 0; i < colors; i++) {
+                uint32_t c = (color + i) % colors;
+                uint64_t k = colorAllocs[c];
+                uint64_t f = ((k / run)*colors + c)*run + k % run;
+                if (f < numFrames) {
+                    colorAllocs[c]++;
+                    allocFrames++;
+                    if (i) profColorMisses.inc();
+                    return f;
+                }
+            }
+            panic("Page allocator: all colors exhausted");
+        }
+        default: panic("!?");
+    }
+}
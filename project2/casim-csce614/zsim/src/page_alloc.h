@@ -0,0 +1,128 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PAGE_ALLOC_H_
+#define PAGE_ALLOC_H_
+
+/* Maps each process's virtual pages to physical frames on first touch, so
+ * cache set indexes and DRAM channels/banks/rows follow a realistic physical
+ * layout instead of the application's virtual one.
+ *
+ * The mapping lives in global memory, in per-process 4-level radix tables
+ * with 4KB pages. Lookups are lock-free; first touches take a lock. Frames are
+ * never freed (we do not track munmap), so simulated memory must be large
+ * enough for the whole run. Policies:
+ *  - Random: each page gets a random free frame
+ *  - Buddy: each 2MB virtual region gets a contiguous 2MB chunk, as a buddy
+ *    allocator with plenty of free memory would give, so pages within a
+ *    region keep their relative layout
+ *  - Color: frames are colored by (frame >> colorShift) % colors (e.g., the
+ *    frame bits that select LLC sets or DRAM banks). Pages get colors in
+ *    virtual order, offset per process, or from a per-process share of the
+ *    colors if partitioned.
+ */
+
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "locks.h"
+#include "memory_hierarchy.h"
+#include "mtrand.h"
+#include "pad.h"
+#include "stats.h"
+
+class PageAllocator : public GlobAlloc {
+    public:
+        enum Policy {RANDOM, BUDDY, COLOR};
+
+    private:
+        static const uint32_t LEVEL_BITS = 9;
+        static const uint32_t LEVELS = 4;  // 36-bit virtual page numbers: 48-bit virtual addresses
+        static const uint32_t FANOUT = 1 << LEVEL_BITS;
+
+        struct Node {
+            void* volatile children[FANOUT];
+        };
+
+        struct Leaf {
+            volatile uint32_t frames[FANOUT];  // frame + 1, 0 if unmapped
+            uint32_t chunk;  // Buddy: first frame of the region's chunk + 1, 0 if none yet
+        };
+
+        const Policy policy;
+        const uint32_t pageLinesBits;
+        const uint64_t numFrames;
+        g_vector<void*> roots;  // per process, Node*
+
+        // Random
+        g_vector<uint64_t> usedFrames;  // bitmap
+        MTRand rng;
+
+        // Buddy
+        uint64_t nextChunk;
+
+        // Color
+        const uint32_t colors, colorShift, colorsPerProc;
+        const bool partitionColors;
+        g_vector<uint64_t> colorAllocs;  // frames handed out so far per color
+
+        uint64_t allocFrames;
+
+        PAD();
+        lock_t lock;
+        PAD();
+
+        Counter profPages, profNodes, profColorMisses;
+
+    public:
+        PageAllocator(Policy _policy, uint64_t sizeMB, uint32_t lineSize, uint32_t maxProcs, uint32_t procs,
+                uint32_t _colors, uint32_t _colorShift, bool _partitionColors, uint64_t seed);
+
+        void initStats(AggregateStat* parentStat);
+
+        uint32_t getPageLines() const {return 1 << pageLinesBits;}
+
+        // Returns the physical line address of vLineAddr in process procIdx, mapping its page on first touch
+        inline Address translate(uint32_t procIdx, Address vLineAddr) {
+            uint64_t vpn = vLineAddr >> pageLinesBits;
+            Leaf* leaf = findLeaf(procIdx, vpn);
+            uint32_t frame = leaf? leaf->frames[vpn % FANOUT] : 0;
+            if (unlikely(!frame)) frame = mapPage(procIdx, vpn);
+            return ((Address)(frame - 1) << pageLinesBits) | (vLineAddr & ((1 << pageLinesBits) - 1));
+        }
+
+    private:
+        inline Leaf* findLeaf(uint32_t procIdx, uint64_t vpn) const {
+            void* node = roots[procIdx];
+            for (uint32_t level = LEVELS - 1; level > 0 && node; level--) {
+                node = static_cast<Node*>(node)->children[(vpn >> (LEVEL_BITS*level)) % FANOUT];
+            }
+            return static_cast<Leaf*>(node);
+        }
+
+        uint32_t mapPage(uint32_t procIdx, uint64_t vpn);
+        uint64_t allocFrame(uint32_t procIdx, uint64_t vpn, Leaf* leaf);
+};
+
+#endif  // PAGE_ALLOC_H_
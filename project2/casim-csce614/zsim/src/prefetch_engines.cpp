@@ -0,0 +1,290 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "prefetch_engines.h"
+#include "bithacks.h"
+
+//#define DBG(args...) info(args)
+#define DBG(args...)
+
+/* Stride */
+
+StridePrefetchEngine::StridePrefetchEngine(const g_string& _name, uint32_t entries, uint32_t _regionBits)
+    : PrefetchEngine(_name), table(entries), regionBits(_regionBits), timestamp(0)
+{
+    for (Entry& e : table) e.valid = false;
+}
+
+void StridePrefetchEngine::train(Address lineAddr, bool pfHit, uint32_t degree, g_vector<Address>& candidates) {
+    Address region = lineAddr >> regionBits;
+    Entry* e = nullptr;
+    Entry* victim = &table[0];
+    for (Entry& c : table) {
+        if (c.valid && c.region == region) {
+            e = &c;
+            break;
+        }
+        if (!c.valid || (victim->valid && c.ts < victim->ts)) victim = &c;
+    }
+
+    if (!e) {
+        victim->region = region;
+        victim->lastLine = lineAddr;
+        victim->stride = 0;
+        victim->conf = 0;
+        victim->ts = timestamp++;
+        victim->valid = true;
+        return;
+    }
+
+    e->ts = timestamp++;
+    int64_t stride = lineAddr - e->lastLine;
+    if (stride == 0) return;
+    if (stride == e->stride) {
+        e->conf = MIN(e->conf + 1, 3u);
+    } else {
+        if (e->conf) e->conf--;
+        if (!e->conf) e->stride = stride;
+    }
+    e->lastLine = lineAddr;
+    DBG("%s: 0x%lx stride %ld conf %d", name.c_str(), lineAddr, e->stride, e->conf);
+
+    if (e->conf >= 2) {
+        for (uint32_t i = 1; i <= degree; i++) candidates.push_back(lineAddr + i*e->stride);
+    }
+}
+
+/* Stream */
+
+StreamPrefetchEngine::StreamPrefetchEngine(const g_string& _name, uint32_t entries, uint32_t _window, uint32_t _distance)
+    : PrefetchEngine(_name), streams(entries), window(_window), distance(_distance), timestamp(0)
+{
+    for (Stream& s : streams) s.valid = false;
+}
+
+void StreamPrefetchEngine::initStats(AggregateStat* engineStat) {
+    profAllocs.init("allocs", "Stream allocations"); engineStat->append(&profAllocs);
+    profTrained.init("trained", "Streams that trained"); engineStat->append(&profTrained);
+}
+
+void StreamPrefetchEngine::train(Address lineAddr, bool pfHit, uint32_t degree, g_vector<Address>& candidates) {
+    Stream* s = nullptr;
+    Stream* victim = &streams[0];
+    for (Stream& c : streams) {
+        if (c.valid) {
+            int64_t d = lineAddr - c.lastLine;
+            // Trained streams only match accesses at or ahead of them
+            bool match = c.trained? (d*c.dir >= 0 && d*c.dir <= (int64_t)window) : (d >= -(int64_t)window && d <= (int64_t)window);
+            if (match) {
+                s = &c;
+                break;
+            }
+        }
+        if (!c.valid || (victim->valid && c.ts < victim->ts)) victim = &c;
+    }
+
+    if (!s) {
+        victim->lastLine = lineAddr;
+        victim->dir = 0;
+        victim->trained = false;
+        victim->valid = true;
+        victim->ts = timestamp++;
+        profAllocs.inc();
+        return;
+    }
+
+    s->ts = timestamp++;
+    if (!s->trained) {
+        int64_t d = lineAddr - s->lastLine;
+        if (d == 0) return;
+        int32_t dir = (d > 0)? 1 : -1;
+        if (dir == s->dir) {
+            s->trained = true;
+            s->nextPfLine = lineAddr + dir;
+            profTrained.inc();
+        }
+        s->dir = dir;
+        s->lastLine = lineAddr;
+        if (!s->trained) return;
+    }
+
+    s->lastLine = lineAddr;
+    int64_t ahead = (int64_t)(s->nextPfLine - lineAddr)*s->dir;
+    if (ahead <= 0) {
+        // Demand stream caught up with us
+        s->nextPfLine = lineAddr + s->dir;
+        ahead = 1;
+    }
+    for (uint32_t i = 0; i < degree && ahead <= (int64_t)distance; i++, ahead++) {
+        candidates.push_back(s->nextPfLine);
+        s->nextPfLine += s->dir;
+    }
+}
+
+/* Best-Offset */
+
+BestOffsetPrefetchEngine::BestOffsetPrefetchEngine(const g_string& _name, uint32_t rrEntries, uint32_t _pageBits)
+    : PrefetchEngine(_name), rrTable(rrEntries), pageBits(_pageBits), testIdx(0), round(0), bestOffset(1)
+{
+    if (!isPow2(rrEntries)) panic("%s: RR table entries (%d) must be a power of 2", name.c_str(), rrEntries);
+    for (Address& a : rrTable) a = 0;
+    // Offsets with no prime factors other than 2, 3 and 5 that fit in a page, as in the paper
+    for (int32_t o = 1; o < (1 << pageBits); o++) {
+        int32_t r = o;
+        while (r % 2 == 0) r /= 2;
+        while (r % 3 == 0) r /= 3;
+        while (r % 5 == 0) r /= 5;
+        if (r == 1) offsets.push_back(o);
+    }
+    scores.resize(offsets.size(), 0);
+}
+
+void BestOffsetPrefetchEngine::initStats(AggregateStat* engineStat) {
+    profPhases.init("phases", "Learning phases completed"); engineStat->append(&profPhases);
+    auto o = [this]() { return (uint64_t)bestOffset; };
+    LambdaStat<decltype(o)>* offsetStat = new LambdaStat<decltype(o)>(o);
+    offsetStat->init("offset", "Current best offset (0 if off)");
+    engineStat->append(offsetStat);
+}
+
+void BestOffsetPrefetchEngine::endPhase() {
+    uint32_t best = 0;
+    for (uint32_t i = 1; i < scores.size(); i++) {
+        if (scores[i] > scores[best]) best = i;
+    }
+    bestOffset = (scores[best] > BAD_SCORE)? offsets[best] : 0;
+    DBG("%s: phase done, best offset %d score %d", name.c_str(), offsets[best], scores[best]);
+    for (uint32_t& s : scores) s = 0;
+    testIdx = 0;
+    round = 0;
+    profPhases.inc();
+}
+
+void BestOffsetPrefetchEngine::train(Address lineAddr, bool pfHit, uint32_t degree, g_vector<Address>& candidates) {
+    Address page = lineAddr >> pageBits;
+
+    // Learning: would offset testIdx have prefetched this line from a recent access?
+    Address base = lineAddr - offsets[testIdx];
+    if ((base >> pageBits) == page && rrTable[rrIdx(base)] == base) {
+        if (++scores[testIdx] >= SCORE_MAX) {
+            endPhase();
+        }
+    }
+    if (++testIdx == offsets.size()) {
+        testIdx = 0;
+        if (++round >= ROUND_MAX) endPhase();
+    }
+
+    rrTable[rrIdx(lineAddr)] = lineAddr;
+
+    if (bestOffset) {
+        for (uint32_t i = 1; i <= degree; i++) {
+            Address pfLine = lineAddr + i*bestOffset;
+            if ((pfLine >> pageBits) != page) break;
+            candidates.push_back(pfLine);
+        }
+    }
+}
+
+/* Signature path */
+
+SignaturePathPrefetchEngine::SignaturePathPrefetchEngine(const g_string& _name, uint32_t sigEntries, uint32_t patternEntries, uint32_t _pageBits, uint32_t _threshold)
+    : PrefetchEngine(_name), sigTable(sigEntries), patternTable(patternEntries), pageBits(_pageBits), threshold(_threshold)
+{
+    if (!isPow2(sigEntries) || !isPow2(patternEntries)) panic("%s: signature (%d) and pattern (%d) table entries must be powers of 2", name.c_str(), sigEntries, patternEntries);
+    if (pageBits > 6) panic("%s: pages of up to 64 lines supported (deltas are 7-bit), pageBits %d", name.c_str(), pageBits);
+    for (SigEntry& e : sigTable) e.valid = false;
+    for (PatternEntry& p : patternTable) {
+        for (uint32_t i = 0; i < DELTAS; i++) {
+            p.delta[i] = 0;
+            p.cDelta[i] = 0;
+        }
+        p.cSig = 0;
+    }
+}
+
+void SignaturePathPrefetchEngine::initStats(AggregateStat* engineStat) {
+    profLookaheads.init("lookaheads", "Lookahead steps past the first prefetch"); engineStat->append(&profLookaheads);
+}
+
+void SignaturePathPrefetchEngine::updatePattern(uint32_t sig, int32_t delta) {
+    PatternEntry& p = patternTable[sig & (patternTable.size() - 1)];
+    if (p.cSig == CTR_MAX) {
+        p.cSig /= 2;
+        for (uint32_t i = 0; i < DELTAS; i++) p.cDelta[i] /= 2;
+    }
+    p.cSig++;
+
+    uint32_t slot = 0;
+    for (uint32_t i = 0; i < DELTAS; i++) {
+        if (p.delta[i] == delta && p.cDelta[i]) {
+            p.cDelta[i]++;
+            return;
+        }
+        if (p.cDelta[i] < p.cDelta[slot]) slot = i;
+    }
+    p.delta[slot] = delta;
+    p.cDelta[slot] = 1;
+}
+
+void SignaturePathPrefetchEngine::train(Address lineAddr, bool pfHit, uint32_t degree, g_vector<Address>& candidates) {
+    Address page = lineAddr >> pageBits;
+    int32_t offset = lineAddr & ((1 << pageBits) - 1);
+    SigEntry& st = sigTable[(page ^ (page >> 10)) & (sigTable.size() - 1)];
+    if (!st.valid || st.page != page) {
+        st.page = page;
+        st.lastOffset = offset;
+        st.sig = 0;
+        st.valid = true;
+        return;
+    }
+
+    int32_t delta = offset - (int32_t)st.lastOffset;
+    if (delta == 0) return;
+    updatePattern(st.sig, delta);
+    st.sig = nextSig(st.sig, delta);
+    st.lastOffset = offset;
+
+    // Lookahead along the most likely path
+    uint32_t sig = st.sig;
+    uint32_t conf = 100;
+    int32_t pfOffset = offset;
+    for (uint32_t depth = 0; depth < degree; depth++) {
+        const PatternEntry& p = patternTable[sig & (patternTable.size() - 1)];
+        if (!p.cSig) break;
+        uint32_t best = 0;
+        for (uint32_t i = 1; i < DELTAS; i++) {
+            if (p.cDelta[i] > p.cDelta[best]) best = i;
+        }
+        if (!p.cDelta[best]) break;
+        conf = conf*p.cDelta[best]/p.cSig;
+        if (conf < threshold) break;
+        pfOffset += p.delta[best];
+        if (pfOffset < 0 || pfOffset >= (1 << pageBits)) break;
+        candidates.push_back((page << pageBits) | pfOffset);
+        if (depth) profLookaheads.inc();
+        sig = nextSig(sig, p.delta[best]);
+    }
+}
@@ -0,0 +1,184 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PREFETCH_ENGINES_H_
+#define PREFETCH_ENGINES_H_
+
+#include "g_std/g_string.h"
+#include "g_std/g_vector.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+
+/* Prefetch engines for PrefetchController. Engines only predict: they see
+ * the stream of demand lines that miss in the child cache(s), and propose
+ * lines to prefetch. The controller issues, tracks and throttles prefetches.
+ *
+ * NOTE: MemReq does not carry the PC, so engines that are PC-localized in
+ * hardware (e.g., IP-stride) are localized by address region instead.
+ */
+class PrefetchEngine : public GlobAlloc {
+    protected:
+        g_string name;
+
+    public:
+        explicit PrefetchEngine(const g_string& _name) : name(_name) {}
+        virtual ~PrefetchEngine() {}
+        const char* getName() const {return name.c_str();}
+
+        // Observe a demand access to lineAddr (pfHit: it hit a line this engine prefetched); append at most degree candidates
+        virtual void train(Address lineAddr, bool pfHit, uint32_t degree, g_vector<Address>& candidates) = 0;
+
+        virtual void initStats(AggregateStat* engineStat) {}
+};
+
+/* Stride prefetcher: a reference prediction table, localized by 2^regionBits-line
+ * region instead of by PC. Once an entry sees the same stride twice, prefetches
+ * the next degree lines in the stride.
+ */
+class StridePrefetchEngine : public PrefetchEngine {
+    private:
+        struct Entry {
+            Address region;
+            Address lastLine;
+            int64_t stride;
+            uint32_t conf;  // 2-bit
+            uint64_t ts;
+            bool valid;
+        };
+
+        g_vector<Entry> table;
+        uint32_t regionBits;
+        uint64_t timestamp;
+
+    public:
+        StridePrefetchEngine(const g_string& _name, uint32_t entries, uint32_t _regionBits);
+        void train(Address lineAddr, bool pfHit, uint32_t degree, g_vector<Address>& candidates);
+};
+
+/* Stream prefetcher: tracks up to N streams, each a window of lines moving in
+ * one direction. A stream trains after two accesses in the same direction,
+ * then runs ahead of the demand stream, up to distance lines.
+ */
+class StreamPrefetchEngine : public PrefetchEngine {
+    private:
+        struct Stream {
+            Address lastLine;
+            Address nextPfLine;
+            int32_t dir;  // 0 if unknown
+            bool trained;
+            bool valid;
+            uint64_t ts;
+        };
+
+        g_vector<Stream> streams;
+        uint32_t window;
+        uint32_t distance;
+        uint64_t timestamp;
+
+        Counter profAllocs, profTrained;
+
+    public:
+        StreamPrefetchEngine(const g_string& _name, uint32_t entries, uint32_t _window, uint32_t _distance);
+        void train(Address lineAddr, bool pfHit, uint32_t degree, g_vector<Address>& candidates);
+        void initStats(AggregateStat* engineStat);
+};
+
+/* Best-Offset prefetcher (Michaud, HPCA 2016). Learns the single line offset D
+ * that would have made the most recent accesses timely prefetch hits, by
+ * testing one candidate offset per access against a table of recent lines
+ * (RR table), and prefetches X + D (and X + k*D for degree > 1) within the page.
+ * Prefetching is turned off when even the best offset scores poorly.
+ */
+class BestOffsetPrefetchEngine : public PrefetchEngine {
+    private:
+        static const uint32_t SCORE_MAX = 31;
+        static const uint32_t ROUND_MAX = 100;
+        static const uint32_t BAD_SCORE = 1;
+
+        g_vector<int32_t> offsets;
+        g_vector<uint32_t> scores;
+        g_vector<Address> rrTable;
+        uint32_t pageBits;
+        uint32_t testIdx;
+        uint32_t round;
+        int32_t bestOffset;  // 0 means off
+
+        Counter profPhases;
+
+        inline uint32_t rrIdx(Address lineAddr) const {return (lineAddr ^ (lineAddr >> 8)) & (rrTable.size() - 1);}
+        void endPhase();
+
+    public:
+        BestOffsetPrefetchEngine(const g_string& _name, uint32_t rrEntries, uint32_t _pageBits);
+        void train(Address lineAddr, bool pfHit, uint32_t degree, g_vector<Address>& candidates);
+        void initStats(AggregateStat* engineStat);
+};
+
+/* Signature Path Prefetcher (Kim et al., MICRO 2016). A per-page signature
+ * table compresses the page's recent line deltas into a signature; a pattern
+ * table maps signatures to likely next deltas. Lookahead walks the most likely
+ * path while the product of delta confidences stays above threshold (%).
+ * Prefetches stay within the page.
+ */
+class SignaturePathPrefetchEngine : public PrefetchEngine {
+    private:
+        static const uint32_t SIG_BITS = 12;
+        static const uint32_t DELTAS = 4;
+        static const uint32_t CTR_MAX = 15;
+
+        struct SigEntry {
+            Address page;
+            uint32_t lastOffset;
+            uint32_t sig;
+            bool valid;
+        };
+
+        struct PatternEntry {
+            int32_t delta[DELTAS];
+            uint32_t cDelta[DELTAS];
+            uint32_t cSig;
+        };
+
+        g_vector<SigEntry> sigTable;
+        g_vector<PatternEntry> patternTable;
+        uint32_t pageBits;
+        uint32_t threshold;
+
+        Counter profLookaheads;
+
+        static inline uint32_t nextSig(uint32_t sig, int32_t delta) {
+            uint32_t enc = (delta < 0)? (((-delta) & 0x3f) | 0x40) : delta;
+            return ((sig << 3) ^ enc) & ((1 << SIG_BITS) - 1);
+        }
+
+        void updatePattern(uint32_t sig, int32_t delta);
+
+    public:
+        SignaturePathPrefetchEngine(const g_string& _name, uint32_t sigEntries, uint32_t patternEntries, uint32_t _pageBits, uint32_t _threshold);
+        void train(Address lineAddr, bool pfHit, uint32_t degree, g_vector<Address>& candidates);
+        void initStats(AggregateStat* engineStat);
+};
+
+#endif  // PREFETCH_ENGINES_H_
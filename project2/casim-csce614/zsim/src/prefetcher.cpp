@@ -25,6 +25,10 @@
 
 #include "prefetcher.h"
 #include "bithacks.h"
+#include "host_prof.h"
+#include "prefetch_engines.h"
+#include "timing_event.h"
+#include "zsim.h"
 
 //#define DBG(args...) info(args)
 #define DBG(args...)
@@ -57,6 +61,7 @@ void StreamPrefetcher::initStats(AggregateStat* parentStat) {
 }
 
 uint64_t StreamPrefetcher::access(MemReq& req) {
+    HostProfScope hps(HP_CACHE);
     uint32_t origChildId = req.childId;
     req.childId = childId;
 
@@ -187,4 +192,240 @@ uint64_t StreamPrefetcher::invalidate(const InvReq& req) {
     return child->invalidate(req);
 }
 
+/* PrefetchController */
 
+PrefetchController::PrefetchController(const g_string& _name, uint32_t trackerEntries, uint32_t evictionEntries, bool _throttle, uint32_t _throttleInterval)
+    : tracker(trackerEntries), evictions(evictionEntries), throttle(_throttle), throttleInterval(_throttleInterval), intAccesses(0), name(_name)
+{
+    if (!isPow2(trackerEntries) || !isPow2(evictionEntries)) {
+        panic("%s: tracker (%d) and eviction (%d) entries must be powers of 2", name.c_str(), trackerEntries, evictionEntries);
+    }
+    for (TrackedPrefetch& t : tracker) t.valid = false;
+    for (EvictedLine& e : evictions) e.valid = false;
+}
+
+void PrefetchController::addEngine(PrefetchEngine* engine, uint32_t degree, uint32_t maxDegree) {
+    EngineState* es = new EngineState();
+    es->engine = engine;
+    es->degree = degree;
+    es->maxDegree = maxDegree;
+    es->intIssued = es->intUseful = es->intLate = es->intPolluting = 0;
+    engines.push_back(es);
+}
+
+void PrefetchController::setParents(uint32_t _childId, const g_vector<MemObject*>& parents, Network* network) {
+    childId = _childId;
+    if (parents.size() != 1) panic("Must have one parent");
+    if (network) panic("Network not handled");
+    parent = parents[0];
+}
+
+void PrefetchController::setChildren(const g_vector<BaseCache*>& children, Network* network) {
+    if (children.size() != 1) panic("Must have one children");
+    if (network) panic("Network not handled");
+    child = children[0];
+}
+
+void PrefetchController::initStats(AggregateStat* parentStat) {
+    AggregateStat* s = new AggregateStat();
+    s->init(name.c_str(), "Prefetcher stats");
+    profAccesses.init("acc", "Demand accesses (child misses)"); s->append(&profAccesses);
+    profPfHits.init("pfHit", "Demand accesses to prefetched lines"); s->append(&profPfHits);
+    profLateHits.init("latePfHit", "Demand accesses to prefetched lines still in flight"); s->append(&profLateHits);
+    for (EngineState* es : engines) {
+        AggregateStat* es_s = new AggregateStat();
+        es_s->init(es->engine->getName(), "Prefetch engine stats");
+        es->profIssued.init("issued", "Issued prefetches"); es_s->append(&es->profIssued);
+        es->profUseful.init("useful", "Prefetches hit by a demand access (accuracy: useful/issued, coverage: useful/acc)"); es_s->append(&es->profUseful);
+        es->profLate.init("late", "Useful prefetches still in flight when the demand access came"); es_s->append(&es->profLate);
+        es->profPolluting.init("polluting", "Demand accesses to lines evicted by this engine's prefetches"); es_s->append(&es->profPolluting);
+        es->profRedundant.init("redundant", "Candidates dropped because they were already prefetched"); es_s->append(&es->profRedundant);
+        es->profDegreeUps.init("degreeUps", "Throttling degree increases"); es_s->append(&es->profDegreeUps);
+        es->profDegreeDowns.init("degreeDowns", "Throttling degree decreases"); es_s->append(&es->profDegreeDowns);
+        auto d = [es]() { return (uint64_t)es->degree; };
+        LambdaStat<decltype(d)>* degreeStat = new LambdaStat<decltype(d)>(d);
+        degreeStat->init("degree", "Current prefetch degree");
+        es_s->append(degreeStat);
+        es->engine->initStats(es_s);
+        s->append(es_s);
+    }
+    parentStat->append(s);
+}
+
+// A prefetch or demand access made room for victim in the parent
+void PrefetchController::noteVictim(Address victim) {
+    // If victim was an unused prefetch, it cannot be useful anymore
+    TrackedPrefetch& t = tracker[trackerIdx(victim)];
+    if (t.valid && t.lineAddr == victim) t.valid = false;
+}
+
+void PrefetchController::issue(Address lineAddr, uint32_t engine, const MemReq& req, uint64_t respCycle, TimingRecord& demandRec, DelayEvent*& root) {
+    EngineState* es = engines[engine];
+    TrackedPrefetch& t = tracker[trackerIdx(lineAddr)];
+    if ((t.valid && t.lineAddr == lineAddr) || lineAddr == req.lineAddr) {
+        es->profRedundant.inc();
+        return;
+    }
+
+    MESIState state = I;
+    Address victim = -1L;
+    MemReq pfReq = {lineAddr, GETS, childId, &state, req.cycle, req.childLock, state, req.srcId, MemReq::PREFETCH, &victim};
+    uint64_t pfRespCycle = parent->access(pfReq);
+    assert(state == I);  // prefetch access should not give us any permissions
+
+    t.lineAddr = lineAddr;
+    t.respCycle = pfRespCycle;
+    t.engine = engine;
+    t.valid = true;
+    es->profIssued.inc();
+    es->intIssued++;
+
+    // This line is in the parent again, so it's not a pollution victim anymore
+    EvictedLine& el = evictions[evictionIdx(lineAddr)];
+    if (el.valid && el.lineAddr == lineAddr) el.valid = false;
+
+    if (victim != (Address)-1L) {
+        noteVictim(victim);
+        EvictedLine& ve = evictions[evictionIdx(victim)];
+        ve.lineAddr = victim;
+        ve.engine = engine;
+        ve.valid = true;
+    }
+
+    // Hang the prefetch's timing record from the demand's, so it is simulated off the critical path
+    EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
+    if (evRec && evRec->hasRecord()) {
+        TimingRecord pfRec = evRec->popRecord();
+        if (!demandRec.isValid()) {
+            // The demand access has no record to hang it from (e.g., it hit in a non-timing parent).
+            // Give it one that just takes its latency, rooted at a start event that prefetches can hang from.
+            assert(!root);
+            root = new (evRec) DelayEvent(0);
+            root->setMinStartCycle(req.cycle);
+            DelayEvent* dDemand = new (evRec) DelayEvent(respCycle - req.cycle);
+            dDemand->setMinStartCycle(req.cycle);
+            root->addChild(dDemand, evRec);
+            demandRec = {req.lineAddr << lineBits, req.cycle, respCycle, req.type, root, dDemand};
+        }
+        assert(pfRec.reqCycle >= demandRec.reqCycle);
+        // As in Cache::access, the record starts at a common root for the demand access and its prefetches
+        if (!root) {
+            root = new (evRec) DelayEvent(0);
+            root->setMinStartCycle(demandRec.reqCycle);
+            root->addChild(demandRec.startEvent, evRec);
+            demandRec.startEvent = root;
+        }
+        DelayEvent* dPf = new (evRec) DelayEvent(pfRec.reqCycle - demandRec.reqCycle);
+        dPf->setMinStartCycle(demandRec.reqCycle);
+        root->addChild(dPf, evRec)->addChild(pfRec.startEvent, evRec);
+        // pfRec.endEvent is not connected: nothing waits on prefetches
+    }
+}
+
+void PrefetchController::adjustDegrees() {
+    for (EngineState* es : engines) {
+        if (es->intIssued) {
+            double accuracy = ((double)es->intUseful)/es->intIssued;
+            double lateness = es->intUseful? ((double)es->intLate)/es->intUseful : 0.0;
+            double pollution = ((double)es->intPolluting)/intAccesses;
+            bool late = lateness > 0.01;
+            bool polluting = pollution > 0.005;
+
+            // High accuracy: go more aggressive if late; medium: only if late and not polluting; low: back off
+            int32_t change = 0;
+            if (accuracy >= 0.75) {
+                change = late? 1 : (polluting? -1 : 0);
+            } else if (accuracy >= 0.40) {
+                change = polluting? -1 : (late? 1 : 0);
+            } else {
+                change = (late && !polluting)? 0 : -1;
+            }
+
+            if (change > 0 && es->degree < es->maxDegree) {
+                es->degree++;
+                es->profDegreeUps.inc();
+            } else if (change < 0 && es->degree > 1) {
+                es->degree--;
+                es->profDegreeDowns.inc();
+            }
+        }
+        // Decay, so older intervals still count but less
+        es->intIssued /= 2;
+        es->intUseful /= 2;
+        es->intLate /= 2;
+        es->intPolluting /= 2;
+    }
+    intAccesses = 0;
+}
+
+uint64_t PrefetchController::access(MemReq& req) {
+    HostProfScope hps(HP_CACHE);
+    uint32_t origChildId = req.childId;
+    req.childId = childId;
+
+    if (!IsGet(req.type)) {
+        uint64_t respCycle = parent->access(req);
+        req.childId = origChildId;
+        return respCycle;
+    }
+
+    profAccesses.inc();
+    intAccesses++;
+
+    Address victim = -1L;
+    req.victimLineAddr = &victim;
+    uint64_t respCycle = parent->access(req);
+    req.victimLineAddr = nullptr;
+    if (victim != (Address)-1L) noteVictim(victim);
+
+    EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
+    TimingRecord demandRec;
+    demandRec.clear();
+    if (evRec && evRec->hasRecord()) demandRec = evRec->popRecord();
+
+    // Was this line prefetched?
+    int32_t pfEngine = -1;
+    TrackedPrefetch& t = tracker[trackerIdx(req.lineAddr)];
+    if (t.valid && t.lineAddr == req.lineAddr) {
+        EngineState* es = engines[t.engine];
+        pfEngine = t.engine;
+        es->profUseful.inc();
+        es->intUseful++;
+        profPfHits.inc();
+        if (t.respCycle > respCycle) {
+            // Still in flight; as in StreamPrefetcher, the demand access sees the prefetch's latency
+            respCycle = t.respCycle;
+            es->profLate.inc();
+            es->intLate++;
+            profLateHits.inc();
+        }
+        t.valid = false;
+    }
+
+    // Did a prefetch evict it?
+    EvictedLine& el = evictions[evictionIdx(req.lineAddr)];
+    if (el.valid && el.lineAddr == req.lineAddr) {
+        engines[el.engine]->profPolluting.inc();
+        engines[el.engine]->intPolluting++;
+        el.valid = false;
+    }
+
+    DelayEvent* root = nullptr;
+    for (uint32_t e = 0; e < engines.size(); e++) {
+        candidates.clear();
+        engines[e]->engine->train(req.lineAddr, pfEngine == (int32_t)e, engines[e]->degree, candidates);
+        for (Address c : candidates) issue(c, e, req, respCycle, demandRec, root);
+    }
+    DBG("%s: 0x%lx pfEngine %d, %ld candidates", name.c_str(), req.lineAddr, pfEngine, candidates.size());
+
+    if (demandRec.isValid()) evRec->pushRecord(demandRec);
+
+    if (throttle && intAccesses >= throttleInterval) adjustDegrees();
+
+    req.childId = origChildId;
+    return respCycle;
+}
+
+uint64_t PrefetchController::invalidate(const InvReq& req) {
+    return child->invalidate(req);
+}
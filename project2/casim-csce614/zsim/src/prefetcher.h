@@ -28,7 +28,9 @@
 
 #include <bitset>
 #include "bithacks.h"
+#include "event_recorder.h"
 #include "g_std/g_string.h"
+#include "g_std/g_vector.h"
 #include "memory_hierarchy.h"
 #include "stats.h"
 
@@ -113,4 +115,77 @@ class StreamPrefetcher : public BaseCache {
         uint64_t invalidate(const InvReq& req);
 };
 
+/* Configurable prefetcher. Interposes between cache levels like StreamPrefetcher, but predictions come
+ * from a chain of PrefetchEngines (see prefetch_engines.h), and:
+ *  - Prefetches go to the parent as PREFETCH GETS, and if the parent is a timing cache, their timing
+ *    records are hung from the demand access' record, so the weave phase simulates them (and the
+ *    contention they cause) off the critical path.
+ *  - Each engine has accuracy (useful/issued), coverage (useful vs demand accesses), lateness (useful
+ *    prefetches that were still in flight) and pollution (demand accesses to lines that a prefetch
+ *    evicted from the parent) counters.
+ *  - Optionally, each engine's degree is throttled from those counters every throttleInterval demand
+ *    accesses, as in feedback-directed prefetching (Srinath et al., HPCA 2007).
+ */
+class DelayEvent;
+class PrefetchEngine;
+
+class PrefetchController : public BaseCache {
+    private:
+        struct EngineState : public GlobAlloc {
+            PrefetchEngine* engine;
+            uint32_t degree;
+            uint32_t maxDegree;
+            Counter profIssued, profUseful, profLate, profPolluting, profRedundant, profDegreeUps, profDegreeDowns;
+            uint64_t intIssued, intUseful, intLate, intPolluting;  // current throttling interval
+        };
+
+        struct TrackedPrefetch {
+            Address lineAddr;
+            uint64_t respCycle;
+            uint32_t engine;
+            bool valid;
+        };
+
+        struct EvictedLine {
+            Address lineAddr;
+            uint32_t engine;
+            bool valid;
+        };
+
+        g_vector<EngineState*> engines;
+        g_vector<TrackedPrefetch> tracker;   // prefetched lines not yet used, direct-mapped
+        g_vector<EvictedLine> evictions;     // lines evicted by prefetches, direct-mapped
+        g_vector<Address> candidates;
+
+        bool throttle;
+        uint32_t throttleInterval;
+        uint64_t intAccesses;
+
+        Counter profAccesses, profPfHits, profLateHits;
+
+        MemObject* parent;
+        BaseCache* child;
+        uint32_t childId;
+        g_string name;
+
+        inline uint32_t trackerIdx(Address lineAddr) const {return (lineAddr ^ (lineAddr >> 12)) & (tracker.size() - 1);}
+        inline uint32_t evictionIdx(Address lineAddr) const {return (lineAddr ^ (lineAddr >> 12)) & (evictions.size() - 1);}
+
+        void noteVictim(Address victim);
+        void issue(Address lineAddr, uint32_t engine, const MemReq& req, uint64_t respCycle, TimingRecord& demandRec, DelayEvent*& root);
+        void adjustDegrees();
+
+    public:
+        PrefetchController(const g_string& _name, uint32_t trackerEntries, uint32_t evictionEntries, bool _throttle, uint32_t _throttleInterval);
+        void addEngine(PrefetchEngine* engine, uint32_t degree, uint32_t maxDegree);
+
+        void initStats(AggregateStat* parentStat);
+        const char* getName() { return name.c_str();}
+        void setParents(uint32_t _childId, const g_vector<MemObject*>& parents, Network* network);
+        void setChildren(const g_vector<BaseCache*>& children, Network* network);
+
+        uint64_t access(MemReq& req);
+        uint64_t invalidate(const InvReq& req);
+};
+
 #endif  // PREFETCHER_H_
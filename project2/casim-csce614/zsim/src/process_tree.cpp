@@ -176,6 +176,7 @@ static void PopulateLevel(Config& config, const std::string& prefix, std::vector
         bool startPaused = config.get<bool>(p_ss.str() +  ".startPaused", false);
         uint32_t clockDomain = config.get<uint32_t>(p_ss.str() +  ".clockDomain", 0);
         uint32_t portDomain = config.get<uint32_t>(p_ss.str() +  ".portDomain", 0);
+        bool hugePages = config.get<bool>(p_ss.str() +  ".hugePages", false);
         uint64_t dumpHeartbeats = config.get<uint64_t>(p_ss.str() +  ".dumpHeartbeats", 0);
         bool dumpsResetHeartbeats = config.get<bool>(p_ss.str() +  ".dumpsResetHeartbeats", false);
         uint64_t dumpInstrs = config.get<uint64_t>(p_ss.str() +  ".dumpInstrs", 0);
@@ -207,7 +208,7 @@ static void PopulateLevel(Config& config, const std::string& prefix, std::vector
         else
             panic("Invalid synced fast forward mode %s", syncedFastForwardStr.c_str());
 
-        ProcessTreeNode* ptn = new ProcessTreeNode(procIdx, groupIdx, startFastForwarded, startPaused, syncedFastForward, clockDomain, portDomain, dumpHeartbeats, dumpsResetHeartbeats, restarts, mask, ffiPoints, syscallBlacklistRegex, gpr);
+        ProcessTreeNode* ptn = new ProcessTreeNode(procIdx, groupIdx, startFastForwarded, startPaused, syncedFastForward, clockDomain, portDomain, dumpHeartbeats, dumpsResetHeartbeats, restarts, mask, ffiPoints, syscallBlacklistRegex, hugePages, gpr);
         //info("Created ProcessTreeNode, procIdx %d", procIdx);
         parent->addChild(ptn);
         children.push_back(ptn);
@@ -229,7 +230,7 @@ static void PopulateLevel(Config& config, const std::string& prefix, std::vector
 }
 
 void CreateProcessTree(Config& config) {
-    ProcessTreeNode* rootNode = new ProcessTreeNode(-1, -1, false, false, SFF_NEVER, 0, 0, 0, false, 0, g_vector<bool> {},  g_vector<uint64_t> {}, g_string {}, nullptr);
+    ProcessTreeNode* rootNode = new ProcessTreeNode(-1, -1, false, false, SFF_NEVER, 0, 0, 0, false, 0, g_vector<bool> {},  g_vector<uint64_t> {}, g_string {}, false, nullptr);
     uint32_t procIdx = 0;
     uint32_t groupIdx = 0;
     std::vector<ProcessTreeNode*> globProcVector;
@@ -39,6 +39,13 @@ inline uint64_t getNs() {
     return 1000000000L*ts.tv_sec + ts.tv_nsec;
 }
 
+// CPU time of the calling thread; the difference with getNs() is time the host did not run it
+inline uint64_t getThreadCpuNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return 1000000000L*ts.tv_sec + ts.tv_nsec;
+}
+
 /* Implements a single stopwatch-style cumulative clock. Useful to profile isolated events.
  * get() accounts for current interval if clock is running.
  */
@@ -0,0 +1,103 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "req_trace.h"
+#include <stdio.h>
+#include <string.h>
+#include "log.h"
+
+static const char* traceReasonNames[] = {"hit", "miss", "net", "mem", "weaveHit", "weaveMiss", "mshrWait", "dramQueue", "rowHit", "rowMiss"};
+
+const char* TraceReasonName(uint32_t reason) {
+    static_assert(sizeof(traceReasonNames)/sizeof(const char*) == TR_NUM_REASONS, "Update traceReasonNames");
+    assert(reason < TR_NUM_REASONS);
+    return traceReasonNames[reason];
+}
+
+ReqTracer::ReqTracer(const char* _filename, uint32_t _sampleRate, uint32_t _numSrcs)
+    : filename(_filename), sampleRate(_sampleRate), numSrcs(_numSrcs), nextId(0), headerWritten(false), bufUsed(0)
+{
+    assert(sampleRate > 0);
+    srcAccesses = gm_calloc<uint64_t>(numSrcs);
+    curIds = gm_calloc<uint64_t>(numSrcs);
+    bufSize = 64*1024;
+    buf = gm_calloc<TraceSpan>(bufSize);
+    futex_init(&lock);
+
+    FILE* f = fopen(filename, "w");
+    if (!f) panic("Could not open request trace %s", filename);
+    fclose(f);
+    info("Request tracing: sampling 1 in %d L1 misses to %s", sampleRate, filename);
+}
+
+uint16_t ReqTracer::registerComponent(const char* name) {
+    assert_msg(!headerWritten, "Request tracer: component %s registered after tracing started", name);
+    for (uint32_t i = 0; i < components.size(); i++) {
+        if (components[i] == name) return i;
+    }
+    assert(components.size() < (1 << 16));
+    components.push_back(g_string(name));
+    return components.size() - 1;
+}
+
+void ReqTracer::record(uint64_t id, uint16_t comp, AccessType type, uint64_t enterCycle, uint64_t exitCycle, TraceReason reason) {
+    assert(id);
+    futex_lock(&lock);
+    TraceSpan& s = buf[bufUsed++];
+    s.id = id;
+    s.enterCycle = enterCycle;
+    s.exitCycle = exitCycle;
+    s.comp = comp;
+    s.type = type;
+    s.reason = reason;
+    if (bufUsed == bufSize) flushLocked();
+    futex_unlock(&lock);
+}
+
+void ReqTracer::flush() {
+    futex_lock(&lock);
+    flushLocked();
+    futex_unlock(&lock);
+}
+
+// Spans may come from any process, so we open and close the file on every flush
+void ReqTracer::flushLocked() {
+    FILE* f = fopen(filename, "a");
+    if (!f) panic("Could not open request trace %s", filename);
+    if (!headerWritten) {
+        fwrite("ZSIMRQT1", 1, 8, f);
+        uint32_t hdr[] = {(uint32_t)sizeof(TraceSpan), (uint32_t)components.size()};
+        fwrite(hdr, sizeof(uint32_t), 2, f);
+        for (const g_string& c : components) {
+            uint16_t len = c.size();
+            fwrite(&len, sizeof(uint16_t), 1, f);
+            fwrite(c.c_str(), 1, len, f);
+        }
+        headerWritten = true;
+    }
+    if (bufUsed) fwrite(buf, sizeof(TraceSpan), bufUsed, f);
+    fclose(f);
+    bufUsed = 0;
+}
@@ -0,0 +1,137 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REQ_TRACE_H_
+#define REQ_TRACE_H_
+
+/* Sampled end-to-end tracing of memory requests. Cores mark 1 in N of their
+ * L1 misses with MemReq::TRACED, and the flag propagates up the hierarchy with
+ * the GET. Every component the request goes through appends a span (component,
+ * enter cycle, exit cycle, reason) tagged with the request's trace id, both in
+ * the bound phase (caches, network, memory) and in the weave phase (timing
+ * cache and DDR events, which keep the id). Spans go to a binary log in the
+ * output dir; the reqtrace utility aggregates them into per-level breakdowns.
+ *
+ * File format: "ZSIMRQT1", uint32_t sizeof(TraceSpan), uint32_t number of
+ * components, then each component name as a uint16_t length and its chars,
+ * then TraceSpans until EOF.
+ */
+
+#include <stdint.h>
+#include "g_std/g_string.h"
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "locks.h"
+#include "memory_hierarchy.h"
+
+enum TraceReason {
+    TR_HIT,         // bound phase, tag present
+    TR_MISS,        // bound phase, tag not present
+    TR_NET,         // network round trip to the parent
+    TR_MEM,         // bound phase, main memory
+    TR_WEAVE_HIT,   // timing cache hit, including tag port contention
+    TR_WEAVE_MISS,  // timing cache miss, from MSHR allocation to response
+    TR_MSHR_WAIT,   // timing cache access queued because all MSHRs were busy
+    TR_DRAM_QUEUE,  // DDR request waiting in the controller queue
+    TR_ROW_HIT,     // DDR service time, row buffer hit
+    TR_ROW_MISS,    // DDR service time, row buffer miss or closed row
+    TR_NUM_REASONS
+};
+
+const char* TraceReasonName(uint32_t reason);
+
+/* Kept by weave-phase events of sampled requests */
+struct TraceTag {
+    uint64_t id; // 0 if not sampled
+    uint64_t arrivalCycle; // first cycle the event was simulated
+    AccessType type;
+
+    TraceTag() : id(0), arrivalCycle(-1L), type(GETS) {}
+
+    void set(uint64_t _id, AccessType _type) {
+        id = _id;
+        type = _type;
+    }
+
+    void arrive(uint64_t cycle) {
+        if (arrivalCycle == (uint64_t)-1L) arrivalCycle = cycle;
+    }
+};
+
+struct TraceSpan {
+    uint64_t id;
+    uint64_t enterCycle;
+    uint64_t exitCycle;
+    uint16_t comp;
+    uint8_t type;    // AccessType
+    uint8_t reason;  // TraceReason
+};
+
+class ReqTracer : public GlobAlloc {
+    private:
+        const char* filename;
+        uint32_t sampleRate;
+        uint32_t numSrcs;
+        uint64_t* srcAccesses; // per source, accesses since its last sample; only touched by the source
+        uint64_t* curIds;      // per source, id of the sampled request in flight
+        volatile uint64_t nextId;
+
+        g_vector<g_string> components;
+        bool headerWritten;
+
+        TraceSpan* buf;
+        uint32_t bufSize;
+        uint32_t bufUsed;
+        lock_t lock;
+
+        void flushLocked();
+
+    public:
+        ReqTracer(const char* _filename, uint32_t _sampleRate, uint32_t _numSrcs);
+
+        // Returns the id of the component with this name, registering it if needed. Call only during initialization.
+        uint16_t registerComponent(const char* name);
+
+        // Called by the core on every access that enters the hierarchy. Returns true if it must be traced.
+        inline bool sample(uint32_t srcId) {
+            assert(srcId < numSrcs);
+            if (++srcAccesses[srcId] < sampleRate) return false;
+            srcAccesses[srcId] = 0;
+            curIds[srcId] = __sync_add_and_fetch(&nextId, 1);
+            return true;
+        }
+
+        // Trace id of srcId's sampled request, for components that must keep it past the bound phase
+        uint64_t curId(uint32_t srcId) const {
+            assert(srcId < numSrcs);
+            return curIds[srcId];
+        }
+
+        void record(uint64_t id, uint16_t comp, AccessType type, uint64_t enterCycle, uint64_t exitCycle, TraceReason reason);
+
+        void flush();
+};
+
+#endif  // REQ_TRACE_H_
@@ -0,0 +1,142 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Aggregates a sampled request trace (see req_trace.h) into per-component
+ * latency breakdowns, by request type and reason. For bound-phase cache spans,
+ * it also reports self latency, i.e., excluding the upper levels and the
+ * network, which nest inside them.
+ */
+
+#include <algorithm>
+#include <map>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include "galloc.h"
+#include "log.h"
+#include "memory_hierarchy.h"
+#include "req_trace.h"
+
+struct LatencyList {
+    std::vector<uint64_t> lats;
+    std::vector<uint64_t> selfLats;
+
+    static uint64_t pct(std::vector<uint64_t>& v, double q) {
+        if (v.empty()) return 0;
+        size_t idx = std::min(v.size() - 1, (size_t)(q*v.size()));
+        std::nth_element(v.begin(), v.begin() + idx, v.end());
+        return v[idx];
+    }
+
+    static double mean(const std::vector<uint64_t>& v) {
+        if (v.empty()) return 0.0;
+        double sum = 0.0;
+        for (uint64_t l : v) sum += l;
+        return sum/v.size();
+    }
+};
+
+int main(int argc, const char* argv[]) {
+    InitLog(""); //no log header
+    if (argc != 2) {
+        info("Prints per-component latency breakdowns of a sampled request trace");
+        info("Usage: %s <reqtrace.bin>", argv[0]);
+        exit(1);
+    }
+
+    FILE* f = fopen(argv[1], "r");
+    if (!f) panic("Could not open %s", argv[1]);
+
+    char magic[8];
+    uint32_t hdr[2];
+    if (fread(magic, 1, 8, f) != 8 || strncmp(magic, "ZSIMRQT1", 8) != 0) panic("%s is not a request trace", argv[1]);
+    if (fread(hdr, sizeof(uint32_t), 2, f) != 2) panic("Truncated header");
+    if (hdr[0] != sizeof(TraceSpan)) panic("Span size mismatch (%d, expected %ld)", hdr[0], sizeof(TraceSpan));
+
+    std::vector<std::string> comps;
+    for (uint32_t i = 0; i < hdr[1]; i++) {
+        uint16_t len;
+        if (fread(&len, sizeof(uint16_t), 1, f) != 1) panic("Truncated header");
+        std::string name(len, ' ');
+        if (fread(&name[0], 1, len, f) != len) panic("Truncated header");
+        comps.push_back(name);
+    }
+
+    // Spans of a request are written in the order they finish, inner levels first
+    std::unordered_map<uint64_t, std::vector<TraceSpan>> reqs;
+    TraceSpan s;
+    uint64_t numSpans = 0;
+    while (fread(&s, sizeof(TraceSpan), 1, f) == 1) {
+        reqs[s.id].push_back(s);
+        numSpans++;
+    }
+    fclose(f);
+
+    // (type, comp, reason) -> latencies
+    std::map<std::tuple<uint32_t, uint32_t, uint32_t>, LatencyList> breakdown;
+    for (auto& kv : reqs) {
+        uint64_t innerLat = 0;
+        uint64_t netLat = 0;
+        for (const TraceSpan& sp : kv.second) {
+            uint64_t lat = sp.exitCycle - sp.enterCycle;
+            LatencyList& l = breakdown[std::make_tuple(sp.type, sp.comp, sp.reason)];
+            l.lats.push_back(lat);
+            if (sp.reason == TR_HIT || sp.reason == TR_MISS) {
+                uint64_t nested = innerLat + netLat;
+                l.selfLats.push_back((lat > nested)? lat - nested : 0);
+                innerLat = lat;
+                netLat = 0;
+            } else if (sp.reason == TR_MEM) {
+                innerLat = lat;
+                netLat = 0;
+            } else if (sp.reason == TR_NET) {
+                netLat += lat;
+            }
+        }
+    }
+
+    info("%ld sampled requests, %ld spans, %ld components", reqs.size(), numSpans, comps.size());
+    info("%4s %-16s %-10s %10s %10s %8s %8s %8s %10s", "Type", "Component", "Reason", "Count", "Mean", "p50", "p99", "p99.9", "SelfMean");
+    for (auto& kv : breakdown) {
+        uint32_t type, comp, reason;
+        std::tie(type, comp, reason) = kv.first;
+        LatencyList& l = kv.second;
+        std::string selfMean = "-";
+        if (!l.selfLats.empty()) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%.1f", LatencyList::mean(l.selfLats));
+            selfMean = buf;
+        }
+        info("%4s %-16s %-10s %10ld %10.1f %8ld %8ld %8ld %10s", AccessTypeName((AccessType)type),
+                (comp < comps.size())? comps[comp].c_str() : "?", TraceReasonName(reason), l.lats.size(),
+                LatencyList::mean(l.lats), LatencyList::pct(l.lats, 0.5), LatencyList::pct(l.lats, 0.99),
+                LatencyList::pct(l.lats, 0.999), selfMean.c_str());
+    }
+
+    return 0;
+}
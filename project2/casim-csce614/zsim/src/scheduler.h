@@ -41,6 +41,7 @@
 #include "intrusive_list.h"
 #include "proc_stats.h"
 #include "process_stats.h"
+#include "profile_stats.h"
 #include "stats.h"
 #include "zsim.h"
 
@@ -110,6 +111,13 @@ class Scheduler : public GlobAlloc, public Callee {
 
             FutexJoinInfo futexJoin;
 
+            // Barrier profiling
+            uint64_t barSyncs; //phases this thread synced in
+            uint64_t barSyncNs; //time inside sync(), including the weave phase and wakeup
+            uint64_t barImbWaitNs; //time spent waiting for the last thread to arrive
+            uint64_t barLastArrivals; //phases this thread was the last to arrive
+            uint64_t boundStartNs, boundStartCpuNs; //wall and thread cpu time when the thread last (re)entered the bound phase, 0 if unknown
+
             ThreadInfo(uint32_t _gid, uint32_t _linuxPid, uint32_t _linuxTid, const g_vector<bool>& _mask) :
                 InListNode<ThreadInfo>(), gid(_gid), linuxPid(_linuxPid), linuxTid(_linuxTid), mask(_mask)
             {
@@ -125,6 +133,8 @@ class Scheduler : public GlobAlloc, public Callee {
                 if (count == 0) panic("Empty mask on gid %d!", gid);
                 fakeLeave = nullptr;
                 futexJoin.action = FJA_NONE;
+                barSyncs = barSyncNs = barImbWaitNs = barLastArrivals = 0;
+                boundStartNs = boundStartCpuNs = 0;
             }
         };
 
@@ -162,6 +172,21 @@ class Scheduler : public GlobAlloc, public Callee {
         VectorCounter occHist, runQueueHist;
         uint32_t scheduledThreads;
 
+        // Barrier and load-imbalance profiling. Arrivals of the current phase
+        // are recorded under schedLock and accounted for at the end of phase.
+        struct BarrierArrival {
+            ThreadInfo* th;
+            uint32_t cid;
+            uint64_t ns;
+            uint64_t boundNs;   // wall time since the thread (re)entered the bound phase, 0 if unknown
+            uint64_t offCpuNs;  // part of boundNs the host did not run the thread
+        };
+        g_vector<BarrierArrival> arrivals;
+        uint32_t parallelThreads;
+        VectorCounter barSyncs, barSyncNs, barImbWaitNs, barLastArrivals, barActiveHist, barHostWaitNs;
+        LatencyHistogram barImbWaitHist, barSpreadHist;
+        Counter barSpreadNs, barOversubPhases, barHostOversubPhases;
+
         // gid <-> (pid, tid) xlat functions
         inline uint32_t getGid(uint32_t pid, uint32_t tid) const {return (pid << 16) | tid;}
         inline uint32_t getPid(uint32_t gid) const {return gid >> 16;}
@@ -169,7 +194,8 @@ class Scheduler : public GlobAlloc, public Callee {
 
     public:
         Scheduler(void (*_atSyncFunc)(void), uint32_t _parallelThreads, uint32_t _numCores, uint32_t _schedQuantum) :
-            atSyncFunc(_atSyncFunc), bar(_parallelThreads, this), numCores(_numCores), schedQuantum(_schedQuantum), rnd(0x5C73D9134)
+            atSyncFunc(_atSyncFunc), bar(_parallelThreads, this), numCores(_numCores), schedQuantum(_schedQuantum), rnd(0x5C73D9134),
+            parallelThreads(_parallelThreads)
         {
             contexts.resize(numCores);
             for (uint32_t i = 0; i < numCores; i++) {
@@ -209,6 +235,22 @@ class Scheduler : public GlobAlloc, public Callee {
             occHist.init("occHist", "Occupancy histogram", numCores+1); schedStats->append(&occHist);
             uint32_t runQueueHistSize = ((numCores > 16)? numCores : 16) + 1;
             runQueueHist.init("rqSzHist", "Run queue size histogram", runQueueHistSize); schedStats->append(&runQueueHist);
+
+            AggregateStat* barStats = new AggregateStat();
+            barStats->init("bar", "Phase barrier and load imbalance stats (host time)");
+            barSyncs.init("syncs", "Per-core barrier syncs", numCores); barStats->append(&barSyncs);
+            barSyncNs.init("syncNs", "Per-core ns inside barrier syncs, including weave phase and wakeup", numCores); barStats->append(&barSyncNs);
+            barImbWaitNs.init("imbWaitNs", "Per-core ns waiting for the last thread to arrive", numCores); barStats->append(&barImbWaitNs);
+            barLastArrivals.init("lastArrivals", "Per-core phases where this core's thread was the last to arrive", numCores); barStats->append(&barLastArrivals);
+            barImbWaitHist.init("imbWaitHist", "Histogram of ns waiting for the last thread to arrive, per sync", 2, 34); barStats->append(&barImbWaitHist);
+            barSpreadNs.init("spreadNs", "Total ns from first to last arrival"); barStats->append(&barSpreadNs);
+            barSpreadHist.init("spreadHist", "Histogram of ns from first to last arrival, per phase", 2, 34); barStats->append(&barSpreadHist);
+            barActiveHist.init("activeHist", "Histogram of threads that synced, per phase", numCores+1); barStats->append(&barActiveHist);
+            barOversubPhases.init("oversubPhases", "Phases with more synced threads than sim.parallelism"); barStats->append(&barOversubPhases);
+            barHostWaitNs.init("hostWaitNs", "Per-core ns of bound phase the thread was not running on a host cpu", numCores); barStats->append(&barHostWaitNs);
+            barHostOversubPhases.init("hostOversubPhases", "Phases where synced threads were not running on a host cpu for over 10% of their bound phase"); barStats->append(&barHostOversubPhases);
+            schedStats->append(barStats);
+
             parentStat->append(schedStats);
         }
 
@@ -266,6 +308,10 @@ class Scheduler : public GlobAlloc, public Callee {
                 //info("[G %d] Removed from outQueue and descheduled", gid);
             }
             //At this point noone holds pointer to th, it's out from all queues, and either on OUT or BLOCKED means it's not pending a handoff
+            if (th->barSyncs) {
+                info("Sched: thread %d (pid %d tid %d) synced %ld phases, %.3f ms in sync, %.3f ms waiting for stragglers, last to arrive %ld times",
+                        gid, th->linuxPid, th->linuxTid, th->barSyncs, th->barSyncNs/1e6, th->barImbWaitNs/1e6, th->barLastArrivals);
+            }
             delete th;
             threadsFinished.inc();
             futex_unlock(&schedLock);
@@ -324,6 +370,7 @@ class Scheduler : public GlobAlloc, public Callee {
                 }
             }
 
+            startBoundWindow(th); //time outside the bound phase (e.g., in syscalls) does not count as host wait
             return th->cid;
         }
 
@@ -383,10 +430,22 @@ class Scheduler : public GlobAlloc, public Callee {
         }
 
         uint32_t sync(uint32_t pid, uint32_t tid, uint32_t cid) {
+            uint64_t arrivalNs = getNs();
+            uint64_t arrivalCpuNs = getThreadCpuNs();
             futex_lock(&schedLock);
             ThreadInfo* th = contexts[cid].curThread;
             assert(!th->markedForSleep);
+            BarrierArrival arrival = {th, cid, arrivalNs, 0, 0};
+            if (th->boundStartNs) {
+                arrival.boundNs = arrivalNs - th->boundStartNs;
+                uint64_t cpuNs = arrivalCpuNs - th->boundStartCpuNs;
+                arrival.offCpuNs = (arrival.boundNs > cpuNs)? arrival.boundNs - cpuNs : 0;
+            }
+            arrivals.push_back(arrival);
             bar.sync(cid, &schedLock); //releases lock, may trigger end of phase, may block us
+            uint64_t syncNs = getNs() - arrivalNs;
+            barSyncNs.atomicInc(cid, syncNs);
+            th->barSyncNs += syncNs;
 
             //No locks at this point; we need to check whether we need to hand off our context
             if (th->handoffThread) {
@@ -416,6 +475,7 @@ class Scheduler : public GlobAlloc, public Callee {
             }
 
             assert(th->state == RUNNING);
+            startBoundWindow(th);
             return th->cid;
         }
 
@@ -426,6 +486,7 @@ class Scheduler : public GlobAlloc, public Callee {
             occHist.inc(scheduledThreads);
             uint32_t rqPos = (runQueue.size() < (runQueueHist.size()-1))? runQueue.size() : (runQueueHist.size()-1);
             runQueueHist.inc(rqPos);
+            accountArrivals();
 
             if (atSyncFunc) atSyncFunc(); //call the simulator-defined actions external to the scheduler
 
@@ -552,6 +613,59 @@ class Scheduler : public GlobAlloc, public Callee {
         uint32_t getScheduledPid(uint32_t cid) const { return (contexts[cid].state == USED)? getPid(contexts[cid].curThread->gid) : (uint32_t)-1; }
 
     private:
+        // Called at the end of phase with schedLock held. Threads that sync
+        // early wait for the last one to arrive; with more synced threads
+        // than sim.parallelism, part of that wait is the barrier running
+        // them in waves rather than a slow core model.
+        void accountArrivals() {
+            if (arrivals.empty()) return;
+            uint64_t firstNs = arrivals[0].ns;
+            uint64_t lastNs = arrivals[0].ns;
+            uint32_t lastIdx = 0;
+            for (uint32_t i = 1; i < arrivals.size(); i++) {
+                if (arrivals[i].ns < firstNs) firstNs = arrivals[i].ns;
+                if (arrivals[i].ns > lastNs) {
+                    lastNs = arrivals[i].ns;
+                    lastIdx = i;
+                }
+            }
+
+            for (BarrierArrival& a : arrivals) {
+                uint64_t waitNs = lastNs - a.ns;
+                barSyncs.inc(a.cid);
+                barImbWaitNs.inc(a.cid, waitNs);
+                barImbWaitHist.record(waitNs);
+                a.th->barSyncs++;
+                a.th->barImbWaitNs += waitNs;
+            }
+            barLastArrivals.inc(arrivals[lastIdx].cid);
+            arrivals[lastIdx].th->barLastArrivals++;
+            barSpreadNs.inc(lastNs - firstNs);
+            barSpreadHist.record(lastNs - firstNs);
+
+            // Threads that are runnable but not running on the host (other host load, or more
+            // simulator threads than host cpus) show up as wall time without thread cpu time
+            uint64_t boundNs = 0;
+            uint64_t offCpuNs = 0;
+            for (BarrierArrival& a : arrivals) {
+                barHostWaitNs.inc(a.cid, a.offCpuNs);
+                boundNs += a.boundNs;
+                offCpuNs += a.offCpuNs;
+            }
+            if (offCpuNs*10 > boundNs) barHostOversubPhases.inc();
+
+            uint32_t active = arrivals.size();
+            barActiveHist.inc(MIN(active, numCores));
+            if (active > parallelThreads) barOversubPhases.inc();
+            arrivals.clear();
+        }
+
+        // Called by th itself when it (re)enters the bound phase
+        void startBoundWindow(ThreadInfo* th) {
+            th->boundStartNs = getNs();
+            th->boundStartCpuNs = getThreadCpuNs();
+        }
+
         void schedule(ThreadInfo* th, ContextInfo* ctx) {
             assert(th->state == STARTED || th->state == BLOCKED || th->state == QUEUED);
             assert(ctx->state == IDLE);
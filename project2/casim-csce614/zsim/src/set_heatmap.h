@@ -0,0 +1,98 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SET_HEATMAP_H_
+#define SET_HEATMAP_H_
+
+#include "bithacks.h"
+#include "galloc.h"
+#include "log.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+
+/* Per-set heatmap counters for cache arrays (array.heatmap). Contiguous sets
+ * are aggregated into at most numBins bins, and each bin counts demand
+ * accesses, misses, evictions, and conflict misses. A miss is a conflict miss
+ * if the line is in its set's shadow tags, which hold the last shadowWays
+ * lines evicted from the set (i.e., it would have hit with shadowWays more
+ * ways). Counters are cumulative vector stats, so periodic dumps
+ * (sim.statsPhaseInterval) give the set x time distribution;
+ * misc/heatmap.py renders them.
+ */
+class SetHeatmap : public GlobAlloc {
+    private:
+        const uint32_t numBins;
+        const uint32_t binShift;
+        const uint32_t shadowWays;
+        Address* shadow;
+        uint8_t* shadowPos; // next shadow slot to fill, per set
+
+        VectorCounter profAccesses, profMisses, profEvictions, profConflicts;
+
+    public:
+        SetHeatmap(uint32_t _numSets, uint32_t bins, uint32_t _shadowWays)
+            : numBins(MIN(bins, _numSets)), binShift(ilog2(_numSets/MIN(bins, _numSets))), shadowWays(_shadowWays)
+        {
+            assert_msg(isPow2(bins), "heatmap bins must be a power of 2, %d given", bins);
+            assert_msg(shadowWays > 0 && shadowWays < 256, "heatmap shadow ways must be in 1..255, %d given", shadowWays);
+            shadow = gm_calloc<Address>(_numSets*shadowWays);
+            shadowPos = gm_calloc<uint8_t>(_numSets);
+        }
+
+        void initStats(AggregateStat* parentStat) {
+            AggregateStat* hmStats = new AggregateStat();
+            hmStats->init("heatmap", "Per-set heatmap (sets in contiguous bins)");
+            profAccesses.init("accesses", "Demand accesses per set bin", numBins); hmStats->append(&profAccesses);
+            profMisses.init("misses", "Demand misses per set bin", numBins); hmStats->append(&profMisses);
+            profEvictions.init("evictions", "Evictions per set bin", numBins); hmStats->append(&profEvictions);
+            profConflicts.init("conflicts", "Misses that hit in the set's shadow tags per set bin", numBins); hmStats->append(&profConflicts);
+            parentStat->append(hmStats);
+        }
+
+        inline void access(uint32_t set, Address lineAddr, bool hit) {
+            uint32_t bin = set >> binShift;
+            profAccesses.inc(bin);
+            if (hit) return;
+            profMisses.inc(bin);
+            Address* setShadow = &shadow[set*shadowWays];
+            for (uint32_t i = 0; i < shadowWays; i++) {
+                if (setShadow[i] == lineAddr) {
+                    profConflicts.inc(bin);
+                    setShadow[i] = 0;  // count each eviction once
+                    break;
+                }
+            }
+        }
+
+        inline void evict(uint32_t set, Address lineAddr) {
+            if (!lineAddr) return;  // invalid line
+            profEvictions.inc(set >> binShift);
+            uint32_t pos = shadowPos[set];
+            shadow[set*shadowWays + pos] = lineAddr;
+            shadowPos[set] = (pos + 1 == shadowWays)? 0 : pos + 1;
+        }
+};
+
+#endif  // SET_HEATMAP_H_
@@ -0,0 +1,234 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sharing_detector.h"
+#include <algorithm>
+#include <fstream>
+#include <utility>
+#include <vector>
+#include "bithacks.h"
+#include "log.h"
+#include "miss_prof.h"
+#include "zsim.h"
+
+SharingDetector::SharingDetector(uint32_t _numCores, uint32_t _numProcs, uint32_t _tableLines, uint32_t _wordBytes, uint32_t _maxEntries)
+    : numCores(_numCores), numProcs(_numProcs), tableLines(_tableLines), maxEntries(_maxEntries),
+      wordShift(ilog2(_wordBytes)), lineOffsetMask(zinfo->lineSize - 1)
+{
+    if (!isPow2(tableLines)) panic("sim.sharingTableLines must be a power of 2, %d is not", tableLines);
+    if (!isPow2(_wordBytes) || _wordBytes > zinfo->lineSize) panic("sim.sharingWordBytes must be a power of 2 up to the line size, %d is not", _wordBytes);
+    if (zinfo->lineSize / _wordBytes > 64) panic("sim.sharingWordBytes: lines can have at most 64 words, %d-byte words give %d", _wordBytes, zinfo->lineSize / _wordBytes);
+    if (!maxEntries) panic("sim.sharingEntries must be > 0");
+
+    shadow = gm_calloc<ShadowLine>(numCores*tableLines);
+    pending = gm_calloc<PendingAccess>(numCores);
+    procs = gm_calloc<ProcTables>(numProcs);
+    for (uint32_t p = 0; p < numProcs; p++) {
+        new (&procs[p]) ProcTables();
+        futex_init(&procs[p].lock);
+        for (uint32_t c = 0; c < SH_NUM_CLASSES; c++) procs[p].totals[c] = 0;
+        procs[p].lineReplacements = procs[p].codeReplacements = 0;
+    }
+}
+
+void SharingDetector::initStats(AggregateStat* parentStat) {
+    AggregateStat* shStat = new AggregateStat();
+    shStat->init("sharing", "False-sharing detector stats, per core that receives the invalidation");
+    classCounts[SH_TRUE_INV].init("trueInv", "Invalidations on words the requester accesses (true sharing)", numCores);
+    classCounts[SH_FALSE_INV].init("falseInv", "Invalidations on words the requester does not access (false sharing)", numCores);
+    classCounts[SH_TRUE_DOWNGRADE].init("trueDown", "Downgrades on words the requester reads (true sharing)", numCores);
+    classCounts[SH_FALSE_DOWNGRADE].init("falseDown", "Downgrades on words the requester does not read (false sharing)", numCores);
+    untracked.init("untracked", "Demand invalidations and downgrades of lines without access history", numCores);
+    indirect.init("indirect", "Invalidations and downgrades not caused by a demand access to the line", numCores);
+    for (uint32_t c = 0; c < SH_NUM_CLASSES; c++) shStat->append(&classCounts[c]);
+    shStat->append(&untracked);
+    shStat->append(&indirect);
+    parentStat->append(shStat);
+}
+
+void SharingDetector::invalidated(uint32_t victimIdx, const InvReq& req) {
+    if (req.type == FWD) return;  // the victim keeps its copy
+    assert(victimIdx < numCores);
+    ShadowLine& l = shadow[victimIdx*tableLines + (req.lineAddr & (tableLines - 1))];
+    bool tracked = l.pLineAddr == req.lineAddr;
+
+    bool demand = req.srcId < numCores && req.srcId != victimIdx && pending[req.srcId].valid && pending[req.srcId].pLineAddr == req.lineAddr;
+    if (!demand) {
+        indirect.inc(victimIdx);
+    } else if (!tracked || !(l.readMask | l.writeMask)) {
+        untracked.inc(victimIdx);
+    } else {
+        const PendingAccess& p = pending[req.srcId];
+        uint64_t bit = 1UL << ((p.vAddr & lineOffsetMask) >> wordShift);
+        SharingClass c;
+        if (req.type == INVX) {
+            // A downgrade only hurts the victim's writes
+            c = (l.writeMask & bit)? SH_TRUE_DOWNGRADE : SH_FALSE_DOWNGRADE;
+        } else {
+            c = ((l.readMask | l.writeMask) & bit)? SH_TRUE_INV : SH_FALSE_INV;
+        }
+        classCounts[c].inc(victimIdx);
+        if (l.writeMask) attribute(p, c, l.writePc, l.writeProc);
+        else attribute(p, c, l.readPc, l.readProc);
+    }
+
+    if (tracked) {
+        if (req.type == INV) l.readMask = 0;
+        l.writeMask = 0;
+    }
+}
+
+// Space-saving: when a table is full, a new key replaces the entry with the fewest events, and inherits its count as the error bound
+template <typename R>
+static R& FindRecord(g_unordered_map<Address, R>& table, Address key, uint32_t maxEntries, uint64_t* replacements) {
+    auto it = table.find(key);
+    if (it != table.end()) return it->second;
+    uint64_t error = 0;
+    if (table.size() >= maxEntries) {
+        auto min = table.begin();
+        for (auto jt = table.begin(); jt != table.end(); ++jt) {
+            if (jt->second.weight < min->second.weight) min = jt;
+        }
+        error = min->second.weight;
+        table.erase(min);
+        (*replacements)++;
+    }
+    R& r = table[key];  // value-initialized (zero counts)
+    r.weight = error;
+    r.error = error;
+    return r;
+}
+
+void SharingDetector::attribute(const PendingAccess& p, SharingClass c, Address victimPc, uint32_t victimProc) {
+    assert(victimProc < numProcs);
+    ProcTables& pt = procs[procIdx];
+    futex_lock(&pt.lock);
+    pt.totals[c]++;
+
+    LineRecord& lr = FindRecord(pt.lines, p.vAddr >> lineBits, maxEntries, &pt.lineReplacements);
+    lr.counts[c]++;
+    lr.weight++;
+    lr.reqPc = p.pc;
+    lr.victimPc = victimPc;
+    lr.victimProc = victimProc;
+
+    CodeRecord& rr = FindRecord(pt.code, p.pc, maxEntries, &pt.codeReplacements);
+    rr.reqCounts[c]++;
+    rr.weight++;
+    futex_unlock(&pt.lock);
+
+    // The victim's code is only meaningful in its own process (they differ if processes share memory)
+    ProcTables& vt = procs[victimProc];
+    futex_lock(&vt.lock);
+    CodeRecord& vr = FindRecord(vt.code, victimPc, maxEntries, &vt.codeReplacements);
+    vr.victimCounts[c]++;
+    vr.weight++;
+    futex_unlock(&vt.lock);
+}
+
+static const char* classNames[] = {"trueInv", "falseInv", "trueDown", "falseDown"};
+
+static uint64_t FalseCount(const uint64_t* counts) {
+    return counts[SH_FALSE_INV] + counts[SH_FALSE_DOWNGRADE];
+}
+
+static uint64_t TrueCount(const uint64_t* counts) {
+    return counts[SH_TRUE_INV] + counts[SH_TRUE_DOWNGRADE];
+}
+
+static void WriteCounts(std::ofstream& out, const uint64_t* counts) {
+    for (uint32_t c = 0; c < SH_NUM_CLASSES; c++) out << "\t" << counts[c];
+}
+
+void SharingDetector::writeReport(const char* fileName) {
+    // Copy our tables so we do not hold the lock while symbolizing
+    ProcTables& pt = procs[procIdx];
+    std::vector<std::pair<Address, LineRecord>> lines;
+    std::vector<std::pair<Address, CodeRecord>> code;
+    uint64_t totals[SH_NUM_CLASSES];
+    futex_lock(&pt.lock);
+    for (auto& it : pt.lines) lines.push_back(it);
+    for (auto& it : pt.code) code.push_back(it);
+    for (uint32_t c = 0; c < SH_NUM_CLASSES; c++) totals[c] = pt.totals[c];
+    uint64_t lineRepl = pt.lineReplacements;
+    uint64_t codeRepl = pt.codeReplacements;
+    futex_unlock(&pt.lock);
+
+    // Most false sharing first, then most true sharing
+    auto cmp = [](const uint64_t* a, const uint64_t* b) {
+        if (FalseCount(a) != FalseCount(b)) return FalseCount(a) > FalseCount(b);
+        return TrueCount(a) > TrueCount(b);
+    };
+    std::sort(lines.begin(), lines.end(), [&](const std::pair<Address, LineRecord>& a, const std::pair<Address, LineRecord>& b) {
+        return cmp(a.second.counts, b.second.counts);
+    });
+    std::sort(code.begin(), code.end(), [&](const std::pair<Address, CodeRecord>& a, const std::pair<Address, CodeRecord>& b) {
+        uint64_t ac[SH_NUM_CLASSES], bc[SH_NUM_CLASSES];
+        for (uint32_t c = 0; c < SH_NUM_CLASSES; c++) {
+            ac[c] = a.second.reqCounts[c] + a.second.victimCounts[c];
+            bc[c] = b.second.reqCounts[c] + b.second.victimCounts[c];
+        }
+        return cmp(ac, bc);
+    });
+
+    std::ofstream out(fileName);
+    out << "# Coherence sharing, process " << procIdx << std::endl;
+    out << "# Invalidations (Inv) and downgrades (Down) of L1D lines caused by demand accesses, split in true sharing" << std::endl;
+    out << "# (the requester accesses a word the victim touched) and false sharing (a different word of the same line)" << std::endl;
+    out << "Totals:";
+    for (uint32_t c = 0; c < SH_NUM_CLASSES; c++) out << " " << classNames[c] << " " << totals[c];
+    out << std::endl << std::endl;
+
+    out << "Lines (" << lines.size() << " entries, " << lineRepl << " replaced)" << std::endl;
+    out << "  rank";
+    for (uint32_t c = 0; c < SH_NUM_CLASSES; c++) out << "\t" << classNames[c];
+    out << "\terr\tline\tlast requester / victim code" << std::endl;
+    uint32_t rank = 0;
+    for (auto& it : lines) {
+        const LineRecord& lr = it.second;
+        out << "  " << ++rank;
+        WriteCounts(out, lr.counts);
+        out << "\t" << lr.error << "\t0x" << std::hex << (it.first << lineBits) << std::dec << "\t" << SymbolizeAddr(lr.reqPc) << " / ";
+        if (lr.victimProc == procIdx) out << SymbolizeAddr(lr.victimPc);
+        else out << "0x" << std::hex << lr.victimPc << std::dec << " (process " << lr.victimProc << ")";
+        out << std::endl;
+    }
+    out << std::endl;
+
+    out << "Code (" << code.size() << " entries, " << codeRepl << " replaced)" << std::endl;
+    out << "  rank";
+    for (uint32_t c = 0; c < SH_NUM_CLASSES; c++) out << "\treq:" << classNames[c];
+    for (uint32_t c = 0; c < SH_NUM_CLASSES; c++) out << "\tvictim:" << classNames[c];
+    out << "\terr\tcode" << std::endl;
+    rank = 0;
+    for (auto& it : code) {
+        out << "  " << ++rank;
+        WriteCounts(out, it.second.reqCounts);
+        WriteCounts(out, it.second.victimCounts);
+        out << "\t" << it.second.error << "\t" << (it.first? SymbolizeAddr(it.first) : "<unknown>") << std::endl;
+    }
+    out << std::endl;
+    info("Wrote sharing report to %s", fileName);
+}
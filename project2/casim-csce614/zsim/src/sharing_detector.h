@@ -0,0 +1,186 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHARING_DETECTOR_H_
+#define SHARING_DETECTOR_H_
+
+/* False-sharing detector (sim.sharingDetector). Tells true from false sharing
+ * in the coherence invalidations and downgrades that L1 data caches receive,
+ * and attributes them to the code and lines involved, writing a per-process
+ * report (sharing-p<procIdx>.txt) when the process ends.
+ *
+ * Each core keeps a direct-mapped shadow table (sim.sharingTableLines
+ * entries) of the physical lines it has touched, with masks of the words
+ * (sim.sharingWordBytes) it has read and written since it last acquired the
+ * line, recorded by its L1D from the effective addresses of its accesses.
+ * Cores do not report access sizes, so each access marks the word that holds
+ * its address, and unaligned or wide accesses may look false.
+ *
+ * On an L1D miss, the requester's access is pending until the miss finishes.
+ * When it invalidates (or downgrades) another L1D's copy of that same line,
+ * the invalidation is true sharing if the requester's word was written (INVX)
+ * or touched (INV) by the victim, and false sharing otherwise. Invalidations
+ * that are not caused by a demand access to the line (evictions from
+ * inclusive levels, prefetches) are counted as indirect.
+ *
+ * Code is identified by basic block addresses (see FilterCache::setProfPc()),
+ * and lines by the requester's virtual address. Events are attributed to the
+ * requester's line and code in the requester's process, and to the victim's
+ * code in the victim's process, so each process symbolizes its own code.
+ * Tables are bounded to sim.sharingEntries lines and code addresses per
+ * process. When a table is full, a new key replaces the entry with the fewest
+ * events and inherits its count as the error bound (space-saving, like the
+ * miss profiler's tables), so heavy hitters are never lost.
+ *
+ * Recording on L1D hits does not take locks, like filter hits themselves, so
+ * masks may miss accesses that race with an invalidation.
+ */
+
+#include <stdint.h>
+#include "g_std/g_unordered_map.h"
+#include "galloc.h"
+#include "locks.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+#include "zsim.h"
+
+enum SharingClass {
+    SH_TRUE_INV,
+    SH_FALSE_INV,
+    SH_TRUE_DOWNGRADE,
+    SH_FALSE_DOWNGRADE,
+    SH_NUM_CLASSES
+};
+
+class SharingDetector : public GlobAlloc {
+    private:
+        struct ShadowLine {
+            Address pLineAddr;
+            uint64_t readMask;
+            uint64_t writeMask;
+            Address readPc;   // last reader and writer
+            Address writePc;
+            uint32_t readProc;
+            uint32_t writeProc;
+        };
+
+        // An L1D miss in flight
+        struct PendingAccess {
+            Address pLineAddr;
+            Address vAddr;
+            Address pc;
+            bool isWrite;
+            bool valid;
+        };
+
+        struct LineRecord {
+            uint64_t counts[SH_NUM_CLASSES];
+            uint64_t weight;  // sum of counts, including the inherited error
+            uint64_t error;   // upper bound of events not counted (space-saving)
+            Address reqPc;     // last requester and victim code, for the report
+            Address victimPc;
+            uint32_t victimProc;
+        };
+
+        struct CodeRecord {
+            uint64_t reqCounts[SH_NUM_CLASSES];     // this code invalidated others
+            uint64_t victimCounts[SH_NUM_CLASSES];  // this code's line was invalidated
+            uint64_t weight;
+            uint64_t error;
+        };
+
+        struct ProcTables {
+            lock_t lock;
+            g_unordered_map<Address, LineRecord> lines;
+            g_unordered_map<Address, CodeRecord> code;
+            uint64_t lineReplacements, codeReplacements;
+            uint64_t totals[SH_NUM_CLASSES];
+        };
+
+        ShadowLine* shadow;  // numCores x tableLines
+        PendingAccess* pending;  // per core
+        ProcTables* procs;
+        const uint32_t numCores, numProcs;
+        const uint32_t tableLines, maxEntries;
+        const uint32_t wordShift;
+        const Address lineOffsetMask;
+
+        VectorCounter classCounts[SH_NUM_CLASSES];  // per victim core
+        VectorCounter untracked;  // the victim had no access history for the line
+        VectorCounter indirect;   // not caused by a demand access to the line
+
+    public:
+        SharingDetector(uint32_t _numCores, uint32_t _numProcs, uint32_t _tableLines, uint32_t _wordBytes, uint32_t _maxEntries);
+
+        void initStats(AggregateStat* parentStat);
+
+        // Bound phase, from the L1D of coreIdx, for every access (hits and finished misses)
+        inline void record(uint32_t coreIdx, Address pLineAddr, Address vAddr, bool isWrite, Address pc) {
+            ShadowLine& l = shadow[coreIdx*tableLines + (pLineAddr & (tableLines - 1))];
+            if (l.pLineAddr != pLineAddr) {
+                l.pLineAddr = pLineAddr;
+                l.readMask = l.writeMask = 0;
+            }
+            uint64_t bit = 1UL << ((vAddr & lineOffsetMask) >> wordShift);
+            if (isWrite) {
+                l.writeMask |= bit;
+                l.writePc = pc;
+                l.writeProc = procIdx;
+            } else {
+                l.readMask |= bit;
+                l.readPc = pc;
+                l.readProc = procIdx;
+            }
+        }
+
+        // L1D miss path, before the request is issued
+        inline void startMiss(uint32_t coreIdx, Address pLineAddr, Address vAddr, bool isWrite, Address pc) {
+            assert(coreIdx < numCores);
+            PendingAccess& p = pending[coreIdx];
+            p.pLineAddr = pLineAddr;
+            p.vAddr = vAddr;
+            p.pc = pc;
+            p.isWrite = isWrite;
+            p.valid = true;
+        }
+
+        // L1D miss path, once the line is in the L1D (with its lock held)
+        inline void endMiss(uint32_t coreIdx) {
+            PendingAccess& p = pending[coreIdx];
+            record(coreIdx, p.pLineAddr, p.vAddr, p.isWrite, p.pc);
+            p.valid = false;
+        }
+
+        // Called by the L1D of victimIdx (with its lock held) when it receives an invalidation
+        void invalidated(uint32_t victimIdx, const InvReq& req);
+
+        // Symbolizes the calling process's tables and writes its report. Call from the process, before it ends.
+        void writeReport(const char* fileName);
+
+    private:
+        void attribute(const PendingAccess& p, SharingClass c, Address victimPc, uint32_t victimProc);
+};
+
+#endif  // SHARING_DETECTOR_H_
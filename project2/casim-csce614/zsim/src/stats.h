@@ -31,12 +31,11 @@
  * - Counter: A plain single counter.
  * - VectorCounter: A fixed-size vector of logically related counters. Each
  *   vector element may be unnamed or named (useful when enum-indexed vectors).
- * - Histogram: A GEMS-style histogram, intended to profile a distribution.
- *   It has a fixed amount of buckets, and buckets are resized as samples
- *   are added, making profiling increasingly coarser but keeping storage
- *   space constant. Unlike GEMS-style stats, though, at some configurable
- *   point part of the array starts growing logarithmically, to capture
- *   outliers without hurting accuracy of most samples.
+ * - LatencyHistogram: A log-linear (HDR-style) histogram, intended to profile
+ *   a distribution (typically latencies). It has a fixed amount of buckets,
+ *   whose widths grow with their values, so every sample is recorded with
+ *   bounded relative error and outliers take little space. It is output as a
+ *   vector of bucket counts, so histograms merge by adding them up.
  * - ProxyStat takes a function pointer uint64_t(*)(void) at initialization,
  *   and calls it to get its value. It is used for cases where a stat can't
  *   be stored as a counter (e.g. aggregates, RDTSC, performance counters,...)
@@ -75,6 +74,7 @@
 /* TODO: I want these to be POD types, but polymorphism (needed by dynamic_cast) probably disables it. Dang. */
 
 #include <stdint.h>
+#include <stdio.h>
 #include <string>
 #include "g_std/g_vector.h"
 #include "log.h"
@@ -297,11 +297,98 @@ class VectorCounter : public VectorStat {
         }
 };
 
-/*
-class Histogram : public Stat {
-    //TBD
+/* Values below 2^subBits get one bucket each. Above that, each power-of-two
+ * range is split in 2^subBits equal buckets, so a bucket is never wider than
+ * 2^-subBits of its lower bound. Values >= 2^maxBits go to the last bucket.
+ * Buckets are named by their lower bound; percentile() returns bucket
+ * midpoints, so its relative error is at most 2^-(subBits+1).
+ */
+class LatencyHistogram : public VectorStat {
+    private:
+        g_vector<uint64_t> _buckets;
+        uint32_t _subBits;
+        uint32_t _maxBits;
+
+    public:
+        LatencyHistogram() : VectorStat(), _subBits(0), _maxBits(0) {}
+
+        virtual void init(const char* name, const char* desc, uint32_t subBits = 3, uint32_t maxBits = 20) {
+            initStat(name, desc);
+            assert(subBits < maxBits && maxBits < 64);
+            _subBits = subBits;
+            _maxBits = maxBits;
+            uint32_t numBuckets = (maxBits - subBits + 1) << subBits;
+            _buckets.resize(numBuckets);
+            for (uint32_t i = 0; i < numBuckets; i++) _buckets[i] = 0;
+
+            const char** names = gm_calloc<const char*>(numBuckets);
+            for (uint32_t i = 0; i < numBuckets; i++) {
+                char buf[24];
+                snprintf(buf, sizeof(buf), "%ld", lowerBound(i));
+                names[i] = gm_strdup(buf);
+            }
+            _counterNames = names;
+        }
+
+        inline uint32_t bucket(uint64_t value) const {
+            if (value < (1ul << _subBits)) return value;
+            if (value >> _maxBits) return _buckets.size() - 1;
+            uint32_t msb = 63 - __builtin_clzl(value);
+            uint32_t shift = msb - _subBits;
+            return ((shift + 1) << _subBits) + (value >> shift) - (1ul << _subBits);
+        }
+
+        inline uint64_t lowerBound(uint32_t idx) const {
+            uint32_t block = idx >> _subBits;
+            if (block == 0) return idx;
+            uint64_t sub = idx & ((1ul << _subBits) - 1);
+            return ((1ul << _subBits) + sub) << (block - 1);
+        }
+
+        inline void record(uint64_t value) {
+            _buckets[bucket(value)]++;
+        }
+
+        inline void atomicRecord(uint64_t value) {
+            __sync_fetch_and_add(&_buckets[bucket(value)], 1);
+        }
+
+        void merge(const LatencyHistogram& other) {
+            assert(other._subBits == _subBits && other._maxBits == _maxBits);
+            for (uint32_t i = 0; i < _buckets.size(); i++) _buckets[i] += other._buckets[i];
+        }
+
+        uint64_t samples() const {
+            uint64_t total = 0;
+            for (uint64_t b : _buckets) total += b;
+            return total;
+        }
+
+        // q in [0, 1], e.g., 0.99 for the 99th percentile. Returns 0 if there are no samples.
+        uint64_t percentile(double q) const {
+            uint64_t total = samples();
+            if (total == 0) return 0;
+            uint64_t rank = (uint64_t)(q*total);
+            if (rank >= total) rank = total - 1;
+            uint64_t seen = 0;
+            for (uint32_t i = 0; i < _buckets.size(); i++) {
+                seen += _buckets[i];
+                if (seen > rank) {
+                    if (i == _buckets.size() - 1) return lowerBound(i);
+                    return (lowerBound(i) + lowerBound(i + 1) - 1)/2;
+                }
+            }
+            panic("Percentile walk overflowed (%ld samples)", total);
+        }
+
+        inline virtual uint64_t count(uint32_t idx) const {
+            return _buckets[idx];
+        }
+
+        inline uint32_t size() const {
+            return _buckets.size();
+        }
 };
-*/
 
 class ProxyStat : public ScalarStat {
     private:
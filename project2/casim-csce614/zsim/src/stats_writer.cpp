@@ -0,0 +1,133 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stats_writer.h"
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "host_prof.h"
+#include "log.h"
+#include "pin.H"
+
+#define WRITER_POLL_NS (1000*1000)  // 1ms between checks for full chunks
+
+CompiledStats::CompiledStats(AggregateStat* rootStat, bool skipVectors, bool sumRegularAggregates) : fold(false) {
+    words = compile(rootStat, 0, skipVectors, sumRegularAggregates);
+}
+
+uint32_t CompiledStats::compile(Stat* s, uint32_t dst, bool skipVectors, bool sumRegularAggregates) {
+    // Same skip rule as the HDF5 type construction, so records and types always match
+    if (skipVectors && dynamic_cast<VectorStat*>(s)) return 0;
+
+    if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
+        if (as->isRegular() && sumRegularAggregates && as->size() > 0) {
+            uint32_t sz = compile(as->get(0), dst, skipVectors, sumRegularAggregates);
+            for (uint32_t i = 1; i < as->size(); i++) {
+                uint32_t childSz = compile(as->get(i), dst, skipVectors, sumRegularAggregates);
+                if (childSz != sz) panic("In regular aggregate %s, child %d has %d words, first child has %d", as->name(), i, childSz, sz);
+            }
+            if (as->size() > 1) fold = true;
+            return sz;
+        } else {
+            uint32_t sz = 0;
+            for (uint32_t i = 0; i < as->size(); i++) {
+                sz += compile(as->get(i), dst + sz, skipVectors, sumRegularAggregates);
+            }
+            return sz;
+        }
+    } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
+        scalars.push_back({ss, dst});
+        return 1;
+    } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
+        vectors.push_back({vs, dst});
+        return vs->size();
+    } else {
+        panic("Unrecognized stat type");
+    }
+}
+
+void CompiledStats::snapshot(uint64_t* record) const {
+    if (fold) {
+        memset(record, 0, words*sizeof(uint64_t));
+        for (const ScalarEntry& e : scalars) record[e.dst] += e.stat->get();
+        for (const VectorEntry& e : vectors) {
+            uint32_t sz = e.stat->size();
+            for (uint32_t i = 0; i < sz; i++) record[e.dst + i] += e.stat->count(i);
+        }
+    } else {
+        for (const ScalarEntry& e : scalars) record[e.dst] = e.stat->get();
+        for (const VectorEntry& e : vectors) {
+            uint32_t sz = e.stat->size();
+            for (uint32_t i = 0; i < sz; i++) record[e.dst + i] = e.stat->count(i);
+        }
+    }
+}
+
+StatsRing::StatsRing(uint32_t _recWords, uint32_t _slots) : recWords(_recWords), slots(_slots), head(0), tail(0) {
+    assert(slots > 0);
+    buf = gm_calloc<uint64_t>((size_t)recWords*slots);
+}
+
+StatsWriter::StatsWriter() : running(false), flushReqs(0), flushAcks(0) {}
+
+void StatsWriter::threadTrampoline(void* arg) {
+    static_cast<StatsWriter*>(arg)->threadLoop();
+}
+
+void StatsWriter::start() {
+    assert(!running);
+    running = true;
+    __sync_synchronize();
+    PIN_SpawnInternalThread(threadTrampoline, this, 64*1024, nullptr);
+}
+
+void StatsWriter::threadLoop() {
+    info("Started stats writer thread");
+    while (true) {
+        uint64_t req = flushReqs;
+        __sync_synchronize();
+        bool flushing = (req != flushAcks);
+        for (AsyncStatsSink* sink : sinks) {
+            HostProfScope hps(HP_STATS);
+            sink->drain(flushing);
+            if (flushing) sink->close();
+        }
+        if (flushing) {
+            __sync_synchronize();
+            flushAcks = req;
+        } else {
+            struct timespec tm;
+            tm.tv_sec = 0;
+            tm.tv_nsec = WRITER_POLL_NS;
+            nanosleep(&tm, nullptr);
+        }
+    }
+}
+
+void StatsWriter::flush() {
+    assert(running);
+    uint64_t req = __sync_add_and_fetch(&flushReqs, 1);
+    while (flushAcks < req) usleep(100);
+}
@@ -0,0 +1,152 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATS_WRITER_H_
+#define STATS_WRITER_H_
+
+/* Asynchronous stats pipeline. Dumps snapshot the stat tree into a ring in the
+ * global heap and return; a writer thread in process 0 (which outlives all
+ * other processes, see SimEnd()) owns the output files and does the encoding,
+ * compression and I/O off the simulation's critical path.
+ */
+
+#include <stdint.h>
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "stats.h"
+
+/* Flat view of a stat tree. The tree is walked once at construction and
+ * turned into arrays of typed getters, each with the word offset it fills in
+ * a record. Regular aggregates are folded by having all their children write
+ * to the same offsets. snapshot() is then a tight loop, without tree walks or
+ * dynamic_casts.
+ */
+class CompiledStats : public GlobAlloc {
+    private:
+        struct ScalarEntry {
+            ScalarStat* stat;
+            uint32_t dst;
+        };
+
+        struct VectorEntry {
+            VectorStat* stat;
+            uint32_t dst;
+        };
+
+        g_vector<ScalarEntry> scalars;
+        g_vector<VectorEntry> vectors;
+        uint32_t words;
+        bool fold; // some offsets are shared by several getters, so snapshot() must accumulate
+
+        uint32_t compile(Stat* s, uint32_t dst, bool skipVectors, bool sumRegularAggregates);
+
+    public:
+        CompiledStats(AggregateStat* rootStat, bool skipVectors, bool sumRegularAggregates);
+
+        uint32_t recordWords() const { return words; }
+        void snapshot(uint64_t* record) const;
+};
+
+/* Single-producer, single-consumer ring of fixed-size records in the global
+ * heap. The producer is whichever thread dumps stats (dumps of a backend are
+ * serialized by the phase barrier, though they may come from any process);
+ * the consumer is the writer thread, or the producer itself when there is no
+ * writer thread.
+ */
+class StatsRing : public GlobAlloc {
+    private:
+        uint64_t* buf;
+        const uint32_t recWords;
+        const uint32_t slots;
+        volatile uint64_t head; // next record to produce
+        volatile uint64_t tail; // next record to consume
+
+    public:
+        StatsRing(uint32_t _recWords, uint32_t _slots);
+
+        // Producer side: reserve() returns nullptr if the ring is full
+        uint64_t* reserve() {
+            return (head - tail < slots)? &buf[(head % slots)*recWords] : nullptr;
+        }
+
+        void commit() {
+            __sync_synchronize();
+            head++;
+        }
+
+        // Consumer side
+        uint32_t occupancy() const { return head - tail; }
+
+        // Returns the number of contiguous records ready to consume, starting at *records
+        uint32_t peek(const uint64_t** records) const {
+            uint64_t h = head;
+            __sync_synchronize();
+            uint32_t idx = tail % slots;
+            *records = &buf[idx*recWords];
+            uint64_t avail = h - tail;
+            return (avail < slots - idx)? avail : slots - idx;
+        }
+
+        void release(uint32_t records) {
+            __sync_synchronize();
+            tail += records;
+        }
+};
+
+/* A backend whose file I/O can run on the writer thread */
+class AsyncStatsSink {
+    public:
+        virtual ~AsyncStatsSink() {}
+        // Writes buffered records to the file: full chunks only, or everything if all is set
+        virtual void drain(bool all) = 0;
+        // Closes the file so other processes (or readers) can open it
+        virtual void close() = 0;
+};
+
+class StatsWriter : public GlobAlloc {
+    private:
+        g_vector<AsyncStatsSink*> sinks;
+        volatile bool running;
+        volatile uint64_t flushReqs;
+        volatile uint64_t flushAcks;
+
+        static void threadTrampoline(void* arg);
+        void threadLoop();
+
+    public:
+        StatsWriter();
+
+        // All sinks must be registered before start()
+        void registerSink(AsyncStatsSink* sink) { sinks.push_back(sink); }
+
+        // Spawns the writer thread; must be called from process 0
+        void start();
+        bool isRunning() const { return running; }
+
+        // Blocks until every sink has written all its records and closed its file
+        void flush();
+};
+
+#endif  // STATS_WRITER_H_
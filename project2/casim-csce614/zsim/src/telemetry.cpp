@@ -0,0 +1,134 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "telemetry.h"
+#include <string.h>
+#include "core.h"
+#include "log.h"
+#include "profile_stats.h"
+#include "stats.h"
+#include "zsim.h"
+
+#define TELEMETRY_RATE_WINDOW_NS (100*1000*1000L)
+
+Telemetry::Telemetry(AggregateStat* filteredStat, uint32_t _updatePhases) : updatePhases(_updatePhases), seq(0) {
+    g_vector<char> namesBuf;
+    if (filteredStat) {
+        // Names are relative to the root, as in the filter regex
+        for (uint32_t i = 0; i < filteredStat->size(); i++) compile(filteredStat->get(i), g_vector<char>(), namesBuf);
+    }
+    namesBytes = namesBuf.size();
+    names = gm_calloc<char>(namesBytes + 1);
+    if (namesBytes) memcpy(names, &namesBuf[0], namesBytes);
+    values = gm_calloc<uint64_t>(entries.size() + 1);
+
+    memset(&snap, 0, sizeof(snap));
+    snap.phaseLength = zinfo->phaseLength;
+    snap.freqMHz = zinfo->freqMHz;
+    snap.lineSize = zinfo->lineSize;
+    windowNs = getNs();
+    windowPhases = 0;
+    windowInstrs = 0;
+    snap.wallNs = windowNs;
+    info("Telemetry: %ld values, updated every %d phases", entries.size(), updatePhases);
+}
+
+void Telemetry::compile(Stat* s, const g_vector<char>& prefix, g_vector<char>& namesBuf) {
+    g_vector<char> name(prefix);
+    if (!name.empty()) name.push_back('.');
+    name.insert(name.end(), s->name(), s->name() + strlen(s->name()));
+
+    auto addEntry = [&](Stat* stat, int32_t idx, const g_vector<char>& n) {
+        entries.push_back({stat, idx});
+        namesBuf.insert(namesBuf.end(), n.begin(), n.end());
+        namesBuf.push_back(0);
+    };
+
+    if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
+        for (uint32_t i = 0; i < as->size(); i++) compile(as->get(i), name, namesBuf);
+    } else if (dynamic_cast<ScalarStat*>(s)) {
+        addEntry(s, -1, name);
+    } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
+        for (uint32_t i = 0; i < vs->size(); i++) {
+            g_vector<char> elemName(name);
+            elemName.push_back('.');
+            if (vs->hasCounterNames()) {
+                const char* cn = vs->counterName(i);
+                elemName.insert(elemName.end(), cn, cn + strlen(cn));
+            } else {
+                char buf[16];
+                snprintf(buf, sizeof(buf), "%d", i);
+                elemName.insert(elemName.end(), buf, buf + strlen(buf));
+            }
+            addEntry(s, i, elemName);
+        }
+    } else {
+        panic("Telemetry: unrecognized stat type for %s", s->name());
+    }
+}
+
+void Telemetry::publish(bool done) {
+    uint64_t now = getNs();
+    uint64_t instrs = 0;
+    for (uint32_t i = 0; i < zinfo->numCores; i++) instrs += zinfo->cores[i]->getInstrs();
+
+    // Called before the phase counters advance
+    uint64_t phases = done? zinfo->numPhases : zinfo->numPhases + 1;
+    uint64_t rateNs = now - windowNs;
+    uint64_t phasesPerSec = snap.phasesPerSec;
+    uint64_t kips = snap.kips;
+    if (rateNs >= TELEMETRY_RATE_WINDOW_NS) {
+        phasesPerSec = (phases - windowPhases)*1e9/rateNs;
+        kips = (instrs - windowInstrs)*1e6/rateNs;
+        windowNs = now;
+        windowPhases = phases;
+        windowInstrs = instrs;
+    }
+
+    seq++;  // odd, write in progress
+    __sync_synchronize();
+    snap.numPhases = phases;
+    snap.cycles = phases*zinfo->phaseLength;
+    snap.instrs = instrs;
+    snap.wallNs = now;
+    snap.phasesPerSec = phasesPerSec;
+    snap.kips = kips;
+    snap.done = done;
+    for (uint32_t i = 0; i < entries.size(); i++) {
+        const Entry& e = entries[i];
+        values[i] = (e.idx < 0)? static_cast<ScalarStat*>(e.stat)->get() : static_cast<VectorStat*>(e.stat)->count(e.idx);
+    }
+    __sync_synchronize();
+    seq++;
+}
+
+void Telemetry::update() {
+    if ((zinfo->numPhases + 1) % updatePhases) return;
+    publish(false);
+}
+
+void Telemetry::finish() {
+    publish(true);
+}
@@ -0,0 +1,134 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+/* Live telemetry (sim.telemetry). At the end of every sim.telemetryPhases
+ * phases, the process that ends the phase snapshots a small set of counters
+ * (the stats that match sim.telemetryFilter, by default per-instance core
+ * cycles and instrs, cache misses and memory reads and writes) into a
+ * seqlock-protected buffer in the global heap. The harness polls it and
+ * republishes it in a plain mmap-able file (sim.telemetryFile, by default
+ * /dev/shm/zsim-telemetry.<harness pid>), so local agents can watch a run
+ * without attaching to the global heap or reading HDF5 files mid-run.
+ *
+ * File layout: a TelemetryFileHeader, then numValues uint64_t values, then
+ * numValues NUL-terminated stat names (namesBytes in total). Values and the
+ * snapshot are only consistent if seq is even and unchanged across the read.
+ * Rates (IPC, MPKI, bandwidth) are left to the reader, which should diff
+ * two snapshots; phasesPerSec and kips are precomputed over ~100ms windows.
+ */
+
+#include <stdint.h>
+#include "g_std/g_vector.h"
+#include "galloc.h"
+
+#define TELEMETRY_MAGIC "ZSIMTLM1"
+#define TELEMETRY_VERSION 1
+
+struct TelemetrySnapshot {
+    uint64_t numPhases;
+    uint64_t cycles;        // global phase cycles
+    uint64_t instrs;        // all cores
+    uint64_t wallNs;        // host CLOCK_REALTIME of this snapshot
+    uint64_t phasesPerSec;
+    uint64_t kips;          // simulated thousands of instructions per host second
+    uint32_t phaseLength;
+    uint32_t freqMHz;
+    uint32_t lineSize;
+    uint32_t done;          // 1 after the simulation has ended
+};
+
+struct TelemetryFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerBytes;   // sizeof(TelemetryFileHeader); values start here
+    uint32_t numValues;
+    uint32_t namesBytes;
+    volatile uint64_t seq;
+    TelemetrySnapshot snap;
+};
+
+class AggregateStat;
+class Stat;
+
+class Telemetry : public GlobAlloc {
+    private:
+        struct Entry {
+            Stat* stat;
+            int32_t idx; // vector element, -1 if scalar
+        };
+
+        g_vector<Entry> entries;
+        char* names;
+        uint32_t namesBytes;
+        const uint32_t updatePhases;
+
+        // Published, protected by seq
+        volatile uint64_t seq;
+        TelemetrySnapshot snap;
+        uint64_t* values;
+
+        // Rate window
+        uint64_t windowNs, windowPhases, windowInstrs;
+
+        void compile(Stat* s, const g_vector<char>& prefix, g_vector<char>& namesBuf);
+
+    public:
+        Telemetry(AggregateStat* filteredStat, uint32_t _updatePhases);
+
+        // Called at the end of each phase, with the phase barrier held
+        void update();
+        // Publishes a final snapshot with done set
+        void finish();
+
+        uint32_t numValues() const { return entries.size(); }
+        const char* getNames() const { return names; }
+        uint32_t getNamesBytes() const { return namesBytes; }
+
+        // Consistent copy of the latest snapshot; safe from any process attached to the global heap.
+        // Returns false if no consistent copy was read in maxTries attempts (e.g., the publisher died mid-update).
+        bool read(TelemetrySnapshot* s, uint64_t* vals, uint32_t maxTries) const {
+            uint32_t n = entries.size();
+            for (uint32_t t = 0; t < maxTries; t++) {
+                uint64_t start = seq;
+                __sync_synchronize();
+                if (!(start & 1)) {
+                    *s = snap;
+                    for (uint32_t i = 0; i < n; i++) vals[i] = values[i];
+                    __sync_synchronize();
+                    if (seq == start) return true;
+                }
+                __asm__ __volatile__("pause");
+            }
+            return false;
+        }
+
+    private:
+        void publish(bool done);
+};
+
+#endif  // TELEMETRY_H_
@@ -25,6 +25,7 @@
 
 #include <fstream>
 #include <iostream>
+#include "g_std/g_vector.h"
 #include "galloc.h"
 #include "log.h"
 #include "stats.h"
@@ -32,33 +33,73 @@
 
 using std::endl;
 
+/* Text dumps only happen at termination, so they are written inline. The
+ * stat tree is still flattened once at construction, so dumps do not need to
+ * walk it with dynamic_casts.
+ */
 class TextBackendImpl : public GlobAlloc {
     private:
         const char* filename;
         AggregateStat* rootStat;
 
-        void dumpStat(Stat* s, uint32_t level, std::ofstream* out) {
-            for (uint32_t i = 0; i < level; i++) *out << " ";
-            *out << s->name() << ": ";
+        enum EntryType {AGGREGATE, SCALAR, VECTOR, HISTOGRAM};
+
+        struct Entry {
+            Stat* stat;
+            EntryType type;
+            uint32_t level;
+        };
+
+        g_vector<Entry> entries; // in-order walk of the tree
+
+        void compile(Stat* s, uint32_t level) {
             if (AggregateStat* as = dynamic_cast<AggregateStat*>(s)) {
-                *out << "# " << as->desc() << endl;
+                entries.push_back({s, AGGREGATE, level});
                 for (uint32_t i = 0; i < as->size(); i++) {
-                    dumpStat(as->get(i), level+1, out);
+                    compile(as->get(i), level+1);
                 }
-            } else if (ScalarStat* ss = dynamic_cast<ScalarStat*>(s)) {
+            } else if (dynamic_cast<ScalarStat*>(s)) {
+                entries.push_back({s, SCALAR, level});
+            } else if (dynamic_cast<LatencyHistogram*>(s)) {
+                entries.push_back({s, HISTOGRAM, level});
+            } else if (dynamic_cast<VectorStat*>(s)) {
+                entries.push_back({s, VECTOR, level});
+            } else {
+                panic("Unrecognized stat type");
+            }
+        }
+
+        void dumpEntry(const Entry& e, std::ofstream* out) {
+            for (uint32_t i = 0; i < e.level; i++) *out << " ";
+            *out << e.stat->name() << ": ";
+            if (e.type == AGGREGATE) {
+                *out << "# " << e.stat->desc() << endl;
+            } else if (e.type == SCALAR) {
+                ScalarStat* ss = static_cast<ScalarStat*>(e.stat);
                 *out << ss->get() << " # " << ss->desc() << endl;
-            } else if (VectorStat* vs = dynamic_cast<VectorStat*>(s)) {
+            } else if (e.type == HISTOGRAM) {
+                // Percentiles first, then only the non-empty buckets (there are a lot of them)
+                LatencyHistogram* hs = static_cast<LatencyHistogram*>(e.stat);
+                *out << "# " << hs->desc() << endl;
+                for (uint32_t j = 0; j < e.level+1; j++) *out << " ";
+                *out << "samples: " << hs->samples() << " p50: " << hs->percentile(0.5) << " p99: " << hs->percentile(0.99)
+                     << " p99.9: " << hs->percentile(0.999) << endl;
+                for (uint32_t i = 0; i < hs->size(); i++) {
+                    if (!hs->count(i)) continue;
+                    for (uint32_t j = 0; j < e.level+1; j++) *out << " ";
+                    *out << hs->counterName(i) << ": " << hs->count(i) << endl;
+                }
+            } else {
+                VectorStat* vs = static_cast<VectorStat*>(e.stat);
                 *out << "# " << vs->desc() << endl;
                 for (uint32_t i = 0; i < vs->size(); i++) {
-                    for (uint32_t j = 0; j < level+1; j++) *out << " ";
+                    for (uint32_t j = 0; j < e.level+1; j++) *out << " ";
                     if (vs->hasCounterNames()) {
                         *out << vs->counterName(i) << ": " << vs->count(i) << endl;
                     } else {
                         *out << i << ": " << vs->count(i) << endl;
                     }
                 }
-            } else {
-                panic("Unrecognized stat type");
             }
         }
 
@@ -66,6 +107,7 @@ class TextBackendImpl : public GlobAlloc {
         TextBackendImpl(const char* _filename, AggregateStat* _rootStat) :
             filename(_filename), rootStat(_rootStat)
         {
+            compile(rootStat, 0);
             std::ofstream out(filename, std::ios_base::out);
             out << "# zsim stats" << endl;
             out << "===" << endl;
@@ -73,7 +115,7 @@ class TextBackendImpl : public GlobAlloc {
 
         void dump(bool buffered) {
             std::ofstream out(filename, std::ios_base::app);
-            dumpStat(rootStat, 0, &out);
+            for (const Entry& e : entries) dumpEntry(e, &out);
             out << "===" << endl;
         }
 };
@@ -0,0 +1,219 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tiered_mem.h"
+#include <algorithm>
+#include "event_recorder.h"
+#include "host_prof.h"
+#include "timing_event.h"
+#include "zsim.h"
+
+class MigrationEvent : public Event {
+    private:
+        TieredMemory* mem;
+    public:
+        MigrationEvent(TieredMemory* _mem, uint64_t _period) : Event(_period), mem(_mem) {}
+        void callback() { mem->migrate(); }
+};
+
+TieredMemory::TieredMemory(MemObject* nearMem, MemObject* farMem, uint64_t _nearFrames, uint32_t pageLines, uint32_t _sampleRate,
+        uint32_t _maxMigrations, uint32_t _promoteThreshold, uint32_t _linesPerAccess, uint32_t epochPhases, const g_string& _name)
+    : tiers{nearMem, farMem}, name(_name), pageLinesBits(ilog2(pageLines)), nearFrames(_nearFrames), sampleRate(_sampleRate),
+      maxMigrations(_maxMigrations), promoteThreshold(_promoteThreshold), linesPerAccess(_linesPerAccess), sampleCounter(0)
+{
+    if (!isPow2(pageLines)) panic("%s: page size must be a power of 2 lines, %d given", name.c_str(), pageLines);
+    if (!nearFrames) panic("%s: near tier holds no pages", name.c_str());
+    if (!sampleRate) panic("%s: sampleRate must be >= 1", name.c_str());
+    if (linesPerAccess > MAX_COPIES_PER_ACCESS) panic("%s: at most %d migration lines per access", name.c_str(), MAX_COPIES_PER_ACCESS);
+    usedFrames[TIER_NEAR] = usedFrames[TIER_FAR] = 0;
+    futex_init(&lock);
+    if (epochPhases) zinfo->eventQueue->insert(new MigrationEvent(this, epochPhases));
+    info("%s: tiered memory, %ld near pages of %d lines, near %s, far %s, migration epoch %d phases", name.c_str(),
+            nearFrames, pageLines, nearMem->getName(), farMem->getName(), epochPhases);
+}
+
+void TieredMemory::initStats(AggregateStat* parentStat) {
+    AggregateStat* memStat = new AggregateStat();
+    memStat->init(name.c_str(), "Tiered memory stats");
+    profReads[TIER_NEAR].init("nearRd", "Demand reads served by the near tier"); memStat->append(&profReads[TIER_NEAR]);
+    profWrites[TIER_NEAR].init("nearWr", "Demand writes served by the near tier"); memStat->append(&profWrites[TIER_NEAR]);
+    profReads[TIER_FAR].init("farRd", "Demand reads served by the far tier"); memStat->append(&profReads[TIER_FAR]);
+    profWrites[TIER_FAR].init("farWr", "Demand writes served by the far tier"); memStat->append(&profWrites[TIER_FAR]);
+    profPages[TIER_NEAR].init("nearPages", "Pages placed in the near tier on first touch"); memStat->append(&profPages[TIER_NEAR]);
+    profPages[TIER_FAR].init("farPages", "Pages placed in the far tier on first touch"); memStat->append(&profPages[TIER_FAR]);
+    profPromotions.init("promotions", "Pages migrated from the far to the near tier"); memStat->append(&profPromotions);
+    profDemotions.init("demotions", "Pages migrated from the near to the far tier"); memStat->append(&profDemotions);
+    profMigratedLines.init("migLines", "Lines copied by migrations (each is a read and a write)"); memStat->append(&profMigratedLines);
+    profEpochs.init("epochs", "Migration epochs"); memStat->append(&profEpochs);
+    tiers[TIER_NEAR]->initStats(memStat);
+    tiers[TIER_FAR]->initStats(memStat);
+    parentStat->append(memStat);
+}
+
+void TieredMemory::migrate() {
+    futex_lock(&lock);
+    profEpochs.inc();
+
+    // Hottest far pages above the threshold, coldest near pages
+    g_vector<Page*> hot, cold;
+    for (auto& it : pages) {
+        Page* p = &it.second;
+        if (p->tier == TIER_FAR) {
+            if (p->count >= promoteThreshold) hot.push_back(p);
+        } else {
+            cold.push_back(p);
+        }
+    }
+    uint32_t n = std::min((size_t)maxMigrations, std::min(hot.size(), cold.size()));
+    std::partial_sort(hot.begin(), hot.begin() + n, hot.end(), [](const Page* a, const Page* b) { return a->count > b->count; });
+    std::partial_sort(cold.begin(), cold.begin() + n, cold.end(), [](const Page* a, const Page* b) { return a->count < b->count; });
+
+    // First-touch placement fills the near tier before any page goes far, so a promotion always swaps with a demotion
+    for (uint32_t i = 0; i < n; i++) {
+        Page* h = hot[i];
+        Page* c = cold[i];
+        if (h->count <= c->count) break;
+        migrations.push_back({h->frame, c->frame, 0, TIER_FAR});
+        migrations.push_back({c->frame, h->frame, 0, TIER_NEAR});
+        std::swap(h->frame, c->frame);
+        h->tier = TIER_NEAR;
+        c->tier = TIER_FAR;
+        profPromotions.inc();
+        profDemotions.inc();
+    }
+
+    for (auto& it : pages) it.second.count >>= 1;
+    futex_unlock(&lock);
+}
+
+uint64_t TieredMemory::tierAccess(uint32_t tier, Address tierLineAddr, AccessType type, uint64_t cycle, uint32_t srcId) {
+    MESIState state = I;
+    MemReq req = {tierLineAddr, type, 0, &state, cycle, nullptr, state, srcId, 0, nullptr};
+    return tiers[tier]->access(req);
+}
+
+uint64_t TieredMemory::access(MemReq& req) {
+    HostProfScope hps(HP_MEM);
+    if (req.type == PUTS) return tiers[TIER_NEAR]->access(req);  // clean writebacks never reach memory; let the tier set the state
+
+    const uint64_t offsetMask = (1ul << pageLinesBits) - 1;
+    uint64_t pageAddr = req.lineAddr >> pageLinesBits;
+    uint32_t numCopies = 0;
+    Migration copies[MAX_COPIES_PER_ACCESS];  // nextLine is the line copied by this access
+
+    futex_lock(&lock);
+    auto it = pages.find(pageAddr);
+    if (it == pages.end()) {
+        Page p;
+        p.tier = (usedFrames[TIER_NEAR] < nearFrames)? TIER_NEAR : TIER_FAR;
+        p.frame = usedFrames[p.tier]++;
+        p.count = 0;
+        it = pages.insert(std::make_pair(pageAddr, p)).first;
+        profPages[p.tier].inc();
+    }
+    Page& page = it->second;
+    if (++sampleCounter == sampleRate) {
+        sampleCounter = 0;
+        if (page.count < (uint32_t)-1) page.count++;
+    }
+    uint32_t tier = page.tier;
+    Address tierLineAddr = (page.frame << pageLinesBits) | (req.lineAddr & offsetMask);
+
+    while (numCopies < linesPerAccess && !migrations.empty()) {
+        Migration& m = migrations.front();
+        copies[numCopies++] = {m.srcFrame, m.dstFrame, m.nextLine, m.srcTier};
+        if (++m.nextLine == (1u << pageLinesBits)) migrations.pop_front();
+    }
+    if (req.type == PUTX) profWrites[tier].inc();
+    else profReads[tier].inc();
+    profMigratedLines.inc(numCopies);
+    futex_unlock(&lock);
+
+    // Demand access, to the page's frame in its current tier
+    Address lineAddr = req.lineAddr;
+    req.lineAddr = tierLineAddr;
+    uint64_t respCycle = tiers[tier]->access(req);
+    req.lineAddr = lineAddr;
+
+    EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
+    TimingRecord demandRec;
+    demandRec.clear();
+    if (evRec && evRec->hasRecord()) demandRec = evRec->popRecord();
+
+    /* Migration copies are off the critical path: each reads the line from
+     * its source tier when the demand access is issued, then writes it to its
+     * destination tier.
+     */
+    TimingRecord copyRecs[2*MAX_COPIES_PER_ACCESS];
+    for (uint32_t i = 0; i < numCopies; i++) {
+        Migration& c = copies[i];
+        uint64_t offset = c.nextLine;
+        uint64_t rdResp = tierAccess(c.srcTier, (c.srcFrame << pageLinesBits) | offset, GETS, req.cycle, req.srcId);
+        copyRecs[2*i].clear();
+        if (evRec && evRec->hasRecord()) copyRecs[2*i] = evRec->popRecord();
+        tierAccess(1 - c.srcTier, (c.dstFrame << pageLinesBits) | offset, PUTX, rdResp, req.srcId);
+        copyRecs[2*i+1].clear();
+        if (evRec && evRec->hasRecord()) copyRecs[2*i+1] = evRec->popRecord();
+    }
+
+    bool anyCopyRecord = false;
+    for (uint32_t i = 0; i < 2*numCopies; i++) anyCopyRecord |= copyRecs[i].isValid();
+    if (evRec && anyCopyRecord) {
+        // Hang the demand access and every copy off a common root
+        DelayEvent* root = new (evRec) DelayEvent(0);
+        root->setMinStartCycle(req.cycle);
+        auto link = [&](TimingEvent* parentEv, uint64_t parentCycle, const TimingRecord& r) {
+            assert(r.reqCycle >= parentCycle);
+            DelayEvent* d = new (evRec) DelayEvent(r.reqCycle - parentCycle);
+            d->setMinStartCycle(parentCycle);
+            parentEv->addChild(d, evRec)->addChild(r.startEvent, evRec);
+        };
+        TimingEvent* endEv = root;
+        uint64_t endCycle = req.cycle;
+        if (demandRec.isValid()) {
+            link(root, req.cycle, demandRec);
+            endEv = demandRec.endEvent;
+            endCycle = demandRec.respCycle;
+        }
+        for (uint32_t i = 0; i < numCopies; i++) {
+            TimingRecord& rd = copyRecs[2*i];
+            TimingRecord& wr = copyRecs[2*i+1];
+            TimingEvent* wrParent = root;
+            uint64_t wrParentCycle = req.cycle;
+            if (rd.isValid()) {
+                link(root, req.cycle, rd);
+                wrParent = rd.endEvent;
+                wrParentCycle = rd.respCycle;
+            }
+            if (wr.isValid()) link(wrParent, wrParentCycle, wr);
+        }
+        TimingRecord tr = {req.lineAddr, req.cycle, endCycle, req.type, root, endEv};
+        evRec->pushRecord(tr);
+    } else if (demandRec.isValid()) {
+        evRec->pushRecord(demandRec);
+    }
+
+    return respCycle;
+}
@@ -0,0 +1,108 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TIERED_MEM_H_
+#define TIERED_MEM_H_
+
+/* Two-tier main memory (e.g., local DDR + CXL-attached far memory) with
+ * hot-page promotion. Pages are placed on first touch, in the near tier while
+ * it has free frames and in the far tier afterwards. Every sampleRate-th
+ * access from the LLC miss stream bumps its page's counter. At the end of
+ * each epoch (an EventQueue event), the hottest far pages swap frames with
+ * the coldest near pages, and all counters are halved.
+ *
+ * Migrations remap pages immediately. The copies (reading each line from its
+ * source tier and writing it to the destination tier) are drained a few lines
+ * per demand access, off the demand's critical path, so both tiers see the
+ * migration traffic.
+ */
+
+#include <deque>
+#include "bithacks.h"
+#include "event_queue.h"
+#include "g_std/g_string.h"
+#include "g_std/g_unordered_map.h"
+#include "locks.h"
+#include "memory_hierarchy.h"
+#include "pad.h"
+#include "stats.h"
+
+class TieredMemory : public MemObject {
+    private:
+        enum Tier {TIER_NEAR = 0, TIER_FAR = 1};
+
+        struct Page {
+            uint64_t frame;   // within its tier
+            uint32_t count;   // sampled accesses, halved every epoch
+            uint8_t tier;
+        };
+
+        // A page copy in progress
+        struct Migration {
+            uint64_t srcFrame, dstFrame;
+            uint32_t nextLine;
+            uint8_t srcTier;
+        };
+
+        static const uint32_t MAX_COPIES_PER_ACCESS = 16;
+
+        MemObject* const tiers[2];
+        const g_string name;
+        const uint32_t pageLinesBits;
+        const uint64_t nearFrames;
+        const uint32_t sampleRate;
+        const uint32_t maxMigrations;     // page swaps per epoch
+        const uint32_t promoteThreshold;  // min sampled accesses for a far page to be promoted
+        const uint32_t linesPerAccess;    // migration copies drained per demand access
+
+        g_unordered_map<uint64_t, Page> pages;
+        uint64_t usedFrames[2];
+        uint64_t sampleCounter;
+        std::deque<Migration, StlGlobAlloc<Migration>> migrations;
+
+        PAD();
+        lock_t lock;
+        PAD();
+
+        Counter profReads[2], profWrites[2];
+        Counter profPages[2];
+        Counter profPromotions, profDemotions, profMigratedLines, profEpochs;
+
+    public:
+        TieredMemory(MemObject* nearMem, MemObject* farMem, uint64_t _nearFrames, uint32_t pageLines, uint32_t _sampleRate,
+                uint32_t _maxMigrations, uint32_t _promoteThreshold, uint32_t _linesPerAccess, uint32_t epochPhases, const g_string& _name);
+
+        uint64_t access(MemReq& req);
+        const char* getName() {return name.c_str();}
+        void initStats(AggregateStat* parentStat);
+
+        // Called at epoch boundaries
+        void migrate();
+
+    private:
+        uint64_t tierAccess(uint32_t tier, Address tierLineAddr, AccessType type, uint64_t cycle, uint32_t srcId);
+};
+
+#endif  // TIERED_MEM_H_
@@ -24,7 +24,9 @@
  */
 
 #include "timing_cache.h"
+#include "domain_profiler.h"
 #include "event_recorder.h"
+#include "req_trace.h"
 #include "timing_event.h"
 #include "zsim.h"
 
@@ -34,7 +36,10 @@ class HitEvent : public TimingEvent {
         TimingCache* cache;
 
     public:
-        HitEvent(TimingCache* _cache,  uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache) {}
+        TraceTag trace;
+        uint64_t arrivalCycle; // first cycle the event was simulated, for latency histograms
+        bool profLat;
+        HitEvent(TimingCache* _cache,  uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache), arrivalCycle(-1L), profLat(false) {}
 
         void simulate(uint64_t startCycle) {
             cache->simulateHit(this, startCycle);
@@ -47,7 +52,10 @@ class MissStartEvent : public TimingEvent {
         TimingCache* cache;
     public:
         uint64_t startCycle; //for profiling purposes
-        MissStartEvent(TimingCache* _cache,  uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache) {}
+        TraceTag trace;
+        uint64_t arrivalCycle; // first cycle the event was simulated, for latency histograms
+        bool profLat;
+        MissStartEvent(TimingCache* _cache,  uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache), arrivalCycle(-1L), profLat(false) {}
         void simulate(uint64_t startCycle) {cache->simulateMissStart(this, startCycle);}
 };
 
@@ -87,6 +95,7 @@ TimingCache::TimingCache(uint32_t _numLines, CC* _cc, CacheArray* _array, ReplPo
     assert(numMSHRs > 0);
     activeMisses = 0;
     domain = _domain;
+    weaveNode = zinfo->domainProfiler? zinfo->domainProfiler->registerNode(name, DomainProfiler::NODE_CACHE, domain) : 0;
     info("%s: mshrs %d domain %d", name.c_str(), numMSHRs, domain);
 }
 
@@ -112,6 +121,7 @@ void TimingCache::initStats(AggregateStat* parentStat) {
 
 // TODO(dsm): This is copied verbatim from Cache. We should split Cache into different methods, then call those.
 uint64_t TimingCache::access(MemReq& req) {
+    HostProfScope hps(profComp);
     EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
     assert_msg(evRec, "TimingCache is not connected to TimingCore");
 
@@ -122,10 +132,19 @@ uint64_t TimingCache::access(MemReq& req) {
 
     uint64_t respCycle = req.cycle;
     bool skipAccess = cc->startAccess(req); //may need to skip access due to races (NOTE: may change req.type!)
+    uint32_t srcNode = evRec->getWeaveNode();
+    if (unlikely(zinfo->domainProfiler != nullptr)) {
+        zinfo->domainProfiler->recordEdge(srcNode, weaveNode);
+        evRec->setWeaveNode(weaveNode);
+    }
     if (likely(!skipAccess)) {
         bool updateReplacement = (req.type == GETS) || (req.type == GETX);
         int32_t lineId = array->lookup(req.lineAddr, &req, updateReplacement);
-        respCycle += accLat;
+        bool hit = (lineId != -1);
+        if (!hit && unlikely(missProfLevel >= 0)) profileMiss(req);
+        uint32_t hitLat = accLat;
+        if (lineId != -1 && (req.type == GETS || req.type == GETX)) hitLat += array->getDecompressionLatency(lineId);
+        respCycle += hitLat;
 
         if (lineId == -1 /*&& cc->shouldAllocate(req)*/) {
             assert(cc->shouldAllocate(req)); //dsm: for now, we don't deal with non-inclusion in TimingCache
@@ -134,12 +153,14 @@ uint64_t TimingCache::access(MemReq& req) {
             Address wbLineAddr;
             lineId = array->preinsert(req.lineAddr, &req, &wbLineAddr); //find the lineId to replace
             trace(Cache, "[%s] Evicting 0x%lx", name.c_str(), wbLineAddr);
+            if (unlikely(req.victimLineAddr != nullptr) && cc->isValid(lineId)) *req.victimLineAddr = wbLineAddr;
 
             //Evictions are not in the critical path in any sane implementation -- we do not include their delays
             //NOTE: We might be "evicting" an invalid line for all we know. Coherence controllers will know what to do
             evDoneCycle = cc->processEviction(req, wbLineAddr, lineId, respCycle); //if needed, send invalidates/downgrades to lower level, and wb to upper level
 
             array->postinsert(req.lineAddr, &req, lineId); //do the actual insertion. NOTE: Now we must split insert into a 2-phase thing because cc unlocks us.
+            evDoneCycle = MAX(evDoneCycle, evictToFit(req, lineId, respCycle));
 
             if (evRec->hasRecord()) writebackRecord = evRec->popRecord();
         }
@@ -152,13 +173,15 @@ uint64_t TimingCache::access(MemReq& req) {
         // At this point we have all the info we need to hammer out the timing record
         TimingRecord tr = {req.lineAddr << lineBits, req.cycle, respCycle, req.type, nullptr, nullptr}; //note the end event is the response, not the wback
 
-        if (getDoneCycle - req.cycle == accLat) {
+        if (getDoneCycle - req.cycle == hitLat) {
             // Hit
             assert(!writebackRecord.isValid());
             assert(!accessRecord.isValid());
             uint64_t hitLat = respCycle - req.cycle; // accLat + invLat
             HitEvent* ev = new (evRec) HitEvent(this, hitLat, domain);
             ev->setMinStartCycle(req.cycle);
+            if (unlikely(req.is(MemReq::TRACED))) ev->trace.set(zinfo->reqTracer->curId(req.srcId), req.type);
+            ev->profLat = profilesLatency(req);
             tr.startEvent = tr.endEvent = ev;
         } else {
             assert_msg(getDoneCycle == respCycle, "gdc %ld rc %ld", getDoneCycle, respCycle);
@@ -169,6 +192,8 @@ uint64_t TimingCache::access(MemReq& req) {
             MissStartEvent* mse = new (evRec) MissStartEvent(this, accLat, domain);
             MissResponseEvent* mre = new (evRec) MissResponseEvent(this, mse, domain);
             MissWritebackEvent* mwe = new (evRec) MissWritebackEvent(this, mse, accLat, domain);
+            if (unlikely(req.is(MemReq::TRACED))) mse->trace.set(zinfo->reqTracer->curId(req.srcId), req.type);
+            mse->profLat = profilesLatency(req);
 
             mse->setMinStartCycle(req.cycle);
             mre->setMinStartCycle(getDoneCycle);
@@ -257,9 +282,12 @@ uint64_t TimingCache::access(MemReq& req) {
             tr.endEvent = mre; // note the end event is the response, not the wback
         }
         evRec->pushRecord(tr);
+        // Latency histograms are recorded in the weave phase, which adds MSHR and port contention
+        if (unlikely(req.is(MemReq::TRACED))) traceAccess(req, hit, respCycle);
     }
 
     cc->endAccess(req);
+    if (unlikely(zinfo->domainProfiler != nullptr)) evRec->setWeaveNode(srcNode);
 
     assert_msg(respCycle >= req.cycle, "[%s] resp < req? 0x%lx type %s childState %s, respCycle %ld reqCycle %ld",
             name.c_str(), req.lineAddr, AccessTypeName(req.type), MESIStateName(*req.state), respCycle, req.cycle);
@@ -296,9 +324,17 @@ uint64_t TimingCache::tryLowPrioAccess(uint64_t cycle) {
 }
 
 void TimingCache::simulateHit(HitEvent* ev, uint64_t cycle) {
+    if (unlikely(ev->trace.id)) ev->trace.arrive(cycle);
+    if (ev->arrivalCycle == (uint64_t)-1L) ev->arrivalCycle = cycle;
     if (activeMisses < numMSHRs) {
         uint64_t lookupCycle = highPrioAccess(cycle);
         profHitLat.inc(lookupCycle-cycle);
+        if (ev->profLat) recordLatency(true, lookupCycle + ev->getPostDelay() - ev->arrivalCycle);
+        if (unlikely(ev->trace.id)) {
+            TraceTag& t = ev->trace;
+            if (cycle > t.arrivalCycle) zinfo->reqTracer->record(t.id, traceComp, t.type, t.arrivalCycle, cycle, TR_MSHR_WAIT);
+            zinfo->reqTracer->record(t.id, traceComp, t.type, cycle, lookupCycle + ev->getPostDelay(), TR_WEAVE_HIT);
+        }
         ev->done(lookupCycle);  // postDelay includes accLat + invalLat
     } else {
         // queue
@@ -308,9 +344,14 @@ void TimingCache::simulateHit(HitEvent* ev, uint64_t cycle) {
 }
 
 void TimingCache::simulateMissStart(MissStartEvent* ev, uint64_t cycle) {
+    if (unlikely(ev->trace.id)) ev->trace.arrive(cycle);
+    if (ev->arrivalCycle == (uint64_t)-1L) ev->arrivalCycle = cycle;
     if (activeMisses < numMSHRs) {
         activeMisses++;
         profOccHist.transition(activeMisses, cycle);
+        if (unlikely(ev->trace.id) && cycle > ev->trace.arrivalCycle) {
+            zinfo->reqTracer->record(ev->trace.id, traceComp, ev->trace.type, ev->trace.arrivalCycle, cycle, TR_MSHR_WAIT);
+        }
 
         ev->startCycle = cycle;
         uint64_t lookupCycle = highPrioAccess(cycle);
@@ -324,6 +365,8 @@ void TimingCache::simulateMissStart(MissStartEvent* ev, uint64_t cycle) {
 
 void TimingCache::simulateMissResponse(MissResponseEvent* ev, uint64_t cycle, MissStartEvent* mse) {
     profMissRespLat.inc(cycle - mse->startCycle);
+    if (mse->profLat) recordLatency(false, cycle - mse->arrivalCycle);
+    if (unlikely(mse->trace.id)) zinfo->reqTracer->record(mse->trace.id, traceComp, mse->trace.type, mse->startCycle, cycle, TR_WEAVE_MISS);
     ev->done(cycle);
 }
 
@@ -47,6 +47,7 @@ class TimingCache : public Cache {
         Counter profHitLat, profMissRespLat, profMissLat;
 
         uint32_t domain;
+        uint32_t weaveNode; //only valid if zinfo->domainProfiler
 
         // For zcache replacement simulation (pessimistic, assumes we walk the whole tree)
         uint32_t tagLat, ways, cands;
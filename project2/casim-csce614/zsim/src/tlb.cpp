@@ -0,0 +1,203 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tlb.h"
+#include "filter_cache.h"
+#include "page_alloc.h"
+#include "process_tree.h"
+#include "timing_event.h"
+#include "zsim.h"
+
+/* TLB arrays */
+
+void TLBArray::init(uint32_t entries, uint32_t _ways) {
+    if (!_ways || !entries || entries % _ways) panic("TLB entries (%d) must be a non-zero multiple of ways (%d)", entries, _ways);
+    ways = _ways;
+    numSets = entries/ways;
+    tags.resize(entries, 0);
+    lastUse.resize(entries, 0);
+    curUse = 0;
+}
+
+bool TLBArray::lookup(uint64_t key) {
+    uint32_t first = (key % numSets)*ways;
+    for (uint32_t i = first; i < first + ways; i++) {
+        if (tags[i] == key + 1) {
+            lastUse[i] = ++curUse;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TLBArray::insert(uint64_t key) {
+    uint32_t first = (key % numSets)*ways;
+    uint32_t victim = first;
+    for (uint32_t i = first; i < first + ways; i++) {
+        if (tags[i] == key + 1) return;  // another core filled it (shared TLB)
+        if (lastUse[i] < lastUse[victim]) victim = i;
+    }
+    tags[victim] = key + 1;
+    lastUse[victim] = ++curUse;
+}
+
+SharedTLB::SharedTLB(uint32_t entries, uint32_t ways) {
+    array.init(entries, ways);
+    futex_init(&lock);
+}
+
+bool SharedTLB::lookup(uint64_t key) {
+    futex_lock(&lock);
+    bool hit = array.lookup(key);
+    futex_unlock(&lock);
+    return hit;
+}
+
+void SharedTLB::insert(uint64_t key) {
+    futex_lock(&lock);
+    array.insert(key);
+    futex_unlock(&lock);
+}
+
+/* MMU */
+
+#define PT_LEVELS 4
+#define PT_LEVEL_BITS 9
+#define PT_BASE (1ul << 47)  // page tables live above the 47-bit user address space
+#define PT_LEVEL_SPAN (1ul << 44)  // each level's tables, in node order
+
+MMU::MMU(uint32_t itlbEntries, uint32_t itlbWays, uint32_t dtlbEntries, uint32_t dtlbWays, SharedTLB* _l2tlb, uint32_t _l2Latency,
+        uint32_t pwcEntries, uint32_t _pwcLatency, const g_string& _name)
+    : l2tlb(_l2tlb), walkCache(nullptr), l2Latency(_l2Latency), pwcLatency(_pwcLatency), name(_name)
+{
+    itlb.init(itlbEntries, itlbWays);
+    dtlb.init(dtlbEntries, dtlbWays);
+    pwc.init(pwcEntries, pwcEntries);  // fully associative
+}
+
+void MMU::initStats(AggregateStat* parentStat) {
+    AggregateStat* mmuStat = new AggregateStat();
+    mmuStat->init(name.c_str(), "MMU stats");
+    profIAccs.init("iAccs", "Instruction translations (filter cache misses)"); mmuStat->append(&profIAccs);
+    profIMisses.init("iMisses", "L1 ITLB misses"); mmuStat->append(&profIMisses);
+    profDAccs.init("dAccs", "Data translations (filter cache misses)"); mmuStat->append(&profDAccs);
+    profDMisses.init("dMisses", "L1 DTLB misses"); mmuStat->append(&profDMisses);
+    profL2Hits.init("l2Hits", "L2 TLB hits"); mmuStat->append(&profL2Hits);
+    profL2Misses.init("l2Misses", "L2 TLB misses (page walks)"); mmuStat->append(&profL2Misses);
+    profPWCHits.init("pwcHits", "Walks that skipped levels on page-walk cache hits"); mmuStat->append(&profPWCHits);
+    profWalkRefs.init("walkRefs", "Page-table memory references"); mmuStat->append(&profWalkRefs);
+    profWalkCycles.init("walkCycles", "Cycles spent in page walks"); mmuStat->append(&profWalkCycles);
+    parentStat->append(mmuStat);
+}
+
+uint64_t MMU::translate(Address vLineAddr, bool isInstr, uint64_t cycle, TimingRecord* walkRec) {
+    bool huge = zinfo->procArray[procIdx]->useHugePages();
+    uint64_t vpn4K = (vLineAddr << lineBits) >> 12;
+    uint64_t vpn = huge? (vpn4K >> PT_LEVEL_BITS) : vpn4K;
+    uint64_t key = ((uint64_t)procIdx << 48) | ((uint64_t)huge << 47) | vpn;
+
+    TLBArray& l1 = isInstr? itlb : dtlb;
+    (isInstr? profIAccs : profDAccs).inc();
+    if (l1.lookup(key)) return cycle;
+    (isInstr? profIMisses : profDMisses).inc();
+
+    cycle += l2Latency;
+    if (l2tlb->lookup(key)) {
+        profL2Hits.inc();
+    } else {
+        profL2Misses.inc();
+        cycle = walk(vpn4K, huge, cycle, walkRec);
+        l2tlb->insert(key);
+    }
+    l1.insert(key);
+    return cycle;
+}
+
+uint64_t MMU::walk(uint64_t vpn4K, bool huge, uint64_t cycle, TimingRecord* walkRec) {
+    assert(walkCache);
+    uint64_t startCycle = cycle;
+    uint32_t leafLevel = huge? 2 : 1;
+    auto entryKey = [vpn4K](uint32_t level) {
+        return ((uint64_t)procIdx << 48) | ((uint64_t)level << 40) | (vpn4K >> (PT_LEVEL_BITS*(level-1)));
+    };
+
+    // Start below the lowest upper-level entry the PWC holds
+    cycle += pwcLatency;
+    uint32_t level = PT_LEVELS;
+    for (uint32_t l = leafLevel + 1; l <= PT_LEVELS; l++) {
+        if (pwc.lookup(entryKey(l))) {
+            level = l - 1;
+            profPWCHits.inc();
+            break;
+        }
+    }
+
+    EventRecorder* evRec = zinfo->eventRecorders[walkCache->getSourceId()];
+    for (; level >= leafLevel; level--) {
+        uint64_t node = vpn4K >> (PT_LEVEL_BITS*level);  // identifies the table at this level
+        uint64_t idx = (vpn4K >> (PT_LEVEL_BITS*(level-1))) & ((1 << PT_LEVEL_BITS) - 1);
+        Address pteLineAddr = (PT_BASE + (level-1)*PT_LEVEL_SPAN + (node << 12) + idx*8) >> lineBits;
+        Address pLineAddr = zinfo->physMem? zinfo->physMem->translate(procIdx, pteLineAddr) : (procMask | pteLineAddr);
+        cycle = walkCache->walkLoad(pLineAddr, cycle);
+        profWalkRefs.inc();
+        if (level > leafLevel) pwc.insert(entryKey(level));
+
+        if (evRec && evRec->hasRecord()) {
+            TimingRecord r = evRec->popRecord();
+            assert(IsGet(r.type) && r.endEvent);
+            if (!walkRec->isValid()) {
+                *walkRec = r;
+            } else {
+                assert(r.reqCycle >= walkRec->respCycle);
+                DelayEvent* d = new (evRec) DelayEvent(r.reqCycle - walkRec->respCycle);
+                d->setMinStartCycle(walkRec->respCycle);
+                walkRec->endEvent->addChild(d, evRec)->addChild(r.startEvent, evRec);
+                walkRec->respCycle = r.respCycle;
+                walkRec->endEvent = r.endEvent;
+            }
+        }
+    }
+    profWalkCycles.inc(cycle - startCycle);
+    return cycle;
+}
+
+void MMU::finishWalk(TimingRecord* walkRec, uint32_t srcId) {
+    EventRecorder* evRec = zinfo->eventRecorders[srcId];
+    assert(evRec && walkRec->isValid());
+    if (evRec->hasRecord()) {
+        TimingRecord r = evRec->popRecord();
+        assert(r.reqCycle >= walkRec->respCycle);
+        DelayEvent* d = new (evRec) DelayEvent(r.reqCycle - walkRec->respCycle);
+        d->setMinStartCycle(walkRec->respCycle);
+        walkRec->endEvent->addChild(d, evRec)->addChild(r.startEvent, evRec);
+        if (IsGet(r.type)) {  // PUT records (writebacks only) have no end event to wait for
+            walkRec->addr = r.addr;
+            walkRec->type = r.type;
+            walkRec->respCycle = r.respCycle;
+            walkRec->endEvent = r.endEvent;
+        }
+    }
+    evRec->pushRecord(*walkRec);
+}
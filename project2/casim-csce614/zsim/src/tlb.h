@@ -0,0 +1,113 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TLB_H_
+#define TLB_H_
+
+/* Address translation: per-core L1 instruction and data TLBs, a shared L2
+ * TLB, and per-core page walkers with a page-walk cache (PWC).
+ *
+ * Translations are checked on filter cache misses, so L1 TLB lookups overlap
+ * with the L1 cache access and cost nothing on hits. L2 TLB misses walk an
+ * x86-64-style 4-level radix page table (3 levels with 2MB pages). The PWC
+ * holds upper-level entries, so walks start at the lowest level it covers.
+ * Each remaining level reads its page-table entry through the core's L1 data
+ * cache. Page tables live in a reserved region of each process's address
+ * space, above the 47-bit user range (and are mapped like any other page if
+ * there is a physical page allocator).
+ */
+
+#include "event_recorder.h"
+#include "g_std/g_string.h"
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "locks.h"
+#include "pad.h"
+#include "stats.h"
+
+class FilterCache;
+
+// Set-associative array of translation tags with LRU replacement
+class TLBArray {
+    private:
+        g_vector<uint64_t> tags;  // key + 1, 0 if invalid
+        g_vector<uint64_t> lastUse;
+        uint32_t ways, numSets;
+        uint64_t curUse;
+
+    public:
+        void init(uint32_t entries, uint32_t _ways);
+        bool lookup(uint64_t key);
+        void insert(uint64_t key);
+};
+
+class SharedTLB : public GlobAlloc {
+    private:
+        TLBArray array;
+        PAD();
+        lock_t lock;
+        PAD();
+
+    public:
+        SharedTLB(uint32_t entries, uint32_t ways);
+        bool lookup(uint64_t key);
+        void insert(uint64_t key);
+};
+
+class MMU : public GlobAlloc {
+    private:
+        TLBArray itlb, dtlb;
+        TLBArray pwc;
+        SharedTLB* l2tlb;
+        FilterCache* walkCache;  // the core's L1D
+        const uint32_t l2Latency, pwcLatency;
+        g_string name;
+
+        Counter profIAccs, profIMisses, profDAccs, profDMisses;
+        Counter profL2Hits, profL2Misses;
+        Counter profPWCHits, profWalkRefs, profWalkCycles;
+
+    public:
+        MMU(uint32_t itlbEntries, uint32_t itlbWays, uint32_t dtlbEntries, uint32_t dtlbWays, SharedTLB* _l2tlb, uint32_t _l2Latency,
+                uint32_t pwcEntries, uint32_t _pwcLatency, const g_string& _name);
+
+        void setWalkCache(FilterCache* _walkCache) {walkCache = _walkCache;}
+        void initStats(AggregateStat* parentStat);
+
+        /* Translates vLineAddr, a line address of the current process. Returns
+         * the cycle the translation is available. If walk accesses produced
+         * timing records, they are chained into walkRec, which the caller must
+         * then pass to finishWalk() after the access it translated.
+         */
+        uint64_t translate(Address vLineAddr, bool isInstr, uint64_t cycle, TimingRecord* walkRec);
+
+        // Chains walkRec before the translated access's timing record, if any, keeping a single record per core access
+        void finishWalk(TimingRecord* walkRec, uint32_t srcId);
+
+    private:
+        uint64_t walk(uint64_t vpn4K, bool huge, uint64_t cycle, TimingRecord* walkRec);
+};
+
+#endif  // TLB_H_
@@ -26,6 +26,8 @@
 #ifndef WEAVE_MD1_MEM_H_
 #define WEAVE_MD1_MEM_H_
 
+#include "domain_profiler.h"
+#include "host_prof.h"
 #include "mem_ctrls.h"
 #include "timing_event.h"
 #include "zsim.h"
@@ -54,6 +56,7 @@ class WeaveMD1Memory : public MD1Memory {
         const uint32_t boundLatency;
         const uint32_t domain;
         uint32_t preDelay, postDelay;
+        uint32_t weaveNode; //only valid if zinfo->domainProfiler
 
     public:
         WeaveMD1Memory(uint32_t lineSize, uint32_t megacyclesPerSecond, uint32_t megabytesPerSecond, uint32_t _zeroLoadLatency, uint32_t _boundLatency, uint32_t _domain, g_string& _name) :
@@ -61,9 +64,11 @@ class WeaveMD1Memory : public MD1Memory {
         {
             preDelay = zeroLoadLatency/2;
             postDelay = zeroLoadLatency - preDelay;
+            weaveNode = zinfo->domainProfiler? zinfo->domainProfiler->registerNode(_name, DomainProfiler::NODE_MEM, domain) : 0;
         }
 
         uint64_t access(MemReq& req) {
+            HostProfScope hps(HP_MEM);
             uint64_t realRespCycle = MD1Memory::access(req);
             uint32_t realLatency = realRespCycle - req.cycle;
 
@@ -72,6 +77,9 @@ class WeaveMD1Memory : public MD1Memory {
             assert(req.type == PUTS || realLatency >= zeroLoadLatency);
 
             if ((req.type != PUTS) && zinfo->eventRecorders[req.srcId]) {
+                if (unlikely(zinfo->domainProfiler != nullptr)) {
+                    zinfo->domainProfiler->recordEdge(zinfo->eventRecorders[req.srcId]->getWeaveNode(), weaveNode);
+                }
                 WeaveMemAccEvent* memEv = new (zinfo->eventRecorders[req.srcId]) WeaveMemAccEvent(realLatency-zeroLoadLatency, domain, preDelay, postDelay);
                 memEv->setMinStartCycle(req.cycle);
                 TimingRecord tr = {req.lineAddr, req.cycle, respCycle, req.type, memEv, memEv};
@@ -89,6 +97,7 @@ class WeaveSimpleMemory : public SimpleMemory {
         uint32_t zeroLoadLatency;
         uint32_t domain;
         uint32_t preDelay, postDelay;
+        uint32_t weaveNode; //only valid if zinfo->domainProfiler
 
     public:
         WeaveSimpleMemory(uint32_t _latency, uint32_t _zeroLoadLatency, uint32_t _domain, g_string& _name) :
@@ -97,9 +106,11 @@ class WeaveSimpleMemory : public SimpleMemory {
             assert(_latency >= _zeroLoadLatency);
             preDelay = zeroLoadLatency/2;
             postDelay = zeroLoadLatency - preDelay;
+            weaveNode = zinfo->domainProfiler? zinfo->domainProfiler->registerNode(_name, DomainProfiler::NODE_MEM, domain) : 0;
         }
 
         uint64_t access(MemReq& req) {
+            HostProfScope hps(HP_MEM);
             uint64_t realRespCycle = SimpleMemory::access(req);
             uint32_t realLatency = realRespCycle - req.cycle;
 
@@ -108,6 +119,9 @@ class WeaveSimpleMemory : public SimpleMemory {
             assert(req.type == PUTS || realLatency >= zeroLoadLatency);
 
             if ((req.type != PUTS) && zinfo->eventRecorders[req.srcId]) {
+                if (unlikely(zinfo->domainProfiler != nullptr)) {
+                    zinfo->domainProfiler->recordEdge(zinfo->eventRecorders[req.srcId]->getWeaveNode(), weaveNode);
+                }
                 WeaveMemAccEvent* memEv = new (zinfo->eventRecorders[req.srcId]) WeaveMemAccEvent(realLatency-zeroLoadLatency, domain, preDelay, postDelay);
                 memEv->setMinStartCycle(req.cycle);
                 TimingRecord tr = {req.lineAddr, req.cycle, respCycle, req.type, memEv, memEv};
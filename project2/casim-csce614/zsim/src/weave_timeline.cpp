@@ -0,0 +1,133 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "weave_timeline.h"
+#include <cxxabi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <typeinfo>
+#include <vector>
+#include "log.h"
+#include "timing_event.h"
+
+WeaveTimeline::WeaveTimeline(const char* _filename, uint32_t _numDomains, uint64_t _startCycle, uint64_t _endCycle, uint32_t _maxRecords)
+    : filename(_filename), startCycle(_startCycle), endCycle(_endCycle), maxRecords(_maxRecords), numDomains(_numDomains), flushed(false)
+{
+    if (endCycle <= startCycle) panic("Weave timeline: empty window [%ld, %ld)", startCycle, endCycle);
+    doms = gm_calloc<DomainTimeline>(numDomains);
+    for (uint32_t d = 0; d < numDomains; d++) {
+        new (&doms[d]) DomainTimeline();
+        doms[d].curEv = nullptr;
+        doms[d].curSlice = 0;
+        doms[d].nextFlow = 0;
+    }
+    futex_init(&typeLock);
+    info("Weave timeline: recording cycles [%ld, %ld) to %s, up to %d records/domain", startCycle, endCycle, filename, maxRecords);
+}
+
+uint16_t WeaveTimeline::getType(DomainTimeline& dt, const char* name) {
+    auto it = dt.typeCache.find(name);
+    if (it != dt.typeCache.end()) return it->second;
+
+    // Other domains may have seen this type already
+    futex_lock(&typeLock);
+    uint32_t type = 0;
+    while (type < typeNames.size() && typeNames[type] != name) type++;
+    if (type == typeNames.size()) typeNames.push_back(name);
+    futex_unlock(&typeLock);
+    assert(type < (1 << 16));
+    dt.typeCache[name] = type;
+    return type;
+}
+
+void WeaveTimeline::beginRun(uint32_t domain, TimingEvent* ev, uint64_t cycle) {
+    DomainTimeline& dt = doms[domain];
+    uint64_t flowIn = 0;
+    if (!dt.pendingFlows.empty()) {
+        auto it = dt.pendingFlows.find(ev);
+        if (it != dt.pendingFlows.end()) {
+            flowIn = it->second;
+            dt.pendingFlows.erase(it);
+        }
+    }
+
+    if (cycle < startCycle || cycle >= endCycle || flushed || dt.records.size() >= maxRecords) {
+        dt.curEv = nullptr;
+        return;
+    }
+
+    uint16_t type = getType(dt, typeid(*ev).name());
+    dt.curSlice = dt.records.size();
+    dt.records.push_back({cycle, cycle, flowIn, type, SLICE});
+    dt.curEv = ev;
+}
+
+void WeaveTimeline::flush() {
+    if (flushed) return;
+    flushed = true;
+
+    FILE* f = fopen(filename, "w");
+    if (!f) panic("Could not open weave timeline %s", filename);
+
+    std::vector<char*> names;
+    for (const char* mangled : typeNames) {
+        int status;
+        char* demangled = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+        names.push_back(demangled? demangled : strdup(mangled));
+    }
+
+    uint64_t slices = 0;
+    uint64_t flows = 0;
+    fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    fprintf(f, "{\"ph\": \"M\", \"pid\": 0, \"name\": \"process_name\", \"args\": {\"name\": \"zsim weave\"}}");
+    for (uint32_t d = 0; d < numDomains; d++) {
+        DomainTimeline& dt = doms[d];
+        fprintf(f, ",\n{\"ph\": \"M\", \"pid\": 0, \"tid\": %d, \"name\": \"thread_name\", \"args\": {\"name\": \"domain %d\"}}", d, d);
+        for (const Record& r : dt.records) {
+            const char* name = names[r.type];
+            if (r.kind == SLICE) {
+                fprintf(f, ",\n{\"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"cat\": \"weave\", \"name\": \"%s\", \"ts\": %ld, \"dur\": %ld}",
+                        d, name, r.start, r.end - r.start);
+                if (r.flow) {
+                    fprintf(f, ",\n{\"ph\": \"f\", \"bp\": \"e\", \"pid\": 0, \"tid\": %d, \"cat\": \"dep\", \"name\": \"dep\", \"id\": %ld, \"ts\": %ld}",
+                            d, r.flow, r.start);
+                }
+                slices++;
+            } else {
+                fprintf(f, ",\n{\"ph\": \"s\", \"pid\": 0, \"tid\": %d, \"cat\": \"dep\", \"name\": \"dep\", \"id\": %ld, \"ts\": %ld}",
+                        d, r.flow, r.start);
+                flows++;
+            }
+        }
+        g_vector<Record>().swap(dt.records);
+        dt.pendingFlows.clear();
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+
+    for (char* n : names) free(n);
+    info("Weave timeline: wrote %ld slices, %ld flows, %ld event types to %s", slices, flows, typeNames.size(), filename);
+}
@@ -0,0 +1,108 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WEAVE_TIMELINE_H_
+#define WEAVE_TIMELINE_H_
+
+/* Records the weave phase's event timeline over a window of cycles, and writes
+ * it as a Chrome/Perfetto JSON trace (open in ui.perfetto.dev or
+ * chrome://tracing). Each domain is a track; each event execution is a slice
+ * named after the event's type, from the cycle it ran to the last cycle at
+ * which it enqueued a child (i.e., when it finished, including its postDelay).
+ * Parent->child enqueues within a domain are flow arrows, so critical paths
+ * and serialization show up directly. 1 cycle is shown as 1 us.
+ *
+ * Recording is per domain, and each domain is only simulated by one
+ * contention thread, so buffers need no locking. Weave threads run in
+ * process 0, but like the rest of zinfo the timeline is reachable from every
+ * process, so its state lives in the global heap.
+ */
+
+#include <stdint.h>
+#include "g_std/g_unordered_map.h"
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "locks.h"
+
+class TimingEvent;
+
+class WeaveTimeline : public GlobAlloc {
+    private:
+        enum RecordKind {SLICE, FLOW_OUT};
+
+        struct Record {
+            uint64_t start;
+            uint64_t end;   // slices only
+            uint64_t flow;  // incoming flow id for slices (0 if none), outgoing for FLOW_OUT
+            uint16_t type;
+            uint16_t kind;
+        };
+
+        struct DomainTimeline {
+            g_vector<Record> records;
+            g_unordered_map<TimingEvent*, uint64_t> pendingFlows; // enqueued child -> flow id
+            g_unordered_map<const char*, uint16_t> typeCache; // typeid name -> type id
+            TimingEvent* curEv; // running event, nullptr if not recording it
+            uint32_t curSlice;
+            uint64_t nextFlow;
+        };
+
+        const char* filename;
+        uint64_t startCycle, endCycle;
+        uint32_t maxRecords; // per domain
+        uint32_t numDomains;
+        DomainTimeline* doms;
+        bool flushed;
+
+        g_vector<const char*> typeNames; // typeid names are in libzsim.so, mapped at the same address in all processes (no ASLR)
+        lock_t typeLock;
+
+        uint16_t getType(DomainTimeline& dt, const char* name);
+
+    public:
+        WeaveTimeline(const char* _filename, uint32_t _numDomains, uint64_t _startCycle, uint64_t _endCycle, uint32_t _maxRecords);
+
+        // Called by the contention thread around each event execution
+        void beginRun(uint32_t domain, TimingEvent* ev, uint64_t cycle);
+        void endRun(uint32_t domain) { doms[domain].curEv = nullptr; }
+
+        // Called on every weave-phase enqueue, by the thread that owns domain
+        inline void recordEnqueue(uint32_t domain, TimingEvent* ev, uint64_t cycle) {
+            DomainTimeline& dt = doms[domain];
+            if (dt.curEv == nullptr) return;
+            Record& slice = dt.records[dt.curSlice];
+            if (cycle > slice.end) slice.end = cycle;
+            if (ev == dt.curEv || dt.records.size() >= maxRecords) return; // requeue, or full
+            uint64_t flow = ((uint64_t)(domain + 1) << 40) | ++dt.nextFlow;
+            dt.records.push_back({slice.start, 0, flow, slice.type, FLOW_OUT});
+            dt.pendingFlows[ev] = flow;
+        }
+
+        // Once the phase limit passes the window; records stop and the trace is written (once)
+        bool windowDone(uint64_t limit) const { return !flushed && limit >= endCycle; }
+        void flush();
+};
+
+#endif  // WEAVE_TIMELINE_H_
@@ -49,16 +49,22 @@
 #include "cpuenum.h"
 #include "cpuid.h"
 #include "debug_zsim.h"
+#include "domain_profiler.h"
 #include "event_queue.h"
 #include "galloc.h"
+#include "host_prof.h"
 #include "init.h"
 #include "log.h"
+#include "miss_prof.h"
 #include "pin.H"
 #include "pin_cmd.h"
 #include "process_tree.h"
 #include "profile_stats.h"
+#include "req_trace.h"
 #include "scheduler.h"
+#include "sharing_detector.h"
 #include "stats.h"
+#include "telemetry.h"
 #include "trace_driver.h"
 #include "virt/virt.h"
 
@@ -191,13 +197,128 @@ VOID PIN_FAST_ANALYSIS_CALL IndirectPredStoreSingle(THREADID tid, ADDRINT addr,
     fPtrs[tid].predStorePtr(tid, addr, pred);
 }
 
+/* Host profiling variants (sim.hostProfile). We insert these instead of the
+ * functions above, so that runs without profiling pay nothing for it.
+ */
+
+VOID PIN_FAST_ANALYSIS_CALL ProfIndirectLoadSingle(THREADID tid, ADDRINT addr) {
+    HostProfScope hps(HP_CORE);
+    fPtrs[tid].loadPtr(tid, addr);
+}
+
+VOID PIN_FAST_ANALYSIS_CALL ProfIndirectStoreSingle(THREADID tid, ADDRINT addr) {
+    HostProfScope hps(HP_CORE);
+    fPtrs[tid].storePtr(tid, addr);
+}
+
+VOID PIN_FAST_ANALYSIS_CALL ProfIndirectBasicBlock(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
+    HostProfScope hps(HP_CORE);
+    fPtrs[tid].bblPtr(tid, bblAddr, bblInfo);
+}
+
+VOID PIN_FAST_ANALYSIS_CALL ProfIndirectRecordBranch(THREADID tid, ADDRINT branchPc, BOOL taken, ADDRINT takenNpc, ADDRINT notTakenNpc) {
+    HostProfScope hps(HP_CORE);
+    fPtrs[tid].branchPtr(tid, branchPc, taken, takenNpc, notTakenNpc);
+}
+
+VOID PIN_FAST_ANALYSIS_CALL ProfIndirectPredLoadSingle(THREADID tid, ADDRINT addr, BOOL pred) {
+    HostProfScope hps(HP_CORE);
+    fPtrs[tid].predLoadPtr(tid, addr, pred);
+}
+
+VOID PIN_FAST_ANALYSIS_CALL ProfIndirectPredStoreSingle(THREADID tid, ADDRINT addr, BOOL pred) {
+    HostProfScope hps(HP_CORE);
+    fPtrs[tid].predStorePtr(tid, addr, pred);
+}
+
+/* Batched analysis (sim.batchedInstrs, Simple and Timing cores only)
+ *
+ * Instead of one indirect call per memory operand and BBL, inlined analysis
+ * code appends {address, info} records to a per-thread buffer, and we replay
+ * the buffer through fPtrs only when it fills up or before any action that
+ * depends on the core's state or changes fPtrs (syscalls, magic ops, RDTSC,
+ * vDSO patching, signals, thread exit). Replay goes through fPtrs record by
+ * record, so joins, barriers, context switches and fast-forward transitions
+ * happen at the same point in the instruction stream as with direct calls;
+ * the only difference is that the thread runs up to a buffer ahead natively.
+ * Branches are not recorded, as Simple and Timing cores ignore them.
+ */
+
+#define TRACE_REC_LOAD  (1L)
+#define TRACE_REC_STORE (2L)
+//Otherwise, info is the BblInfo* of a BBL record
+
+struct TraceRecord {
+    ADDRINT addr;
+    ADDRINT info;
+};
+
+struct TraceBuffer {
+    TraceRecord* recs;
+    uint32_t pos;
+    uint32_t size;
+} ATTR_LINE_ALIGNED;
+
+static TraceBuffer traceBufs[MAX_THREADS];
+
+//Inlined by Pin; returns true when the buffer is full
+ADDRINT PIN_FAST_ANALYSIS_CALL BufferRecord(THREADID tid, ADDRINT addr, ADDRINT info) {
+    TraceBuffer& buf = traceBufs[tid];
+    TraceRecord& rec = buf.recs[buf.pos++];
+    rec.addr = addr;
+    rec.info = info;
+    return buf.pos == buf.size;
+}
+
+VOID PIN_FAST_ANALYSIS_CALL DrainTraceBuffer(THREADID tid) {
+    TraceBuffer& buf = traceBufs[tid];
+    uint32_t n = buf.pos;
+    buf.pos = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        const TraceRecord& rec = buf.recs[i];
+        switch (rec.info) {
+            case TRACE_REC_LOAD:
+                fPtrs[tid].loadPtr(tid, rec.addr);
+                break;
+            case TRACE_REC_STORE:
+                fPtrs[tid].storePtr(tid, rec.addr);
+                break;
+            default:
+                fPtrs[tid].bblPtr(tid, rec.addr, (BblInfo*)rec.info);
+        }
+    }
+}
+
+VOID PIN_FAST_ANALYSIS_CALL ProfDrainTraceBuffer(THREADID tid) {
+    HostProfScope hps(HP_CORE);
+    DrainTraceBuffer(tid);
+}
+
+//Called before anything that reads core state or changes fPtrs[tid]
+static inline void SyncTraceBuffer(THREADID tid) {
+    if (zinfo->batchedInstrs && traceBufs[tid].pos) DrainTraceBuffer(tid);
+}
+
+static void InitTraceBuffer(THREADID tid) {
+    TraceBuffer& buf = traceBufs[tid];
+    if (!buf.recs) {
+        buf.size = zinfo->batchedInstrsBuffer;
+        buf.recs = new TraceRecord[buf.size];
+    }
+    buf.pos = 0;
+}
+
 
 //Non-simulation variants of analysis functions
 
 // Join variants: Call join on the next instrumentation poin and return to analysis code
 void Join(uint32_t tid) {
     assert(fPtrs[tid].type == FPTR_JOIN);
-    uint32_t cid = zinfo->sched->join(procIdx, tid); //can block
+    uint32_t cid;
+    {
+        HostProfScope hps(HP_SYNC);
+        cid = zinfo->sched->join(procIdx, tid); //can block
+    }
     setCid(tid, cid);
 
     if (unlikely(zinfo->terminationConditionMet)) {
@@ -492,12 +613,17 @@ VOID EndOfPhaseActions() {
     CheckForTermination();
     zinfo->contentionSim->simulatePhase(zinfo->globPhaseCycles + zinfo->phaseLength);
     zinfo->eventQueue->tick();
+    if (zinfo->telemetry) zinfo->telemetry->update();
     zinfo->profSimTime->transition(PROF_BOUND);
 }
 
 
 uint32_t TakeBarrier(uint32_t tid, uint32_t cid) {
-    uint32_t newCid = zinfo->sched->sync(procIdx, tid, cid);
+    uint32_t newCid;
+    {
+        HostProfScope hps(HP_SYNC);
+        newCid = zinfo->sched->sync(procIdx, tid, cid);
+    }
     clearCid(tid); //this is after the sync for a hack needed to make EndOfPhase reliable
     setCid(tid, newCid);
 
@@ -530,16 +656,35 @@ static void PrintIp(THREADID tid, ADDRINT ip) {
 }
 #endif
 
+static VOID InsertBufferRecord(INS ins, IARG_TYPE eaArg, ADDRINT info) {
+    AFUNPTR DrainFuncPtr = zinfo->hostProf? (AFUNPTR) ProfDrainTraceBuffer : (AFUNPTR) DrainTraceBuffer;
+    if (!INS_IsPredicated(ins)) {
+        INS_InsertIfCall(ins, IPOINT_BEFORE, (AFUNPTR) BufferRecord, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, eaArg, IARG_ADDRINT, info, IARG_END);
+        INS_InsertThenCall(ins, IPOINT_BEFORE, DrainFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_END);
+    } else {
+        //Simple and Timing cores skip non-executing ops, so we don't even record them
+        INS_InsertIfPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR) BufferRecord, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, eaArg, IARG_ADDRINT, info, IARG_END);
+        INS_InsertThenPredicatedCall(ins, IPOINT_BEFORE, DrainFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_END);
+    }
+}
+
 VOID Instruction(INS ins) {
     //Uncomment to print an instruction trace
     //INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)PrintIp, IARG_THREAD_ID, IARG_REG_VALUE, REG_INST_PTR, IARG_END);
 
-    if (!procTreeNode->isInFastForward() || !zinfo->ffReinstrument) {
-        AFUNPTR LoadFuncPtr = (AFUNPTR) IndirectLoadSingle;
-        AFUNPTR StoreFuncPtr = (AFUNPTR) IndirectStoreSingle;
+    bool instrument = !procTreeNode->isInFastForward() || !zinfo->ffReinstrument;
+    if (instrument && zinfo->batchedInstrs) {
+        if (INS_IsMemoryRead(ins)) InsertBufferRecord(ins, IARG_MEMORYREAD_EA, TRACE_REC_LOAD);
+        if (INS_HasMemoryRead2(ins)) InsertBufferRecord(ins, IARG_MEMORYREAD2_EA, TRACE_REC_LOAD);
+        if (INS_IsMemoryWrite(ins)) InsertBufferRecord(ins, IARG_MEMORYWRITE_EA, TRACE_REC_STORE);
+    } else if (instrument) {
+        bool prof = zinfo->hostProf;
+        AFUNPTR LoadFuncPtr = prof? (AFUNPTR) ProfIndirectLoadSingle : (AFUNPTR) IndirectLoadSingle;
+        AFUNPTR StoreFuncPtr = prof? (AFUNPTR) ProfIndirectStoreSingle : (AFUNPTR) IndirectStoreSingle;
+        AFUNPTR BranchFuncPtr = prof? (AFUNPTR) ProfIndirectRecordBranch : (AFUNPTR) IndirectRecordBranch;
 
-        AFUNPTR PredLoadFuncPtr = (AFUNPTR) IndirectPredLoadSingle;
-        AFUNPTR PredStoreFuncPtr = (AFUNPTR) IndirectPredStoreSingle;
+        AFUNPTR PredLoadFuncPtr = prof? (AFUNPTR) ProfIndirectPredLoadSingle : (AFUNPTR) IndirectPredLoadSingle;
+        AFUNPTR PredStoreFuncPtr = prof? (AFUNPTR) ProfIndirectPredStoreSingle : (AFUNPTR) IndirectPredStoreSingle;
 
         if (INS_IsMemoryRead(ins)) {
             if (!INS_IsPredicated(ins)) {
@@ -567,7 +712,7 @@ VOID Instruction(INS ins) {
 
         // Instrument only conditional branches
         if (INS_Category(ins) == XED_CATEGORY_COND_BR) {
-            INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) IndirectRecordBranch, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID,
+            INS_InsertCall(ins, IPOINT_BEFORE, BranchFuncPtr, IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID,
                     IARG_INST_PTR, IARG_BRANCH_TAKEN, IARG_BRANCH_TARGET_ADDR, IARG_FALLTHROUGH_ADDR, IARG_END);
         }
     }
@@ -603,8 +748,16 @@ VOID Trace(TRACE trace, VOID *v) {
         // Visit every basic block in the trace
         for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
             BblInfo* bblInfo = Decoder::decodeBbl(bbl, zinfo->oooDecode);
-            BBL_InsertCall(bbl, IPOINT_BEFORE /*could do IPOINT_ANYWHERE if we redid load and store simulation in OOO*/, (AFUNPTR)IndirectBasicBlock, IARG_FAST_ANALYSIS_CALL,
-                 IARG_THREAD_ID, IARG_ADDRINT, BBL_Address(bbl), IARG_PTR, bblInfo, IARG_END);
+            if (zinfo->batchedInstrs) {
+                BBL_InsertIfCall(bbl, IPOINT_BEFORE, (AFUNPTR)BufferRecord, IARG_FAST_ANALYSIS_CALL,
+                     IARG_THREAD_ID, IARG_ADDRINT, BBL_Address(bbl), IARG_ADDRINT, (ADDRINT)bblInfo, IARG_END);
+                BBL_InsertThenCall(bbl, IPOINT_BEFORE, zinfo->hostProf? (AFUNPTR)ProfDrainTraceBuffer : (AFUNPTR)DrainTraceBuffer,
+                     IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID, IARG_END);
+            } else {
+                BBL_InsertCall(bbl, IPOINT_BEFORE /*could do IPOINT_ANYWHERE if we redid load and store simulation in OOO*/,
+                     zinfo->hostProf? (AFUNPTR)ProfIndirectBasicBlock : (AFUNPTR)IndirectBasicBlock, IARG_FAST_ANALYSIS_CALL,
+                     IARG_THREAD_ID, IARG_ADDRINT, BBL_Address(bbl), IARG_PTR, bblInfo, IARG_END);
+            }
         }
     }
 
@@ -616,6 +769,10 @@ VOID Trace(TRACE trace, VOID *v) {
     }
 }
 
+VOID MissProfImageLoad(IMG img, VOID* v) {
+    MissProfInstrumentImage(img);
+}
+
 /***** vDSO instrumentation and patching code *****/
 
 // Helper function to find section address
@@ -754,6 +911,7 @@ VOID VdsoRetPoint(THREADID tid, REG* raxPtr) {
         // info("vDSO return post level %d, skipping ret handling", vdsoPatchData[tid].level); //common
         return;
     }
+    SyncTraceBuffer(tid);
     if (fPtrs[tid].type != FPTR_NOP || vdsoPatchData[tid].func == VF_GETCPU) {
         // info("vDSO patching for func %d", vdsoPatchData[tid].func);  // common
         ADDRINT arg0 = vdsoPatchData[tid].arg0;
@@ -856,6 +1014,8 @@ VOID ThreadStart(THREADID tid, CONTEXT *ctxt, INT32 flags, VOID *v) {
         info("Unpaused");
     }
 
+    if (zinfo->batchedInstrs) InitTraceBuffer(tid);
+
     if (procTreeNode->isInFastForward()) {
         info("FF thread %d starting", tid);
         fPtrs[tid] = GetFFPtrs();
@@ -873,9 +1033,11 @@ VOID SimThreadFini(THREADID tid) {
     zinfo->sched->finish(procIdx, tid);
     activeThreads[tid] = false;
     cids[tid] = UNINITIALIZED_CID; //clear this cid, it might get reused
+    if (zinfo->hostProf) zinfo->hostProf->threadFini(tid);
 }
 
 VOID ThreadFini(THREADID tid, const CONTEXT *ctxt, INT32 flags, VOID *v) {
+    SyncTraceBuffer(tid);
     //NOTE: Thread has no valid cid here!
     if (fPtrs[tid].type == FPTR_NOP) {
         info("Shadow/NOP thread %d finished", tid);
@@ -888,6 +1050,7 @@ VOID ThreadFini(THREADID tid, const CONTEXT *ctxt, INT32 flags, VOID *v) {
 
 //Need to remove ourselves from running threads in case the syscall is blocking
 VOID SyscallEnter(THREADID tid, CONTEXT *ctxt, SYSCALL_STANDARD std, VOID *v) {
+    SyncTraceBuffer(tid);
     bool isNopThread = fPtrs[tid].type == FPTR_NOP;
     bool isRetryThread = fPtrs[tid].type == FPTR_RETRY;
 
@@ -978,6 +1141,7 @@ VOID ContextChange(THREADID tid, CONTEXT_CHANGE_REASON reason, const CONTEXT* fr
     }
 
     warn("[%d] ContextChange, reason %s, inSyscall %d", tid, reasonStr, inSyscall[tid]);
+    SyncTraceBuffer(tid);
     if (inSyscall[tid]) {
         SyscallExit(tid, to, SYSCALL_STANDARD_IA32E_LINUX, nullptr);
     }
@@ -1067,7 +1231,10 @@ VOID AfterForkInChild(THREADID tid, const CONTEXT* ctxt, VOID * arg) {
         activeThreads[i] = false;
         inSyscall[i] = false;
         cores[i] = nullptr;
+        traceBufs[i].pos = 0;
     }
+    if (zinfo->hostProf) zinfo->hostProf->processFork();
+    if (zinfo->missProf) MissProfProcessFork();
 
     //We need to launch another copy of the FF control thread
     PIN_SpawnInternalThread(FFThread, nullptr, 64*1024, nullptr);
@@ -1100,6 +1267,18 @@ VOID SimEnd() {
     Decoder::dumpBblProfile();
 #endif
 
+    if (zinfo->missProf) {
+        std::stringstream ss;
+        ss << zinfo->outputDir << "/missprof-p" << procIdx << ".txt";
+        zinfo->missProf->writeReport(ss.str().c_str());
+    }
+
+    if (zinfo->sharingDetector) {
+        std::stringstream ss;
+        ss << zinfo->outputDir << "/sharing-p" << procIdx << ".txt";
+        zinfo->sharingDetector->writeReport(ss.str().c_str());
+    }
+
     //global
     bool lastToFinish = procTreeNode->notifyEnd();
     (void) lastToFinish; //make gcc happy; not needed anymore, since proc 0 dumps stats
@@ -1114,8 +1293,13 @@ VOID SimEnd() {
 
         info("Dumping termination stats");
         zinfo->trigger = 20000;
+        if (zinfo->hostProf) zinfo->hostProf->flush();
         for (StatsBackend* backend : *(zinfo->statsBackends)) backend->dump(false /*unbuffered, write out*/);
         for (AccessTraceWriter* t : *(zinfo->traceWriters)) t->dump(false);  // flushes trace writer
+        if (zinfo->reqTracer) zinfo->reqTracer->flush();
+        if (zinfo->telemetry) zinfo->telemetry->finish();
+        zinfo->contentionSim->flushTimeline();  // in case the run ended before the timeline window
+        if (zinfo->domainProfiler) zinfo->domainProfiler->computeAndWrite((string(zinfo->outputDir) + "/domains.cfg").c_str());
 
         if (zinfo->sched) zinfo->sched->notifyTermination();
     }
@@ -1137,6 +1321,7 @@ VOID SimEnd() {
 #define ZSIM_MAGIC_OP_HEARTBEAT         (1028)
 
 VOID HandleMagicOp(THREADID tid, ADDRINT op) {
+    SyncTraceBuffer(tid);
     switch (op) {
         case ZSIM_MAGIC_OP_ROI_BEGIN:
             if (!zinfo->ignoreHooks) {
@@ -1265,6 +1450,7 @@ VOID FakeCPUIDPost(THREADID tid, ADDRINT* eax, ADDRINT* ebx, ADDRINT* ecx, ADDRI
 
 //RDTSC faking
 VOID FakeRDTSCPost(THREADID tid, REG* eax, REG* edx) {
+    SyncTraceBuffer(tid);
     if (fPtrs[tid].type == FPTR_NOP) return; //avoid virtualizing NOP threads.
 
     uint32_t cid = getCid(tid);
@@ -1525,6 +1711,9 @@ int main(int argc, char *argv[]) {
 
     if (zinfo->sched) zinfo->sched->processCleanup(procIdx);
 
+    //Only OOO cores use decoded BBLs
+    if (zinfo->decodeCacheFile && zinfo->oooDecode) Decoder::initDecodeCache(zinfo->decodeCacheFile, zinfo->decodeCacheMB);
+
     VirtCaptureClocks(false);
     FFIInit();
 
@@ -1532,6 +1721,7 @@ int main(int argc, char *argv[]) {
 
     //Register instrumentation
     TRACE_AddInstrumentFunction(Trace, 0);
+    if (zinfo->missProf) IMG_AddInstrumentFunction(MissProfImageLoad, 0);
     VdsoInit(); //initialized vDSO patching information (e.g., where all the possible vDSO entry points are)
 
     PIN_AddThreadStartFunction(ThreadStart, 0);
@@ -37,17 +37,25 @@ class Core;
 class Scheduler;
 class AggregateStat;
 class StatsBackend;
+class StatsWriter;
 class ProcessTreeNode;
 class ProcessStats;
 class ProcStats;
 class EventQueue;
 class ContentionSim;
+class DomainProfiler;
 class EventRecorder;
 class PinCmd;
 class PortVirtualizer;
 class VectorCounter;
 class AccessTraceWriter;
 class TraceDriver;
+class PageAllocator;
+class ReqTracer;
+class HostProfiler;
+class Telemetry;
+class MissProfiler;
+class SharingDetector;
 template <typename T> class g_vector;
 
 struct ClockDomainInfo {
@@ -89,6 +97,7 @@ struct GlobSimInfo {
     uint32_t numDomains;
     ContentionSim* contentionSim;
     EventRecorder** eventRecorders; //CID->EventRecorder* array
+    DomainProfiler* domainProfiler; //nullptr unless sim.profileDomains is set
 
     PAD();
 
@@ -108,6 +117,8 @@ struct GlobSimInfo {
     bool blockingSyscalls;
     bool perProcessCpuEnum; //if true, cpus are enumerated according to per-process masks (e.g., a 16-core mask in a 64-core sim sees 16 cores)
     bool oooDecode; //if true, Decoder does OOO (instr->uop) decoding
+    const char* decodeCacheFile; //persistent decoded-BBL cache shared across processes and runs, nullptr if disabled
+    uint32_t decodeCacheMB;
 
     PAD();
 
@@ -137,6 +148,7 @@ struct GlobSimInfo {
     g_vector<StatsBackend*>* statsBackends; // used for termination dumps
     StatsBackend* periodicStatsBackend;
     StatsBackend* eventualStatsBackend;
+    StatsWriter* statsWriter; // owns stats files when dumps are asynchronous, nullptr otherwise
     ProcessStats* processStats;
     ProcStats* procStats;
 
@@ -169,6 +181,9 @@ struct GlobSimInfo {
 
     bool ffReinstrument; //true if we should reinstrument on ffwd, works fine with ST apps and it's faster since we run with basically no instrumentation, but it's not precise with MT apps
 
+    bool batchedInstrs; //if true, analysis records are buffered per thread and replayed in bulk (Simple and Timing cores only)
+    uint32_t batchedInstrsBuffer; //records per thread buffer
+
     //fftoggle stuff
     lock_t ffToggleLocks[256]; //f*ing Pin and its f*ing inability to handle external signals...
     lock_t pauseLocks[256]; //per-process pauses
@@ -178,6 +193,14 @@ struct GlobSimInfo {
     // Trace writers (stored globally because they need to be deleted when the simulation ends)
     g_vector<AccessTraceWriter*>* traceWriters;
 
+    // Virtual-to-physical page mapping (nullptr: physical line addresses are procMask | vLineAddr)
+    PageAllocator* physMem;
+    ReqTracer* reqTracer; // nullptr unless sampled request tracing is on
+    HostProfiler* hostProf; // nullptr unless sim.hostProfile is set
+    Telemetry* telemetry; // nullptr unless sim.telemetry is set
+    MissProfiler* missProf; // nullptr unless sim.missProfile is set
+    SharingDetector* sharingDetector; // nullptr unless sim.sharingDetector is set
+
     // Trace-driven simulation (no cores)
     bool traceDriven;
     TraceDriver* traceDriver;
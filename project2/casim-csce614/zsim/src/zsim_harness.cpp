@@ -29,11 +29,14 @@
 
 #include <fcntl.h>
 #include <fstream>
+#include <pthread.h>
 #include <iostream>
 #include <signal.h>
 #include <sstream>
 #include <stdlib.h>
 #include <string>
+#include <string.h>
+#include <sys/mman.h>
 #include <sys/personality.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -44,6 +47,7 @@
 #include "galloc.h"
 #include "log.h"
 #include "pin_cmd.h"
+#include "telemetry.h"
 #include "version.h" //autogenerated, in build dir, see SConstruct
 #include "zsim.h"
 
@@ -80,6 +84,9 @@ bool perProcessDir, aslr;
 
 PinCmd* pinCmd;
 
+std::string telemetryFile; //empty if telemetry is off
+uint32_t telemetryPollMs;
+
 /* Defs & helper functions */
 
 void LaunchProcess(uint32_t procIdx);
@@ -183,6 +190,7 @@ void exitHandler() {
         warn("Hard death at exit (%d children running), killing the whole process tree", children);
         kill(-getpid(), SIGKILL);
     }
+    if (!telemetryFile.empty()) unlink(telemetryFile.c_str());
 }
 
 void debugSigHandler(int signum, siginfo_t* siginfo, void* dummy) {
@@ -195,6 +203,67 @@ void debugSigHandler(int signum, siginfo_t* siginfo, void* dummy) {
     childInfo[debuggerChildIdx++].status = PS_RUNNING;
 }
 
+/* Telemetry */
+
+static pthread_t telemetryThread;
+static volatile bool telemetryStop = false;
+static bool telemetryRunning = false;
+
+// Copies the simulator's snapshot to the telemetry file every telemetryPollMs
+static void* TelemetryThread(void* arg) {
+    const Telemetry* tl = static_cast<GlobSimInfo*>(arg)->telemetry;
+    uint32_t numValues = tl->numValues();
+    uint32_t namesBytes = tl->getNamesBytes();
+    size_t bytes = sizeof(TelemetryFileHeader) + numValues*sizeof(uint64_t) + namesBytes;
+
+    int fd = open(telemetryFile.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, bytes) != 0) {
+        warn("Could not create telemetry file %s, telemetry disabled", telemetryFile.c_str());
+        if (fd >= 0) close(fd);
+        return nullptr;
+    }
+    void* buf = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (buf == MAP_FAILED) {
+        warn("Could not map telemetry file %s, telemetry disabled", telemetryFile.c_str());
+        return nullptr;
+    }
+
+    TelemetryFileHeader* hdr = static_cast<TelemetryFileHeader*>(buf);
+    uint64_t* values = reinterpret_cast<uint64_t*>(hdr + 1);
+    hdr->version = TELEMETRY_VERSION;
+    hdr->headerBytes = sizeof(TelemetryFileHeader);
+    hdr->numValues = numValues;
+    hdr->namesBytes = namesBytes;
+    memcpy(values + numValues, tl->getNames(), namesBytes);
+    __sync_synchronize();
+    memcpy(hdr->magic, TELEMETRY_MAGIC, sizeof(hdr->magic)); //written last, so readers can tell when the file is ready
+    info("Publishing telemetry (%d values) in %s", numValues, telemetryFile.c_str());
+
+    std::vector<uint64_t> vals(numValues + 1);
+    TelemetrySnapshot snap;
+    bool done = false;
+    uint32_t failedReads = 0;
+    while (!done) {
+        done = telemetryStop; //do a last copy after the simulation ends
+        // Bounded, so a simulator process that dies mid-publish can't hang us (and the final join)
+        if (tl->read(&snap, &vals[0], 100000)) {
+            failedReads = 0;
+            hdr->seq++;
+            __sync_synchronize();
+            hdr->snap = snap;
+            for (uint32_t i = 0; i < numValues; i++) values[i] = vals[i];
+            __sync_synchronize();
+            hdr->seq++;
+        } else if (++failedReads == 10) {
+            warn("Telemetry snapshot has been inconsistent for %d polls, a simulator process may have died mid-update", failedReads);
+        }
+        if (!done) usleep(telemetryPollMs*1000);
+    }
+    munmap(buf, bytes);
+    return nullptr;
+}
+
 /* Heartbeats */
 
 static time_t startTime;
@@ -391,6 +460,14 @@ int main(int argc, char *argv[]) {
     aslr = conf.get<bool>("sim.aslr", false);
     if (aslr) info("Not disabling ASLR, multiprocess runs will fail");
 
+    if (conf.get<bool>("sim.telemetry", false)) {
+        std::stringstream ss;
+        ss << "/dev/shm/zsim-telemetry." << getpid();
+        telemetryFile = conf.get<const char*>("sim.telemetryFile", ss.str().c_str());
+        telemetryPollMs = conf.get<uint32_t>("sim.telemetryPollMs", 100);
+        if (telemetryFile.empty()) panic("sim.telemetryFile can't be empty");
+    }
+
     //Create children processes
     outputDir = conf.get<const char*>("pin.outputDir", outputDir);
     pinCmd = new PinCmd(&conf, configFile, outputDir, shmid);
@@ -419,6 +496,12 @@ int main(int argc, char *argv[]) {
             zinfo = static_cast<GlobSimInfo*>(gm_get_glob_ptr());
             globzinfo = zinfo;
             info("Attached to global heap");
+            if (zinfo->telemetry) {
+                if (pthread_create(&telemetryThread, nullptr, TelemetryThread, zinfo)) panic("Could not create telemetry thread");
+                telemetryRunning = true;
+            } else {
+                telemetryFile.clear();
+            }
         }
 
         printHeartbeat(zinfo);  // ensure we dump hostname etc on early crashes
@@ -476,6 +559,10 @@ int main(int argc, char *argv[]) {
         info("Graceful termination finished, exiting");
         exitCode = 1;
     }
+    if (telemetryRunning) {
+        telemetryStop = true;
+        pthread_join(telemetryThread, nullptr);
+    }
     if (zinfo && zinfo->globalActiveProcs) warn("Unclean exit of %d children, termination stats were most likely not dumped", zinfo->globalActiveProcs);
     exit(exitCode);
 }